@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+#include "allocationTracker.h"
+
+// Every block starts with its size so delete knows what it frees, 16 bytes keep the alignment malloc gives
+static const size_t HEADER_SIZE = 16;
+
+// Zero initialized before any constructor runs, so allocations of static objects are counted as well
+static std::atomic<size_t> allocations;
+static std::atomic<size_t> frees;
+static std::atomic<size_t> bytes;
+static std::atomic<size_t> live_bytes;
+static std::atomic<size_t> peak_bytes;
+
+
+/// <summary>
+/// Allocates a block with room for its size in front of it and counts it
+/// </summary>
+/// <returns>The block or nullptr when the heap is out of memory</returns>
+static void * TrackedAllocate(size_t size)
+{
+	unsigned char * block = (unsigned char *)malloc(size + HEADER_SIZE);
+	if (block == nullptr)
+		return nullptr;
+	*(size_t *)block = size;
+
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	bytes.fetch_add(size, std::memory_order_relaxed);
+	const size_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+	size_t peak = peak_bytes.load(std::memory_order_relaxed);
+	while (live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+	{
+	}
+	return block + HEADER_SIZE;
+}
+
+
+static void TrackedFree(void * memory)
+{
+	if (memory == nullptr)
+		return;
+
+	unsigned char * block = (unsigned char *)memory - HEADER_SIZE;
+	frees.fetch_add(1, std::memory_order_relaxed);
+	live_bytes.fetch_sub(*(size_t *)block, std::memory_order_relaxed);
+	free(block);
+}
+
+
+/// <summary>
+/// Throwing version, new has to return a block or throw
+/// </summary>
+static void * TrackedNew(size_t size)
+{
+	void * memory = TrackedAllocate(size == 0 ? 1 : size);
+	if (memory == nullptr)
+		throw std::bad_alloc();
+	return memory;
+}
+
+
+void * operator new(size_t size)
+{
+	return TrackedNew(size);
+}
+
+
+void * operator new[](size_t size)
+{
+	return TrackedNew(size);
+}
+
+
+void * operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	return TrackedAllocate(size == 0 ? 1 : size);
+}
+
+
+void * operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+	return TrackedAllocate(size == 0 ? 1 : size);
+}
+
+
+void operator delete(void * memory) noexcept
+{
+	TrackedFree(memory);
+}
+
+
+void operator delete[](void * memory) noexcept
+{
+	TrackedFree(memory);
+}
+
+
+void operator delete(void * memory, const std::nothrow_t &) noexcept
+{
+	TrackedFree(memory);
+}
+
+
+void operator delete[](void * memory, const std::nothrow_t &) noexcept
+{
+	TrackedFree(memory);
+}
+
+
+void operator delete(void * memory, size_t) noexcept
+{
+	TrackedFree(memory);
+}
+
+
+void operator delete[](void * memory, size_t) noexcept
+{
+	TrackedFree(memory);
+}
+
+
+AllocationCounts GetAllocationCounts()
+{
+	AllocationCounts counts;
+	counts.allocations = allocations.load(std::memory_order_relaxed);
+	counts.frees = frees.load(std::memory_order_relaxed);
+	counts.bytes = bytes.load(std::memory_order_relaxed);
+	counts.live_bytes = live_bytes.load(std::memory_order_relaxed);
+	counts.peak_bytes = peak_bytes.load(std::memory_order_relaxed);
+	return counts;
+}
+
+
+/// <summary>
+/// Allocations, frees and bytes since an earlier snapshot, live and peak bytes as they are now
+/// </summary>
+/// <param name="start">Snapshot of GetAllocationCounts</param>
+AllocationCounts AllocationsSince(const AllocationCounts & start)
+{
+	AllocationCounts counts = GetAllocationCounts();
+	counts.allocations -= start.allocations;
+	counts.frees -= start.frees;
+	counts.bytes -= start.bytes;
+	return counts;
+}
+
+
+void ResetAllocationPeak()
+{
+	peak_bytes.store(live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+
+/// <summary>
+/// Prints counts in one line, "what: n allocations (x MB), n frees, x MB live, peak x MB"
+/// </summary>
+void PrintAllocations(const char * what, const AllocationCounts & counts)
+{
+	const double mb = 1024.0 * 1024.0;
+	printf("%s: %u allocations (%.2f MB), %u frees, %.2f MB live, peak %.2f MB\n", what, (unsigned)counts.allocations, counts.bytes / mb,
+		(unsigned)counts.frees, counts.live_bytes / mb, counts.peak_bytes / mb);
+}
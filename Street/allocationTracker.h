@@ -0,0 +1,24 @@
+#pragma once
+#include <stddef.h>
+
+
+// Heap use through new and delete (everything the standard containers allocate goes through them)
+// The global operators are replaced by counting ones, the counters are process wide and cheap enough to stay on
+struct AllocationCounts
+{
+	size_t allocations;		// Calls to new
+	size_t frees;			// Calls to delete
+	size_t bytes;			// Requested by those calls
+	size_t live_bytes;		// Allocated and not freed yet
+	size_t peak_bytes;		// Most live bytes since the peak was reset
+};
+
+AllocationCounts GetAllocationCounts();
+
+// Allocations, frees and bytes since an earlier snapshot, live and peak bytes as they are now
+AllocationCounts AllocationsSince(const AllocationCounts & start);
+
+// Starts measuring the peak from the bytes that are live now
+void ResetAllocationPeak();
+
+void PrintAllocations(const char * what, const AllocationCounts & counts);
@@ -0,0 +1,768 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <sstream>
+#include <algorithm>
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "animation.h"
+#include "assetPack.h"
+#include "matrixKernels.h"
+#include "stats.h"
+
+// Playing objects per job
+const size_t ANIMATION_GRAIN = 256;
+
+// Objects per block of an update, their control points fit in the level 1 cache
+const size_t ANIMATION_BLOCK = 32;
+
+// Samples per object, a clip a and a clip b of every channel
+const int SLOT_SAMPLES = 2 * CHANNELS;
+
+
+/// <summary>
+/// Time inside the clip, looping clips wrap around and the others stop at their last key
+/// </summary>
+static float ClipTime(const AnimationClip & clip, float time)
+{
+	if (clip.duration <= 0.0f)
+		return 0.0f;
+	if (!clip.loop)
+		return std::min(std::max(time, 0.0f), clip.duration);
+
+	const float wrapped = fmodf(time, clip.duration);
+	return wrapped < 0.0f ? wrapped + clip.duration : wrapped;
+}
+
+
+/// <summary>
+/// Finds the segment a time is in, the key of the last update is tried first
+/// </summary>
+/// <param name="track">Track with at least two keys</param>
+/// <param name="time"></param>
+/// <param name="cursor">Key the last update found</param>
+/// <returns>k so that the time lies between key k and key k + 1, clamped to the first and last segment</returns>
+static int FindKey(const AnimationTrack & track, float time, int cursor)
+{
+	const int last = (int)track.times.size() - 2;
+	if (cursor >= 0 && cursor <= last && track.times[cursor] <= time)
+	{
+		while (cursor < last && track.times[cursor + 1] <= time)
+			cursor++;
+		return cursor;
+	}
+
+	// Went back (a loop wrapped around), search from the start
+	const int key = (int)(std::upper_bound(track.times.begin(), track.times.end(), time) - track.times.begin()) - 1;
+	return std::min(std::max(key, 0), last);
+}
+
+
+/// <summary>
+/// Position of a time between key k and key k + 1, 0 to 1
+/// </summary>
+static float SegmentPosition(const AnimationTrack & track, int k, float time)
+{
+	const float length = track.times[k + 1] - track.times[k];
+	return length > 0.0f ? std::min(std::max((time - track.times[k]) / length, 0.0f), 1.0f) : 1.0f;
+}
+
+
+/// <summary>
+/// The same rotation on the same side of the 4D sphere as another one, so the interpolation takes the short way
+/// </summary>
+static inline glm::vec4 Align(const glm::vec4 & q, const glm::vec4 & to)
+{
+	return glm::dot(q, to) < 0.0f ? -q : q;
+}
+
+
+/// <summary>
+/// Weights of the four Catmull-Rom control points at u
+/// </summary>
+static inline glm::vec4 CubicWeights(float u)
+{
+	const float u2 = u * u;
+	const float u3 = u2 * u;
+	return 0.5f * glm::vec4(-u3 + 2.0f * u2 - u, 3.0f * u3 - 5.0f * u2 + 2.0f, -3.0f * u3 + 4.0f * u2 + u, u3 - u2);
+}
+
+
+/// <summary>
+/// Weights of the two rotations of a slerp at u, the second one has to be aligned with the first one
+/// Nearly equal rotations are interpolated linearly, they get normalized later
+/// </summary>
+static inline glm::vec2 SlerpWeights(const glm::vec4 & a, const glm::vec4 & b, float u)
+{
+	const float cos_theta = std::min(glm::dot(a, b), 1.0f);
+	if (cos_theta > 0.9995f)
+		return glm::vec2(1.0f - u, u);
+
+	const float theta = acosf(cos_theta);
+	const float inv_sin = 1.0f / sinf(theta);
+	return glm::vec2(sinf((1.0f - u) * theta) * inv_sin, sinf(u * theta) * inv_sin);
+}
+
+
+/// <summary>
+/// Reference implementation of the weighted sums, used when there is no simd support
+/// </summary>
+static void WeightedSumScalar(const glm::vec4 * points, const glm::vec4 * weights, glm::vec4 * samples, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		const glm::vec4 * p = points + i * 4;
+		samples[i] = weights[i].x * p[0] + weights[i].y * p[1] + weights[i].z * p[2] + weights[i].w * p[3];
+	}
+}
+
+
+/// <summary>
+/// One sample per iteration, the four components of a value are the four lanes
+/// </summary>
+static void WeightedSumSSE(const glm::vec4 * points, const glm::vec4 * weights, glm::vec4 * samples, size_t count)
+{
+	const float * p = &points[0].x;
+	const float * w = &weights[0].x;
+	float * out = &samples[0].x;
+	for (size_t i = 0; i < count; i++, p += 16)
+	{
+		const __m128 weight = _mm_loadu_ps(w + i * 4);
+		__m128 r = _mm_mul_ps(_mm_loadu_ps(p + 0), _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(0, 0, 0, 0)));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(p + 4), _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(1, 1, 1, 1))));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(p + 8), _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(2, 2, 2, 2))));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(p + 12), _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(3, 3, 3, 3))));
+		_mm_storeu_ps(out + i * 4, r);
+	}
+}
+
+
+/// <summary>
+/// Two samples per iteration, one per 128 bit lane, the permute broadcasts a weight within its own lane
+/// </summary>
+KERNEL_TARGET_AVX2
+static void WeightedSumAVX2(const glm::vec4 * points, const glm::vec4 * weights, glm::vec4 * samples, size_t count)
+{
+	const float * p = &points[0].x;
+	const float * w = &weights[0].x;
+	float * out = &samples[0].x;
+
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		const float * first = p + i * 16;
+		const float * second = first + 16;
+		const __m256 weight = _mm256_loadu_ps(w + i * 4);
+
+		__m256 r = _mm256_mul_ps(_mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(first + 0)), _mm_loadu_ps(second + 0), 1),
+			_mm256_permute_ps(weight, _MM_SHUFFLE(0, 0, 0, 0)));
+		for (int k = 1; k < 4; k++)
+		{
+			const __m256 point = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(first + k * 4)), _mm_loadu_ps(second + k * 4), 1);
+			const __m256 broadcast = k == 1 ? _mm256_permute_ps(weight, _MM_SHUFFLE(1, 1, 1, 1))
+				: k == 2 ? _mm256_permute_ps(weight, _MM_SHUFFLE(2, 2, 2, 2)) : _mm256_permute_ps(weight, _MM_SHUFFLE(3, 3, 3, 3));
+			r = _mm256_fmadd_ps(point, broadcast, r);
+		}
+		_mm256_storeu_ps(out + i * 4, r);
+	}
+
+	// The tail call would skip the vzeroupper the compiler puts in front of the return, the dirty upper
+	// halves make every sse instruction after it (libm included) wait on a merge
+	_mm256_zeroupper();
+	WeightedSumScalar(points + i * 4, weights + i, samples + i, count - i);
+}
+
+
+/// <summary>
+/// samples[i] = the points of sample i weighted by weights[i]
+/// </summary>
+static void WeightedSum(const glm::vec4 * points, const glm::vec4 * weights, glm::vec4 * samples, size_t count)
+{
+	switch (GetKernelPath())
+	{
+	case KERNEL_AVX2:
+		WeightedSumAVX2(points, weights, samples, count);
+		break;
+	case KERNEL_SSE:
+		WeightedSumSSE(points, weights, samples, count);
+		break;
+	default:
+		WeightedSumScalar(points, weights, samples, count);
+		break;
+	}
+}
+
+
+/// <summary>
+/// Adds a clip, a clip with the same name is replaced
+/// </summary>
+/// <returns>Index of the clip</returns>
+int Animator::AddClip(const AnimationClip & clip)
+{
+	const int existing = this->FindClip(clip.name.c_str());
+	if (existing >= 0)
+	{
+		this->clips[existing] = clip;
+		return existing;
+	}
+	this->clips.push_back(clip);
+	return (int)this->clips.size() - 1;
+}
+
+
+/// <returns>Index of the clip or -1</returns>
+int Animator::FindClip(const char * name) const
+{
+	for (size_t i = 0; i < this->clips.size(); i++)
+		if (this->clips[i].name == name)
+			return (int)i;
+	return -1;
+}
+
+
+const AnimationClip & Animator::GetClip(int clip) const
+{
+	return this->clips[clip];
+}
+
+
+size_t Animator::ClipCount() const
+{
+	return this->clips.size();
+}
+
+
+/// <summary>
+/// Loads the clips of a text file, from the asset pack when it has the file
+/// Lines are "clip", "track" and "key" declarations, # starts a comment
+/// </summary>
+/// <param name="path"></param>
+/// <returns>Whether every clip loaded, errors are printed with their line</returns>
+bool Animator::LoadClips(const char * path)
+{
+	std::vector<unsigned char> data;
+	if (!asset_pack.Read(path, data) && !ReadLooseFile(path, data))
+	{
+		printf("Impossible to open %s\n", path);
+		return false;
+	}
+	const std::string text(data.begin(), data.end());
+
+	static const char * CHANNEL_NAMES[CHANNELS] = { "position", "rotation", "scale" };
+	static const char * INTERPOLATION_NAMES[] = { "step", "linear", "cubic" };
+
+	std::vector<AnimationClip> loaded;
+	AnimationTrack * track = nullptr;
+	int channel = -1;
+	int line_number = 0;
+	bool ok = true;
+	std::istringstream lines(text);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		line_number++;
+		line = line.substr(0, line.find('#'));
+
+		std::istringstream words(line);
+		std::string command;
+		if (!(words >> command))
+			continue;
+
+		std::string error;
+		if (command == "clip")
+		{
+			// clip <name> <duration> [once]
+			AnimationClip clip;
+			std::string mode;
+			if (!(words >> clip.name >> clip.duration) || clip.duration <= 0.0f)
+				error = "clip needs a name and a duration above 0";
+			else if (words >> mode && mode != "once" && mode != "loop")
+				error = "unknown clip mode " + mode;
+			clip.loop = mode != "once";
+			loaded.push_back(clip);
+			track = nullptr;
+		}
+		else if (command == "track")
+		{
+			// track <position|rotation|scale> [step|linear|cubic]
+			std::string name, interpolation = "linear";
+			words >> name >> interpolation;
+			channel = -1;
+			for (int c = 0; c < CHANNELS; c++)
+				if (name == CHANNEL_NAMES[c])
+					channel = c;
+
+			track = nullptr;
+			if (loaded.empty())
+				error = "track outside of a clip";
+			else if (channel < 0)
+				error = "unknown channel " + name;
+			else
+			{
+				track = &loaded.back().tracks[channel];
+				*track = AnimationTrack();
+				error = "unknown interpolation " + interpolation;
+				for (int i = 0; i <= INTERPOLATE_CUBIC; i++)
+				{
+					if (interpolation == INTERPOLATION_NAMES[i])
+					{
+						track->interpolation = (Interpolation)i;
+						error.clear();
+					}
+				}
+			}
+		}
+		else if (command == "key")
+		{
+			// key <time> <x> <y> <z>, rotations in degrees
+			float time;
+			glm::vec3 value;
+			if (track == nullptr)
+				error = "key outside of a track";
+			else if (!(words >> time >> value.x >> value.y >> value.z))
+				error = "key needs a time and three values";
+			else if (!track->times.empty() && time <= track->times.back())
+				error = "keys have to be in order of time";
+			else
+			{
+				glm::vec4 key = glm::vec4(value, 0.0f);
+				if (channel == CHANNEL_ROTATION)
+				{
+					const glm::quat rotation = glm::quat(glm::vec3(glm::radians(value.x), glm::radians(value.y), glm::radians(value.z)));
+					key = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+				}
+				track->times.push_back(time);
+				track->values.push_back(key);
+			}
+		}
+		else
+		{
+			error = "unknown command " + command;
+		}
+
+		if (!error.empty())
+		{
+			printf("%s:%d: %s\n", path, line_number, error.c_str());
+			ok = false;
+		}
+	}
+
+	if (!ok)
+		return false;
+	for (auto & clip : loaded)
+		this->AddClip(clip);
+	printf("Loaded %u animation clips from %s\n", (unsigned)loaded.size(), path);
+	return true;
+}
+
+
+/// <summary>
+/// Starts a clip on an object, it replaces what the object played before
+/// </summary>
+/// <param name="object"></param>
+/// <param name="clip"></param>
+/// <param name="current">Transform of the object, channels the clip has no keys for keep its values</param>
+/// <param name="start_time">Seconds into the clip</param>
+/// <param name="speed">1 for the speed the clip was made for</param>
+void Animator::Play(int object, int clip, const Transform & current, float start_time, float speed)
+{
+	if (object >= (int)this->slots.size())
+		this->slots.resize(object + 1, -1);
+
+	int slot = this->slots[object];
+	if (slot < 0)
+	{
+		slot = (int)this->objects.size();
+		this->slots[object] = slot;
+		this->objects.push_back(object);
+		this->clip_a.push_back(0);
+		this->clip_b.push_back(-1);
+		this->time_a.push_back(0.0f);
+		this->time_b.push_back(0.0f);
+		this->weight.push_back(0.0f);
+		this->fade.push_back(0.0f);
+		this->speed.push_back(1.0f);
+		this->base.resize(this->base.size() + CHANNELS);
+		this->cursors.resize(this->cursors.size() + SLOT_SAMPLES, 0);
+	}
+
+	this->clip_a[slot] = clip;
+	this->clip_b[slot] = -1;
+	this->time_a[slot] = start_time;
+	this->weight[slot] = 0.0f;
+	this->fade[slot] = 0.0f;
+	this->speed[slot] = speed;
+
+	const glm::quat rotation = current.GetRotation();
+	this->base[slot * CHANNELS + CHANNEL_POSITION] = glm::vec4(current.GetPosition(), 0.0f);
+	this->base[slot * CHANNELS + CHANNEL_ROTATION] = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+	this->base[slot * CHANNELS + CHANNEL_SCALE] = glm::vec4(current.GetScale(), 0.0f);
+	std::fill(this->cursors.begin() + slot * SLOT_SAMPLES, this->cursors.begin() + (slot + 1) * SLOT_SAMPLES, 0);
+}
+
+
+/// <summary>
+/// Blends from the clip an object plays to another one, the other one starts at its beginning
+/// </summary>
+/// <param name="object">An object that plays a clip</param>
+/// <param name="clip"></param>
+/// <param name="seconds">Length of the fade</param>
+void Animator::CrossFade(int object, int clip, float seconds)
+{
+	const int slot = object < (int)this->slots.size() ? this->slots[object] : -1;
+	if (slot < 0)
+		return;
+
+	this->clip_b[slot] = clip;
+	this->time_b[slot] = 0.0f;
+	this->weight[slot] = 0.0f;
+	this->fade[slot] = seconds > 0.0f ? 1.0f / seconds : FLT_MAX;
+	std::fill(this->cursors.begin() + slot * SLOT_SAMPLES + CHANNELS, this->cursors.begin() + (slot + 1) * SLOT_SAMPLES, 0);
+}
+
+
+/// <summary>
+/// Mixes a second clip into the one an object plays, at a fixed weight
+/// The second clip runs in step with the first one
+/// </summary>
+/// <param name="object">An object that plays a clip</param>
+/// <param name="clip">-1 to stop blending</param>
+/// <param name="weight">0 is only the clip the object plays, 1 only the other one</param>
+void Animator::Blend(int object, int clip, float weight)
+{
+	const int slot = object < (int)this->slots.size() ? this->slots[object] : -1;
+	if (slot < 0)
+		return;
+
+	if (clip != this->clip_b[slot])
+		this->time_b[slot] = this->time_a[slot];
+	this->clip_b[slot] = clip;
+	this->weight[slot] = clip >= 0 ? weight : 0.0f;
+	this->fade[slot] = 0.0f;
+}
+
+
+/// <summary>
+/// Stops the animation of an object, it keeps the pose it was in
+/// </summary>
+void Animator::Stop(int object)
+{
+	const int slot = object < (int)this->slots.size() ? this->slots[object] : -1;
+	if (slot < 0)
+		return;
+
+	// The last playing object takes the slot
+	const int last = (int)this->objects.size() - 1;
+	if (slot != last)
+	{
+		this->objects[slot] = this->objects[last];
+		this->clip_a[slot] = this->clip_a[last];
+		this->clip_b[slot] = this->clip_b[last];
+		this->time_a[slot] = this->time_a[last];
+		this->time_b[slot] = this->time_b[last];
+		this->weight[slot] = this->weight[last];
+		this->fade[slot] = this->fade[last];
+		this->speed[slot] = this->speed[last];
+		std::copy(this->base.begin() + last * CHANNELS, this->base.begin() + (last + 1) * CHANNELS, this->base.begin() + slot * CHANNELS);
+		std::copy(this->cursors.begin() + last * SLOT_SAMPLES, this->cursors.begin() + (last + 1) * SLOT_SAMPLES, this->cursors.begin() + slot * SLOT_SAMPLES);
+		this->slots[this->objects[slot]] = slot;
+	}
+	this->slots[object] = -1;
+
+	this->objects.pop_back();
+	this->clip_a.pop_back();
+	this->clip_b.pop_back();
+	this->time_a.pop_back();
+	this->time_b.pop_back();
+	this->weight.pop_back();
+	this->fade.pop_back();
+	this->speed.pop_back();
+	this->base.resize(this->base.size() - CHANNELS);
+	this->cursors.resize(this->cursors.size() - SLOT_SAMPLES);
+}
+
+
+/// <summary>
+/// Amount of objects that play a clip
+/// </summary>
+size_t Animator::Count() const
+{
+	return this->objects.size();
+}
+
+
+/// <summary>
+/// The objects that play a clip, in slot order
+/// </summary>
+const std::vector<int> & Animator::Objects() const
+{
+	return this->objects;
+}
+
+
+/// <summary>
+/// Moves the clips of a range of objects forward and finishes the cross fades that are done
+/// </summary>
+void Animator::Advance(size_t begin, size_t end, float seconds)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		const float step = seconds * this->speed[i];
+		this->time_a[i] += step;
+		if (this->clip_b[i] < 0)
+			continue;
+
+		this->time_b[i] += step;
+		if (this->fade[i] > 0.0f)
+		{
+			this->weight[i] = std::min(this->weight[i] + this->fade[i] * seconds, 1.0f);
+			if (this->weight[i] >= 1.0f)
+			{
+				this->clip_a[i] = this->clip_b[i];
+				this->time_a[i] = this->time_b[i];
+				this->clip_b[i] = -1;
+				this->weight[i] = 0.0f;
+				this->fade[i] = 0.0f;
+				std::copy(this->cursors.begin() + i * SLOT_SAMPLES + CHANNELS, this->cursors.begin() + (i + 1) * SLOT_SAMPLES, this->cursors.begin() + i * SLOT_SAMPLES);
+			}
+		}
+	}
+}
+
+
+/// <summary>
+/// Turns the channels of a clip at a time into four control points and their weights each
+/// Step, linear, slerp and Catmull-Rom all end up as a weighted sum of the keys around the segment
+/// </summary>
+/// <param name="slot">Object the base values come from</param>
+/// <param name="clip"></param>
+/// <param name="time">Seconds since the clip started</param>
+/// <param name="cursors">Key of the last update per channel, updated</param>
+/// <param name="points">Receives four points per channel</param>
+/// <param name="weights">Receives the weights per channel</param>
+void Animator::Prepare(size_t slot, int clip, float time, int * cursors, glm::vec4 * points, glm::vec4 * weights) const
+{
+	const AnimationClip & source = this->clips[clip];
+	const float t = ClipTime(source, time);
+
+	for (int c = 0; c < CHANNELS; c++)
+	{
+		const AnimationTrack & track = source.tracks[c];
+		glm::vec4 * p = points + c * 4;
+		const int keys = (int)track.values.size();
+		if (keys < 2)
+		{
+			p[0] = p[2] = p[3] = glm::vec4(0.0f);
+			p[1] = keys == 1 ? track.values[0] : this->base[slot * CHANNELS + c];
+			weights[c] = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+			continue;
+		}
+
+		const int k = FindKey(track, t, cursors[c]);
+		cursors[c] = k;
+		const float u = SegmentPosition(track, k, t);
+		p[1] = track.values[k];
+		p[2] = track.values[k + 1];
+
+		switch (track.interpolation)
+		{
+		case INTERPOLATE_STEP:
+			p[0] = p[3] = glm::vec4(0.0f);
+			weights[c] = u < 1.0f ? glm::vec4(0.0f, 1.0f, 0.0f, 0.0f) : glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+			break;
+		case INTERPOLATE_LINEAR:
+			p[0] = p[3] = glm::vec4(0.0f);
+			if (c == CHANNEL_ROTATION)
+			{
+				p[2] = Align(p[2], p[1]);
+				const glm::vec2 w = SlerpWeights(p[1], p[2], u);
+				weights[c] = glm::vec4(0.0f, w.x, w.y, 0.0f);
+			}
+			else
+			{
+				weights[c] = glm::vec4(0.0f, 1.0f - u, u, 0.0f);
+			}
+			break;
+		case INTERPOLATE_CUBIC:
+			// The first and last segment repeat their outer key
+			p[0] = track.values[std::max(k - 1, 0)];
+			p[3] = track.values[std::min(k + 2, keys - 1)];
+			if (c == CHANNEL_ROTATION)
+			{
+				p[0] = Align(p[0], p[1]);
+				p[2] = Align(p[2], p[1]);
+				p[3] = Align(p[3], p[2]);
+			}
+			weights[c] = CubicWeights(u);
+			break;
+		}
+	}
+}
+
+
+/// <summary>
+/// Blends the samples of a block of objects and writes them to their transforms
+/// </summary>
+/// <param name="begin">First object of the block</param>
+/// <param name="end"></param>
+/// <param name="samples">Samples of the block, clip a and then clip b when the object plays two clips</param>
+/// <param name="first">First sample of every object of the block</param>
+/// <param name="transforms"></param>
+void Animator::Apply(size_t begin, size_t end, const glm::vec4 * samples, const int * first, std::vector<Transform> & transforms) const
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		const glm::vec4 * a = samples + first[i - begin];
+		glm::vec4 position = a[CHANNEL_POSITION];
+		glm::vec4 rotation = a[CHANNEL_ROTATION];
+		glm::vec4 scale = a[CHANNEL_SCALE];
+
+		if (this->clip_b[i] >= 0 && this->weight[i] > 0.0f)
+		{
+			const glm::vec4 * b = a + CHANNELS;
+			const float w = this->weight[i];
+			position = glm::mix(position, b[CHANNEL_POSITION], w);
+			rotation = glm::mix(rotation, Align(b[CHANNEL_ROTATION], rotation), w);
+			scale = glm::mix(scale, b[CHANNEL_SCALE], w);
+		}
+
+		const float length = sqrtf(glm::dot(rotation, rotation));
+		rotation = length > 0.0f ? rotation / length : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+		Transform & transform = transforms[this->objects[i]];
+		transform.SetPosition(glm::vec3(position));
+		transform.SetRotation(glm::quat(rotation.w, rotation.x, rotation.y, rotation.z));
+		transform.SetScale(glm::vec3(scale));
+	}
+}
+
+
+/// <summary>
+/// Moves every clip forward and poses the objects that play them
+/// The jobs work through their objects in small blocks, the control points of a block are prepared,
+/// summed and applied while they are still in the cache
+/// </summary>
+/// <param name="seconds">Time since the last update</param>
+/// <param name="transforms">Transforms of the scene, indexed by object</param>
+/// <param name="jobs"></param>
+void Animator::Update(float seconds, std::vector<Transform> & transforms, JobSystem & jobs)
+{
+	const size_t count = this->objects.size();
+	if (count == 0)
+		return;
+
+	const double start = GetWallTime();
+	jobs.ParallelFor(count, ANIMATION_GRAIN, [this, seconds, &transforms](size_t begin, size_t end) {
+		this->Advance(begin, end, seconds);
+
+		glm::vec4 points[ANIMATION_BLOCK * SLOT_SAMPLES * 4];
+		glm::vec4 weights[ANIMATION_BLOCK * SLOT_SAMPLES];
+		glm::vec4 samples[ANIMATION_BLOCK * SLOT_SAMPLES];
+		int first[ANIMATION_BLOCK];
+		for (size_t block = begin; block < end; block += ANIMATION_BLOCK)
+		{
+			const size_t block_end = std::min(block + ANIMATION_BLOCK, end);
+
+			// Objects that play a single clip only take the samples of that one
+			int used = 0;
+			for (size_t i = block; i < block_end; i++)
+			{
+				first[i - block] = used;
+				this->Prepare(i, this->clip_a[i], this->time_a[i], &this->cursors[i * SLOT_SAMPLES], points + used * 4, weights + used);
+				used += CHANNELS;
+				if (this->clip_b[i] >= 0)
+				{
+					this->Prepare(i, this->clip_b[i], this->time_b[i], &this->cursors[i * SLOT_SAMPLES + CHANNELS], points + used * 4, weights + used);
+					used += CHANNELS;
+				}
+			}
+
+			WeightedSum(points, weights, samples, used);
+			this->Apply(block, block_end, samples, first, transforms);
+		}
+	});
+
+	stats.Add("animated objects", (double)count);
+	stats.Add("animation ms", GetWallTime() - start);
+}
+
+
+/// <summary>
+/// Evaluates every channel of a clip on its own with the textbook formulas
+/// </summary>
+/// <param name="clip"></param>
+/// <param name="time">Seconds since the clip started</param>
+/// <param name="base">Values of the channels without keys</param>
+/// <param name="result">Receives position, rotation (x, y, z, w, normalized) and scale</param>
+void Animator::Sample(int clip, float time, const glm::vec4 base[CHANNELS], glm::vec4 result[CHANNELS]) const
+{
+	const AnimationClip & source = this->clips[clip];
+	const float t = ClipTime(source, time);
+
+	for (int c = 0; c < CHANNELS; c++)
+	{
+		const AnimationTrack & track = source.tracks[c];
+		const int keys = (int)track.values.size();
+		if (keys < 2)
+		{
+			result[c] = keys == 1 ? track.values[0] : base[c];
+			continue;
+		}
+
+		const int k = FindKey(track, t, -1);
+		const float u = SegmentPosition(track, k, t);
+		const glm::vec4 a = track.values[k];
+		glm::vec4 b = track.values[k + 1];
+		if (c == CHANNEL_ROTATION)
+			b = Align(b, a);
+
+		if (track.interpolation == INTERPOLATE_STEP)
+		{
+			result[c] = u < 1.0f ? a : b;
+		}
+		else if (track.interpolation == INTERPOLATE_LINEAR && c == CHANNEL_ROTATION)
+		{
+			const float cos_theta = std::min(glm::dot(a, b), 1.0f);
+			if (cos_theta > 0.9995f)
+			{
+				result[c] = glm::mix(a, b, u);
+			}
+			else
+			{
+				const float theta = acosf(cos_theta);
+				result[c] = (a * sinf((1.0f - u) * theta) + b * sinf(u * theta)) / sinf(theta);
+			}
+		}
+		else if (track.interpolation == INTERPOLATE_LINEAR)
+		{
+			result[c] = glm::mix(a, b, u);
+		}
+		else
+		{
+			// Catmull-Rom with tangents from the keys around the segment
+			glm::vec4 before = track.values[std::max(k - 1, 0)];
+			glm::vec4 after = track.values[std::min(k + 2, keys - 1)];
+			if (c == CHANNEL_ROTATION)
+			{
+				before = Align(before, a);
+				after = Align(after, b);
+			}
+			const glm::vec4 m0 = 0.5f * (b - before);
+			const glm::vec4 m1 = 0.5f * (after - a);
+			const float u2 = u * u;
+			const float u3 = u2 * u;
+			result[c] = (2.0f * u3 - 3.0f * u2 + 1.0f) * a + (u3 - 2.0f * u2 + u) * m0 + (-2.0f * u3 + 3.0f * u2) * b + (u3 - u2) * m1;
+		}
+
+		if (c == CHANNEL_ROTATION)
+			result[c] = glm::normalize(result[c]);
+	}
+}
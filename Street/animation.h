@@ -0,0 +1,90 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "transform.h"
+#include "jobSystem.h"
+
+
+// How the values between two keys are found
+enum Interpolation
+{
+	INTERPOLATE_STEP,		// The value of the key before
+	INTERPOLATE_LINEAR,		// Straight line, rotations slerp
+	INTERPOLATE_CUBIC		// Catmull-Rom through the keys around the segment, rotations are normalized afterwards
+};
+
+// Parts of a transform a clip can animate
+enum AnimationChannel
+{
+	CHANNEL_POSITION,
+	CHANNEL_ROTATION,
+	CHANNEL_SCALE,
+	CHANNELS
+};
+
+// Keys of one channel, times in seconds and ascending
+// Positions and scales use xyz, rotations are quaternions stored as x, y, z, w
+struct AnimationTrack
+{
+	Interpolation interpolation = INTERPOLATE_LINEAR;
+	std::vector<float> times;
+	std::vector<glm::vec4> values;
+};
+
+// Named set of tracks, a channel without keys keeps the value the object had when the clip started
+struct AnimationClip
+{
+	std::string name;
+	float duration = 0.0f;
+	bool loop = true;
+	AnimationTrack tracks[CHANNELS];
+};
+
+// Plays keyframed clips on scene objects
+// The playing objects are stored as one array per property, every update runs over all of them in ranges on the jobs:
+// the key segments are looked up (from the key of the last update, so mostly without a search), every interpolation
+// is turned into four control points with four weights and a simd kernel sums them, then the clips are blended
+// An object plays one clip, or two while it blends or cross fades from one to the other
+class Animator
+{
+private:
+	std::vector<AnimationClip> clips;
+
+	// Slot of every scene object, -1 when it plays nothing
+	std::vector<int> slots;
+
+	// Per playing object
+	std::vector<int> objects;
+	std::vector<int> clip_a;
+	std::vector<int> clip_b;		// -1 when only clip a plays
+	std::vector<float> time_a;
+	std::vector<float> time_b;
+	std::vector<float> weight;		// Of clip b
+	std::vector<float> fade;		// Weight change per second, clip b replaces clip a when the weight reaches 1
+	std::vector<float> speed;
+	std::vector<glm::vec4> base;	// Position, rotation and scale the object had, for channels without keys
+	std::vector<int> cursors;		// Key of the last update, per object, clip and channel
+
+	void Advance(size_t begin, size_t end, float seconds);
+	void Prepare(size_t slot, int clip, float time, int * cursors, glm::vec4 * points, glm::vec4 * weights) const;
+	void Apply(size_t begin, size_t end, const glm::vec4 * samples, const int * first, std::vector<Transform> & transforms) const;
+public:
+	int AddClip(const AnimationClip & clip);
+	int FindClip(const char * name) const;
+	const AnimationClip & GetClip(int clip) const;
+	size_t ClipCount() const;
+	bool LoadClips(const char * path);
+
+	void Play(int object, int clip, const Transform & current, float start_time = 0.0f, float speed = 1.0f);
+	void CrossFade(int object, int clip, float seconds);
+	void Blend(int object, int clip, float weight);
+	void Stop(int object);
+	size_t Count() const;
+	const std::vector<int> & Objects() const;
+
+	void Update(float seconds, std::vector<Transform> & transforms, JobSystem & jobs);
+
+	// A single clip at a time, the straightforward way without batching, used to check the batch
+	void Sample(int clip, float time, const glm::vec4 base[CHANNELS], glm::vec4 result[CHANNELS]) const;
+};
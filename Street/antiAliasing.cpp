@@ -0,0 +1,235 @@
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "glsl.h"
+#include "antiAliasing.h"
+#include "glState.h"
+
+const char * post_vertexshader_name = "upscale.vsh";
+const char * fxaa_fragshader_name = "fxaa.fsh";
+const char * temporal_fragshader_name = "temporal.fsh";
+
+const char * AA_MODE_NAMES[AA_MODES] = { "off", "msaa 2x", "msaa 4x", "msaa 8x", "fxaa", "temporal" };
+
+
+const char * AntiAliasingModeName(AntiAliasingMode mode)
+{
+	return mode >= 0 && mode < AA_MODES ? AA_MODE_NAMES[mode] : "unknown";
+}
+
+
+int AntiAliasingSamples(AntiAliasingMode mode)
+{
+	switch (mode)
+	{
+	case AA_MSAA_2X:
+		return 2;
+	case AA_MSAA_4X:
+		return 4;
+	case AA_MSAA_8X:
+		return 8;
+	default:
+		return 1;
+	}
+}
+
+
+/// <summary>
+/// Radical inverse of an index, the low discrepancy sequence the jitter offsets come from
+/// </summary>
+static float Halton(int index, int base)
+{
+	float result = 0.0f;
+	float fraction = 1.0f / base;
+	for (; index > 0; index /= base, fraction /= base)
+		result += fraction * (index % base);
+	return result;
+}
+
+
+/// <summary>
+/// Compiles a fullscreen pass
+/// </summary>
+static GLuint MakePostProgram(const char * fragshader_name)
+{
+	char * vertexshader = glsl::readFile(post_vertexshader_name);
+	GLuint vsh_id = glsl::makeVertexShader(vertexshader);
+	delete[] vertexshader;
+
+	char * fragshader = glsl::readFile(fragshader_name);
+	GLuint fsh_id = glsl::makeFragmentShader(fragshader);
+	delete[] fragshader;
+
+	return glsl::makeShaderProgram(vsh_id, fsh_id);
+}
+
+
+AntiAliasing::~AntiAliasing()
+{
+	if (this->fxaa_program)
+		gl_state.DeleteProgram(this->fxaa_program);
+	if (this->temporal_program)
+		gl_state.DeleteProgram(this->temporal_program);
+	if (this->vao)
+		gl_state.DeleteVertexArrays(1, &this->vao);
+}
+
+
+/// <summary>
+/// Builds the post process programs
+/// </summary>
+void AntiAliasing::Initialize()
+{
+	this->fxaa_program = MakePostProgram(fxaa_fragshader_name);
+	this->fxaa_texel_size = glGetUniformLocation(this->fxaa_program, "texel_size");
+	this->fxaa_render_size = glGetUniformLocation(this->fxaa_program, "render_size");
+
+	this->temporal_program = MakePostProgram(temporal_fragshader_name);
+	this->temporal_reprojection = glGetUniformLocation(this->temporal_program, "reprojection");
+	this->temporal_render_size = glGetUniformLocation(this->temporal_program, "render_size");
+	this->temporal_history_scale = glGetUniformLocation(this->temporal_program, "history_scale");
+	this->temporal_blend = glGetUniformLocation(this->temporal_program, "blend");
+	gl_state.UseProgram(this->temporal_program);
+	gl_state.Uniform1i(glGetUniformLocation(this->temporal_program, "frame"), 0);
+	gl_state.Uniform1i(glGetUniformLocation(this->temporal_program, "depth"), 1);
+	gl_state.Uniform1i(glGetUniformLocation(this->temporal_program, "history"), 2);
+
+	glGenVertexArrays(1, &this->vao);
+}
+
+
+AntiAliasingMode AntiAliasing::Mode() const
+{
+	return this->mode;
+}
+
+
+/// <summary>
+/// Switches the mode, the history starts over
+/// The msaa samples of the offscreen target are up to the caller (AntiAliasingSamples)
+/// </summary>
+void AntiAliasing::SetMode(AntiAliasingMode mode)
+{
+	this->mode = mode;
+	this->current = 0;
+	this->history_valid = false;
+	this->frame = 0;
+}
+
+
+/// <summary>
+/// Moves the projection by the sub pixel offset of this frame, only in the temporal mode
+/// </summary>
+/// <param name="projection"></param>
+/// <param name="render_width">Width of the used part of the target</param>
+/// <param name="render_height">Height of the used part of the target</param>
+/// <returns>The projection to render with</returns>
+glm::mat4 AntiAliasing::Jitter(const glm::mat4 & projection, int render_width, int render_height) const
+{
+	if (this->mode != AA_TEMPORAL)
+		return projection;
+
+	// Offsets within the pixel in -0.5..0.5, turned into clip space
+	const int index = this->frame % TEMPORAL_SAMPLES + 1;
+	const glm::vec2 offset = glm::vec2(Halton(index, 2) - 0.5f, Halton(index, 3) - 0.5f);
+
+	glm::mat4 jittered = projection;
+	jittered[2][0] += offset.x * 2.0f / render_width;
+	jittered[2][1] += offset.y * 2.0f / render_height;
+	return jittered;
+}
+
+
+/// <summary>
+/// Adds the post process pass of the mode over the resolved frame to the graph
+/// </summary>
+/// <param name="graph"></param>
+/// <param name="frame">Resolved frame in the bottom left of a texture the size of the target</param>
+/// <param name="depth">Depth of the frame, read by the temporal mode</param>
+/// <param name="render_width">Width of the used part of the target</param>
+/// <param name="render_height">Height of the used part of the target</param>
+/// <param name="view_projection">Unjittered view projection of the frame</param>
+/// <returns>Resource with the anti aliased frame, the frame itself in the msaa modes</returns>
+int AntiAliasing::AddPass(FrameGraph & graph, int frame, int depth, int render_width, int render_height, const glm::mat4 & view_projection)
+{
+	if (this->mode != AA_FXAA && this->mode != AA_TEMPORAL)
+		return frame;
+
+	TextureDesc desc = graph.Desc(frame);
+	desc.format = GL_RGBA8;
+	desc.samples = 1;
+
+	if (this->mode == AA_FXAA)
+	{
+		const int output = graph.CreateTexture("fxaa", desc);
+		const int pass = graph.AddPass("fxaa", [this, frame, output, render_width, render_height](FrameGraph & graph) {
+			graph.Framebuffer(output);
+			gl_state.UseProgram(this->fxaa_program);
+			gl_state.Uniform2f(this->fxaa_texel_size, 1.0f / graph.Desc(frame).width, 1.0f / graph.Desc(frame).height);
+			gl_state.Uniform2f(this->fxaa_render_size, (float)render_width, (float)render_height);
+			this->Draw(graph.Texture(frame), 0, 0, render_width, render_height);
+		});
+		graph.Read(pass, frame, ACCESS_SAMPLED);
+		graph.Write(pass, output, ACCESS_ATTACHMENT);
+		return output;
+	}
+
+	// Depth of this frame to the uv of the history, without a history the frame is taken as is
+	const int history = graph.RetainTexture(this->current == 0 ? "history 0" : "history 1", desc);
+	const int output = graph.RetainTexture(this->current == 0 ? "history 1" : "history 0", desc);
+	const glm::mat4 reprojection = this->previous_view_projection * glm::inverse(view_projection);
+	const glm::vec2 history_scale = glm::vec2(this->previous_size.x / desc.width, this->previous_size.y / desc.height);
+	const float blend = this->history_valid ? TEMPORAL_BLEND : 1.0f;
+
+	const int pass = graph.AddPass("temporal", [this, frame, depth, history, output, render_width, render_height, reprojection, history_scale, blend](FrameGraph & graph) {
+		graph.Framebuffer(output);
+		gl_state.UseProgram(this->temporal_program);
+		gl_state.UniformMatrix4fv(this->temporal_reprojection, 1, GL_FALSE, glm::value_ptr(reprojection));
+		gl_state.Uniform2f(this->temporal_render_size, (float)render_width, (float)render_height);
+		gl_state.Uniform2fv(this->temporal_history_scale, 1, glm::value_ptr(history_scale));
+		gl_state.Uniform1f(this->temporal_blend, blend);
+		this->Draw(graph.Texture(frame), graph.Texture(depth), graph.Texture(history), render_width, render_height);
+	});
+	graph.Read(pass, frame, ACCESS_SAMPLED);
+	graph.Read(pass, depth, ACCESS_SAMPLED);
+	graph.Read(pass, history, ACCESS_SAMPLED);
+	graph.Write(pass, output, ACCESS_ATTACHMENT);
+
+	this->previous_view_projection = view_projection;
+	this->previous_size = glm::vec2(render_width, render_height);
+	this->history_valid = true;
+	this->current = 1 - this->current;
+	this->frame++;
+	return output;
+}
+
+
+/// <summary>
+/// Draws the fullscreen triangle of the bound program into the bound framebuffer
+/// </summary>
+/// <param name="frame">Texture for unit 0</param>
+/// <param name="depth">Texture for unit 1, 0 for none</param>
+/// <param name="history">Texture for unit 2, 0 for none</param>
+void AntiAliasing::Draw(GLuint frame, GLuint depth, GLuint history, int render_width, int render_height)
+{
+	gl_state.Viewport(0, 0, render_width, render_height);
+	gl_state.Disable(GL_DEPTH_TEST);
+
+	gl_state.BindTexture(1, GL_TEXTURE_2D, depth);
+	gl_state.BindTexture(2, GL_TEXTURE_2D, history);
+	gl_state.BindTexture(0, GL_TEXTURE_2D, frame);
+
+	gl_state.BindVertexArray(this->vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	gl_state.BindVertexArray(0);
+
+	// The textures are rendered to in the next frame, they can't stay bound
+	gl_state.BindTexture(0, GL_TEXTURE_2D, 0);
+	gl_state.BindTexture(1, GL_TEXTURE_2D, 0);
+	gl_state.BindTexture(2, GL_TEXTURE_2D, 0);
+	gl_state.Enable(GL_DEPTH_TEST);
+}
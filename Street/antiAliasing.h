@@ -0,0 +1,69 @@
+#pragma once
+#include <stddef.h>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "frameGraph.h"
+
+
+enum AntiAliasingMode
+{
+	AA_OFF,
+	AA_MSAA_2X,
+	AA_MSAA_4X,
+	AA_MSAA_8X,
+	AA_FXAA,
+	AA_TEMPORAL,
+	AA_MODES
+};
+
+const char * AntiAliasingModeName(AntiAliasingMode mode);
+
+// Msaa samples the offscreen target needs for a mode, 1 for the post process modes
+int AntiAliasingSamples(AntiAliasingMode mode);
+
+// Amount of jitter offsets the temporal mode cycles through
+const int TEMPORAL_SAMPLES = 8;
+
+// Share of the new frame in the temporal history
+const float TEMPORAL_BLEND = 0.1f;
+
+// Post process anti aliasing of the resolved frame
+// Fxaa blurs along the edges it finds in the luma of the frame. The temporal mode jitters the projection
+// by a sub pixel offset every frame and accumulates the frames, the history is reprojected with the depth
+// and clamped to the colors around the pixel so moving objects don't smear
+// The passes work on the same partly used targets as DynamicResolution, the histories are retained by the frame graph
+class AntiAliasing
+{
+private:
+	AntiAliasingMode mode = AA_MSAA_4X;
+
+	GLuint vao = 0;
+	GLuint fxaa_program = 0;
+	GLint fxaa_texel_size = -1;
+	GLint fxaa_render_size = -1;
+	GLuint temporal_program = 0;
+	GLint temporal_reprojection = -1;
+	GLint temporal_render_size = -1;
+	GLint temporal_history_scale = -1;
+	GLint temporal_blend = -1;
+
+	// The temporal mode switches between two histories
+	int current = 0;
+
+	// Unjittered view projection and the used part of the history of the frame before
+	glm::mat4 previous_view_projection;
+	glm::vec2 previous_size;
+	bool history_valid = false;
+	int frame = 0;
+
+	void Draw(GLuint frame, GLuint depth, GLuint history, int render_width, int render_height);
+public:
+	~AntiAliasing();
+
+	void Initialize();
+	AntiAliasingMode Mode() const;
+	void SetMode(AntiAliasingMode mode);
+
+	glm::mat4 Jitter(const glm::mat4 & projection, int render_width, int render_height) const;
+	int AddPass(FrameGraph & graph, int frame, int depth, int render_width, int render_height, const glm::mat4 & view_projection);
+};
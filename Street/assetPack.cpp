@@ -0,0 +1,522 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "lz4.h"
+#include "objloader.hpp"
+#include "imageDecoder.h"
+#include "assetPack.h"
+
+AssetPack asset_pack;
+
+// Shaders the renderer compiles at startup, packed next to the assets of the scene
+const char * PACKED_SHADERS[] = {
+	"vertexshader.vsh", "fragmentshader.fsh",
+	"depth.vsh", "depth.fsh",
+	"shadow.vsh", "shadow.fsh",
+	"overdraw.vsh", "overdraw.fsh",
+	"upscale.vsh", "upscale.fsh",
+	"fxaa.fsh", "temporal.fsh",
+	"swarm.vsh", "swarm.fsh"
+};
+
+// Entries that don't shrink by at least this much are stored uncompressed
+const double MIN_COMPRESSION = 0.9;
+
+
+/// <summary>
+/// FNV-1a hash of an asset name
+/// </summary>
+uint32_t HashAssetName(const char * name)
+{
+	uint32_t hash = 2166136261u;
+	for (; *name; name++)
+		hash = (hash ^ (unsigned char)*name) * 16777619u;
+	return hash;
+}
+
+
+/// <summary>
+/// Reads a whole file
+/// </summary>
+/// <param name="path"></param>
+/// <param name="data">Receives the contents</param>
+/// <returns>Whether the file could be read</returns>
+bool ReadLooseFile(const char * path, std::vector<unsigned char> & data)
+{
+	FILE * file = fopen(path, "rb");
+	if (file == NULL)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data.resize(length > 0 ? (size_t)length : 0);
+	bool ok = length >= 0 && fread(data.data(), 1, data.size(), file) == data.size();
+	fclose(file);
+	return ok;
+}
+
+
+/// <summary>
+/// Maps a pack and checks its header and table of contents
+/// </summary>
+/// <param name="path"></param>
+/// <returns>Whether the pack can be used</returns>
+bool AssetPack::Open(const char * path)
+{
+	this->Close();
+	if (!this->file.Open(path))
+		return false;
+
+	const PackHeader * header = (const PackHeader *)this->file.Data();
+	const size_t size = this->file.Size();
+	if (size < sizeof(PackHeader) || header->magic != PACK_MAGIC || header->version != PACK_VERSION ||
+		header->entry_offset > size || (size - header->entry_offset) / sizeof(PackEntry) < header->entry_count ||
+		header->slot_offset > size || (size - header->slot_offset) / sizeof(uint32_t) < header->slot_count ||
+		header->slot_count == 0 || (header->slot_count & (header->slot_count - 1)) != 0)
+	{
+		printf("%s is not an asset pack of version %u\n", path, PACK_VERSION);
+		this->Close();
+		return false;
+	}
+
+	const PackEntry * entries = (const PackEntry *)(this->file.Data() + header->entry_offset);
+	for (uint32_t i = 0; i < header->entry_count; i++)
+	{
+		if (entries[i].offset > size || size - entries[i].offset < entries[i].packed_size ||
+			(size_t)entries[i].block_count * sizeof(uint32_t) > entries[i].packed_size)
+		{
+			printf("%s: entry %s lies outside the pack\n", path, entries[i].name);
+			this->Close();
+			return false;
+		}
+	}
+
+	this->header = header;
+	return true;
+}
+
+
+void AssetPack::Close()
+{
+	this->header = nullptr;
+	this->file.Close();
+}
+
+
+bool AssetPack::IsOpen() const
+{
+	return this->header != nullptr;
+}
+
+
+const PackEntry * AssetPack::Entries() const
+{
+	return (const PackEntry *)(this->file.Data() + this->header->entry_offset);
+}
+
+
+/// <summary>
+/// Looks an entry up by name
+/// </summary>
+/// <param name="name">The path the loose file has</param>
+/// <returns>The entry or nullptr when the pack doesn't have it (or isn't open)</returns>
+const PackEntry * AssetPack::Find(const char * name) const
+{
+	if (!this->header || name == nullptr)
+		return nullptr;
+
+	const uint32_t * slots = (const uint32_t *)(this->file.Data() + this->header->slot_offset);
+	const uint32_t mask = this->header->slot_count - 1;
+	const uint32_t hash = HashAssetName(name);
+
+	for (uint32_t i = hash & mask, probes = 0; probes < this->header->slot_count; i = (i + 1) & mask, probes++)
+	{
+		if (slots[i] == 0 || slots[i] > this->header->entry_count)
+			return nullptr;
+
+		const PackEntry & entry = this->Entries()[slots[i] - 1];
+		if (entry.hash == hash && strncmp(entry.name, name, PACK_NAME_LENGTH) == 0)
+			return &entry;
+	}
+	return nullptr;
+}
+
+
+/// <summary>
+/// The data of an entry, straight from the mapping when it is stored uncompressed
+/// Compressed blocks are decompressed into storage, in parallel when a job system is given
+/// </summary>
+/// <returns>The data or nullptr when a block is damaged</returns>
+const unsigned char * AssetPack::Payload(const PackEntry & entry, std::vector<unsigned char> & storage, JobSystem * jobs) const
+{
+	const unsigned char * data = this->file.Data() + entry.offset;
+	if (entry.block_count == 0)
+		return entry.packed_size == entry.size ? data : nullptr;
+
+	const uint32_t * block_ends = (const uint32_t *)data;
+	const unsigned char * blocks = data + entry.block_count * sizeof(uint32_t);
+	const size_t blocks_size = entry.packed_size - entry.block_count * sizeof(uint32_t);
+	storage.resize(entry.size);
+
+	std::atomic<bool> ok(true);
+	auto decompress = [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; b++)
+		{
+			const size_t start = b == 0 ? 0 : block_ends[b - 1];
+			const size_t first = b * PACK_BLOCK_SIZE;
+			const size_t size = std::min(PACK_BLOCK_SIZE, (size_t)entry.size - std::min(first, (size_t)entry.size));
+			if (start > block_ends[b] || block_ends[b] > blocks_size ||
+				!LZ4Decompress(blocks + start, block_ends[b] - start, storage.data() + first, size))
+				ok = false;
+		}
+	};
+
+	if (jobs)
+		jobs->ParallelFor(entry.block_count, 1, decompress);
+	else
+		decompress(0, entry.block_count);
+	return ok ? storage.data() : nullptr;
+}
+
+
+/// <summary>
+/// Reads an entry as it was packed
+/// </summary>
+/// <param name="name"></param>
+/// <param name="data">Receives the data</param>
+/// <param name="jobs">Decompresses the blocks in parallel when given, only from the thread that started it</param>
+/// <returns>Whether the pack has the entry</returns>
+bool AssetPack::Read(const char * name, std::vector<unsigned char> & data, JobSystem * jobs) const
+{
+	const PackEntry * entry = this->Find(name);
+	if (!entry)
+		return false;
+
+	std::vector<unsigned char> storage;
+	const unsigned char * payload = this->Payload(*entry, storage, jobs);
+	if (!payload)
+		return false;
+
+	if (payload == storage.data())
+		data.swap(storage);
+	else
+		data.assign(payload, payload + entry->size);
+	return true;
+}
+
+
+/// <summary>
+/// Reads a parsed obj, no text has to be parsed
+/// </summary>
+/// <param name="name">Path of the obj file</param>
+/// <param name="mesh">Receives the vertices, normals and uvs</param>
+/// <param name="jobs"></param>
+/// <returns>Whether the pack has the mesh</returns>
+bool AssetPack::ReadMesh(const char * name, Mesh & mesh, JobSystem * jobs) const
+{
+	const PackEntry * entry = this->Find(name);
+	if (!entry || entry->kind != PACK_MESH || entry->size < 5 * sizeof(uint32_t))
+		return false;
+
+	std::vector<unsigned char> storage;
+	const unsigned char * payload = this->Payload(*entry, storage, jobs);
+	if (!payload)
+		return false;
+
+	// Vertex, index, range and material counts and the length of the texture paths of the materials
+	uint32_t counts[5];
+	memcpy(counts, payload, sizeof(counts));
+	const size_t vertex_size = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
+	if (entry->size != sizeof(counts) + (size_t)counts[0] * vertex_size + (size_t)counts[1] * sizeof(unsigned int)
+		+ (size_t)counts[2] * sizeof(MeshRange) + (size_t)counts[3] * sizeof(Material) + counts[4])
+		return false;
+
+	const glm::vec3 * vertices = (const glm::vec3 *)(payload + sizeof(counts));
+	const glm::vec3 * normals = vertices + counts[0];
+	const glm::vec2 * uvs = (const glm::vec2 *)(normals + counts[0]);
+	const unsigned int * indices = (const unsigned int *)(uvs + counts[0]);
+	const MeshRange * ranges = (const MeshRange *)(indices + counts[1]);
+	const Material * materials = (const Material *)(ranges + counts[2]);
+	const char * textures = (const char *)(materials + counts[3]);
+	mesh.vertices.assign(vertices, vertices + counts[0]);
+	mesh.normals.assign(normals, normals + counts[0]);
+	mesh.uvs.assign(uvs, uvs + counts[0]);
+	mesh.indices.assign(indices, indices + counts[1]);
+	mesh.ranges.assign(ranges, ranges + counts[2]);
+	mesh.materials.assign(materials, materials + counts[3]);
+	// One path per material, every path ends with a zero
+	if (counts[4] > 0 && textures[counts[4] - 1] != '\0')
+		return false;
+	mesh.textures.clear();
+	for (const char * path = textures; path < textures + counts[4]; path += strlen(path) + 1)
+		mesh.textures.push_back(path);
+	if (mesh.textures.size() != counts[3])
+		return false;
+	mesh.lightmap_uvs.clear();
+	return true;
+}
+
+
+/// <summary>
+/// Reads a decoded image
+/// </summary>
+/// <param name="name">Path of the image file</param>
+/// <param name="image">Receives the rgba pixels, bottom row first</param>
+/// <param name="jobs"></param>
+/// <returns>Whether the pack has the texture</returns>
+bool AssetPack::ReadTexture(const char * name, Image & image, JobSystem * jobs) const
+{
+	const PackEntry * entry = this->Find(name);
+	if (!entry || entry->kind != PACK_TEXTURE || entry->size < 3 * sizeof(uint32_t))
+		return false;
+
+	std::vector<unsigned char> storage;
+	const unsigned char * payload = this->Payload(*entry, storage, jobs);
+	if (!payload)
+		return false;
+
+	uint32_t info[3];
+	memcpy(info, payload, sizeof(info));
+	if (entry->size != sizeof(info) + (size_t)info[0] * info[1] * 4)
+		return false;
+
+	image.width = info[0];
+	image.height = info[1];
+	image.has_alpha = info[2] != 0;
+	image.pixels.assign(payload + sizeof(info), payload + entry->size);
+	return true;
+}
+
+
+/// <summary>
+/// Lists every file the scene and the renderer load: the meshes and textures of the scene and the shaders
+/// </summary>
+/// <param name="scene">The compiled scene</param>
+/// <param name="sources">Receives the files, every path once</param>
+void CollectPackSources(const SceneFile & scene, std::vector<PackSource> & sources)
+{
+	auto add = [&sources](const char * path, PackKind kind) {
+		if (path[0] == '\0')
+			return;
+		for (auto & source : sources)
+			if (source.path == path)
+				return;
+		sources.push_back(PackSource{ path, kind });
+	};
+
+	for (size_t i = 0; i < scene.MeshCount(); i++)
+	{
+		add(scene.GetMesh(i).object_path, PACK_MESH);
+		add(scene.GetMesh(i).texture_path, PACK_TEXTURE);
+	}
+	for (const char * shader : PACKED_SHADERS)
+		add(shader, PACK_RAW);
+}
+
+
+/// <summary>
+/// Turns a loose file into the data of its entry
+/// </summary>
+/// <returns>Whether the file could be loaded</returns>
+static bool ProcessSource(const PackSource & source, std::vector<unsigned char> & data)
+{
+	if (source.kind == PACK_MESH)
+	{
+		Mesh mesh;
+		if (!loadOBJ(source.path.c_str(), mesh))
+			return false;
+
+		std::string textures;
+		for (auto & texture : mesh.textures)
+			textures.append(texture.c_str(), texture.size() + 1);
+
+		const uint32_t counts[5] = { (uint32_t)mesh.vertices.size(), (uint32_t)mesh.indices.size(), (uint32_t)mesh.ranges.size(),
+			(uint32_t)mesh.materials.size(), (uint32_t)textures.size() };
+		const size_t vertex_size = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
+		data.resize(sizeof(counts) + counts[0] * vertex_size + counts[1] * sizeof(unsigned int)
+			+ counts[2] * sizeof(MeshRange) + counts[3] * sizeof(Material) + counts[4]);
+		unsigned char * out = data.data();
+		memcpy(out, counts, sizeof(counts));
+		memcpy(out += sizeof(counts), mesh.vertices.data(), counts[0] * sizeof(glm::vec3));
+		memcpy(out += counts[0] * sizeof(glm::vec3), mesh.normals.data(), counts[0] * sizeof(glm::vec3));
+		memcpy(out += counts[0] * sizeof(glm::vec3), mesh.uvs.data(), counts[0] * sizeof(glm::vec2));
+		memcpy(out += counts[0] * sizeof(glm::vec2), mesh.indices.data(), counts[1] * sizeof(unsigned int));
+		memcpy(out += counts[1] * sizeof(unsigned int), mesh.ranges.data(), counts[2] * sizeof(MeshRange));
+		memcpy(out += counts[2] * sizeof(MeshRange), mesh.materials.data(), counts[3] * sizeof(Material));
+		memcpy(out += counts[3] * sizeof(Material), textures.data(), counts[4]);
+		return true;
+	}
+
+	if (source.kind == PACK_TEXTURE)
+	{
+		Image image;
+		if (!ReadImage(source.path.c_str(), image))
+			return false;
+
+		const uint32_t info[3] = { image.width, image.height, image.has_alpha ? 1u : 0u };
+		data.resize(sizeof(info) + image.pixels.size());
+		memcpy(data.data(), info, sizeof(info));
+		memcpy(data.data() + sizeof(info), image.pixels.data(), image.pixels.size());
+		return true;
+	}
+
+	return ReadLooseFile(source.path.c_str(), data);
+}
+
+
+/// <summary>
+/// Compresses the data of an entry in independent blocks
+/// </summary>
+/// <param name="data"></param>
+/// <param name="packed">Receives the block table and the blocks</param>
+/// <returns>Amount of blocks, 0 when compressing doesn't pay off and the data should be stored as is</returns>
+static uint32_t CompressEntry(const std::vector<unsigned char> & data, std::vector<unsigned char> & packed)
+{
+	const size_t block_count = (data.size() + PACK_BLOCK_SIZE - 1) / PACK_BLOCK_SIZE;
+	if (block_count == 0)
+		return 0;
+
+	std::vector<uint32_t> block_ends(block_count);
+	std::vector<unsigned char> blocks(block_count * LZ4Bound(PACK_BLOCK_SIZE));
+	size_t end = 0;
+	for (size_t b = 0; b < block_count; b++)
+	{
+		const size_t first = b * PACK_BLOCK_SIZE;
+		end += LZ4Compress(data.data() + first, std::min(PACK_BLOCK_SIZE, data.size() - first), blocks.data() + end);
+		block_ends[b] = (uint32_t)end;
+	}
+
+	const size_t table_size = block_count * sizeof(uint32_t);
+	if (table_size + end > data.size() * MIN_COMPRESSION)
+		return 0;
+
+	packed.resize(table_size + end);
+	memcpy(packed.data(), block_ends.data(), table_size);
+	memcpy(packed.data() + table_size, blocks.data(), end);
+	return (uint32_t)block_count;
+}
+
+
+/// <summary>
+/// Packs files into one asset pack: objs are parsed and bmps decoded up front, everything is LZ4 compressed when it pays off
+/// The files are processed in parallel
+/// </summary>
+/// <param name="pack_path">Where the pack is written</param>
+/// <param name="sources">The files, by the path the loaders ask for</param>
+/// <param name="jobs"></param>
+/// <returns>Whether every file made it into the pack</returns>
+bool BuildAssetPack(const char * pack_path, const std::vector<PackSource> & sources, JobSystem & jobs)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	struct Processed
+	{
+		bool ok;
+		uint32_t size;
+		uint32_t block_count;
+		std::vector<unsigned char> data;
+	};
+	std::vector<Processed> processed(sources.size());
+
+	jobs.ParallelFor(sources.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			std::vector<unsigned char> data;
+			Processed & result = processed[i];
+			result.ok = sources[i].path.size() < PACK_NAME_LENGTH && ProcessSource(sources[i], data);
+			result.size = (uint32_t)data.size();
+			result.block_count = result.ok ? CompressEntry(data, result.data) : 0;
+			if (result.block_count == 0)
+				result.data.swap(data);
+		}
+	});
+
+	bool ok = true;
+	std::vector<PackEntry> entries;
+	std::vector<size_t> sources_of_entries;
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		if (!processed[i].ok)
+		{
+			printf("Skipped %s, it could not be loaded\n", sources[i].path.c_str());
+			ok = false;
+			continue;
+		}
+
+		PackEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		memcpy(entry.name, sources[i].path.c_str(), sources[i].path.size());
+		entry.hash = HashAssetName(entry.name);
+		entry.kind = sources[i].kind;
+		entry.size = processed[i].size;
+		entry.packed_size = (uint32_t)processed[i].data.size();
+		entry.block_count = processed[i].block_count;
+		entries.push_back(entry);
+		sources_of_entries.push_back(i);
+	}
+
+	// Open addressing with at most half of the slots used
+	uint32_t slot_count = 1;
+	while (slot_count < entries.size() * 2)
+		slot_count *= 2;
+	std::vector<uint32_t> slots(slot_count, 0);
+	for (size_t e = 0; e < entries.size(); e++)
+	{
+		uint32_t slot = entries[e].hash & (slot_count - 1);
+		while (slots[slot] != 0)
+			slot = (slot + 1) & (slot_count - 1);
+		slots[slot] = (uint32_t)e + 1;
+	}
+
+	// Header, table of contents and slots first, then the aligned data
+	auto align = [](size_t offset) { return (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT; };
+	PackHeader header;
+	header.magic = PACK_MAGIC;
+	header.version = PACK_VERSION;
+	header.entry_count = (uint32_t)entries.size();
+	header.entry_offset = (uint32_t)align(sizeof(PackHeader));
+	header.slot_count = slot_count;
+	header.slot_offset = (uint32_t)align(header.entry_offset + entries.size() * sizeof(PackEntry));
+
+	size_t offset = align(header.slot_offset + slots.size() * sizeof(uint32_t));
+	size_t raw_size = 0;
+	for (auto & entry : entries)
+	{
+		entry.offset = (uint32_t)offset;
+		offset = align(offset + entry.packed_size);
+		raw_size += entry.size;
+	}
+
+	std::vector<unsigned char> output(offset, 0);
+	memcpy(output.data(), &header, sizeof(header));
+	memcpy(output.data() + header.entry_offset, entries.data(), entries.size() * sizeof(PackEntry));
+	memcpy(output.data() + header.slot_offset, slots.data(), slots.size() * sizeof(uint32_t));
+	for (size_t e = 0; e < entries.size(); e++)
+	{
+		const std::vector<unsigned char> & data = processed[sources_of_entries[e]].data;
+		memcpy(output.data() + entries[e].offset, data.data(), data.size());
+	}
+
+	FILE * file = fopen(pack_path, "wb");
+	if (file == NULL)
+	{
+		printf("Impossible to write %s\n", pack_path);
+		return false;
+	}
+	ok = fwrite(output.data(), 1, output.size(), file) == output.size() && ok;
+	fclose(file);
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	printf("Packed %u files into %s: %.2f MB -> %.2f MB in %.1f ms\n", (unsigned)entries.size(), pack_path,
+		raw_size / (1024.0 * 1024.0), output.size() / (1024.0 * 1024.0), ms);
+	return ok;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "types.h"
+#include "mappedFile.h"
+#include "sceneFile.h"
+#include "jobSystem.h"
+#include "imageDecoder.h"
+
+
+// One file holding every asset, written by the packer and mapped as is at runtime
+// Entries are found through a hash table of their names, their data is 16 byte aligned
+// and compressed entries are split in LZ4 blocks that decompress independently
+const uint32_t PACK_MAGIC = 0x314B4150; // "PAK1"
+const uint32_t PACK_VERSION = 4;
+const int PACK_NAME_LENGTH = 64;
+const size_t PACK_ALIGNMENT = 16;
+const size_t PACK_BLOCK_SIZE = 256 * 1024;
+
+// How the data of an entry is stored
+enum PackKind
+{
+	PACK_RAW,		// The file as is (shaders)
+	PACK_MESH,		// uint32 vertex, index, range, material and path counts, then the arrays of the parsed obj and its texture path
+	PACK_TEXTURE	// uint32 width, height and whether it has alpha, then the decoded rgba pixels (bottom row first)
+};
+
+struct PackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_count;
+	uint32_t entry_offset;
+	uint32_t slot_count;	// Power of two, slot i holds an entry index + 1 or 0 when empty
+	uint32_t slot_offset;
+};
+
+// Compressed entries start with the end offset of every block (relative to the first block)
+struct PackEntry
+{
+	char name[PACK_NAME_LENGTH];
+	uint32_t hash;
+	uint32_t kind;
+	uint32_t offset;
+	uint32_t size;			// Size of the data once decompressed
+	uint32_t packed_size;	// Size in the pack, block table included
+	uint32_t block_count;	// 0 when the data is stored uncompressed
+};
+
+// A file that goes into the pack
+struct PackSource
+{
+	std::string path;
+	PackKind kind;
+};
+
+
+// A mapped asset pack, lookups and reads don't change it so loader threads can share it
+class AssetPack
+{
+private:
+	MappedFile file;
+	const PackHeader * header = nullptr;
+
+	const PackEntry * Entries() const;
+	const unsigned char * Payload(const PackEntry & entry, std::vector<unsigned char> & storage, JobSystem * jobs) const;
+public:
+	bool Open(const char * path);
+	void Close();
+	bool IsOpen() const;
+
+	const PackEntry * Find(const char * name) const;
+	bool Read(const char * name, std::vector<unsigned char> & data, JobSystem * jobs = nullptr) const;
+	bool ReadMesh(const char * name, Mesh & mesh, JobSystem * jobs = nullptr) const;
+	bool ReadTexture(const char * name, Image & image, JobSystem * jobs = nullptr) const;
+};
+
+// The pack the loaders look in before they go to the loose files
+extern AssetPack asset_pack;
+
+uint32_t HashAssetName(const char * name);
+bool ReadLooseFile(const char * path, std::vector<unsigned char> & data);
+void CollectPackSources(const SceneFile & scene, std::vector<PackSource> & sources);
+bool BuildAssetPack(const char * pack_path, const std::vector<PackSource> & sources, JobSystem & jobs);
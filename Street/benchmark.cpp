@@ -0,0 +1,1322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include "jobSystem.h"
+#include "scene.h"
+#include "matrixKernels.h"
+#include "clusteredLights.h"
+#include "objloader.hpp"
+#include "texture.hpp"
+#include "sceneFile.h"
+#include "sceneCompiler.h"
+#include "assetPack.h"
+#include "imageDecoder.h"
+#include "pixelKernels.h"
+#include "mappedFile.h"
+#include "dynamicResolution.h"
+#include "input.h"
+#include "swarm.h"
+#include "animation.h"
+#include "allocationTracker.h"
+#include "frameGraph.h"
+#include "frameScheduler.h"
+#include "stats.h"
+#include "benchmark.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+
+/// <summary>
+/// Milliseconds between two points in time
+/// </summary>
+static double Milliseconds(Clock::time_point start, Clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+
+/// <summary>
+/// Spins an object around its y axis, used to keep a part of the synthetic street moving
+/// </summary>
+/// <param name="transform"></param>
+static void Spin(Transform &transform)
+{
+	transform.Rotate(0.01f, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+
+/// <summary>
+/// Builds a street of houses on both sides, every 50th object is attached to the one before it
+/// and every 100th object is animated
+/// </summary>
+/// <param name="scene"></param>
+/// <param name="count">Amount of objects</param>
+static void CreateSyntheticStreet(Scene & scene, int count)
+{
+	ModelRenderer house("Synthetic house");
+	// A cube around the center, the sphere is the one through its corners
+	const glm::vec3 center = glm::vec3(0.0f, 1.0f, 0.0f);
+	const float radius = 1.5f;
+	const glm::vec3 half = glm::vec3(radius / sqrtf(3.0f));
+	house.bounds = Bounds{ center, radius, center - half, center + half };
+	int mesh = scene.AddMesh(house);
+	int material = scene.AddMaterial(Material{ glm::vec3(0.2f), glm::vec3(0.9f), glm::vec3(1.0f), 128 });
+
+	for (int i = 0; i < count; i++)
+	{
+		glm::vec3 position = glm::vec3((i % 2) ? 10.0f : -10.0f, 0.0f, -(i / 2) * 3.0f);
+		int parent = (i % 50 == 49) ? i - 1 : -1;
+		if (parent >= 0)
+			position = glm::vec3(0.0f, 2.0f, 0.0f);
+
+		int object = scene.AddObject(mesh, material, Transform(position, glm::quat(), glm::vec3(1.0f), parent));
+		if (i % 100 == 0)
+			scene.SetAnimation(object, &Spin);
+	}
+}
+
+
+/// <summary>
+/// Runs the frame update (animation, transforms, culling and draw list) of a 100K object street
+/// on 1..N threads, the camera keeps moving so no mv matrix can be reused
+/// </summary>
+static int BenchJobs()
+{
+	const int objects = 100000;
+	const int frames = 100;
+	const int max_threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	Scene scene;
+	CreateSyntheticStreet(scene, objects);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+
+	printf("Frame update of %d objects, %d frames per run\n", objects, frames);
+	printf("threads    ms/frame    speedup    visible\n");
+
+	double single = 0.0;
+	for (int threads = 1; threads <= max_threads; threads++)
+	{
+		JobSystem jobs;
+		jobs.Start(threads);
+
+		Clock::time_point start = Clock::now();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			glm::vec3 eye = glm::vec3(0.0f, 1.0f, -frame * 10.0f);
+			glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+			scene.Update(view, projection, jobs);
+		}
+		double ms = Milliseconds(start, Clock::now()) / frames;
+		if (threads == 1)
+			single = ms;
+
+		printf("%7d %11.3f %10.2f %10u\n", threads, ms, single / ms, (unsigned)scene.DrawList().size());
+		jobs.Stop();
+	}
+
+	return 0;
+}
+
+
+/// <summary>
+/// Random affine matrix (rotation, non uniform scale and translation)
+/// </summary>
+static glm::mat4 RandomAffine()
+{
+	auto random = [](float min, float max) { return min + (max - min) * (rand() / (float)RAND_MAX); };
+
+	glm::mat4 m = glm::translate(glm::mat4(), glm::vec3(random(-100, 100), random(-100, 100), random(-100, 100)));
+	m = glm::rotate(m, random(0, 6.28f), glm::normalize(glm::vec3(random(-1, 1), random(-1, 1), random(0.1f, 1))));
+	return glm::scale(m, glm::vec3(random(0.2f, 5), random(0.2f, 5), random(0.2f, 5)));
+}
+
+
+/// <summary>
+/// Checks every batch kernel path against glm and measures its throughput
+/// </summary>
+/// <returns>1 when a path doesn't match glm</returns>
+static int BenchMatrix()
+{
+	const size_t count = 1 << 20;
+	const int runs = 10;
+
+	std::vector<glm::mat4> models(count), mvs(count), normals(count);
+	for (auto & model : models)
+		model = RandomAffine();
+	glm::mat4 view = glm::lookAt(glm::vec3(-5, 1, 100), glm::vec3(-5, 1, 99), glm::vec3(0, 1, 0));
+
+	const KernelPath best = DetectKernelPath();
+	int result = 0;
+
+	printf("Batch mv + normal matrix over %u matrices\n", (unsigned)count);
+	printf("path      max error    Mmatrices/s\n");
+	for (int path = KERNEL_SCALAR; path <= best; path++)
+	{
+		SetKernelPath((KernelPath)path);
+
+		// Validate against glm, relative to the size of the values
+		BatchModelView(view, &models[0], sizeof(glm::mat4), &mvs[0], &normals[0], count);
+		float error = 0.0f;
+		for (size_t i = 0; i < count; i += 97)
+		{
+			glm::mat4 mv = view * models[i];
+			glm::mat3 normal = glm::inverseTranspose(glm::mat3(mv));
+			for (int c = 0; c < 4; c++)
+				for (int r = 0; r < 4; r++)
+					error = std::max(error, std::abs(mv[c][r] - mvs[i][c][r]) / (1.0f + std::abs(mv[c][r])));
+			for (int c = 0; c < 3; c++)
+				for (int r = 0; r < 3; r++)
+					error = std::max(error, std::abs(normal[c][r] - normals[i][c][r]) / (1.0f + std::abs(normal[c][r])));
+		}
+
+		Clock::time_point start = Clock::now();
+		for (int run = 0; run < runs; run++)
+			BatchModelView(view, &models[0], sizeof(glm::mat4), &mvs[0], &normals[0], count);
+		double seconds = Milliseconds(start, Clock::now()) / 1000.0;
+
+		const bool valid = error < 1e-3f;
+		if (!valid)
+			result = 1;
+		printf("%-8s %10.2e %14.1f %s\n", KernelPathName((KernelPath)path), error, count * runs / seconds / 1e6, valid ? "" : "MISMATCH");
+	}
+
+	SetKernelPath(best);
+	return result;
+}
+
+
+/// <summary>
+/// Assigns 0..2048 lamp lights along a long street to the clusters
+/// The per pixel cost follows the amount of lights per cluster, which should stay flat while the total grows
+/// </summary>
+static int BenchLights()
+{
+	const int frames = 50;
+	const int width = 800;
+	const int height = 600;
+
+	JobSystem jobs;
+	jobs.Start();
+
+	ClusteredLights clusters;
+	clusters.SetProjection(glm::radians(45.0f), width / (float)height, 0.1f, 100.0f, width, height);
+
+	glm::vec3 eye = glm::vec3(-5.0f, 1.0f, 0.0f);
+	glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	printf("Light assignment, %dx%dx%d clusters, %d threads\n", CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z, jobs.ThreadCount());
+	printf("  lights   assign ms   avg/cluster   max/cluster\n");
+	for (int count = 0; count <= 2048; count = count == 0 ? 16 : count * 2)
+	{
+		// Lamps on both sides of the street, 3 units apart
+		std::vector<LightSource> lights(count);
+		for (int i = 0; i < count; i++)
+		{
+			lights[i].position = glm::vec3((i % 2) ? 0.0f : -10.0f, 2.5f, -(i / 2) * 3.0f);
+			lights[i].color = glm::vec3(1.0f);
+			lights[i].radius = 10.0f;
+		}
+
+		Clock::time_point start = Clock::now();
+		for (int frame = 0; frame < frames; frame++)
+			clusters.Assign(lights, view, jobs);
+		double ms = Milliseconds(start, Clock::now()) / frames;
+
+		printf("%8d %11.3f %13.2f %13u\n", count, ms,
+			clusters.IndexCount() / (double)(CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z), clusters.MaxLightsPerCluster());
+	}
+
+	return 0;
+}
+
+
+/// <summary>
+/// Loads one asset the way the loaders do without a pack
+/// </summary>
+/// <returns>Bytes loaded</returns>
+static size_t LoadLoose(const PackSource & source)
+{
+	if (source.kind == PACK_MESH)
+	{
+		Mesh mesh;
+		loadOBJ(source.path.c_str(), mesh);
+		return mesh.vertices.size() * (2 * sizeof(glm::vec3) + sizeof(glm::vec2)) + mesh.indices.size() * sizeof(unsigned int);
+	}
+
+	if (source.kind == PACK_TEXTURE)
+	{
+		Image image;
+		MappedFile file;
+		if (file.Open(source.path.c_str()))
+			DecodeImage(file.Data(), file.Size(), source.path.c_str(), image);
+		return image.pixels.size();
+	}
+
+	std::vector<unsigned char> data;
+	ReadLooseFile(source.path.c_str(), data);
+	return data.size();
+}
+
+
+/// <summary>
+/// Loads one asset from a pack
+/// </summary>
+/// <returns>Bytes loaded</returns>
+static size_t LoadPacked(const AssetPack & pack, const PackSource & source, JobSystem * jobs)
+{
+	if (source.kind == PACK_MESH)
+	{
+		Mesh mesh;
+		pack.ReadMesh(source.path.c_str(), mesh, jobs);
+		return mesh.vertices.size() * (2 * sizeof(glm::vec3) + sizeof(glm::vec2)) + mesh.indices.size() * sizeof(unsigned int);
+	}
+
+	if (source.kind == PACK_TEXTURE)
+	{
+		Image image;
+		pack.ReadTexture(source.path.c_str(), image, jobs);
+		return image.pixels.size();
+	}
+
+	std::vector<unsigned char> data;
+	pack.Read(source.path.c_str(), data, jobs);
+	return data.size();
+}
+
+
+/// <summary>
+/// Loads every asset of the street (meshes, textures and shaders) from the loose files and from an asset pack
+/// The first pass is the first read in this process, run it right after a reboot (or after flushing the
+/// os standby list) to measure a cold file cache. The second pass is always warm
+/// </summary>
+static int BenchAssets()
+{
+	const char * pack_path = "bench_assets.pak";
+
+	SceneFile scene;
+	if ((IsSceneOutdated("Scenes/street.scene", "Scenes/street.bin") && !CompileScene("Scenes/street.scene", "Scenes/street.bin")) ||
+		!scene.Open("Scenes/street.bin"))
+		return 1;
+
+	JobSystem jobs;
+	jobs.Start();
+
+	std::vector<PackSource> all_sources, sources;
+	CollectPackSources(scene, all_sources);
+	BuildAssetPack(pack_path, all_sources, jobs);
+
+	// Only what made it into the pack, missing files would only measure failed opens
+	{
+		AssetPack pack;
+		if (!pack.Open(pack_path))
+			return 1;
+		for (auto & source : all_sources)
+			if (pack.Find(source.path.c_str()))
+				sources.push_back(source);
+	}
+
+	const char * passes[] = { "first", "warm" };
+	double results[2][3];
+	size_t bytes = 0;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		Clock::time_point start = Clock::now();
+		bytes = 0;
+		for (auto & source : sources)
+			bytes += LoadLoose(source);
+		results[pass][0] = Milliseconds(start, Clock::now());
+
+		// A new mapping every time, opening the pack is part of the startup
+		start = Clock::now();
+		{
+			AssetPack pack;
+			pack.Open(pack_path);
+			for (auto & source : sources)
+				LoadPacked(pack, source, &jobs);
+		}
+		results[pass][1] = Milliseconds(start, Clock::now());
+
+		start = Clock::now();
+		{
+			AssetPack pack;
+			pack.Open(pack_path);
+			jobs.ParallelFor(sources.size(), 1, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++)
+					LoadPacked(pack, sources[i], nullptr);
+			});
+		}
+		results[pass][2] = Milliseconds(start, Clock::now());
+	}
+	remove(pack_path);
+
+	printf("\nStartup asset loading, %u files, %.2f MB, %d threads\n", (unsigned)sources.size(), bytes / (1024.0 * 1024.0), jobs.ThreadCount());
+	printf("  pass     loose ms   pack ms   pack parallel ms\n");
+	for (int pass = 0; pass < 2; pass++)
+		printf("  %-6s %10.2f %9.2f %18.2f\n", passes[pass], results[pass][0], results[pass][1], results[pass][2]);
+	return 0;
+}
+
+
+/// <summary>
+/// Writes rgba pixels (bottom row first) as a bmp, 24 bits or 32 bits with an alpha mask
+/// </summary>
+static std::vector<unsigned char> EncodeBMP(const Image & image, int bits)
+{
+	const size_t header_size = bits == 32 ? 56 : 40;
+	const size_t stride = (image.width * bits + 31) / 32 * 4;
+	const size_t offset = 14 + header_size;
+	std::vector<unsigned char> data(offset + stride * image.height);
+	auto put = [&data](size_t at, uint32_t value) {
+		for (int i = 0; i < 4; i++)
+			data[at + i] = (unsigned char)(value >> (i * 8));
+	};
+	data[0] = 'B';
+	data[1] = 'M';
+	put(2, (uint32_t)data.size());
+	put(10, (uint32_t)offset);
+	put(14, (uint32_t)header_size);
+	put(18, image.width);
+	put(22, image.height);
+	data[26] = 1;
+	data[28] = (unsigned char)bits;
+	if (bits == 32)
+	{
+		put(30, 3);
+		put(54, 0x00FF0000);
+		put(58, 0x0000FF00);
+		put(62, 0x000000FF);
+		put(66, 0xFF000000);
+	}
+
+	for (size_t y = 0; y < image.height; y++)
+		for (size_t x = 0; x < image.width; x++)
+		{
+			const unsigned char * in = &image.pixels[(y * image.width + x) * 4];
+			unsigned char * out = &data[offset + y * stride + x * bits / 8];
+			out[0] = in[2];
+			out[1] = in[1];
+			out[2] = in[0];
+			if (bits == 32)
+				out[3] = in[3];
+		}
+	return data;
+}
+
+
+/// <summary>
+/// Writes rgba pixels (bottom row first) as a 24 or 32 bit tga, optionally run length encoded
+/// </summary>
+static std::vector<unsigned char> EncodeTGA(const Image & image, int bits, bool rle)
+{
+	const size_t pixel_size = bits / 8;
+	std::vector<unsigned char> data(18);
+	data[2] = rle ? 10 : 2;
+	data[12] = (unsigned char)image.width;
+	data[13] = (unsigned char)(image.width >> 8);
+	data[14] = (unsigned char)image.height;
+	data[15] = (unsigned char)(image.height >> 8);
+	data[16] = (unsigned char)bits;
+	data[17] = bits == 32 ? 8 : 0;
+
+	const size_t count = (size_t)image.width * image.height;
+	auto pixel = [&image, pixel_size](size_t i, unsigned char * out) {
+		const unsigned char * in = &image.pixels[i * 4];
+		out[0] = in[2];
+		out[1] = in[1];
+		out[2] = in[0];
+		if (pixel_size == 4)
+			out[3] = in[3];
+	};
+	unsigned char bytes[4];
+	for (size_t i = 0; i < count;)
+	{
+		if (!rle)
+		{
+			pixel(i++, bytes);
+			data.insert(data.end(), bytes, bytes + pixel_size);
+			continue;
+		}
+
+		// Runs of equal pixels, everything else in raw packets of up to 128 pixels
+		size_t run = 1;
+		while (i + run < count && run < 128 && memcmp(&image.pixels[i * 4], &image.pixels[(i + run) * 4], 4) == 0)
+			run++;
+		if (run > 1)
+		{
+			data.push_back((unsigned char)(128 | (run - 1)));
+			pixel(i, bytes);
+			data.insert(data.end(), bytes, bytes + pixel_size);
+			i += run;
+			continue;
+		}
+		size_t raw = 1;
+		while (i + raw < count && raw < 128 && memcmp(&image.pixels[(i + raw - 1) * 4], &image.pixels[(i + raw) * 4], 4) != 0)
+			raw++;
+		data.push_back((unsigned char)(raw - 1));
+		for (size_t k = 0; k < raw; k++)
+		{
+			pixel(i + k, bytes);
+			data.insert(data.end(), bytes, bytes + pixel_size);
+		}
+		i += raw;
+	}
+	return data;
+}
+
+
+/// <summary>
+/// Writes rgba pixels (bottom row first) as an 8 bit rgba png without compression
+/// The deflate stream alternates stored blocks with fixed huffman blocks of literals, so the decoder has to go from
+/// one kind of block to the other many times and every pixel it gets is known
+/// </summary>
+static std::vector<unsigned char> EncodePNG(const Image & image)
+{
+	// Rows without a filter, the top row first
+	const size_t row_size = (size_t)image.width * 4 + 1;
+	std::vector<unsigned char> raw(row_size * image.height);
+	for (size_t y = 0; y < image.height; y++)
+	{
+		raw[y * row_size] = 0;
+		memcpy(&raw[y * row_size + 1], &image.pixels[(image.height - 1 - y) * image.width * 4], image.width * 4);
+	}
+
+	std::vector<unsigned char> zlib = { 0x78, 0x01 };
+	uint64_t bits = 0;
+	int bit_count = 0;
+	auto put = [&](uint32_t value, int count) {
+		bits |= (uint64_t)value << bit_count;
+		for (bit_count += count; bit_count >= 8; bit_count -= 8, bits >>= 8)
+			zlib.push_back((unsigned char)bits);
+	};
+	// Huffman codes go out with their first bit first
+	auto put_code = [&](uint32_t code, int length) {
+		uint32_t reversed = 0;
+		for (int i = 0; i < length; i++)
+			reversed |= ((code >> i) & 1) << (length - 1 - i);
+		put(reversed, length);
+	};
+
+	for (size_t at = 0, block = 0; at < raw.size(); block++)
+	{
+		const bool stored = block % 2 == 0;
+		const size_t size = std::min<size_t>(raw.size() - at, stored ? 40000 : 3001);
+		put(at + size == raw.size() ? 1 : 0, 1);
+		if (stored)
+		{
+			put(0, 2);
+			if (bit_count > 0)
+				put(0, 8 - bit_count);
+			put((uint32_t)size, 16);
+			put((uint32_t)size ^ 0xFFFF, 16);
+			zlib.insert(zlib.end(), raw.begin() + at, raw.begin() + at + size);
+		}
+		else
+		{
+			put(1, 2);
+			for (size_t i = at; i < at + size; i++)
+			{
+				if (raw[i] < 144)
+					put_code(0x30 + raw[i], 8);
+				else
+					put_code(0x190 + raw[i] - 144, 9);
+			}
+			put_code(0, 7);
+		}
+		at += size;
+	}
+	if (bit_count > 0)
+		put(0, 8 - bit_count);
+
+	uint32_t a = 1, b = 0;
+	for (unsigned char byte : raw)
+	{
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	const uint32_t adler = b << 16 | a;
+	for (int i = 3; i >= 0; i--)
+		zlib.push_back((unsigned char)(adler >> (i * 8)));
+
+	std::vector<unsigned char> data = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	auto chunk = [&data](const char * type, const unsigned char * contents, size_t size) {
+		for (int i = 3; i >= 0; i--)
+			data.push_back((unsigned char)(size >> (i * 8)));
+		const size_t start = data.size();
+		data.insert(data.end(), type, type + 4);
+		data.insert(data.end(), contents, contents + size);
+
+		uint32_t crc = 0xFFFFFFFF;
+		for (size_t i = start; i < data.size(); i++)
+		{
+			crc ^= data[i];
+			for (int k = 0; k < 8; k++)
+				crc = (crc >> 1) ^ (0xEDB88320 & (0u - (crc & 1)));
+		}
+		crc ^= 0xFFFFFFFF;
+		for (int i = 3; i >= 0; i--)
+			data.push_back((unsigned char)(crc >> (i * 8)));
+	};
+	const unsigned char header[13] = {
+		(unsigned char)(image.width >> 24), (unsigned char)(image.width >> 16), (unsigned char)(image.width >> 8), (unsigned char)image.width,
+		(unsigned char)(image.height >> 24), (unsigned char)(image.height >> 16), (unsigned char)(image.height >> 8), (unsigned char)image.height,
+		8, 6, 0, 0, 0 };
+	chunk("IHDR", header, sizeof(header));
+	chunk("IDAT", zlib.data(), zlib.size());
+	chunk("IEND", nullptr, 0);
+	return data;
+}
+
+
+/// <summary>
+/// Whether two decoded images hold the same pixels, alpha is skipped for formats without it
+/// </summary>
+static bool SameImage(const Image & a, const Image & b, bool compare_alpha)
+{
+	if (a.width != b.width || a.height != b.height || a.pixels.size() != b.pixels.size())
+		return false;
+	for (size_t i = 0; i < a.pixels.size(); i++)
+		if ((compare_alpha || i % 4 != 3) && a.pixels[i] != b.pixels[i])
+			return false;
+	return true;
+}
+
+
+/// <summary>
+/// Decode rate per format and throughput of the pixel kernels per instruction set, in megapixels per second
+/// The png is the baked house texture, the other formats are encoded from it in memory so they hold the same pixels
+/// The baked png is only timed, it is its own reference, the png encoded in memory is what checks the png decoder
+/// </summary>
+static int BenchImages()
+{
+	const char * png_path = "../Blender/House2/Baked.png";
+	const int runs = 5;
+	int result = 0;
+
+	// Reference pixels, a generated gradient when the png isn't there
+	MappedFile png_file;
+	Image reference;
+	if (!png_file.Open(png_path) || !DecodeImage(png_file.Data(), png_file.Size(), png_path, reference))
+	{
+		png_file.Close();
+		reference = Image();
+		reference.width = reference.height = 1024;
+		reference.has_alpha = true;
+		reference.pixels.resize(1024 * 1024 * 4);
+		for (size_t i = 0; i < reference.pixels.size(); i++)
+			reference.pixels[i] = (unsigned char)((i / 4 % 1024) * (i % 4 + 1) / 16 + (i / 4096) / 8);
+	}
+
+	struct Format
+	{
+		const char * name;
+		const char * path;
+		std::vector<unsigned char> data;
+		bool alpha;
+	};
+	std::vector<Format> formats;
+	if (png_file.Data() != nullptr)
+		formats.push_back(Format{ "png rgba8", png_path, std::vector<unsigned char>(png_file.Data(), png_file.Data() + png_file.Size()), true });
+	formats.push_back(Format{ "png stored", "bench.png", EncodePNG(reference), true });
+	formats.push_back(Format{ "bmp 24", "bench.bmp", EncodeBMP(reference, 24), false });
+	formats.push_back(Format{ "bmp 32", "bench.bmp", EncodeBMP(reference, 32), true });
+	formats.push_back(Format{ "tga 24", "bench.tga", EncodeTGA(reference, 24, false), false });
+	formats.push_back(Format{ "tga 32 rle", "bench.tga", EncodeTGA(reference, 32, true), true });
+
+	const double megapixels = (double)reference.width * reference.height / 1e6;
+	printf("Image decoding, %ux%u, %s kernels\n", reference.width, reference.height, KernelPathName(GetKernelPath()));
+	printf("format        file MB   decode ms       MP/s\n");
+	for (auto & format : formats)
+	{
+		Image image;
+		const bool valid = DecodeImage(format.data.data(), format.data.size(), format.path, image) && SameImage(image, reference, format.alpha);
+		if (!valid)
+			result = 1;
+
+		Clock::time_point start = Clock::now();
+		for (int run = 0; run < runs; run++)
+			DecodeImage(format.data.data(), format.data.size(), format.path, image);
+		const double ms = Milliseconds(start, Clock::now()) / runs;
+		printf("%-12s %8.2f %11.2f %10.1f %s\n", format.name, format.data.size() / (1024.0 * 1024.0), ms, megapixels / (ms / 1000.0), valid ? "" : "MISMATCH");
+	}
+
+	// Every format decoded by every thread at once, the way the loaders decode textures
+	JobSystem jobs;
+	jobs.Start();
+	const size_t copies = std::max(1, jobs.ThreadCount());
+	std::vector<Image> images(formats.size() * copies);
+	Clock::time_point start = Clock::now();
+	jobs.ParallelFor(images.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			const Format & format = formats[i % formats.size()];
+			DecodeImage(format.data.data(), format.data.size(), format.path, images[i]);
+		}
+	});
+	const double parallel_ms = Milliseconds(start, Clock::now());
+	printf("all formats x %u on %d threads: %.2f ms, %.1f MP/s\n", (unsigned)copies, jobs.ThreadCount(), parallel_ms, images.size() * megapixels / (parallel_ms / 1000.0));
+
+	// The kernels on their own, checked against the scalar path
+	const size_t count = (size_t)reference.width * reference.height;
+	std::vector<unsigned char> bgr(count * 3), expected[4], output;
+	for (size_t i = 0; i < count; i++)
+		memcpy(&bgr[i * 3], &reference.pixels[i * 4], 3);
+
+	const KernelPath best = DetectKernelPath();
+	printf("\npath      expand MP/s   swap MP/s   premultiply MP/s   flip MP/s\n");
+	for (int path = KERNEL_SCALAR; path <= best; path++)
+	{
+		SetKernelPath((KernelPath)path);
+		double rates[4];
+		bool valid = true;
+		for (int kernel = 0; kernel < 4; kernel++)
+		{
+			output.resize(count * 4);
+			auto run_kernel = [&]() {
+				if (kernel == 0)
+					ExpandToRGBA(bgr.data(), output.data(), count, true);
+				else if (kernel == 1)
+					SwapRedBlue(output.data(), count);
+				else if (kernel == 2)
+					PremultiplyAlpha(output.data(), count);
+				else
+					FlipRows(output.data(), reference.width * 4, reference.height);
+			};
+
+			// One run from the same input for validation, the timed runs work on their own output
+			if (kernel > 0)
+				output = reference.pixels;
+			run_kernel();
+			if (path == KERNEL_SCALAR)
+				expected[kernel] = output;
+			else if (output != expected[kernel])
+				valid = false;
+
+			start = Clock::now();
+			for (int run = 0; run < runs; run++)
+				run_kernel();
+			rates[kernel] = megapixels / (Milliseconds(start, Clock::now()) / runs / 1000.0);
+		}
+		if (!valid)
+			result = 1;
+		printf("%-8s %12.1f %11.1f %18.1f %11.1f %s\n", KernelPathName((KernelPath)path), rates[0], rates[1], rates[2], rates[3], valid ? "" : "MISMATCH");
+	}
+	SetKernelPath(best);
+	return result;
+}
+
+
+/// <summary>
+/// Runs the resolution controller against a simulated gpu: street level, the heavier eagle eye view and back again
+/// A frame costs a fixed part plus a part that grows with the shaded pixels, with a bit of noise,
+/// its timing reaches the controller two frames later like the timestamp queries do
+/// </summary>
+static int BenchResolution()
+{
+	struct Phase
+	{
+		const char * name;
+		double fixed_ms;
+		double pixel_ms;	// Cost of the pixels at full resolution
+	};
+	const Phase phases[] = {
+		{ "street", 2.0, 4.5 },
+		{ "eagle eye", 3.0, 13.0 },
+		{ "street", 2.0, 4.5 }
+	};
+	const int frames_per_phase = 300;
+	const int latency = 2;
+
+	// Frames a phase may take to get under the budget again
+	const int settle_frames = 30;
+
+	int result = 0;
+	unsigned int seed = 1;
+	printf("Dynamic resolution, %.1f ms budget, %d frames per phase\n", RESOLUTION_TARGET_MS, frames_per_phase);
+	printf("phase        fixed: over budget   dynamic: over budget  settled after  avg scale  min scale   avg ms\n");
+
+	ResolutionController controller;
+	std::vector<double> in_flight;
+	for (const Phase & phase : phases)
+	{
+		int fixed_over = 0;
+		int dynamic_over = 0;
+		int late_over = 0;
+		int settled = -1;
+		float min_scale = RESOLUTION_MAX_SCALE;
+		double scale_sum = 0.0;
+		double ms_sum = 0.0;
+
+		for (int frame = 0; frame < frames_per_phase; frame++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			const double noise = 1.0 + ((seed >> 8) / double(1 << 24) - 0.5) * 0.1;
+
+			const float scale = controller.Scale();
+			const double fixed_ms = (phase.fixed_ms + phase.pixel_ms) * noise;
+			const double dynamic_ms = (phase.fixed_ms + phase.pixel_ms * scale * scale) * noise;
+			fixed_over += fixed_ms > RESOLUTION_TARGET_MS;
+			dynamic_over += dynamic_ms > RESOLUTION_TARGET_MS;
+			if (frame >= settle_frames)
+				late_over += dynamic_ms > RESOLUTION_TARGET_MS;
+			if (settled < 0 && dynamic_ms <= RESOLUTION_TARGET_MS)
+				settled = frame;
+
+			min_scale = std::min(min_scale, scale);
+			scale_sum += scale;
+			ms_sum += dynamic_ms;
+
+			in_flight.push_back(dynamic_ms);
+			if ((int)in_flight.size() > latency)
+			{
+				controller.Update(in_flight.front());
+				in_flight.erase(in_flight.begin());
+			}
+			controller.Record();
+		}
+
+		// Once settled nearly every frame has to fit, unless even the lowest scale doesn't
+		const bool reachable = phase.fixed_ms + phase.pixel_ms * RESOLUTION_MIN_SCALE * RESOLUTION_MIN_SCALE < RESOLUTION_TARGET_MS * 0.9;
+		if (reachable && (settled < 0 || settled > settle_frames || late_over > frames_per_phase / 20))
+			result = 1;
+
+		printf("%-12s %19d %20d %14d %10.3f %10.3f %8.2f\n", phase.name, fixed_over, dynamic_over, settled, scale_sum / frames_per_phase,
+			min_scale, ms_sum / frames_per_phase);
+	}
+	printf("%d scale changes%s\n", controller.Changes(), result ? ", CONTROLLER MISSED THE BUDGET" : "");
+	return result;
+}
+
+
+/// <summary>
+/// Feeds key taps and mouse movement from a thread like the window callbacks would, and samples them every frame
+/// Compares the time the key was held and the distance the mouse moved with what went in, and with polling the
+/// key state once per frame (what GetAsyncKeyState did)
+/// </summary>
+static int BenchInput()
+{
+	const double frame_ms = 10.0;
+	const int taps = 400;
+
+	Input input;
+	std::atomic<bool> done(false);
+	double true_held_ms = 0.0;
+	int true_dx = 0;
+	int true_dy = 0;
+	int mouse_events = 0;
+
+	std::thread producer([&]() {
+		srand(7);
+		int x = 400;
+		int y = 300;
+		input.OnMouseMove(x, y);
+		for (int tap = 0; tap < taps; tap++)
+		{
+			// Taps from a few ms (shorter than a frame) to a few frames, with mouse movement in between
+			const double hold = 2.0 + rand() % 30;
+			const double down = InputTime();
+			input.OnKey('w', true);
+			while (InputTime() - down < hold)
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+			input.OnKey('w', false);
+			true_held_ms += InputTime() - down;
+
+			for (int move = 0; move < 4; move++)
+			{
+				const int dx = rand() % 21 - 10;
+				const int dy = rand() % 21 - 10;
+				x += dx;
+				y += dy;
+				true_dx += dx;
+				true_dy += dy;
+				input.OnMouseMove(x, y);
+				mouse_events++;
+				std::this_thread::sleep_for(std::chrono::microseconds(500));
+			}
+		}
+		done = true;
+	});
+
+	double held_ms = 0.0;
+	double polled_ms = 0.0;
+	double mouse_dx = 0.0;
+	double mouse_dy = 0.0;
+	int frames = 0;
+	double next = InputTime();
+	while (!done)
+	{
+		next += frame_ms;
+		std::this_thread::sleep_for(std::chrono::microseconds((long long)std::max(0.0, (next - InputTime()) * 1000.0)));
+
+		input.Sample(InputTime());
+		held_ms += input.HeldTime('w');
+		if (input.IsDown('w'))
+			polled_ms += frame_ms;
+		mouse_dx += input.MouseX();
+		mouse_dy += input.MouseY();
+		input.Presented(InputTime());
+		frames++;
+	}
+	producer.join();
+	input.Sample(InputTime());
+	held_ms += input.HeldTime('w');
+	mouse_dx += input.MouseX();
+	mouse_dy += input.MouseY();
+
+	const double held_error = 100.0 * fabs(held_ms - true_held_ms) / true_held_ms;
+	const double polled_error = 100.0 * fabs(polled_ms - true_held_ms) / true_held_ms;
+	printf("%d taps of w and %d mouse events over %d frames of %.0f ms\n", taps, mouse_events, frames, frame_ms);
+	printf("key held           %10.1f ms\n", true_held_ms);
+	printf("events, timestamps %10.1f ms %7.2f%% off\n", held_ms, held_error);
+	printf("polled per frame   %10.1f ms %7.2f%% off\n", polled_ms, polled_error);
+	printf("mouse moved        %6d, %6d (sampled %.0f, %.0f)\n", true_dx, true_dy, mouse_dx, mouse_dy);
+	input.PrintLatency();
+
+	const bool ok = held_error < 1.0 && mouse_dx == true_dx && mouse_dy == true_dy;
+	if (!ok)
+		printf("INPUT WAS LOST\n");
+	return ok ? 0 : 1;
+}
+
+
+/// <summary>
+/// Flies swarms of 1K to 64K paper planes and reports the simulation time per frame against the plane count,
+/// scalar on one thread, simd on one thread and simd on every thread
+/// Every path has to end up where the scalar one ends up after a step
+/// </summary>
+/// <returns>1 when a path doesn't match the scalar one</returns>
+static int BenchSwarm()
+{
+	const int counts[] = { 1000, 4000, 16000, 64000 };
+	const int warmup = 5;
+	const int steps = 60;
+	const float dt = 1.0f / 60.0f;
+
+	const KernelPath best = DetectKernelPath();
+	JobSystem single;
+	single.Start(1);
+	JobSystem all;
+	all.Start();
+
+	struct Run
+	{
+		const char * name;
+		KernelPath path;
+		JobSystem * jobs;
+	};
+	const Run runs[] = { { "scalar", KERNEL_SCALAR, &single }, { KernelPathName(best), best, &single }, { "threads", best, &all } };
+
+	printf("Swarm simulation, %d steps, simd path %s, %d threads\n", steps, KernelPathName(best), all.ThreadCount());
+	printf("planes   neighbours   scalar ms   simd ms   threads ms   hash    flock   move    speedup\n");
+	int result = 0;
+	for (int count : counts)
+	{
+		double ms[3] = {};
+		SwarmTimes times = {};
+		std::vector<glm::vec3> reference(count);
+		for (int r = 0; r < 3; r++)
+		{
+			SetKernelPath(runs[r].path);
+			Swarm swarm;
+			swarm.Spawn(count, 1);
+
+			// One step from the same start has to land in the same place on every path
+			swarm.Update(dt, *runs[r].jobs);
+			float error = 0.0f;
+			for (int i = 0; i < count; i++)
+			{
+				if (r == 0)
+					reference[i] = swarm.Position(i);
+				else
+					error = std::max(error, glm::length(swarm.Position(i) - reference[i]));
+			}
+			if (error > 1e-3f)
+			{
+				printf("%s path is %.2e off the scalar one\n", runs[r].name, error);
+				result = 1;
+			}
+
+			for (int step = 1; step < warmup; step++)
+				swarm.Update(dt, *runs[r].jobs);
+
+			SwarmTimes sum = {};
+			Clock::time_point start = Clock::now();
+			for (int step = 0; step < steps; step++)
+			{
+				swarm.Update(dt, *runs[r].jobs);
+				sum.hash_ms += swarm.Times().hash_ms;
+				sum.flock_ms += swarm.Times().flock_ms;
+				sum.integrate_ms += swarm.Times().integrate_ms;
+				sum.neighbours += swarm.Times().neighbours;
+			}
+			ms[r] = Milliseconds(start, Clock::now()) / steps;
+			times = sum;
+		}
+
+		printf("%6d %12.1f %11.3f %9.3f %12.3f %7.3f %7.3f %7.3f %9.1fx\n", count, times.neighbours / steps, ms[0], ms[1], ms[2],
+			times.hash_ms / steps, times.flock_ms / steps, times.integrate_ms / steps, ms[0] / ms[2]);
+	}
+
+	SetKernelPath(best);
+	all.Stop();
+	single.Stop();
+	return result;
+}
+
+
+/// <summary>
+/// A clip with random keys, every channel with its own key count and interpolation
+/// </summary>
+static AnimationClip RandomClip(int index, unsigned int & seed)
+{
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return (seed >> 8) / 16777216.0f;
+	};
+
+	AnimationClip clip;
+	clip.name = "clip" + std::to_string(index);
+	clip.duration = 2.0f + 6.0f * random();
+	clip.loop = index % 4 != 3;
+	for (int c = 0; c < CHANNELS; c++)
+	{
+		AnimationTrack & track = clip.tracks[c];
+		track.interpolation = (Interpolation)((index + c) % 3);
+		const int keys = 16 + (int)(48 * random());
+		for (int k = 0; k < keys; k++)
+		{
+			glm::vec4 value = glm::vec4(random(), random(), random(), random()) * 2.0f - glm::vec4(1.0f);
+			if (c == CHANNEL_POSITION)
+				value = glm::vec4(value.x * 50.0f, value.y * 5.0f, value.z * 50.0f, 0.0f);
+			else if (c == CHANNEL_ROTATION)
+				value = glm::normalize(value);
+			else
+				value = glm::vec4(1.0f + value.x * 0.5f, 1.0f + value.y * 0.5f, 1.0f + value.z * 0.5f, 0.0f);
+			track.times.push_back(clip.duration * k / (keys - 1));
+			track.values.push_back(value);
+		}
+	}
+
+	// One clip leaves its scale to the objects
+	if (index == 5)
+		clip.tracks[CHANNEL_SCALE] = AnimationTrack();
+	return clip;
+}
+
+
+/// <summary>
+/// Plays keyframed clips on 10K objects, a quarter of them cross fading, with the batched animator
+/// on the scalar and simd paths and on all threads, against sampling every object on its own
+/// The batch is checked against the reference sampler first
+/// </summary>
+static int BenchAnimation()
+{
+	const int count = 10000;
+	const int clip_count = 8;
+	const int warmup = 10;
+	const int steps = 240;
+	const float dt = 1.0f / 60.0f;
+
+	const KernelPath best = DetectKernelPath();
+	JobSystem single;
+	single.Start(1);
+	JobSystem all;
+	all.Start();
+
+	unsigned int seed = 1;
+	Animator animator;
+	for (int c = 0; c < clip_count; c++)
+		animator.AddClip(RandomClip(c, seed));
+
+	std::vector<Transform> transforms(count);
+	std::vector<int> clips(count);
+	std::vector<float> starts(count);
+	std::vector<float> speeds(count);
+	for (int i = 0; i < count; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		clips[i] = (seed >> 8) % clip_count;
+		starts[i] = (seed >> 16) / 6553.6f;
+		speeds[i] = 0.5f + (seed & 255) / 255.0f;
+		transforms[i] = Transform(glm::vec3((float)(i % 100), 0.0f, (float)(i / 100)), glm::quat(), glm::vec3(1.0f));
+	}
+
+	auto start_all = [&](Animator & target, bool fades) {
+		for (int i = 0; i < count; i++)
+		{
+			target.Play(i, clips[i], transforms[i], starts[i], speeds[i]);
+			if (fades && i % 4 == 0)
+				target.CrossFade(i, (clips[i] + 1) % clip_count, 2.0f + (i % 7));
+		}
+	};
+
+	printf("Keyframe animation, %d objects, %d clips, simd path %s, %d threads\n", count, clip_count, KernelPathName(best), all.ThreadCount());
+
+	// Without fades every object has to be exactly where the reference sampler puts it
+	int result = 0;
+	for (KernelPath path : { KERNEL_SCALAR, best })
+	{
+		SetKernelPath(path);
+		Animator batch = animator;
+		start_all(batch, false);
+		std::vector<float> times(starts);
+		float position_error = 0.0f;
+		float rotation_error = 0.0f;
+		for (int step = 0; step < 30; step++)
+		{
+			// Now and then a long step, so loops wrap around and the key cursors jump
+			const float seconds = step % 10 == 9 ? 7.3f : dt;
+			batch.Update(seconds, transforms, single);
+			for (int i = 0; i < count; i++)
+			{
+				times[i] += seconds * speeds[i];
+				glm::vec4 base[CHANNELS] = { glm::vec4(glm::vec3((float)(i % 100), 0.0f, (float)(i / 100)), 0.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), glm::vec4(1.0f, 1.0f, 1.0f, 0.0f) };
+				glm::vec4 expected[CHANNELS];
+				animator.Sample(clips[i], times[i], base, expected);
+
+				const glm::quat rotation = transforms[i].GetRotation();
+				const glm::vec4 got = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+				position_error = std::max(position_error, glm::length(transforms[i].GetPosition() - glm::vec3(expected[CHANNEL_POSITION])));
+				position_error = std::max(position_error, glm::length(transforms[i].GetScale() - glm::vec3(expected[CHANNEL_SCALE])));
+				rotation_error = std::max(rotation_error, 1.0f - std::abs(glm::dot(got, expected[CHANNEL_ROTATION])));
+			}
+		}
+		if (position_error > 1e-3f || rotation_error > 1e-4f)
+		{
+			printf("%s path is off the reference: position %.2e, rotation %.2e\n", KernelPathName(path), position_error, rotation_error);
+			result = 1;
+		}
+	}
+
+	printf("path                ms/update   objects/ms   speedup\n");
+
+	// What a callback per object would do: look up every key with a search, blend the fading objects
+	// and write the transform
+	double reference_ms = 0.0;
+	{
+		std::vector<float> times(starts);
+		std::vector<float> fade_times(count, 0.0f);
+		Clock::time_point start;
+		for (int step = 0; step < warmup + steps; step++)
+		{
+			if (step == warmup)
+				start = Clock::now();
+			for (int i = 0; i < count; i++)
+			{
+				const glm::vec3 position = transforms[i].GetPosition();
+				const glm::quat rotation = transforms[i].GetRotation();
+				glm::vec4 base[CHANNELS] = { glm::vec4(position, 0.0f), glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w), glm::vec4(transforms[i].GetScale(), 0.0f) };
+				glm::vec4 sample[CHANNELS];
+				times[i] += dt * speeds[i];
+				animator.Sample(clips[i], times[i], base, sample);
+				if (i % 4 == 0)
+				{
+					glm::vec4 other[CHANNELS];
+					fade_times[i] += dt * speeds[i];
+					animator.Sample((clips[i] + 1) % clip_count, fade_times[i], base, other);
+					const float weight = std::min(fade_times[i] / (2.0f + (i % 7)), 1.0f);
+					for (int c = 0; c < CHANNELS; c++)
+						sample[c] = glm::mix(sample[c], c == CHANNEL_ROTATION && glm::dot(other[c], sample[c]) < 0.0f ? -other[c] : other[c], weight);
+					sample[CHANNEL_ROTATION] = glm::normalize(sample[CHANNEL_ROTATION]);
+				}
+				transforms[i].SetPosition(glm::vec3(sample[CHANNEL_POSITION]));
+				transforms[i].SetRotation(glm::quat(sample[CHANNEL_ROTATION].w, sample[CHANNEL_ROTATION].x, sample[CHANNEL_ROTATION].y, sample[CHANNEL_ROTATION].z));
+				transforms[i].SetScale(glm::vec3(sample[CHANNEL_SCALE]));
+			}
+		}
+		reference_ms = Milliseconds(start, Clock::now()) / steps;
+		printf("%-18s %10.3f %12.0f %8.1fx\n", "per object", reference_ms, count / reference_ms, 1.0);
+	}
+
+	struct Run
+	{
+		const char * name;
+		KernelPath path;
+		JobSystem * jobs;
+	};
+	const Run runs[] = { { "batch scalar", KERNEL_SCALAR, &single }, { best == KERNEL_AVX2 ? "batch avx2" : best == KERNEL_SSE ? "batch sse" : "batch", best, &single },
+		{ "batch threads", best, &all } };
+	for (auto & run : runs)
+	{
+		SetKernelPath(run.path);
+		Animator batch = animator;
+		start_all(batch, true);
+
+		Clock::time_point start;
+		for (int step = 0; step < warmup + steps; step++)
+		{
+			if (step == warmup)
+				start = Clock::now();
+			batch.Update(dt, transforms, *run.jobs);
+		}
+		const double ms = Milliseconds(start, Clock::now()) / steps;
+		printf("%-18s %10.3f %12.0f %8.1fx\n", run.name, ms, count / ms, reference_ms / ms);
+	}
+
+	SetKernelPath(best);
+	all.Stop();
+	single.Stop();
+	return result;
+}
+
+
+/// <summary>
+/// Counts the heap allocations of building a street and of the frames that follow, every part of the frame
+/// that runs without a window is in it: input, animation clips, the swarm, the scene update, the shadow lights, the
+/// redraw decision, the frame graph and the stats
+/// Fails when a frame allocates anything once the first frames warmed the buffers up
+/// </summary>
+static int BenchAllocations()
+{
+	const int objects = 20000;
+	const int planes = 4000;
+	const int warmup = 120;
+	const int frames = 300;
+	const float dt = 1.0f / 60.0f;
+
+	ResetAllocationPeak();
+	const AllocationCounts before = GetAllocationCounts();
+
+	JobSystem jobs;
+	jobs.Start();
+	Scene scene;
+	CreateSyntheticStreet(scene, objects);
+
+	// Every 20th object flies a clip, every 80th one cross fades to a second one
+	unsigned int seed = 1;
+	Animator & animator = scene.GetAnimator();
+	const int clip = animator.AddClip(RandomClip(0, seed));
+	const int other = animator.AddClip(RandomClip(1, seed));
+	for (int i = 1; i < objects; i += 20)
+	{
+		scene.PlayClip(i, clip, i * 0.01f);
+		if (i % 80 == 1)
+			scene.CrossFade(i, other, 10.0f);
+	}
+
+	Swarm swarm;
+	swarm.Spawn(planes, 1);
+	Input input;
+
+	// A few street lights cast shadows of the moving objects, the scheduler bounds them to decide the redraw
+	for (int i = 0; i < 4; i++)
+	{
+		LightSource light;
+		light.position = glm::vec3((i % 2) ? 8.0f : -8.0f, 5.0f, -i * 40.0f);
+		light.radius = 20.0f;
+		scene.AddLight(light);
+	}
+	FrameScheduler scheduler;
+
+	// The graph is described and compiled every frame like the game does, executing it would need gl
+	FrameGraph graph;
+	const TextureDesc color_desc = { 800, 600, GL_RGBA8, 1 };
+	const TextureDesc depth_desc = { 800, 600, GL_DEPTH_COMPONENT24, 1 };
+
+	const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+	auto frame = [&](int index) {
+		input.OnKey('w', index % 30 < 15);
+		input.OnMouseMove(400 + index % 7, 300);
+		input.Sample(index * 16.0);
+
+		glm::vec3 eye = glm::vec3(0.0f, 1.0f, -index * 0.5f);
+		glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		scene.AdvanceAnimations(dt);
+		scene.Update(view, projection, jobs);
+		swarm.Update(dt, jobs);
+		scene.UpdateShadowLights();
+		scheduler.Decide(scene, projection * view, 800, 600, 0, true);
+
+		graph.Reset();
+		const int window = graph.ImportBackBuffer("window", 800, 600);
+		const int color = graph.CreateTexture("color", color_desc);
+		const int depth = graph.CreateTexture("depth", depth_desc);
+		const int resolved = graph.CreateTexture("resolved", color_desc);
+		int pass = graph.AddPass("scene", [view, projection, color, depth](FrameGraph &) {});
+		graph.Write(pass, color, ACCESS_ATTACHMENT);
+		graph.Write(pass, depth, ACCESS_ATTACHMENT);
+		pass = graph.AddPass("post", [color, resolved](FrameGraph &) {});
+		graph.Read(pass, color, ACCESS_SAMPLED);
+		graph.Write(pass, resolved, ACCESS_ATTACHMENT);
+		pass = graph.AddPass("present", [resolved, window](FrameGraph &) {});
+		graph.Read(pass, resolved, ACCESS_SAMPLED);
+		graph.Write(pass, window, ACCESS_ATTACHMENT);
+		graph.Compile();
+
+		stats.EndFrame();
+	};
+	for (int i = 0; i < warmup; i++)
+		frame(i);
+
+	const AllocationCounts startup = AllocationsSince(before);
+	printf("Allocations of %d objects (%d playing clips), %d planes and %d warmup frames, %d threads\n", objects, (int)animator.Count(),
+		planes, warmup, jobs.ThreadCount());
+	PrintAllocations("startup", startup);
+
+	// Steady frames
+	ResetAllocationPeak();
+	size_t allocating_frames = 0;
+	size_t most = 0;
+	const AllocationCounts steady = GetAllocationCounts();
+	for (int i = warmup; i < warmup + frames; i++)
+	{
+		const AllocationCounts start = GetAllocationCounts();
+		frame(i);
+		const AllocationCounts counts = AllocationsSince(start);
+		if (counts.allocations > 0)
+			allocating_frames++;
+		most = std::max(most, counts.allocations);
+	}
+	const AllocationCounts total = AllocationsSince(steady);
+	PrintAllocations("frames", total);
+	printf("%.1f allocations (%.2f KB) per frame, %u of %d frames allocated, at most %u in one\n", total.allocations / (double)frames,
+		total.bytes / 1024.0 / frames, (unsigned)allocating_frames, frames, (unsigned)most);
+
+	jobs.Stop();
+	if (allocating_frames > 0)
+	{
+		printf("Steady frames are not supposed to allocate\n");
+		return 1;
+	}
+	return 0;
+}
+
+
+int RunBenchmark(const char * name)
+{
+	if (strcmp(name, "jobs") == 0)
+		return BenchJobs();
+	if (strcmp(name, "matrix") == 0)
+		return BenchMatrix();
+	if (strcmp(name, "lights") == 0)
+		return BenchLights();
+	if (strcmp(name, "assets") == 0)
+		return BenchAssets();
+	if (strcmp(name, "images") == 0)
+		return BenchImages();
+	if (strcmp(name, "resolution") == 0)
+		return BenchResolution();
+	if (strcmp(name, "input") == 0)
+		return BenchInput();
+	if (strcmp(name, "swarm") == 0)
+		return BenchSwarm();
+	if (strcmp(name, "animation") == 0)
+		return BenchAnimation();
+	if (strcmp(name, "allocs") == 0)
+		return BenchAllocations();
+
+	printf("Unknown benchmark %s, available: jobs, matrix, lights, assets, images, resolution, input, swarm, animation, allocs, aa, idle, framegraph, glstate, storage\n", name);
+	return 1;
+}
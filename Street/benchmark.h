@@ -0,0 +1,5 @@
+#pragma once
+
+// Headless benchmarks, started with: Street.exe --bench <name>
+// Returns the process exit code
+int RunBenchmark(const char * name);
@@ -0,0 +1,87 @@
+#include <algorithm>
+
+#include "blockPool.h"
+
+
+/// <summary>
+/// ctor, no memory is taken until the first allocation
+/// </summary>
+/// <param name="block_size">Bytes of every block, rounded up so every block is aligned like new would align it</param>
+/// <param name="blocks_per_chunk">Blocks the pool grows by</param>
+BlockPool::BlockPool(size_t block_size, size_t blocks_per_chunk) : blocks_per_chunk(std::max<size_t>(1, blocks_per_chunk))
+{
+	const size_t alignment = alignof(max_align_t);
+	this->block_size = (std::max(block_size, sizeof(FreeBlock)) + alignment - 1) & ~(alignment - 1);
+}
+
+
+BlockPool::~BlockPool()
+{
+	for (char * chunk : this->chunks)
+		::operator delete(chunk);
+}
+
+
+/// <summary>
+/// Takes a block from the free list, a new chunk is split into blocks when it is empty
+/// </summary>
+void * BlockPool::Allocate()
+{
+	if (this->free_blocks == nullptr)
+	{
+		char * chunk = (char *)::operator new(this->block_size * this->blocks_per_chunk);
+		this->chunks.push_back(chunk);
+
+		// Linked back to front so the blocks are handed out in address order
+		for (size_t i = this->blocks_per_chunk; i-- > 0;)
+		{
+			FreeBlock * block = (FreeBlock *)(chunk + i * this->block_size);
+			block->next = this->free_blocks;
+			this->free_blocks = block;
+		}
+	}
+
+	FreeBlock * block = this->free_blocks;
+	this->free_blocks = block->next;
+	this->live++;
+	return block;
+}
+
+
+/// <summary>
+/// Gives a block back to the pool it came from
+/// </summary>
+void BlockPool::Free(void * block)
+{
+	if (block == nullptr)
+		return;
+
+	FreeBlock * freed = (FreeBlock *)block;
+	freed->next = this->free_blocks;
+	this->free_blocks = freed;
+	this->live--;
+}
+
+
+size_t BlockPool::BlockSize() const
+{
+	return this->block_size;
+}
+
+
+/// <summary>
+/// Blocks handed out and not freed yet
+/// </summary>
+size_t BlockPool::Live() const
+{
+	return this->live;
+}
+
+
+/// <summary>
+/// Blocks the chunks of the pool hold
+/// </summary>
+size_t BlockPool::Capacity() const
+{
+	return this->chunks.size() * this->blocks_per_chunk;
+}
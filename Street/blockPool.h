@@ -0,0 +1,83 @@
+#pragma once
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+
+// Blocks of one size taken from larger chunks, freed blocks go on a list and are handed out again first
+// Suits many small objects that come and go one at a time, like the nodes of a map or list
+// The chunks are only returned when the pool is destroyed
+class BlockPool
+{
+private:
+	struct FreeBlock
+	{
+		FreeBlock * next;
+	};
+
+	size_t block_size;
+	size_t blocks_per_chunk;
+	std::vector<char *> chunks;
+	FreeBlock * free_blocks = nullptr;
+	size_t live = 0;
+
+	BlockPool(const BlockPool &) = delete;
+	BlockPool & operator=(const BlockPool &) = delete;
+public:
+	BlockPool(size_t block_size, size_t blocks_per_chunk = 1024);
+	~BlockPool();
+
+	void * Allocate();
+	void Free(void * block);
+
+	size_t BlockSize() const;
+	size_t Live() const;
+	size_t Capacity() const;
+};
+
+// Lets a node based container take its nodes from a pool, anything that doesn't fit a block (the bucket array
+// of a hash map) comes from the heap as usual
+template <typename T>
+class PoolAllocator
+{
+public:
+	typedef T value_type;
+
+	BlockPool * pool;
+
+	explicit PoolAllocator(BlockPool & pool) : pool(&pool) {}
+	template <typename U>
+	PoolAllocator(const PoolAllocator<U> & other) : pool(other.pool) {}
+
+	bool Fits(size_t count) const
+	{
+		return count == 1 && sizeof(T) <= this->pool->BlockSize() && alignof(T) <= alignof(max_align_t);
+	}
+
+	T * allocate(size_t count)
+	{
+		if (this->Fits(count))
+			return (T *)this->pool->Allocate();
+		return (T *)::operator new(count * sizeof(T));
+	}
+
+	void deallocate(T * pointer, size_t count)
+	{
+		if (this->Fits(count))
+			this->pool->Free(pointer);
+		else
+			::operator delete(pointer);
+	}
+
+	template <typename U>
+	bool operator==(const PoolAllocator<U> & other) const
+	{
+		return this->pool == other.pool;
+	}
+
+	template <typename U>
+	bool operator!=(const PoolAllocator<U> & other) const
+	{
+		return this->pool != other.pool;
+	}
+};
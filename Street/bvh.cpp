@@ -0,0 +1,330 @@
+#include <assert.h>
+#include <algorithm>
+#include <emmintrin.h>
+
+#include "bvh.h"
+
+// Triangles per leaf before the surface area heuristic is even asked
+const int LEAF_SIZE = 4;
+const int SAH_BINS = 12;
+
+// Deeper nodes become leaves however many triangles they hold, so the traversal stack (one entry per level
+// plus the sibling) never runs out. Clustered or degenerate triangles could otherwise go deeper
+const int MAX_DEPTH = 60;
+const int STACK_SIZE = 64;
+static_assert(MAX_DEPTH + 2 <= STACK_SIZE, "the traversal stack has to fit the deepest node");
+
+
+/// <summary>
+/// Half the surface area of a box
+/// </summary>
+static float HalfArea(const glm::vec3 & min, const glm::vec3 & max)
+{
+	glm::vec3 extent = max - min;
+	return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+
+/// <summary>
+/// Builds the hierarchy
+/// </summary>
+/// <param name="positions">Three world space positions per triangle</param>
+void Bvh::Build(const std::vector<glm::vec3> & positions)
+{
+	const int count = (int)(positions.size() / 3);
+
+	std::vector<glm::vec3> centroids(count), mins(count), maxs(count);
+	this->order.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		const glm::vec3 & a = positions[i * 3 + 0];
+		const glm::vec3 & b = positions[i * 3 + 1];
+		const glm::vec3 & c = positions[i * 3 + 2];
+		mins[i] = glm::min(a, glm::min(b, c));
+		maxs[i] = glm::max(a, glm::max(b, c));
+		centroids[i] = (a + b + c) / 3.0f;
+		this->order[i] = i;
+	}
+
+	this->nodes.clear();
+	this->nodes.reserve(count * 2 + 1);
+	this->nodes.push_back(Node{ glm::vec3(0.0f), 0, glm::vec3(0.0f), count });
+	UpdateBounds(0, mins, maxs);
+	if (count > 0)
+		Subdivide(0, 0, centroids, mins, maxs);
+
+	// Store the triangles in leaf order so a leaf is one contiguous range
+	this->triangles.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		const int t = this->order[i];
+		const glm::vec3 & a = positions[t * 3 + 0];
+		this->triangles[i] = Triangle{ a, positions[t * 3 + 1] - a, positions[t * 3 + 2] - a };
+	}
+}
+
+
+/// <summary>
+/// Fits the box of a node around its triangles
+/// </summary>
+void Bvh::UpdateBounds(int node, const std::vector<glm::vec3> & mins, const std::vector<glm::vec3> & maxs)
+{
+	Node & n = this->nodes[node];
+	n.min = glm::vec3(1e30f);
+	n.max = glm::vec3(-1e30f);
+	for (int i = n.first; i < n.first + n.count; i++)
+	{
+		n.min = glm::min(n.min, mins[this->order[i]]);
+		n.max = glm::max(n.max, maxs[this->order[i]]);
+	}
+}
+
+
+/// <summary>
+/// Splits a node in two at the cheapest binned plane, stops when splitting doesn't pay off or the node is too deep
+/// </summary>
+void Bvh::Subdivide(int node, int depth, const std::vector<glm::vec3> & centroids, const std::vector<glm::vec3> & mins, const std::vector<glm::vec3> & maxs)
+{
+	const int first = this->nodes[node].first;
+	const int count = this->nodes[node].count;
+	if (count <= LEAF_SIZE || depth >= MAX_DEPTH)
+		return;
+
+	glm::vec3 centroid_min = glm::vec3(1e30f);
+	glm::vec3 centroid_max = glm::vec3(-1e30f);
+	for (int i = first; i < first + count; i++)
+	{
+		centroid_min = glm::min(centroid_min, centroids[this->order[i]]);
+		centroid_max = glm::max(centroid_max, centroids[this->order[i]]);
+	}
+
+	int best_axis = -1;
+	int best_split = 0;
+	float best_cost = count * HalfArea(this->nodes[node].min, this->nodes[node].max);
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const float extent = centroid_max[axis] - centroid_min[axis];
+		if (extent <= 0.0f)
+			continue;
+
+		int bin_count[SAH_BINS] = {};
+		glm::vec3 bin_min[SAH_BINS], bin_max[SAH_BINS];
+		for (int b = 0; b < SAH_BINS; b++)
+		{
+			bin_min[b] = glm::vec3(1e30f);
+			bin_max[b] = glm::vec3(-1e30f);
+		}
+
+		const float scale = SAH_BINS / extent;
+		for (int i = first; i < first + count; i++)
+		{
+			const int t = this->order[i];
+			const int b = std::min(SAH_BINS - 1, (int)((centroids[t][axis] - centroid_min[axis]) * scale));
+			bin_count[b]++;
+			bin_min[b] = glm::min(bin_min[b], mins[t]);
+			bin_max[b] = glm::max(bin_max[b], maxs[t]);
+		}
+
+		// Sweep from the right to know the cost of every right side
+		float right_area[SAH_BINS];
+		int right_count[SAH_BINS];
+		glm::vec3 r_min = glm::vec3(1e30f), r_max = glm::vec3(-1e30f);
+		int r_count = 0;
+		for (int b = SAH_BINS - 1; b > 0; b--)
+		{
+			r_count += bin_count[b];
+			r_min = glm::min(r_min, bin_min[b]);
+			r_max = glm::max(r_max, bin_max[b]);
+			right_count[b] = r_count;
+			right_area[b] = r_count > 0 ? HalfArea(r_min, r_max) : 0.0f;
+		}
+
+		glm::vec3 l_min = glm::vec3(1e30f), l_max = glm::vec3(-1e30f);
+		int l_count = 0;
+		for (int b = 0; b < SAH_BINS - 1; b++)
+		{
+			l_count += bin_count[b];
+			l_min = glm::min(l_min, bin_min[b]);
+			l_max = glm::max(l_max, bin_max[b]);
+			if (l_count == 0 || right_count[b + 1] == 0)
+				continue;
+
+			const float cost = l_count * HalfArea(l_min, l_max) + right_count[b + 1] * right_area[b + 1];
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_split = b + 1;
+			}
+		}
+	}
+
+	if (best_axis < 0)
+		return;
+
+	// Partition the triangles on the chosen bin
+	const float scale = SAH_BINS / (centroid_max[best_axis] - centroid_min[best_axis]);
+	int* middle = std::partition(&this->order[first], &this->order[first] + count, [&](int t) {
+		return std::min(SAH_BINS - 1, (int)((centroids[t][best_axis] - centroid_min[best_axis]) * scale)) < best_split;
+	});
+	const int left_count = (int)(middle - &this->order[first]);
+	if (left_count == 0 || left_count == count)
+		return;
+
+	const int left = (int)this->nodes.size();
+	this->nodes.push_back(Node{ glm::vec3(0.0f), first, glm::vec3(0.0f), left_count });
+	this->nodes.push_back(Node{ glm::vec3(0.0f), first + left_count, glm::vec3(0.0f), count - left_count });
+	this->nodes[node].first = left;
+	this->nodes[node].count = 0;
+
+	UpdateBounds(left, mins, maxs);
+	UpdateBounds(left + 1, mins, maxs);
+	Subdivide(left, depth + 1, centroids, mins, maxs);
+	Subdivide(left + 1, depth + 1, centroids, mins, maxs);
+}
+
+
+/// <summary>
+/// Traces four rays at once, a node is entered when any of the active rays hits its box
+/// </summary>
+/// <param name="packet"></param>
+/// <param name="active">Bit mask of the lanes that are in use</param>
+/// <param name="any_hit">Stop a ray at its first hit (shadow rays) instead of looking for the nearest one</param>
+/// <returns>The lanes that hit, with the distance and triangle of the hit</returns>
+PacketHit Bvh::Trace(const RayPacket & packet, int active, bool any_hit) const
+{
+	const __m128 ox = _mm_loadu_ps(packet.origin_x);
+	const __m128 oy = _mm_loadu_ps(packet.origin_y);
+	const __m128 oz = _mm_loadu_ps(packet.origin_z);
+	const __m128 dx = _mm_loadu_ps(packet.dir_x);
+	const __m128 dy = _mm_loadu_ps(packet.dir_y);
+	const __m128 dz = _mm_loadu_ps(packet.dir_z);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 epsilon = _mm_set1_ps(1e-5f);
+	const __m128 idx = _mm_div_ps(one, dx);
+	const __m128 idy = _mm_div_ps(one, dy);
+	const __m128 idz = _mm_div_ps(one, dz);
+
+	__m128 t_max = _mm_loadu_ps(packet.t_max);
+	__m128i hit_triangle = _mm_set1_epi32(-1);
+	int hits = 0;
+
+	PacketHit result;
+	result.hits = 0;
+
+	if (this->nodes.empty() || this->triangles.empty())
+		return result;
+
+	int stack[STACK_SIZE];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0 && active != 0)
+	{
+		const Node & node = this->nodes[stack[--stack_size]];
+
+		// Slab test against the box of the node
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.x), ox), idx);
+		__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.x), ox), idx);
+		__m128 t_near = _mm_min_ps(t1, t2);
+		__m128 t_far = _mm_max_ps(t1, t2);
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.y), oy), idy);
+		t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.y), oy), idy);
+		t_near = _mm_max_ps(t_near, _mm_min_ps(t1, t2));
+		t_far = _mm_min_ps(t_far, _mm_max_ps(t1, t2));
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.z), oz), idz);
+		t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.z), oz), idz);
+		t_near = _mm_max_ps(_mm_max_ps(t_near, _mm_min_ps(t1, t2)), zero);
+		t_far = _mm_min_ps(_mm_min_ps(t_far, _mm_max_ps(t1, t2)), t_max);
+
+		if ((_mm_movemask_ps(_mm_cmple_ps(t_near, t_far)) & active) == 0)
+			continue;
+
+		if (node.count == 0)
+		{
+			assert(stack_size + 2 <= STACK_SIZE);
+			stack[stack_size++] = node.first + 1;
+			stack[stack_size++] = node.first;
+			continue;
+		}
+
+		for (int i = node.first; i < node.first + node.count; i++)
+		{
+			const Triangle & tri = this->triangles[i];
+			const __m128 e1x = _mm_set1_ps(tri.e1.x), e1y = _mm_set1_ps(tri.e1.y), e1z = _mm_set1_ps(tri.e1.z);
+			const __m128 e2x = _mm_set1_ps(tri.e2.x), e2y = _mm_set1_ps(tri.e2.y), e2z = _mm_set1_ps(tri.e2.z);
+
+			// Moller-Trumbore, one triangle against four rays
+			__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+			__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+			__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+			__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+			__m128 inv_det = _mm_div_ps(one, det);
+
+			__m128 tx = _mm_sub_ps(ox, _mm_set1_ps(tri.v0.x));
+			__m128 ty = _mm_sub_ps(oy, _mm_set1_ps(tri.v0.y));
+			__m128 tz = _mm_sub_ps(oz, _mm_set1_ps(tri.v0.z));
+			__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+
+			__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+			__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+			__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+			__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+			__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+			const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+			__m128 hit = _mm_cmpgt_ps(_mm_and_ps(det, abs_mask), _mm_set1_ps(1e-10f));
+			hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+			hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+			hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+			hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, epsilon));
+			hit = _mm_and_ps(hit, _mm_cmplt_ps(t, t_max));
+
+			const int mask = _mm_movemask_ps(hit) & active;
+			if (mask == 0)
+				continue;
+
+			// Keep the closer hits
+			const __m128 lanes = _mm_castsi128_ps(_mm_set_epi32((mask & 8) ? -1 : 0, (mask & 4) ? -1 : 0, (mask & 2) ? -1 : 0, (mask & 1) ? -1 : 0));
+			t_max = _mm_or_ps(_mm_and_ps(lanes, t), _mm_andnot_ps(lanes, t_max));
+			hit_triangle = _mm_castps_si128(_mm_or_ps(_mm_and_ps(lanes, _mm_castsi128_ps(_mm_set1_epi32(i))), _mm_andnot_ps(lanes, _mm_castsi128_ps(hit_triangle))));
+			hits |= mask;
+
+			if (any_hit)
+			{
+				active &= ~mask;
+				if (active == 0)
+					break;
+			}
+		}
+	}
+
+	result.hits = hits;
+	_mm_storeu_ps(result.t, t_max);
+	_mm_storeu_si128((__m128i *)result.triangle, hit_triangle);
+	return result;
+}
+
+
+/// <summary>
+/// Geometric normal of a triangle as returned by Trace
+/// </summary>
+glm::vec3 Bvh::Normal(int triangle) const
+{
+	const Triangle & tri = this->triangles[triangle];
+	return glm::normalize(glm::cross(tri.e1, tri.e2));
+}
+
+
+size_t Bvh::TriangleCount() const
+{
+	return this->triangles.size();
+}
+
+
+size_t Bvh::NodeCount() const
+{
+	return this->nodes.size();
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+
+// Four rays traced together, stored per component so every lane is one ray
+struct RayPacket
+{
+	float origin_x[4], origin_y[4], origin_z[4];
+	float dir_x[4], dir_y[4], dir_z[4];
+	float t_max[4];
+};
+
+// Result of tracing a packet, hits is a bit mask of the lanes that hit something
+struct PacketHit
+{
+	int hits;
+	float t[4];
+	int triangle[4];
+};
+
+// Bounding volume hierarchy over a triangle soup, built with the surface area heuristic
+class Bvh
+{
+private:
+	struct Node
+	{
+		glm::vec3 min;
+		int first;	// First triangle of a leaf, or the left child (the right one follows it)
+		glm::vec3 max;
+		int count;	// Amount of triangles, 0 for an inner node
+	};
+
+	struct Triangle
+	{
+		glm::vec3 v0;
+		glm::vec3 e1;
+		glm::vec3 e2;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<Triangle> triangles;
+	std::vector<int> order;
+
+	void Subdivide(int node, int depth, const std::vector<glm::vec3> & centroids, const std::vector<glm::vec3> & mins, const std::vector<glm::vec3> & maxs);
+	void UpdateBounds(int node, const std::vector<glm::vec3> & mins, const std::vector<glm::vec3> & maxs);
+public:
+	void Build(const std::vector<glm::vec3> & positions);
+	PacketHit Trace(const RayPacket & packet, int active, bool any_hit) const;
+	glm::vec3 Normal(int triangle) const;
+
+	size_t TriangleCount() const;
+	size_t NodeCount() const;
+};
@@ -0,0 +1,482 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <set>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "stats.h"
+#include "chunkStreamer.h"
+
+// Meshes uploaded per frame, the rest waits so a frame never uploads the whole street
+const int UPLOADS_PER_FRAME = 1;
+
+// Frames between two samples of the resident memory of the process, the first frame takes one
+const long long RESIDENT_SAMPLE_FRAMES = 60;
+
+/// <summary>
+/// ctor
+/// </summary>
+/// <param name="scene">The scene the chunks are added to</param>
+ChunkStreamer::ChunkStreamer(Scene & scene) : scene(scene)
+{
+}
+
+
+ChunkStreamer::~ChunkStreamer()
+{
+	this->Stop();
+}
+
+
+/// <summary>
+/// Takes the meshes and rows of a scene file and starts the loader threads
+/// The file has to stay open while the streamer runs
+/// </summary>
+/// <param name="file">The compiled scene</param>
+/// <param name="material_base">Scene index of the first material of the file</param>
+/// <param name="thread_count">Amount of loader threads</param>
+void ChunkStreamer::Start(const SceneFile & file, int material_base, int thread_count)
+{
+	this->file = &file;
+	this->material_base = material_base;
+
+	for (size_t i = 0; i < file.MeshCount(); i++)
+	{
+		const SceneMesh & mesh = file.GetMesh(i);
+		this->assets.push_back(Asset{ mesh.name, mesh.object_path, mesh.texture_path[0] ? mesh.texture_path : nullptr, ASSET_UNLOADED, nullptr, -1, 0, 0, 0 });
+	}
+
+	this->running = true;
+	for (int i = 0; i < thread_count; i++)
+		this->threads.push_back(std::thread(&ChunkStreamer::LoaderLoop, this));
+}
+
+
+/// <summary>
+/// Stops the loader threads, work that is still queued is dropped
+/// </summary>
+void ChunkStreamer::Stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(this->request_lock);
+		this->running = false;
+		this->requests.clear();
+	}
+	this->wake.notify_all();
+
+	for (auto & thread : this->threads)
+		thread.join();
+	this->threads.clear();
+}
+
+
+/// <summary>
+/// Amount of chunks in front of and behind the player that are kept loaded
+/// </summary>
+/// <param name="chunks"></param>
+void ChunkStreamer::SetRadius(int chunks)
+{
+	this->radius = std::max(0, chunks);
+}
+
+
+/// <summary>
+/// Bytes the streamed meshes and objects may use, cached meshes are evicted first and
+/// no new chunks are loaded while the budget is exceeded
+/// </summary>
+/// <param name="bytes"></param>
+void ChunkStreamer::SetMemoryBudget(size_t bytes)
+{
+	this->memory_budget = bytes;
+}
+
+
+/// <summary>
+/// Bytes used by the meshes (resident and waiting for upload) and the objects of the loaded chunks
+/// </summary>
+size_t ChunkStreamer::ResidentBytes() const
+{
+	size_t bytes = 0;
+	for (auto & asset : this->assets)
+	{
+		if (asset.state == ASSET_RESIDENT)
+			bytes += asset.bytes;
+		else if (asset.state == ASSET_PARSED)
+			bytes += asset.parsed->MemoryBytes();
+	}
+
+	for (auto & chunk : this->chunks)
+		bytes += chunk.second.objects.size() * this->scene.BytesPerObject();
+	return bytes;
+}
+
+
+/// <summary>
+/// Runs queued work until the streamer stops
+/// </summary>
+void ChunkStreamer::LoaderLoop()
+{
+	while (true)
+	{
+		std::function<void()> work;
+		{
+			std::unique_lock<std::mutex> guard(this->request_lock);
+			this->wake.wait(guard, [this] { return !this->running || !this->requests.empty(); });
+			if (!this->running)
+				return;
+
+			work = std::move(this->requests.front());
+			this->requests.pop_front();
+		}
+		work();
+	}
+}
+
+
+/// <summary>
+/// Queues work for the loader threads
+/// </summary>
+void ChunkStreamer::Load(std::function<void()> work)
+{
+	{
+		std::lock_guard<std::mutex> guard(this->request_lock);
+		this->requests.push_back(std::move(work));
+	}
+	this->wake.notify_one();
+}
+
+
+/// <summary>
+/// Hands the result of a loader back, it runs on the glut thread during the next Update
+/// </summary>
+void ChunkStreamer::Finish(std::function<void()> result)
+{
+	std::lock_guard<std::mutex> guard(this->result_lock);
+	this->results.push_back(std::move(result));
+}
+
+
+/// <summary>
+/// Lays out a chunk, every row of the scene file puts its copies whose position falls in the chunk
+/// </summary>
+/// <param name="index">Chunk index, chunk i covers z from i * CHUNK_LENGTH</param>
+/// <param name="instances">Receives the objects</param>
+/// <param name="lights">Receives the lights of the rows that give light</param>
+void ChunkStreamer::BuildChunk(int index, std::vector<ChunkInstance> & instances, std::vector<LightSource> & lights) const
+{
+	const float start = index * CHUNK_LENGTH;
+	const float end = start + CHUNK_LENGTH;
+
+	for (size_t r = 0; r < this->file->RowCount(); r++)
+	{
+		const SceneRow & row = this->file->GetRow(r);
+		const Transform origin = SceneFile::ToTransform(row.transform);
+		const float z = row.transform.position[2];
+
+		const double first = std::max((double)row.first, ceil((double)(start - z) / row.spacing));
+		const double last = std::min((double)row.last, ceil((double)(end - z) / row.spacing) - 1.0);
+		for (double k = first; k <= last; k++)
+		{
+			const int material = SceneFile::RowMaterial(row, (int)k);
+			Transform transform = origin;
+			transform.SetPosition(origin.GetPosition() + glm::vec3(0.0f, 0.0f, (float)k * row.spacing));
+			instances.push_back(ChunkInstance{ (int)row.mesh, this->material_base + material, transform, (unsigned char)row.flags });
+
+			if (row.light_radius > 0.0f)
+			{
+				LightSource light;
+				light.position = transform.GetPosition() + glm::vec3(row.light_offset[0], row.light_offset[1], row.light_offset[2]);
+				light.color = this->file->GetMaterial(material).diffuse_color;
+				light.radius = row.light_radius;
+				lights.push_back(light);
+			}
+		}
+	}
+}
+
+
+/// <summary>
+/// Starts building a chunk on a loader thread
+/// </summary>
+/// <param name="index"></param>
+void ChunkStreamer::RequestChunk(int index)
+{
+	Chunk & chunk = this->chunks[index];
+	chunk.state = CHUNK_BUILDING;
+	chunk.requested = Clock::now();
+
+	this->Load([this, index]() {
+		std::vector<ChunkInstance> instances;
+		std::vector<LightSource> lights;
+		this->BuildChunk(index, instances, lights);
+
+		this->Finish([this, index, instances, lights]() {
+			// The chunk may have been unloaded (or requested again) in the meantime
+			auto it = this->chunks.find(index);
+			if (it == this->chunks.end() || it->second.state != CHUNK_BUILDING)
+				return;
+
+			Chunk & chunk = it->second;
+			chunk.instances = instances;
+			chunk.lights = lights;
+			chunk.state = CHUNK_WAITING;
+
+			std::set<int> used;
+			for (auto & instance : instances)
+				used.insert(instance.asset);
+			for (int asset : used)
+			{
+				chunk.assets.push_back(asset);
+				this->assets[asset].references++;
+				this->RequestAsset(asset);
+			}
+		});
+	});
+}
+
+
+/// <summary>
+/// Starts parsing a mesh and reading its texture on a loader thread, unless it is already there
+/// </summary>
+/// <param name="asset"></param>
+void ChunkStreamer::RequestAsset(int asset)
+{
+	if (this->assets[asset].state != ASSET_UNLOADED)
+		return;
+	this->assets[asset].state = ASSET_LOADING;
+
+	const char * name = this->assets[asset].name;
+	const char * object_path = this->assets[asset].object_path;
+	const char * texture_path = this->assets[asset].texture_path;
+	this->Load([this, asset, name, object_path, texture_path]() {
+		std::shared_ptr<ModelRenderer> mesh = std::make_shared<ModelRenderer>(name);
+		mesh->ParseObject(object_path);
+		mesh->SetTexture(texture_path);
+
+		this->Finish([this, asset, mesh]() {
+			this->assets[asset].parsed = mesh;
+			this->assets[asset].state = ASSET_PARSED;
+		});
+	});
+}
+
+
+/// <summary>
+/// Uploads parsed meshes, a limited amount per frame unless the streamer is flushing
+/// </summary>
+void ChunkStreamer::UploadAssets()
+{
+	int uploads = 0;
+	for (auto & asset : this->assets)
+	{
+		if (asset.state != ASSET_PARSED)
+			continue;
+		if (!this->flushing && uploads >= UPLOADS_PER_FRAME)
+			break;
+
+		std::string key = std::string(asset.object_path) + "|" + (asset.texture_path ? asset.texture_path : "");
+		asset.mesh = this->scene.UploadMesh(*asset.parsed, key);
+		asset.bytes = this->scene.GetMesh(asset.mesh).MemoryBytes();
+		asset.parsed.reset();
+		asset.state = ASSET_RESIDENT;
+		asset.last_used = this->frame;
+		uploads++;
+	}
+	stats.Add("stream uploads", uploads);
+}
+
+
+/// <summary>
+/// Adds the objects and lights of a chunk to the scene once all its meshes are resident
+/// </summary>
+/// <returns>Whether the chunk is resident now</returns>
+bool ChunkStreamer::InstantiateChunk(int index, Chunk & chunk)
+{
+	for (int asset : chunk.assets)
+		if (this->assets[asset].state != ASSET_RESIDENT)
+			return false;
+
+	for (auto & instance : chunk.instances)
+		chunk.objects.push_back(this->scene.AddObject(this->assets[instance.asset].mesh, instance.material, instance.transform, instance.flags));
+	chunk.instances = std::vector<ChunkInstance>();
+	chunk.state = CHUNK_RESIDENT;
+	this->lights_changed = true;
+
+	double ms = std::chrono::duration<double, std::milli>(Clock::now() - chunk.requested).count();
+	stats.Add("chunk load ms", ms);
+	if (stats.IsEnabled())
+		printf("Chunk %d loaded in %.2f ms (%u objects)\n", index, ms, (unsigned)chunk.objects.size());
+	return true;
+}
+
+
+/// <summary>
+/// Removes the objects of a chunk and lets go of its meshes, they stay cached until the budget needs the memory
+/// </summary>
+void ChunkStreamer::UnloadChunk(Chunk & chunk)
+{
+	for (int object : chunk.objects)
+		this->scene.RemoveObject(object);
+	if (!chunk.objects.empty())
+		this->lights_changed = true;
+
+	for (int asset : chunk.assets)
+	{
+		this->assets[asset].references--;
+		this->assets[asset].last_used = this->frame;
+	}
+}
+
+
+/// <summary>
+/// Releases the least recently used meshes no chunk uses until the streamer is within its budget again
+/// </summary>
+void ChunkStreamer::EvictAssets()
+{
+	while (this->ResidentBytes() > this->memory_budget)
+	{
+		Asset * victim = nullptr;
+		for (auto & asset : this->assets)
+			if (asset.state == ASSET_RESIDENT && asset.references == 0 && (!victim || asset.last_used < victim->last_used))
+				victim = &asset;
+		if (!victim)
+			return;
+
+		this->scene.ReleaseMesh(victim->mesh);
+		victim->state = ASSET_UNLOADED;
+		victim->mesh = -1;
+		victim->bytes = 0;
+	}
+}
+
+
+/// <summary>
+/// Gives the scene the lights of all resident chunks, the closest chunks first so they get the shadow maps
+/// </summary>
+/// <param name="center">The chunk the player is in</param>
+void ChunkStreamer::RebuildLights(int center)
+{
+	std::vector<int> order;
+	for (auto & chunk : this->chunks)
+		if (chunk.second.state == CHUNK_RESIDENT)
+			order.push_back(chunk.first);
+	std::sort(order.begin(), order.end(), [center](int a, int b) { return abs(a - center) < abs(b - center); });
+
+	this->scene.ClearLights();
+	for (int index : order)
+		for (auto & light : this->chunks[index].lights)
+			this->scene.AddLight(light);
+	this->lights_changed = false;
+}
+
+
+/// <summary>
+/// Handles the finished loads, uploads, unloads the chunks that went out of range and requests the new ones
+/// Runs on the glut thread every frame
+/// </summary>
+/// <param name="position">Position of the player</param>
+void ChunkStreamer::Update(const glm::vec3 & position)
+{
+	Clock::time_point start = Clock::now();
+	this->frame++;
+
+	std::vector<std::function<void()>> finished;
+	{
+		std::lock_guard<std::mutex> guard(this->result_lock);
+		finished.swap(this->results);
+	}
+	for (auto & result : finished)
+		result();
+
+	this->UploadAssets();
+
+	const int center = (int)floorf(position.z / CHUNK_LENGTH);
+	for (auto it = this->chunks.begin(); it != this->chunks.end();)
+	{
+		if (abs(it->first - center) > this->radius)
+		{
+			this->UnloadChunk(it->second);
+			it = this->chunks.erase(it);
+		}
+		else
+		{
+			if (it->second.state == CHUNK_WAITING)
+				this->InstantiateChunk(it->first, it->second);
+			++it;
+		}
+	}
+
+	this->EvictAssets();
+
+	// Closest chunks first, nothing new while the budget is exceeded
+	bool over_budget = false;
+	for (int distance = 0; distance <= this->radius && !over_budget; distance++)
+	{
+		for (int index : { center - distance, center + distance })
+		{
+			if (this->chunks.count(index))
+				continue;
+			if (this->ResidentBytes() > this->memory_budget)
+			{
+				over_budget = true;
+				break;
+			}
+			this->RequestChunk(index);
+		}
+	}
+
+	if (this->lights_changed)
+		this->RebuildLights(center);
+
+	int resident = 0;
+	for (auto & chunk : this->chunks)
+		if (chunk.second.state == CHUNK_RESIDENT)
+			resident++;
+
+	stats.Add("chunks resident", resident);
+	stats.Add("chunks loading", (double)(this->chunks.size() - resident));
+	stats.Add("stream over budget", over_budget ? 1.0 : 0.0);
+	stats.Add("stream resident MB", this->ResidentBytes() / (1024.0 * 1024.0));
+	if (this->frame % RESIDENT_SAMPLE_FRAMES == 1)
+		this->process_resident = GetResidentMemory();
+	stats.Add("process resident MB", this->process_resident / (1024.0 * 1024.0));
+	stats.Add("stream main thread ms", std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+}
+
+
+/// <summary>
+/// Whether chunks are still on their way, Update has to keep running until they are in the scene
+/// </summary>
+bool ChunkStreamer::IsBusy() const
+{
+	for (auto & chunk : this->chunks)
+		if (chunk.second.state != CHUNK_RESIDENT)
+			return true;
+	return false;
+}
+
+
+/// <summary>
+/// Loads every chunk in range before returning, used before the first frame so the street is there right away
+/// </summary>
+/// <param name="position">Position of the player</param>
+void ChunkStreamer::Flush(const glm::vec3 & position)
+{
+	this->flushing = true;
+	while (true)
+	{
+		this->Update(position);
+
+		bool pending = false;
+		for (auto & chunk : this->chunks)
+			pending = pending || chunk.second.state != CHUNK_RESIDENT;
+		if (!pending)
+			break;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	this->flushing = false;
+}
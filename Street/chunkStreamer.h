@@ -0,0 +1,112 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include "scene.h"
+#include "sceneFile.h"
+
+
+// Length of a chunk along the street (the z axis)
+const float CHUNK_LENGTH = 25.0f;
+
+// An object of a chunk, it refers to its mesh by asset (mesh of the scene file) until the asset is resident
+struct ChunkInstance
+{
+	int asset;
+	int material;
+	Transform transform;
+	unsigned char flags;
+};
+
+// Splits the rows of a scene file in chunks along z and keeps the chunks around the player loaded
+// Geometry, textures and instances are prepared on loader threads, the glut thread only uploads a mesh
+// and adds the objects. Meshes no chunk uses anymore stay cached until the memory budget runs out
+class ChunkStreamer
+{
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	enum AssetState { ASSET_UNLOADED, ASSET_LOADING, ASSET_PARSED, ASSET_RESIDENT };
+	struct Asset
+	{
+		const char * name;
+		const char * object_path;
+		const char * texture_path;
+		AssetState state;
+		std::shared_ptr<ModelRenderer> parsed;
+		int mesh;
+		int references;
+		size_t bytes;
+		long long last_used;
+	};
+
+	enum ChunkState { CHUNK_BUILDING, CHUNK_WAITING, CHUNK_RESIDENT };
+	struct Chunk
+	{
+		ChunkState state;
+		std::vector<ChunkInstance> instances;
+		std::vector<LightSource> lights;
+		std::vector<int> assets;
+		std::vector<int> objects;
+		Clock::time_point requested;
+	};
+
+	Scene & scene;
+	const SceneFile * file = nullptr;
+	std::vector<Asset> assets;
+	std::map<int, Chunk> chunks;
+
+	// Scene index of the first material of the file
+	int material_base = 0;
+
+	int radius = 4;
+	size_t memory_budget = 256 * 1024 * 1024;
+	long long frame = 0;
+	bool flushing = false;
+
+	// Resident memory of the process for the stats, asking the os costs a file read so it is sampled now and then
+	size_t process_resident = 0;
+	bool lights_changed = false;
+
+	// Loader threads and the results they hand back to the glut thread
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> requests;
+	std::vector<std::function<void()>> results;
+	std::mutex request_lock;
+	std::mutex result_lock;
+	std::condition_variable wake;
+	bool running = false;
+
+	void LoaderLoop();
+	void Load(std::function<void()> work);
+	void Finish(std::function<void()> result);
+
+	void BuildChunk(int index, std::vector<ChunkInstance> & instances, std::vector<LightSource> & lights) const;
+	void RequestChunk(int index);
+	void RequestAsset(int asset);
+	void UploadAssets();
+	bool InstantiateChunk(int index, Chunk & chunk);
+	void UnloadChunk(Chunk & chunk);
+	void EvictAssets();
+	void RebuildLights(int center);
+public:
+	ChunkStreamer(Scene & scene);
+	~ChunkStreamer();
+
+	void Start(const SceneFile & file, int material_base, int thread_count = 2);
+	void Stop();
+	void SetRadius(int chunks);
+	void SetMemoryBudget(size_t bytes);
+	size_t ResidentBytes() const;
+
+	void Update(const glm::vec3 & position);
+	bool IsBusy() const;
+	void Flush(const glm::vec3 & position);
+};
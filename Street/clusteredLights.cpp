@@ -0,0 +1,241 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "clusteredLights.h"
+#include "glState.h"
+
+
+/// <summary>
+/// ctor
+/// </summary>
+ClusteredLights::ClusteredLights()
+{
+	this->grid.resize(CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z);
+	this->slice_lists.resize(CLUSTERS_Z, std::vector<std::vector<unsigned int>>(CLUSTERS_X * CLUSTERS_Y));
+}
+
+
+/// <summary>
+/// Distance from the eye to the near side of a depth slice
+/// </summary>
+/// <param name="slice"></param>
+/// <returns></returns>
+float ClusteredLights::SliceDepth(int slice) const
+{
+	return this->near_plane * powf(this->far_plane / this->near_plane, slice / (float)CLUSTERS_Z);
+}
+
+
+/// <summary>
+/// Sets the projection the clusters are built for, the cluster boxes are only rebuilt when it changed
+/// </summary>
+/// <param name="fov">Vertical field of view in radians</param>
+/// <param name="aspect"></param>
+/// <param name="near_plane"></param>
+/// <param name="far_plane"></param>
+/// <param name="width">Width of the framebuffer in pixels</param>
+/// <param name="height">Height of the framebuffer in pixels</param>
+void ClusteredLights::SetProjection(float fov, float aspect, float near_plane, float far_plane, int width, int height)
+{
+	const float tan_half_fov = tanf(fov * 0.5f);
+	if (tan_half_fov == this->tan_half_fov && aspect == this->aspect && near_plane == this->near_plane
+		&& far_plane == this->far_plane && width == this->width && height == this->height)
+		return;
+
+	this->tan_half_fov = tan_half_fov;
+	this->aspect = aspect;
+	this->near_plane = near_plane;
+	this->far_plane = far_plane;
+	this->width = width;
+	this->height = height;
+	BuildClusters();
+}
+
+
+/// <summary>
+/// Calculates the view space bounding box of every cluster
+/// The box spans the four corner rays of the screen tile between the near and far depth of the slice
+/// </summary>
+void ClusteredLights::BuildClusters()
+{
+	this->cluster_min.resize(this->grid.size());
+	this->cluster_max.resize(this->grid.size());
+
+	for (int z = 0; z < CLUSTERS_Z; z++)
+	{
+		const float depths[2] = { SliceDepth(z), SliceDepth(z + 1) };
+
+		for (int y = 0; y < CLUSTERS_Y; y++)
+		{
+			for (int x = 0; x < CLUSTERS_X; x++)
+			{
+				// Tile corners in normalized device coordinates
+				const float ndc_x[2] = { -1.0f + 2.0f * x / CLUSTERS_X, -1.0f + 2.0f * (x + 1) / CLUSTERS_X };
+				const float ndc_y[2] = { -1.0f + 2.0f * y / CLUSTERS_Y, -1.0f + 2.0f * (y + 1) / CLUSTERS_Y };
+
+				glm::vec3 min = glm::vec3(1e30f);
+				glm::vec3 max = glm::vec3(-1e30f);
+				for (float depth : depths)
+					for (float nx : ndc_x)
+						for (float ny : ndc_y)
+						{
+							glm::vec3 corner = glm::vec3(nx * depth * this->tan_half_fov * this->aspect, ny * depth * this->tan_half_fov, -depth);
+							min = glm::min(min, corner);
+							max = glm::max(max, corner);
+						}
+
+				const int index = x + y * CLUSTERS_X + z * CLUSTERS_X * CLUSTERS_Y;
+				this->cluster_min[index] = min;
+				this->cluster_max[index] = max;
+			}
+		}
+	}
+}
+
+
+/// <summary>
+/// Collects the lights that touch the clusters of one depth slice
+/// </summary>
+/// <param name="slice"></param>
+void ClusteredLights::AssignSlice(int slice)
+{
+	const float slice_near = SliceDepth(slice);
+	const float slice_far = SliceDepth(slice + 1);
+	const int first = slice * CLUSTERS_X * CLUSTERS_Y;
+	std::vector<std::vector<unsigned int>> & lists = this->slice_lists[slice];
+
+	for (auto & list : lists)
+		list.clear();
+
+	for (size_t l = 0; l < this->view_lights.size(); l++)
+	{
+		const glm::vec3 center = glm::vec3(this->view_lights[l].position_radius);
+		const float radius = this->view_lights[l].position_radius.w;
+
+		// Most lights are rejected on depth alone
+		const float depth = -center.z;
+		if (depth + radius < slice_near || depth - radius > slice_far)
+			continue;
+
+		for (int c = 0; c < CLUSTERS_X * CLUSTERS_Y; c++)
+		{
+			// Squared distance from the sphere center to the box
+			glm::vec3 closest = glm::clamp(center, this->cluster_min[first + c], this->cluster_max[first + c]);
+			glm::vec3 delta = closest - center;
+			if (glm::dot(delta, delta) <= radius * radius)
+				lists[c].push_back((unsigned int)l);
+		}
+	}
+}
+
+
+/// <summary>
+/// Moves the lights to view space and assigns them to clusters, every depth slice is a job
+/// </summary>
+/// <param name="lights">All point lights in world space</param>
+/// <param name="view"></param>
+/// <param name="jobs"></param>
+void ClusteredLights::Assign(const std::vector<LightSource> & lights, const glm::mat4 & view, JobSystem & jobs)
+{
+	this->view_lights.resize(lights.size());
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		glm::vec3 position = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+		this->view_lights[i].position_radius = glm::vec4(position, lights[i].radius);
+		this->view_lights[i].color = glm::vec4(lights[i].color, 1.0f);
+	}
+
+	jobs.ParallelFor(CLUSTERS_Z, 1, [this](size_t begin, size_t end) {
+		for (size_t slice = begin; slice < end; slice++)
+			this->AssignSlice((int)slice);
+	});
+
+	// Join the per cluster lists into one index list
+	this->indices.clear();
+	for (int z = 0; z < CLUSTERS_Z; z++)
+	{
+		for (int c = 0; c < CLUSTERS_X * CLUSTERS_Y; c++)
+		{
+			const std::vector<unsigned int> & list = this->slice_lists[z][c];
+			this->grid[z * CLUSTERS_X * CLUSTERS_Y + c] = ClusterRange{ (unsigned int)this->indices.size(), (unsigned int)list.size() };
+			this->indices.insert(this->indices.end(), list.begin(), list.end());
+		}
+	}
+}
+
+
+/// <summary>
+/// Copies a block into the stream buffer and binds it to a shader storage binding
+/// </summary>
+static void UploadBlock(StreamBuffer & stream, GLuint binding, const void * data, size_t size)
+{
+	// Empty ranges can't be bound
+	GLsizeiptr bytes = std::max((GLsizeiptr)size, (GLsizeiptr)16);
+	StreamAllocation block = stream.Allocate(bytes);
+	if (block.data == nullptr)
+		return;
+
+	if (size > 0)
+		memcpy(block.data, data, size);
+	gl_state.BindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, stream.Buffer(), block.offset, bytes);
+}
+
+
+/// <summary>
+/// Writes the lights, the cluster grid and the index list to the stream buffer and binds them
+/// The caller has to flush the stream before drawing
+/// </summary>
+/// <param name="stream">A stream buffer created for GL_SHADER_STORAGE_BUFFER</param>
+void ClusteredLights::Upload(StreamBuffer & stream) const
+{
+	stream.Reserve((GLsizeiptr)(this->view_lights.size() * sizeof(GpuLight) + this->grid.size() * sizeof(ClusterRange)
+		+ this->indices.size() * sizeof(unsigned int)) + 1024);
+	stream.BeginFrame();
+
+	UploadBlock(stream, LIGHT_BUFFER_BINDING, this->view_lights.data(), this->view_lights.size() * sizeof(GpuLight));
+	UploadBlock(stream, CLUSTER_BUFFER_BINDING, this->grid.data(), this->grid.size() * sizeof(ClusterRange));
+	UploadBlock(stream, LIGHT_INDEX_BUFFER_BINDING, this->indices.data(), this->indices.size() * sizeof(unsigned int));
+}
+
+
+/// <summary>
+/// Size of a cluster on screen in pixels
+/// </summary>
+glm::vec2 ClusteredLights::TileSize() const
+{
+	return glm::vec2(this->width / (float)CLUSTERS_X, this->height / (float)CLUSTERS_Y);
+}
+
+
+/// <summary>
+/// slice = log(depth) * scale + bias
+/// </summary>
+glm::vec2 ClusteredLights::DepthScaleBias() const
+{
+	const float log_ratio = logf(this->far_plane / this->near_plane);
+	return glm::vec2(CLUSTERS_Z / log_ratio, -CLUSTERS_Z * logf(this->near_plane) / log_ratio);
+}
+
+
+size_t ClusteredLights::LightCount() const
+{
+	return this->view_lights.size();
+}
+
+
+size_t ClusteredLights::IndexCount() const
+{
+	return this->indices.size();
+}
+
+
+unsigned int ClusteredLights::MaxLightsPerCluster() const
+{
+	unsigned int max = 0;
+	for (auto & range : this->grid)
+		max = std::max(max, range.count);
+	return max;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "types.h"
+#include "jobSystem.h"
+#include "streamBuffer.h"
+
+
+// Amount of clusters the view frustum is split in, the depth slices are exponential
+const int CLUSTERS_X = 16;
+const int CLUSTERS_Y = 9;
+const int CLUSTERS_Z = 24;
+
+// Shader storage bindings used by the fragment shader
+const unsigned int LIGHT_BUFFER_BINDING = 1;
+const unsigned int CLUSTER_BUFFER_BINDING = 2;
+const unsigned int LIGHT_INDEX_BUFFER_BINDING = 3;
+
+// Point light as the shader sees it (std430), position in view space
+struct GpuLight
+{
+	glm::vec4 position_radius;
+	glm::vec4 color;
+};
+
+// Range in the light index list that belongs to a cluster
+struct ClusterRange
+{
+	unsigned int offset;
+	unsigned int count;
+};
+
+// Assigns the point lights to the clusters they touch so every fragment only loops over the lights of its own cluster
+class ClusteredLights
+{
+private:
+	float near_plane = 0.1f;
+	float far_plane = 100.0f;
+	float tan_half_fov = 0.0f;
+	float aspect = 1.0f;
+	int width = 1;
+	int height = 1;
+
+	// View space bounding box of every cluster
+	std::vector<glm::vec3> cluster_min;
+	std::vector<glm::vec3> cluster_max;
+
+	std::vector<GpuLight> view_lights;
+	std::vector<std::vector<std::vector<unsigned int>>> slice_lists;
+	std::vector<ClusterRange> grid;
+	std::vector<unsigned int> indices;
+
+	float SliceDepth(int slice) const;
+	void BuildClusters();
+	void AssignSlice(int slice);
+public:
+	ClusteredLights();
+
+	void SetProjection(float fov, float aspect, float near_plane, float far_plane, int width, int height);
+	void Assign(const std::vector<LightSource> & lights, const glm::mat4 & view, JobSystem & jobs);
+	void Upload(StreamBuffer & stream) const;
+
+	glm::vec2 TileSize() const;
+	glm::vec2 DepthScaleBias() const;
+	size_t LightCount() const;
+	size_t IndexCount() const;
+	unsigned int MaxLightsPerCluster() const;
+};
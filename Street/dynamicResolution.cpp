@@ -0,0 +1,424 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "glsl.h"
+#include "stats.h"
+#include "dynamicResolution.h"
+#include "glState.h"
+
+const char * upscale_fragshader_name = "upscale.fsh";
+const char * upscale_vertexshader_name = "upscale.vsh";
+
+// Share of the budget the controller aims for, so noise doesn't push every other frame over it
+const float RESOLUTION_AIM = 0.95f;
+
+// Below this share of the budget there is room to go up again
+const float RESOLUTION_HEADROOM = 0.8f;
+
+// Largest drop in a single step, a hitch shouldn't halve the resolution
+const float RESOLUTION_MAX_DROP = 0.15f;
+
+// Strength of the sharpen filter
+const float UPSCALE_SHARPNESS = 0.5f;
+
+
+/// <summary>
+/// ctor
+/// </summary>
+/// <param name="target_ms">Gpu time budget of a frame</param>
+/// <param name="latency">Frames between rendering a frame and getting its timing</param>
+ResolutionController::ResolutionController(float target_ms, int latency)
+{
+	this->target_ms = target_ms;
+	this->latency = latency;
+	this->history.assign(RESOLUTION_HISTORY, RESOLUTION_MAX_SCALE);
+}
+
+
+void ResolutionController::SetTarget(float target_ms)
+{
+	this->target_ms = target_ms;
+}
+
+
+float ResolutionController::Target() const
+{
+	return this->target_ms;
+}
+
+
+/// <summary>
+/// Feeds the gpu time of a frame to the controller
+/// </summary>
+/// <param name="gpu_ms">Measured gpu time</param>
+/// <returns>The scale to render the next frame at</returns>
+float ResolutionController::Update(double gpu_ms)
+{
+	// The timings that are still in flight were rendered at the old scale
+	if (this->cooldown > 0)
+	{
+		this->cooldown--;
+		return this->scale;
+	}
+
+	this->smoothed_ms = this->smoothed_ms == 0.0 ? gpu_ms : this->smoothed_ms * 0.75 + gpu_ms * 0.25;
+
+	float wanted = this->scale;
+	if (this->smoothed_ms > this->target_ms)
+	{
+		wanted = this->scale * sqrtf(float(this->target_ms * RESOLUTION_AIM / this->smoothed_ms));
+		wanted = std::max(wanted, this->scale - RESOLUTION_MAX_DROP);
+	}
+	else if (this->smoothed_ms < this->target_ms * RESOLUTION_HEADROOM)
+	{
+		wanted = this->scale * sqrtf(float(this->target_ms * RESOLUTION_AIM / this->smoothed_ms));
+		wanted = std::min(wanted, this->scale + RESOLUTION_STEP);
+	}
+
+	// Rounded down to a step, going over the budget is worse than leaving a bit unused
+	wanted = floorf(wanted / RESOLUTION_STEP + 0.001f) * RESOLUTION_STEP;
+	wanted = std::min(std::max(wanted, RESOLUTION_MIN_SCALE), RESOLUTION_MAX_SCALE);
+
+	if (wanted != this->scale)
+	{
+		this->scale = wanted;
+		this->changes++;
+		this->cooldown = this->latency;
+		this->smoothed_ms = 0.0;
+	}
+	return this->scale;
+}
+
+
+/// <summary>
+/// Adds the current scale to the history, once per frame
+/// </summary>
+void ResolutionController::Record()
+{
+	this->history[this->history_next] = this->scale;
+	this->history_next = (this->history_next + 1) % RESOLUTION_HISTORY;
+}
+
+
+/// <summary>
+/// Jumps to a scale and forgets the timings so far
+/// </summary>
+void ResolutionController::Reset(float scale)
+{
+	this->scale = scale;
+	this->smoothed_ms = 0.0;
+	this->cooldown = 0;
+}
+
+
+float ResolutionController::Scale() const
+{
+	return this->scale;
+}
+
+
+/// <summary>
+/// Amount of times the scale changed
+/// </summary>
+int ResolutionController::Changes() const
+{
+	return this->changes;
+}
+
+
+/// <summary>
+/// Copies the scale of the last RESOLUTION_HISTORY frames, oldest first
+/// </summary>
+void ResolutionController::History(std::vector<float> & scales) const
+{
+	scales.clear();
+	scales.insert(scales.end(), this->history.begin() + this->history_next, this->history.end());
+	scales.insert(scales.end(), this->history.begin(), this->history.begin() + this->history_next);
+}
+
+
+DynamicResolution::~DynamicResolution()
+{
+	if (this->program)
+		gl_state.DeleteProgram(this->program);
+	if (this->vao)
+		gl_state.DeleteVertexArrays(1, &this->vao);
+	if (this->start_queries[0])
+	{
+		glDeleteQueries(QUERIES, this->start_queries);
+		glDeleteQueries(QUERIES, this->end_queries);
+	}
+}
+
+
+/// <summary>
+/// Creates the upscale program and the timer queries
+/// </summary>
+/// <param name="width">Width of the window</param>
+/// <param name="height">Height of the window</param>
+/// <param name="samples">Msaa samples of the targets, 1 for none</param>
+void DynamicResolution::Initialize(int width, int height, int samples)
+{
+	this->width = width;
+	this->height = height;
+	this->render_width = width;
+	this->render_height = height;
+	this->SetSamples(samples);
+
+	char * vertexshader = glsl::readFile(upscale_vertexshader_name);
+	GLuint vsh_id = glsl::makeVertexShader(vertexshader);
+	delete[] vertexshader;
+
+	char * fragshader = glsl::readFile(upscale_fragshader_name);
+	GLuint fsh_id = glsl::makeFragmentShader(fragshader);
+	delete[] fragshader;
+
+	this->program = glsl::makeShaderProgram(vsh_id, fsh_id);
+	this->uv_scale_location = glGetUniformLocation(this->program, "uv_scale");
+	this->texel_size_location = glGetUniformLocation(this->program, "texel_size");
+	this->sharpness_location = glGetUniformLocation(this->program, "sharpness");
+
+	glGenVertexArrays(1, &this->vao);
+	glGenQueries(QUERIES, this->start_queries);
+	glGenQueries(QUERIES, this->end_queries);
+}
+
+
+/// <summary>
+/// Sets the msaa samples the scene is drawn with, capped at what the driver supports
+/// </summary>
+/// <param name="samples">1 for none</param>
+void DynamicResolution::SetSamples(int samples)
+{
+	GLint max_samples = 1;
+	glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+	this->samples = std::max(1, std::min(samples, (int)max_samples));
+}
+
+
+int DynamicResolution::Samples() const
+{
+	return this->samples;
+}
+
+
+/// <summary>
+/// Width of the targets, the width of the window
+/// </summary>
+int DynamicResolution::Width() const
+{
+	return this->width;
+}
+
+
+/// <summary>
+/// Height of the targets, the height of the window
+/// </summary>
+int DynamicResolution::Height() const
+{
+	return this->height;
+}
+
+
+/// <summary>
+/// Width of the part of the target the current frame is rendered in
+/// </summary>
+int DynamicResolution::RenderWidth() const
+{
+	return this->render_width;
+}
+
+
+/// <summary>
+/// Height of the part of the target the current frame is rendered in
+/// </summary>
+int DynamicResolution::RenderHeight() const
+{
+	return this->render_height;
+}
+
+
+/// <summary>
+/// Gpu time of the frames that were measured since the last call
+/// </summary>
+double DynamicResolution::TakeGpuTime()
+{
+	const double gpu_ms = this->gpu_ms;
+	this->gpu_ms = 0.0;
+	return gpu_ms;
+}
+
+
+/// <summary>
+/// Picks the size of the next frame, it is known before the frame starts so callers can plan for it
+/// </summary>
+void DynamicResolution::UpdateRenderSize()
+{
+	const float scale = this->enabled ? this->controller.Scale() : RESOLUTION_MAX_SCALE;
+	this->render_width = std::max(1, int(this->width * scale + 0.5f));
+	this->render_height = std::max(1, int(this->height * scale + 0.5f));
+}
+
+
+bool DynamicResolution::IsEnabled() const
+{
+	return this->enabled;
+}
+
+
+/// <summary>
+/// Switches between the scale of the controller and the full resolution
+/// </summary>
+void DynamicResolution::Toggle()
+{
+	this->enabled = !this->enabled;
+	this->controller.Reset(RESOLUTION_MAX_SCALE);
+	this->UpdateRenderSize();
+	printf("Dynamic resolution %s\n", this->enabled ? "on" : "off");
+}
+
+
+void DynamicResolution::CycleFilter()
+{
+	this->filter = this->filter == UPSCALE_BILINEAR ? UPSCALE_SHARPEN : UPSCALE_BILINEAR;
+	printf("Upscale filter: %s\n", this->filter == UPSCALE_BILINEAR ? "bilinear" : "sharpen");
+}
+
+
+/// <summary>
+/// Prints the lowest, average and highest scale of the history and the scale over time
+/// </summary>
+void DynamicResolution::PrintHistory() const
+{
+	std::vector<float> scales;
+	this->controller.History(scales);
+
+	float lowest = RESOLUTION_MAX_SCALE;
+	float highest = 0.0f;
+	double sum = 0.0;
+	for (float scale : scales)
+	{
+		lowest = std::min(lowest, scale);
+		highest = std::max(highest, scale);
+		sum += scale;
+	}
+
+	printf("Resolution scale over the last %d frames: min %.3f avg %.3f max %.3f, %d changes, target %.1f ms\n",
+		RESOLUTION_HISTORY, lowest, sum / scales.size(), highest, this->controller.Changes(), this->controller.Target());
+
+	// One percentage per 10 frames, oldest first
+	const int per_column = 10;
+	for (size_t i = 0; i < scales.size(); i += per_column)
+		printf(" %3d", (int)(scales[i] * 100.0f + 0.5f));
+	printf("\n");
+}
+
+
+/// <summary>
+/// Starts timing the gpu work of the frame
+/// </summary>
+void DynamicResolution::BeginFrame()
+{
+	glQueryCounter(this->start_queries[this->query_frame % QUERIES], GL_TIMESTAMP);
+}
+
+
+/// <summary>
+/// Binds the scaled part of a target for the scene and clears it
+/// </summary>
+/// <param name="framebuffer">Framebuffer with the scene color and depth</param>
+/// <param name="region">Pixels x0, y0, x1, y1 to redraw, the rest keeps the frame before (nullptr for all of it)
+/// The scissor test stays on for the scene</param>
+void DynamicResolution::Begin(GLuint framebuffer, const glm::ivec4 * region)
+{
+	gl_state.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	gl_state.Viewport(0, 0, this->render_width, this->render_height);
+	if (region != nullptr)
+	{
+		gl_state.Enable(GL_SCISSOR_TEST);
+		glScissor(region->x, region->y, region->z - region->x, region->w - region->y);
+	}
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+
+/// <summary>
+/// Resolves the msaa samples of the rendered part, only the redrawn region when there is one
+/// </summary>
+/// <param name="multisampled">Framebuffer the scene was drawn in</param>
+/// <param name="resolved">Framebuffer with a single sample color texture</param>
+/// <param name="region">Pixels x0, y0, x1, y1 that were redrawn (nullptr for all of them)</param>
+void DynamicResolution::Resolve(GLuint multisampled, GLuint resolved, const glm::ivec4 * region)
+{
+	if (region != nullptr)
+	{
+		gl_state.Enable(GL_SCISSOR_TEST);
+		glScissor(region->x, region->y, region->z - region->x, region->w - region->y);
+	}
+	gl_state.BindFramebuffer(GL_READ_FRAMEBUFFER, multisampled);
+	gl_state.BindFramebuffer(GL_DRAW_FRAMEBUFFER, resolved);
+	glBlitFramebuffer(0, 0, this->render_width, this->render_height, 0, 0, this->render_width, this->render_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	gl_state.Disable(GL_SCISSOR_TEST);
+}
+
+
+/// <summary>
+/// Stretches a frame over the window
+/// </summary>
+/// <param name="frame">Texture with the size of the target that holds the frame in its bottom left part</param>
+void DynamicResolution::Present(GLuint frame)
+{
+	gl_state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+	gl_state.Viewport(0, 0, this->width, this->height);
+
+	gl_state.Disable(GL_DEPTH_TEST);
+	gl_state.UseProgram(this->program);
+	gl_state.Uniform2f(this->uv_scale_location, this->render_width / (float)this->width, this->render_height / (float)this->height);
+	gl_state.Uniform2f(this->texel_size_location, 1.0f / this->width, 1.0f / this->height);
+	gl_state.Uniform1f(this->sharpness_location, this->filter == UPSCALE_SHARPEN ? UPSCALE_SHARPNESS : 0.0f);
+	gl_state.BindTexture(0, GL_TEXTURE_2D, frame);
+	gl_state.BindVertexArray(this->vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	gl_state.BindVertexArray(0);
+	gl_state.BindTexture(0, GL_TEXTURE_2D, 0);
+	gl_state.Enable(GL_DEPTH_TEST);
+}
+
+
+/// <summary>
+/// Stops timing the frame and feeds the timing of an earlier frame to the controller
+/// </summary>
+void DynamicResolution::EndFrame()
+{
+	glQueryCounter(this->end_queries[this->query_frame % QUERIES], GL_TIMESTAMP);
+
+	// Timing of a frame from a few frames ago, skipped when the gpu isn't done with it yet
+	this->query_frame++;
+	if (this->query_frame >= QUERIES)
+	{
+		const int query = this->query_frame % QUERIES;
+		GLint available = 0;
+		glGetQueryObjectiv(this->end_queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 start = 0;
+			GLuint64 end = 0;
+			glGetQueryObjectui64v(this->start_queries[query], GL_QUERY_RESULT, &start);
+			glGetQueryObjectui64v(this->end_queries[query], GL_QUERY_RESULT, &end);
+			const double gpu_ms = (end - start) / 1e6;
+			this->gpu_ms += gpu_ms;
+			stats.Add("frame gpu ms", gpu_ms);
+			if (this->enabled)
+				this->controller.Update(gpu_ms);
+		}
+	}
+
+	this->controller.Record();
+	stats.Add("resolution scale", this->render_width / (double)this->width);
+	stats.Add("rendered pixels", (double)this->render_width * this->render_height);
+	this->UpdateRenderSize();
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+
+// Gpu time of a frame the resolution is scaled for, a bit under the 10 ms the frame timer runs at
+const float RESOLUTION_TARGET_MS = 8.0f;
+
+// Bounds of the scale (per axis) and the steps it moves in, small changes aren't worth a different resolution
+const float RESOLUTION_MIN_SCALE = 0.5f;
+const float RESOLUTION_MAX_SCALE = 1.0f;
+const float RESOLUTION_STEP = 0.025f;
+
+// Frames of scale history that are kept
+const int RESOLUTION_HISTORY = 240;
+
+// How the scaled frame is stretched over the window
+enum UpscaleFilter
+{
+	UPSCALE_BILINEAR,
+	UPSCALE_SHARPEN
+};
+
+// Picks the resolution scale from the measured gpu time of the frame, makes no gl calls
+// The shaded pixels grow with the square of the scale so the scale moves with the root of the time ratio,
+// it drops quickly when the frame is over budget and only creeps back up when there is clear headroom
+class ResolutionController
+{
+private:
+	float target_ms;
+	float scale = RESOLUTION_MAX_SCALE;
+	double smoothed_ms = 0.0;
+
+	// A new scale only shows in the timings once the queries of the frames before it are read
+	int latency;
+	int cooldown = 0;
+
+	std::vector<float> history;
+	int history_next = 0;
+	int changes = 0;
+public:
+	ResolutionController(float target_ms = RESOLUTION_TARGET_MS, int latency = 2);
+
+	void SetTarget(float target_ms);
+	float Target() const;
+	float Update(double gpu_ms);
+	void Record();
+	void Reset(float scale);
+	float Scale() const;
+	int Changes() const;
+	void History(std::vector<float> & scales) const;
+};
+
+// Renders the frame into offscreen targets that are only partly used, the used part follows the scale
+// of the controller and is upscaled to the window afterwards
+// The targets (see FrameGraph) have the full size of the window, changing the scale only changes the viewport
+class DynamicResolution
+{
+private:
+	static const int QUERIES = 3;
+
+	int width = 0;
+	int height = 0;
+	int samples = 1;
+	int render_width = 0;
+	int render_height = 0;
+
+	GLuint program = 0;
+	GLuint vao = 0;
+	GLint uv_scale_location = -1;
+	GLint texel_size_location = -1;
+	GLint sharpness_location = -1;
+
+	// Timestamps around the frame, read a few frames later so it never stalls
+	GLuint start_queries[QUERIES] = {};
+	GLuint end_queries[QUERIES] = {};
+	int query_frame = 0;
+
+	ResolutionController controller;
+	UpscaleFilter filter = UPSCALE_BILINEAR;
+	bool enabled = true;
+
+	// Gpu time of the frames measured since the last TakeGpuTime
+	double gpu_ms = 0.0;
+
+	void UpdateRenderSize();
+public:
+	~DynamicResolution();
+
+	void Initialize(int width, int height, int samples);
+	void SetSamples(int samples);
+	int Samples() const;
+	int Width() const;
+	int Height() const;
+	int RenderWidth() const;
+	int RenderHeight() const;
+	double TakeGpuTime();
+
+	bool IsEnabled() const;
+	void Toggle();
+	void CycleFilter();
+	void PrintHistory() const;
+
+	void BeginFrame();
+	void Begin(GLuint framebuffer, const glm::ivec4 * region = nullptr);
+	void Resolve(GLuint multisampled, GLuint resolved, const glm::ivec4 * region = nullptr);
+	void Present(GLuint frame);
+	void EndFrame();
+};
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <new>
+
+#include "frameArena.h"
+
+
+/// <summary>
+/// ctor, no memory is taken until the first allocation
+/// </summary>
+/// <param name="block_size">Size of the blocks the arena grows by, larger allocations get a block of their own</param>
+FrameArena::FrameArena(size_t block_size) : block_size(block_size)
+{
+}
+
+
+FrameArena::~FrameArena()
+{
+	for (Block & block : this->blocks)
+		::operator delete(block.memory);
+}
+
+
+/// <summary>
+/// Takes memory from the current block, or from the next one when it doesn't fit anymore
+/// </summary>
+/// <param name="bytes"></param>
+/// <param name="alignment">Power of two</param>
+/// <returns>Memory that stays valid until Reset</returns>
+void * FrameArena::Allocate(size_t bytes, size_t alignment)
+{
+	for (;;)
+	{
+		if (this->current < this->blocks.size())
+		{
+			Block & block = this->blocks[this->current];
+			const size_t start = ((size_t)block.memory + this->offset + alignment - 1) & ~(alignment - 1);
+			if (start + bytes <= (size_t)block.memory + block.size)
+			{
+				this->offset = start + bytes - (size_t)block.memory;
+				return (void *)start;
+			}
+
+			// Move on, the rest of this block stays unused until Reset
+			this->used += this->offset;
+			this->current++;
+			this->offset = 0;
+			if (this->current < this->blocks.size())
+				continue;
+		}
+
+		Block block;
+		block.size = std::max(this->block_size, bytes + alignment);
+		block.memory = (char *)::operator new(block.size);
+		this->blocks.push_back(block);
+		this->current = this->blocks.size() - 1;
+	}
+}
+
+
+/// <summary>
+/// Frees everything that was allocated
+/// A frame that took more than one block merges them into a single one, so the next frame fits in it
+/// </summary>
+void FrameArena::Reset()
+{
+	if (this->blocks.size() > 1)
+	{
+		const size_t total = this->Capacity();
+		for (Block & block : this->blocks)
+			::operator delete(block.memory);
+		this->blocks.clear();
+
+		Block block;
+		block.size = total;
+		block.memory = (char *)::operator new(total);
+		this->blocks.push_back(block);
+	}
+
+	this->current = 0;
+	this->offset = 0;
+	this->used = 0;
+}
+
+
+/// <summary>
+/// Bytes allocated since the last Reset, with the padding alignment and skipped block ends took
+/// </summary>
+size_t FrameArena::Used() const
+{
+	return this->used + this->offset;
+}
+
+
+/// <summary>
+/// Bytes the arena holds
+/// </summary>
+size_t FrameArena::Capacity() const
+{
+	size_t total = 0;
+	for (const Block & block : this->blocks)
+		total += block.size;
+	return total;
+}
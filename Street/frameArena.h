@@ -0,0 +1,73 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+
+// Memory for data that only lives until the next Reset, typically one frame or one load
+// Allocating bumps a pointer, nothing is freed on its own, Reset frees everything at once and keeps the memory
+// Once a frame fit, the next frames of the same size allocate nothing from the heap
+// Destructors are not run, it is meant for trivially destructible data and the containers below
+class FrameArena
+{
+private:
+	struct Block
+	{
+		char * memory;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t block_size;
+	size_t current = 0;		// Block that is allocated from
+	size_t offset = 0;		// Used bytes of that block
+	size_t used = 0;		// Of the earlier blocks, alignment padding included
+
+	FrameArena(const FrameArena &) = delete;
+	FrameArena & operator=(const FrameArena &) = delete;
+public:
+	explicit FrameArena(size_t block_size = 64 * 1024);
+	~FrameArena();
+
+	void * Allocate(size_t bytes, size_t alignment = alignof(max_align_t));
+	void Reset();
+
+	size_t Used() const;
+	size_t Capacity() const;
+};
+
+// Lets the standard containers allocate from an arena, freeing does nothing as the arena frees everything on Reset
+// A container must not outlive the Reset of its arena
+template <typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	FrameArena * arena;
+
+	explicit ArenaAllocator(FrameArena & arena) : arena(&arena) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U> & other) : arena(other.arena) {}
+
+	T * allocate(size_t count)
+	{
+		return (T *)this->arena->Allocate(count * sizeof(T), alignof(T));
+	}
+
+	void deallocate(T *, size_t) {}
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U> & other) const
+	{
+		return this->arena == other.arena;
+	}
+
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U> & other) const
+	{
+		return this->arena != other.arena;
+	}
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,834 @@
+#include <stdio.h>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "stats.h"
+#include "frameGraph.h"
+#include "glState.h"
+#include "glStorage.h"
+
+const char * ACCESS_NAMES[] = { "attachment", "sampled", "image", "blit" };
+
+
+/// <summary>
+/// Size class of a format, textures of one class can be views of each other
+/// Every depth format is a class of its own
+/// </summary>
+/// <param name="format">Sized internal format</param>
+/// <param name="bytes">Bytes per sample</param>
+/// <returns>Class, the same for compatible formats</returns>
+static int FormatClass(GLenum format, int & bytes)
+{
+	switch (format)
+	{
+	case GL_R8:
+		bytes = 1;
+		return 8;
+	case GL_RGBA8:
+	case GL_RGB10_A2:
+	case GL_R11F_G11F_B10F:
+	case GL_RG16F:
+	case GL_R32F:
+	case GL_R32UI:
+	case GL_R32I:
+		bytes = 4;
+		return 32;
+	case GL_RGBA16F:
+	case GL_RG32F:
+		bytes = 8;
+		return 64;
+	case GL_RGBA32F:
+		bytes = 16;
+		return 128;
+	case GL_DEPTH_COMPONENT16:
+		bytes = 2;
+		return -(int)format;
+	default:
+		// The 24 bit depth formats take 4 bytes per sample as well
+		bytes = 4;
+		return -(int)format;
+	}
+}
+
+
+static bool IsDepthFormat(GLenum format)
+{
+	return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F ||
+		format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+}
+
+
+/// <summary>
+/// Whether two textures can share one storage
+/// </summary>
+static bool Compatible(const TextureDesc & a, const TextureDesc & b)
+{
+	int bytes;
+	return a.width == b.width && a.height == b.height && a.samples == b.samples && FormatClass(a.format, bytes) == FormatClass(b.format, bytes);
+}
+
+
+/// <summary>
+/// Memory of a texture, every sample counts
+/// </summary>
+size_t TextureBytes(const TextureDesc & desc)
+{
+	int bytes;
+	FormatClass(desc.format, bytes);
+	return (size_t)desc.width * desc.height * std::max(desc.samples, 1) * bytes;
+}
+
+
+/// <summary>
+/// Barrier that makes earlier image stores visible to an access
+/// </summary>
+static GLbitfield BarrierBit(ResourceAccess access)
+{
+	switch (access)
+	{
+	case ACCESS_SAMPLED:
+		return GL_TEXTURE_FETCH_BARRIER_BIT;
+	case ACCESS_IMAGE:
+		return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+	default:
+		return GL_FRAMEBUFFER_BARRIER_BIT;
+	}
+}
+
+
+/// <summary>
+/// Sets the sampling up the way the passes expect it, filtered color and unfiltered depth and integers
+/// Multisampled textures have no sampler state
+/// </summary>
+static void SetTextureParameters(GLuint texture, const TextureDesc & desc)
+{
+	if (desc.samples > 1)
+		return;
+
+	const bool nearest = IsDepthFormat(desc.format) || desc.format == GL_R32UI || desc.format == GL_R32I;
+	SetTextureSampling(texture, nearest ? GL_NEAREST : GL_LINEAR, GL_CLAMP_TO_EDGE);
+}
+
+
+FrameGraph::~FrameGraph()
+{
+	for (Storage & storage : this->pool)
+		this->ReleaseStorage(storage);
+	for (auto & framebuffer : this->framebuffers)
+		gl_state.DeleteFramebuffers(1, &framebuffer.second);
+}
+
+
+/// <summary>
+/// Starts the description of a new frame, the storage of the frame before is kept for reuse
+/// </summary>
+void FrameGraph::Reset()
+{
+	this->resources.clear();
+	this->passes.clear();
+	this->order.clear();
+	this->slots.clear();
+	this->arena.Reset();
+	this->compiled = false;
+}
+
+
+int FrameGraph::AddResource(const std::string & name, const TextureDesc & desc, GLuint imported, bool external, bool transient)
+{
+	Resource resource;
+	resource.name = name;
+	resource.desc = desc;
+	resource.imported = imported;
+	resource.external = external;
+	resource.transient = transient;
+	resource.output = false;
+	resource.back_buffer = false;
+	resource.first_use = resource.last_use = resource.slot = -1;
+	this->resources.push_back(resource);
+	return (int)this->resources.size() - 1;
+}
+
+
+/// <summary>
+/// Declares a texture that only lives during the frame, its memory can be shared with others
+/// </summary>
+/// <returns>Resource id</returns>
+int FrameGraph::CreateTexture(const std::string & name, const TextureDesc & desc)
+{
+	return this->AddResource(name, desc, 0, false, true);
+}
+
+
+/// <summary>
+/// Declares a texture owned by the graph that keeps its contents from frame to frame, it is never aliased
+/// The name identifies it, a retained texture that goes unused for a few frames is released
+/// </summary>
+/// <returns>Resource id</returns>
+int FrameGraph::RetainTexture(const std::string & name, const TextureDesc & desc)
+{
+	return this->AddResource(name, desc, 0, false, false);
+}
+
+
+/// <summary>
+/// Declares a texture owned by something else
+/// </summary>
+/// <returns>Resource id</returns>
+int FrameGraph::ImportTexture(const std::string & name, GLuint texture, const TextureDesc & desc)
+{
+	return this->AddResource(name, desc, texture, true, false);
+}
+
+
+/// <summary>
+/// Declares the default framebuffer, it is an output of the frame
+/// </summary>
+/// <returns>Resource id</returns>
+int FrameGraph::ImportBackBuffer(const std::string & name, int width, int height)
+{
+	const int resource = this->AddResource(name, TextureDesc{ width, height, GL_RGBA8, 1 }, 0, true, false);
+	this->resources[resource].back_buffer = true;
+	this->resources[resource].output = true;
+	return resource;
+}
+
+
+/// <summary>
+/// Keeps the passes that write a resource, and the passes they depend on, from being culled
+/// </summary>
+void FrameGraph::MarkOutput(int resource)
+{
+	this->resources[resource].output = true;
+}
+
+
+/// <summary>
+/// Adds a pass, it only runs when Compile finds that the output depends on it
+/// </summary>
+/// <param name="name"></param>
+/// <param name="closure">Function of the pass, copied into the arena</param>
+/// <param name="execute">Calls the closure</param>
+/// <returns>Pass id</returns>
+int FrameGraph::AddPass(const std::string & name, const void * closure, void(*execute)(const void * closure, FrameGraph & graph))
+{
+	Pass pass(this->arena);
+	pass.name = name;
+	pass.execute = execute;
+	pass.closure = closure;
+	pass.live = false;
+	pass.barriers = 0;
+	this->passes.push_back(pass);
+	return (int)this->passes.size() - 1;
+}
+
+
+void FrameGraph::Read(int pass, int resource, ResourceAccess access)
+{
+	this->passes[pass].reads.push_back(Access{ resource, access });
+}
+
+
+void FrameGraph::Write(int pass, int resource, ResourceAccess access)
+{
+	this->passes[pass].writes.push_back(Access{ resource, access });
+}
+
+
+/// <summary>
+/// Marks the passes the outputs depend on, starting from the writers of the outputs
+/// A resource that is read makes every pass that writes it live
+/// </summary>
+void FrameGraph::Cull()
+{
+	ArenaVector<int> work{ ArenaAllocator<int>(this->arena) };
+	for (int p = 0; p < (int)this->passes.size(); p++)
+	{
+		this->passes[p].live = false;
+		for (const Access & write : this->passes[p].writes)
+			if (this->resources[write.resource].output)
+				this->passes[p].live = true;
+		if (this->passes[p].live)
+			work.push_back(p);
+	}
+
+	while (!work.empty())
+	{
+		const int p = work.back();
+		work.pop_back();
+		for (const Access & read : this->passes[p].reads)
+		{
+			for (int q = 0; q < (int)this->passes.size(); q++)
+			{
+				if (this->passes[q].live)
+					continue;
+				for (const Access & write : this->passes[q].writes)
+				{
+					if (write.resource == read.resource)
+					{
+						this->passes[q].live = true;
+						work.push_back(q);
+						break;
+					}
+				}
+			}
+		}
+	}
+}
+
+
+/// <summary>
+/// Orders the live passes, the writers of a resource run in the order they were added and before every pass that only reads it
+/// Passes without a dependency between them keep the order they were added in
+/// </summary>
+/// <returns>False when the dependencies have a cycle</returns>
+bool FrameGraph::Sort()
+{
+	const int count = (int)this->passes.size();
+	const ArenaAllocator<int> ints(this->arena);
+	ArenaVector<ArenaVector<int>> edges(count, ArenaVector<int>(ints), ints);
+	ArenaVector<int> incoming(count, 0, ints);
+	ArenaVector<int> writers(ints);
+	ArenaVector<int> readers(ints);
+
+	for (int r = 0; r < (int)this->resources.size(); r++)
+	{
+		writers.clear();
+		readers.clear();
+		for (int p = 0; p < count; p++)
+		{
+			if (!this->passes[p].live)
+				continue;
+			bool writes = false;
+			bool reads = false;
+			for (const Access & write : this->passes[p].writes)
+				writes = writes || write.resource == r;
+			for (const Access & read : this->passes[p].reads)
+				reads = reads || read.resource == r;
+			if (writes)
+				writers.push_back(p);
+			else if (reads)
+				readers.push_back(p);
+		}
+
+		for (size_t i = 1; i < writers.size(); i++)
+			edges[writers[i - 1]].push_back(writers[i]);
+		for (int writer : writers)
+			for (int reader : readers)
+				edges[writer].push_back(reader);
+	}
+	for (int p = 0; p < count; p++)
+		for (int next : edges[p])
+			incoming[next]++;
+
+	// Always the first pass that is ready, so the order only changes where a dependency demands it
+	this->order.clear();
+	ArenaVector<bool> placed(count, false, ArenaAllocator<bool>(this->arena));
+	for (;;)
+	{
+		int next = -1;
+		for (int p = 0; p < count && next < 0; p++)
+			if (this->passes[p].live && !placed[p] && incoming[p] == 0)
+				next = p;
+		if (next < 0)
+			break;
+
+		placed[next] = true;
+		this->order.push_back(next);
+		for (int after : edges[next])
+			incoming[after]--;
+	}
+
+	for (int p = 0; p < count; p++)
+	{
+		if (this->passes[p].live && !placed[p])
+		{
+			printf("Frame graph: pass %s is part of a dependency cycle\n", this->passes[p].name.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/// <summary>
+/// Finds the lifetimes of the transient resources and lets the ones that don't overlap share a slot
+/// </summary>
+void FrameGraph::Assign()
+{
+	for (Resource & resource : this->resources)
+		resource.first_use = resource.last_use = resource.slot = -1;
+
+	for (int i = 0; i < (int)this->order.size(); i++)
+	{
+		const Pass & pass = this->passes[this->order[i]];
+		for (const ArenaVector<Access> * accesses : { &pass.reads, &pass.writes })
+		{
+			for (const Access & access : *accesses)
+			{
+				Resource & resource = this->resources[access.resource];
+				if (resource.first_use < 0)
+					resource.first_use = i;
+				resource.last_use = i;
+			}
+		}
+	}
+
+	// In the order they come alive, a slot is free again once the last pass of its texture ran
+	// Ties keep the declaration order, a stable sort would want a buffer from the heap for that
+	ArenaVector<int> transients{ ArenaAllocator<int>(this->arena) };
+	for (int r = 0; r < (int)this->resources.size(); r++)
+		if (this->resources[r].transient && this->resources[r].first_use >= 0)
+			transients.push_back(r);
+	std::sort(transients.begin(), transients.end(), [this](int a, int b) {
+		const int first_a = this->resources[a].first_use;
+		const int first_b = this->resources[b].first_use;
+		return first_a < first_b || (first_a == first_b && a < b);
+	});
+
+	this->transient_bytes = 0;
+	this->aliased_bytes = 0;
+	for (int r : transients)
+	{
+		Resource & resource = this->resources[r];
+		this->transient_bytes += TextureBytes(resource.desc);
+
+		for (int s = 0; s < (int)this->slots.size() && resource.slot < 0; s++)
+			if (this->slots[s].last_use < resource.first_use && Compatible(this->slots[s].desc, resource.desc))
+				resource.slot = s;
+
+		if (resource.slot < 0)
+		{
+			resource.slot = (int)this->slots.size();
+			this->slots.push_back(Slot{ resource.desc, -1 });
+			this->aliased_bytes += TextureBytes(resource.desc);
+		}
+		this->slots[resource.slot].last_use = resource.last_use;
+	}
+
+	this->declared_bytes = 0;
+	this->retained_bytes = 0;
+	for (const Resource & resource : this->resources)
+	{
+		if (resource.external)
+			continue;
+		this->declared_bytes += TextureBytes(resource.desc);
+		if (!resource.transient && resource.first_use >= 0)
+			this->retained_bytes += TextureBytes(resource.desc);
+	}
+}
+
+
+/// <summary>
+/// Storage for a slot or a retained texture, taken from the pool when one fits
+/// The gl texture is only made in Execute
+/// </summary>
+/// <param name="desc"></param>
+/// <param name="retained_name">Name of the retained texture, empty for a slot</param>
+/// <returns>Index in the pool</returns>
+int FrameGraph::FindStorage(const TextureDesc & desc, const std::string & retained_name)
+{
+	for (int i = 0; i < (int)this->pool.size(); i++)
+	{
+		Storage & storage = this->pool[i];
+		if (storage.in_use || storage.retained_name != retained_name || !Compatible(storage.desc, desc))
+			continue;
+		storage.in_use = true;
+		storage.unused_frames = 0;
+		return i;
+	}
+
+	Storage storage;
+	storage.desc = desc;
+	storage.texture = 0;
+	storage.retained_name = retained_name;
+	storage.unused_frames = 0;
+	storage.in_use = true;
+	storage.image_written = false;
+	this->pool.push_back(storage);
+	return (int)this->pool.size() - 1;
+}
+
+
+/// <summary>
+/// Releases storage that went unused for a while and gives every slot and retained texture its storage
+/// </summary>
+void FrameGraph::Allocate()
+{
+	for (size_t i = 0; i < this->pool.size();)
+	{
+		if (this->pool[i].unused_frames > FRAME_GRAPH_POOL_FRAMES)
+		{
+			this->ReleaseStorage(this->pool[i]);
+			this->pool.erase(this->pool.begin() + i);
+		}
+		else
+		{
+			this->pool[i].unused_frames++;
+			this->pool[i].in_use = false;
+			i++;
+		}
+	}
+
+	ArenaVector<int> slot_storage(this->slots.size(), 0, ArenaAllocator<int>(this->arena));
+	for (size_t s = 0; s < this->slots.size(); s++)
+		slot_storage[s] = this->FindStorage(this->slots[s].desc, "");
+
+	this->storage_of.assign(this->resources.size(), -1);
+	for (int r = 0; r < (int)this->resources.size(); r++)
+	{
+		const Resource & resource = this->resources[r];
+		if (resource.first_use < 0)
+			continue;
+		if (resource.transient)
+			this->storage_of[r] = slot_storage[resource.slot];
+		else if (!resource.external)
+			this->storage_of[r] = this->FindStorage(resource.desc, resource.name);
+	}
+}
+
+
+/// <summary>
+/// Places a barrier before every pass that uses storage an earlier pass wrote with image stores
+/// Framebuffer writes and blits are ordered by gl itself, only image stores need one
+/// </summary>
+void FrameGraph::PlaceBarriers()
+{
+	this->barrier_count = 0;
+	for (int p : this->order)
+	{
+		Pass & pass = this->passes[p];
+		pass.barriers = 0;
+
+		for (const ArenaVector<Access> * accesses : { &pass.reads, &pass.writes })
+		{
+			for (const Access & access : *accesses)
+			{
+				const int storage = this->storage_of[access.resource];
+				const Resource & resource = this->resources[access.resource];
+				bool & written = storage >= 0 ? this->pool[storage].image_written : this->image_written[resource.imported];
+				if (written)
+				{
+					pass.barriers |= BarrierBit(access.access);
+					written = false;
+				}
+			}
+		}
+
+		for (const Access & write : pass.writes)
+		{
+			if (write.access != ACCESS_IMAGE)
+				continue;
+			const int storage = this->storage_of[write.resource];
+			if (storage >= 0)
+				this->pool[storage].image_written = true;
+			else
+				this->image_written[this->resources[write.resource].imported] = true;
+		}
+
+		if (pass.barriers)
+			this->barrier_count++;
+	}
+}
+
+
+/// <summary>
+/// Culls, orders and places the passes and resources of the frame, makes no gl calls
+/// Warns about passes that sample the texture they render to, and about transient textures read before they are written
+/// </summary>
+/// <returns>False when the passes can't be ordered, nothing is executed then</returns>
+bool FrameGraph::Compile()
+{
+	this->Cull();
+	if (!this->Sort())
+		return false;
+
+	for (int p : this->order)
+	{
+		const Pass & pass = this->passes[p];
+		for (const Access & read : pass.reads)
+			for (const Access & write : pass.writes)
+				if (read.resource == write.resource && read.access == ACCESS_SAMPLED && write.access == ACCESS_ATTACHMENT)
+					printf("Frame graph: pass %s samples %s while rendering to it\n", pass.name.c_str(), this->resources[read.resource].name.c_str());
+	}
+
+	this->Assign();
+	for (int r = 0; r < (int)this->resources.size(); r++)
+	{
+		const Resource & resource = this->resources[r];
+		if (!resource.transient || resource.first_use < 0)
+			continue;
+		bool written = false;
+		for (const Access & write : this->passes[this->order[resource.first_use]].writes)
+			written = written || write.resource == r;
+		if (!written)
+			printf("Frame graph: %s is read before anything writes it\n", resource.name.c_str());
+	}
+
+	this->Allocate();
+	this->PlaceBarriers();
+	this->compiled = true;
+	return true;
+}
+
+
+/// <summary>
+/// Texture of a storage in a format of its class, views are made once and kept with the storage
+/// </summary>
+GLuint FrameGraph::View(Storage & storage, GLenum format)
+{
+	if (format == storage.desc.format)
+		return storage.texture;
+
+	for (auto & view : storage.views)
+		if (view.first == format)
+			return view.second;
+
+	TextureDesc desc = storage.desc;
+	desc.format = format;
+
+	GLuint view;
+	glGenTextures(1, &view);
+	glTextureView(view, desc.samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D, storage.texture, format, 0, 1, 0, 1);
+	SetTextureParameters(view, desc);
+	storage.views.push_back(std::make_pair(format, view));
+	return view;
+}
+
+
+/// <summary>
+/// Deletes the textures of a storage and the framebuffers they are attached to
+/// </summary>
+void FrameGraph::ReleaseStorage(Storage & storage)
+{
+	std::vector<GLuint> textures;
+	if (storage.texture)
+		textures.push_back(storage.texture);
+	for (auto & view : storage.views)
+		textures.push_back(view.second);
+
+	for (GLuint texture : textures)
+	{
+		for (auto it = this->framebuffers.begin(); it != this->framebuffers.end();)
+		{
+			if ((GLuint)(it->first >> 32) == texture || (GLuint)(it->first & 0xffffffff) == texture)
+			{
+				gl_state.DeleteFramebuffers(1, &it->second);
+				it = this->framebuffers.erase(it);
+			}
+			else
+				it++;
+		}
+		gl_state.DeleteTextures(1, &texture);
+	}
+	storage.texture = 0;
+	storage.views.clear();
+}
+
+
+/// <summary>
+/// Makes the missing storage and runs the live passes in order with their barriers
+/// </summary>
+void FrameGraph::Execute()
+{
+	if (!this->compiled)
+		return;
+
+	for (Storage & storage : this->pool)
+	{
+		if (!storage.in_use || storage.texture)
+			continue;
+
+		storage.texture = CreateTextureStorage(storage.desc.format, storage.desc.width, storage.desc.height, storage.desc.samples);
+		SetTextureParameters(storage.texture, storage.desc);
+	}
+
+	this->textures_of.assign(this->resources.size(), 0);
+	for (int r = 0; r < (int)this->resources.size(); r++)
+	{
+		const Resource & resource = this->resources[r];
+		if (this->storage_of[r] >= 0)
+			this->textures_of[r] = this->View(this->pool[this->storage_of[r]], resource.desc.format);
+		else
+			this->textures_of[r] = resource.imported;
+	}
+
+	for (int p : this->order)
+	{
+		Pass & pass = this->passes[p];
+		if (pass.barriers)
+			glMemoryBarrier(pass.barriers);
+		pass.execute(pass.closure, *this);
+	}
+
+	stats.Add("graph passes", (double)this->order.size());
+	stats.Add("graph culled passes", (double)this->CulledCount());
+	stats.Add("graph barriers", this->barrier_count);
+	stats.Add("render targets MB", this->AllocatedBytes() / (1024.0 * 1024.0));
+	stats.Add("render targets saved MB", (this->declared_bytes - this->AllocatedBytes()) / (1024.0 * 1024.0));
+}
+
+
+const TextureDesc & FrameGraph::Desc(int resource) const
+{
+	return this->resources[resource].desc;
+}
+
+
+/// <summary>
+/// Texture a resource is read and written through this frame, only valid in Execute
+/// </summary>
+GLuint FrameGraph::Texture(int resource) const
+{
+	return this->textures_of[resource];
+}
+
+
+/// <summary>
+/// Framebuffer with textures attached, made once per combination of textures
+/// The back buffer is framebuffer 0
+/// </summary>
+/// <param name="color">Resource for the color attachment, -1 for a depth only framebuffer</param>
+/// <param name="depth">Resource for the depth attachment, -1 for none</param>
+/// <returns>Framebuffer, left bound to GL_FRAMEBUFFER</returns>
+GLuint FrameGraph::Framebuffer(int color, int depth)
+{
+	if (color >= 0 && this->resources[color].back_buffer)
+	{
+		gl_state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+		return 0;
+	}
+
+	const GLuint color_texture = color >= 0 ? this->textures_of[color] : 0;
+	const GLuint depth_texture = depth >= 0 ? this->textures_of[depth] : 0;
+	const unsigned long long key = ((unsigned long long)color_texture << 32) | depth_texture;
+
+	auto found = this->framebuffers.find(key);
+	if (found != this->framebuffers.end())
+	{
+		gl_state.BindFramebuffer(GL_FRAMEBUFFER, found->second);
+		return found->second;
+	}
+
+	GLuint framebuffer;
+	glGenFramebuffers(1, &framebuffer);
+	gl_state.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	if (color_texture)
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color_texture, 0);
+	else
+	{
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	if (depth_texture)
+	{
+		const GLenum format = this->resources[depth].desc.format;
+		const bool stencil = format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+		glFramebufferTexture(GL_FRAMEBUFFER, stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, depth_texture, 0);
+	}
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		printf("Frame graph: framebuffer of %s and %s is incomplete\n", color >= 0 ? this->resources[color].name.c_str() : "nothing",
+			depth >= 0 ? this->resources[depth].name.c_str() : "nothing");
+	this->framebuffers[key] = framebuffer;
+	return framebuffer;
+}
+
+
+int FrameGraph::PassCount() const
+{
+	return (int)this->order.size();
+}
+
+
+int FrameGraph::CulledCount() const
+{
+	return (int)(this->passes.size() - this->order.size());
+}
+
+
+int FrameGraph::BarrierCount() const
+{
+	return this->barrier_count;
+}
+
+
+/// <summary>
+/// Memory of every declared texture with a texture each, the culled passes included
+/// That is what the targets took when every pass owned its own
+/// </summary>
+size_t FrameGraph::DeclaredBytes() const
+{
+	return this->declared_bytes;
+}
+
+
+/// <summary>
+/// Memory the graph has in use for the frame, the aliased transient textures and the retained ones
+/// </summary>
+size_t FrameGraph::AllocatedBytes() const
+{
+	return this->aliased_bytes + this->retained_bytes;
+}
+
+
+/// <summary>
+/// Memory the live transient textures would take with a texture each
+/// </summary>
+size_t FrameGraph::TransientBytes() const
+{
+	return this->transient_bytes;
+}
+
+
+/// <summary>
+/// Memory the transient textures take with aliasing
+/// </summary>
+size_t FrameGraph::AliasedBytes() const
+{
+	return this->aliased_bytes;
+}
+
+
+size_t FrameGraph::RetainedBytes() const
+{
+	return this->retained_bytes;
+}
+
+
+/// <summary>
+/// Prints the passes in the order they run with their barriers, the culled passes and where every texture lives
+/// </summary>
+void FrameGraph::Print() const
+{
+	printf("Frame graph, %d passes, %d culled\n", this->PassCount(), this->CulledCount());
+	for (size_t i = 0; i < this->order.size(); i++)
+	{
+		const Pass & pass = this->passes[this->order[i]];
+		printf(" %2d %-16s", (int)i, pass.name.c_str());
+		if (pass.barriers)
+			printf(" [barrier%s%s%s]", pass.barriers & GL_TEXTURE_FETCH_BARRIER_BIT ? " fetch" : "",
+				pass.barriers & GL_SHADER_IMAGE_ACCESS_BARRIER_BIT ? " image" : "", pass.barriers & GL_FRAMEBUFFER_BARRIER_BIT ? " framebuffer" : "");
+		for (const Access & read : pass.reads)
+			printf(" <%s (%s)", this->resources[read.resource].name.c_str(), ACCESS_NAMES[read.access]);
+		for (const Access & write : pass.writes)
+			printf(" >%s (%s)", this->resources[write.resource].name.c_str(), ACCESS_NAMES[write.access]);
+		printf("\n");
+	}
+	for (const Pass & pass : this->passes)
+		if (!pass.live)
+			printf("    %-16s culled\n", pass.name.c_str());
+
+	for (const Resource & resource : this->resources)
+	{
+		if (resource.first_use < 0)
+			printf("    %-16s unused\n", resource.name.c_str());
+		else if (resource.transient)
+			printf("    %-16s passes %d-%d, slot %d, %.2f MB\n", resource.name.c_str(), resource.first_use, resource.last_use, resource.slot,
+				TextureBytes(resource.desc) / (1024.0 * 1024.0));
+		else
+			printf("    %-16s %s\n", resource.name.c_str(), resource.external ? "imported" : "retained");
+	}
+	printf("Declared %.2f MB, transient %.2f MB aliased into %.2f MB, retained %.2f MB\n", this->declared_bytes / (1024.0 * 1024.0),
+		this->transient_bytes / (1024.0 * 1024.0), this->aliased_bytes / (1024.0 * 1024.0), this->retained_bytes / (1024.0 * 1024.0));
+}
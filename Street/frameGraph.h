@@ -0,0 +1,176 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <stddef.h>
+#include <GL/glew.h>
+#include "frameArena.h"
+
+
+// Frames a pooled texture may go unused before it is deleted
+const int FRAME_GRAPH_POOL_FRAMES = 3;
+
+// How a pass touches a resource, the barriers between passes follow from it
+enum ResourceAccess
+{
+	ACCESS_ATTACHMENT,		// Rendered to or blended with as a framebuffer attachment
+	ACCESS_SAMPLED,			// Read through a sampler
+	ACCESS_IMAGE,			// Image load, store or atomics
+	ACCESS_BLIT				// Source or destination of glBlitFramebuffer
+};
+
+// Size and format of a texture, width and height are the full size of the target
+struct TextureDesc
+{
+	int width;
+	int height;
+	GLenum format;
+	int samples;
+};
+
+// Describes the frame as passes that declare the textures they read and write, it is built again every frame
+// Compile culls the passes nothing of the output depends on, orders the rest by their dependencies, places the
+// memory barriers image writes need, and gives the transient textures whose lifetimes don't overlap the same memory
+// Gl can't place two textures in one allocation, so aliasing textures share an immutable storage of the same size and
+// samples, a texture view gives each of them its own format (only formats of the same size class can share one)
+// Imported textures are owned elsewhere, retained ones belong to the graph but keep their contents over frames
+// Everything that only lives for the frame (the functions of the passes, their accesses and what Compile works with)
+// comes from an arena that Reset empties, so building the same frame again doesn't allocate
+class FrameGraph
+{
+private:
+	struct Access
+	{
+		int resource;
+		ResourceAccess access;
+	};
+
+	struct Resource
+	{
+		std::string name;
+		TextureDesc desc;
+		GLuint imported;
+		bool external;
+		bool transient;
+		bool output;
+		bool back_buffer;
+
+		// Filled in by Compile
+		int first_use;
+		int last_use;
+		int slot;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		void(*execute)(const void * closure, FrameGraph & graph);
+		const void * closure;
+		ArenaVector<Access> reads;
+		ArenaVector<Access> writes;
+
+		// Filled in by Compile
+		bool live;
+		GLbitfield barriers;
+
+		Pass(FrameArena & arena) : reads(ArenaAllocator<Access>(arena)), writes(ArenaAllocator<Access>(arena)) {}
+	};
+
+	// Gl storage the transient and retained resources live in, kept over frames
+	struct Storage
+	{
+		TextureDesc desc;
+		GLuint texture;
+		std::string retained_name;
+		int unused_frames;
+		bool in_use;
+		bool image_written;
+
+		// Views of the storage in other formats of its size class
+		std::vector<std::pair<GLenum, GLuint>> views;
+	};
+
+	FrameArena arena;
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<int> order;
+
+	// Storage of every resource, the texture (or view) it is read and written through
+	std::vector<int> storage_of;
+	std::vector<GLuint> textures_of;
+
+	// Aliasing within the frame, storage size and the last pass using it
+	struct Slot
+	{
+		TextureDesc desc;
+		int last_use;
+	};
+	std::vector<Slot> slots;
+
+	std::vector<Storage> pool;
+	std::unordered_map<unsigned long long, GLuint> framebuffers;
+
+	// Storage written through image stores, the next pass using it needs a barrier first
+	std::unordered_map<GLuint, bool> image_written;
+
+	bool compiled = false;
+	size_t declared_bytes = 0;
+	size_t transient_bytes = 0;
+	size_t aliased_bytes = 0;
+	size_t retained_bytes = 0;
+	int barrier_count = 0;
+
+	int AddResource(const std::string & name, const TextureDesc & desc, GLuint imported, bool external, bool transient);
+	int AddPass(const std::string & name, const void * closure, void(*execute)(const void * closure, FrameGraph & graph));
+	void Cull();
+	bool Sort();
+	void Assign();
+	void PlaceBarriers();
+	void Allocate();
+	int FindStorage(const TextureDesc & desc, const std::string & retained_name);
+	GLuint View(Storage & storage, GLenum format);
+	void ReleaseStorage(Storage & storage);
+public:
+	~FrameGraph();
+
+	void Reset();
+
+	int CreateTexture(const std::string & name, const TextureDesc & desc);
+	int RetainTexture(const std::string & name, const TextureDesc & desc);
+	int ImportTexture(const std::string & name, GLuint texture, const TextureDesc & desc);
+	int ImportBackBuffer(const std::string & name, int width, int height);
+	void MarkOutput(int resource);
+
+	// Execute makes the gl calls of the pass, it gets the graph to look the textures up in
+	// It is copied into the arena and never destroyed, so it can only capture what needs no destructor
+	template <typename F>
+	int AddPass(const std::string & name, const F & execute)
+	{
+		static_assert(std::is_trivially_destructible<F>::value, "the captures of a pass are dropped with the frame without their destructors");
+		const void * closure = new (this->arena.Allocate(sizeof(F), alignof(F))) F(execute);
+		return this->AddPass(name, closure, [](const void * closure, FrameGraph & graph) { (*(const F *)closure)(graph); });
+	}
+	void Read(int pass, int resource, ResourceAccess access);
+	void Write(int pass, int resource, ResourceAccess access);
+
+	bool Compile();
+	void Execute();
+
+	const TextureDesc & Desc(int resource) const;
+	GLuint Texture(int resource) const;
+	GLuint Framebuffer(int color, int depth = -1);
+
+	int PassCount() const;
+	int CulledCount() const;
+	int BarrierCount() const;
+	size_t DeclaredBytes() const;
+	size_t AllocatedBytes() const;
+	size_t TransientBytes() const;
+	size_t AliasedBytes() const;
+	size_t RetainedBytes() const;
+	void Print() const;
+};
+
+size_t TextureBytes(const TextureDesc & desc);
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "scene.h"
+#include "stats.h"
+#include "frameScheduler.h"
+
+
+bool FrameScheduler::IsEnabled() const
+{
+	return this->enabled;
+}
+
+
+/// <summary>
+/// Switches between drawing on demand and drawing every tick
+/// </summary>
+void FrameScheduler::Toggle()
+{
+	this->enabled = !this->enabled;
+	this->dirty = DIRTY_ALL;
+	printf("Render on demand %s\n", this->enabled ? "on" : "off");
+}
+
+
+bool FrameScheduler::IsPartial() const
+{
+	return this->partial;
+}
+
+
+/// <summary>
+/// Switches redrawing only the region of the moving objects on or off
+/// </summary>
+void FrameScheduler::TogglePartial()
+{
+	this->partial = !this->partial;
+	this->dirty = DIRTY_ALL;
+	printf("Partial redraw %s\n", this->partial ? "on" : "off");
+}
+
+
+/// <summary>
+/// Forces the next frame to be drawn
+/// </summary>
+/// <param name="flags">DirtyFlags, the reason</param>
+void FrameScheduler::MarkDirty(unsigned int flags)
+{
+	this->dirty |= flags;
+}
+
+
+/// <summary>
+/// Whether the scheduler still has frames to draw without anything changing
+/// </summary>
+bool FrameScheduler::NeedsFrames() const
+{
+	return !this->enabled || this->dirty != 0 || this->settle_frames > 0 || this->has_last_region;
+}
+
+
+/// <summary>
+/// Collects the changes of the tick, the scene has to be updated already
+/// </summary>
+/// <param name="scene"></param>
+/// <param name="view_projection">Unjittered projection * view of the frame</param>
+/// <param name="width">Width of the frame in pixels</param>
+/// <param name="height">Height of the frame in pixels</param>
+/// <param name="settle_frames">Full frames to draw after the last change</param>
+/// <param name="allow_partial">Whether the current render settings can redraw a part of the frame</param>
+/// <returns>How much of the frame has to be drawn</returns>
+FrameAction FrameScheduler::Decide(Scene & scene, const glm::mat4 & view_projection, int width, int height, int settle_frames, bool allow_partial)
+{
+	if (view_projection != this->last_view_projection)
+		this->dirty |= DIRTY_CAMERA;
+	if (width != this->last_width || height != this->last_height)
+		this->dirty |= DIRTY_SETTINGS;
+	if (scene.TakeContentChanged())
+		this->dirty |= DIRTY_RESOURCES;
+	this->last_view_projection = view_projection;
+	this->last_width = width;
+	this->last_height = height;
+
+	// Moving objects have to be drawn where they are now and erased where they were
+	glm::ivec4 moved;
+	const bool has_moved = scene.MovedRegion(view_projection, width, height, moved);
+	if (has_moved || this->has_last_region)
+		this->dirty |= DIRTY_ANIMATION;
+	if (has_moved && this->has_last_region)
+		this->region = glm::ivec4(glm::min(glm::ivec2(moved.x, moved.y), glm::ivec2(this->last_region.x, this->last_region.y)),
+			glm::max(glm::ivec2(moved.z, moved.w), glm::ivec2(this->last_region.z, this->last_region.w)));
+	else
+		this->region = has_moved ? moved : this->last_region;
+	this->last_region = moved;
+	this->has_last_region = has_moved;
+
+	const unsigned int reasons = this->dirty;
+	this->dirty = 0;
+	if (!this->enabled)
+		return FRAME_FULL;
+
+	if (reasons == 0)
+	{
+		if (this->settle_frames == 0)
+			return FRAME_SKIP;
+		this->settle_frames--;
+		return FRAME_FULL;
+	}
+
+	if (reasons & DIRTY_CAMERA)
+		stats.Add("dirty camera", 1);
+	if (reasons & DIRTY_ANIMATION)
+		stats.Add("dirty animation", 1);
+	if (reasons & DIRTY_RESOURCES)
+		stats.Add("dirty resources", 1);
+	if (reasons & DIRTY_SETTINGS)
+		stats.Add("dirty settings", 1);
+
+	this->settle_frames = settle_frames;
+	if (reasons == DIRTY_ANIMATION && this->partial && allow_partial)
+		return FRAME_PARTIAL;
+	return FRAME_FULL;
+}
+
+
+/// <summary>
+/// Region to redraw in a partial frame, pixels x0, y0, x1, y1 (exclusive)
+/// </summary>
+const glm::ivec4 & FrameScheduler::Region() const
+{
+	return this->region;
+}
+
+
+/// <summary>
+/// Closes the tick and adds what was drawn and how busy the cpu and gpu were since the tick before to the stats
+/// Utilization is relative to one core, the time between ticks (waiting for the timer or for input) counts as idle
+/// </summary>
+/// <param name="action">What was drawn this tick</param>
+/// <param name="gpu_ms">Gpu time of the frames that were measured this tick</param>
+void FrameScheduler::EndTick(FrameAction action, double gpu_ms)
+{
+	const double now = GetWallTime();
+	const double cpu = GetProcessCpuTime();
+	if (this->tick_start > 0.0 && now > this->tick_start)
+	{
+		stats.Add("cpu utilization %", 100.0 * (cpu - this->tick_cpu) / (now - this->tick_start));
+		stats.Add("gpu utilization %", 100.0 * gpu_ms / (now - this->tick_start));
+	}
+	this->tick_start = now;
+	this->tick_cpu = cpu;
+
+	stats.Add("frames drawn", action == FRAME_FULL ? 1 : 0);
+	stats.Add("frames partial", action == FRAME_PARTIAL ? 1 : 0);
+	stats.Add("frames skipped", action == FRAME_SKIP ? 1 : 0);
+	if (action == FRAME_PARTIAL)
+		stats.Add("redrawn pixels", (double)(this->region.z - this->region.x) * (this->region.w - this->region.y));
+}
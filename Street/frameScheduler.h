@@ -0,0 +1,59 @@
+#pragma once
+#include <glm/glm.hpp>
+
+class Scene;
+
+
+// Why a frame has to be drawn
+enum DirtyFlags
+{
+	DIRTY_CAMERA = 1,		// The view or the projection changed
+	DIRTY_ANIMATION = 2,	// A visible object moved, or a moved object left the view
+	DIRTY_RESOURCES = 4,	// Objects, lights or lightmaps were added or removed
+	DIRTY_SETTINGS = 8,		// A render setting or the size of the frame changed
+	DIRTY_ALL = 15
+};
+
+enum FrameAction
+{
+	FRAME_SKIP,			// Nothing changed, the last frame is still right
+	FRAME_PARTIAL,		// Only moving objects changed, their region is redrawn
+	FRAME_FULL
+};
+
+// Keeps track of what changed since the last frame and decides how much of the next one has to be drawn
+// When nothing needs the loop anymore (no animations, no input, nothing streaming) the game can wait for input
+class FrameScheduler
+{
+private:
+	bool enabled = true;
+	bool partial = false;
+	unsigned int dirty = DIRTY_ALL;
+
+	// Temporal anti aliasing keeps converging for a few frames after the last change
+	int settle_frames = 0;
+
+	glm::mat4 last_view_projection;
+	int last_width = 0;
+	int last_height = 0;
+
+	// Where moving objects were last frame, that part has to be redrawn once they are gone
+	glm::ivec4 region;
+	glm::ivec4 last_region;
+	bool has_last_region = false;
+
+	// Utilization over the ticks
+	double tick_start = 0.0;
+	double tick_cpu = 0.0;
+public:
+	bool IsEnabled() const;
+	void Toggle();
+	bool IsPartial() const;
+	void TogglePartial();
+
+	void MarkDirty(unsigned int flags);
+	bool NeedsFrames() const;
+	FrameAction Decide(Scene & scene, const glm::mat4 & view_projection, int width, int height, int settle_frames, bool allow_partial);
+	const glm::ivec4 & Region() const;
+	void EndTick(FrameAction action, double gpu_ms);
+};
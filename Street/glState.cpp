@@ -0,0 +1,754 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "glState.h"
+#include "stats.h"
+
+GlState gl_state;
+
+// Value of a binding the cache doesn't know, no gl name or enum has it
+static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+// Types a cached uniform value was written as
+static const unsigned char UNIFORM_FLOAT = 1;
+static const unsigned char UNIFORM_INT = 2;
+static const unsigned char UNIFORM_UNSIGNED = 3;
+
+static const char * CALL_NAMES[CALL_KINDS] = { "program", "vertex array", "texture", "buffer", "framebuffer", "fixed function", "uniform" };
+
+static const GLenum TEXTURE_TARGETS[4] = { GL_TEXTURE_2D, GL_TEXTURE_2D_MULTISAMPLE, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP };
+static const GLenum BUFFER_TARGETS[8] = { GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER, GL_ATOMIC_COUNTER_BUFFER,
+	GL_DRAW_INDIRECT_BUFFER, GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_COPY_WRITE_BUFFER };
+static const GLenum INDEXED_TARGETS[3] = { GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER, GL_ATOMIC_COUNTER_BUFFER };
+static const GLenum CAPABILITIES[6] = { GL_DEPTH_TEST, GL_SCISSOR_TEST, GL_MULTISAMPLE, GL_POLYGON_OFFSET_FILL, GL_CULL_FACE, GL_BLEND };
+
+#ifdef GL_STATE_VALIDATE
+static const GLenum TEXTURE_BINDINGS[4] = { GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_2D_MULTISAMPLE, GL_TEXTURE_BINDING_2D_ARRAY, GL_TEXTURE_BINDING_CUBE_MAP };
+static const GLenum BUFFER_BINDINGS[8] = { GL_ARRAY_BUFFER_BINDING, GL_UNIFORM_BUFFER_BINDING, GL_SHADER_STORAGE_BUFFER_BINDING, GL_ATOMIC_COUNTER_BUFFER_BINDING,
+	GL_DRAW_INDIRECT_BUFFER_BINDING, GL_PIXEL_PACK_BUFFER_BINDING, GL_PIXEL_UNPACK_BUFFER_BINDING, GL_COPY_WRITE_BUFFER_BINDING };
+#endif
+
+
+static GLint GetInteger(GLenum name)
+{
+	GLint value = 0;
+	glGetIntegerv(name, &value);
+	return value;
+}
+
+
+/// <summary>
+/// Returns the index of an enum in a table, or -1 when the cache doesn't track it
+/// </summary>
+template <int N>
+static int Find(const GLenum (&table)[N], GLenum value)
+{
+	for (int i = 0; i < N; i++)
+		if (table[i] == value)
+			return i;
+	return -1;
+}
+
+
+/// <summary>
+/// ctor, nothing is known about the context yet
+/// </summary>
+GlState::GlState()
+{
+	Invalidate();
+}
+
+
+bool GlState::IsEnabled() const
+{
+	return this->enabled;
+}
+
+
+/// <summary>
+/// Turns dropping redundant calls on and off, the state stays tracked either way so it can be turned back on any time
+/// </summary>
+void GlState::Toggle()
+{
+	this->enabled = !this->enabled;
+	printf("Gl state cache: %s\n", this->enabled ? "on" : "off");
+}
+
+
+/// <summary>
+/// Forgets everything that is cached, for when code outside of the cache (a library, a new context) changed the state
+/// </summary>
+void GlState::Invalidate()
+{
+	this->program = UNKNOWN;
+	this->vertex_array = UNKNOWN;
+	this->active_unit = UNKNOWN;
+	memset(this->textures, 0xFF, sizeof(this->textures));
+	memset(this->buffers, 0xFF, sizeof(this->buffers));
+	for (auto & target : this->indexed)
+		for (auto & binding : target)
+			binding = Binding{ UNKNOWN, 0, 0 };
+	this->draw_framebuffer = UNKNOWN;
+	this->read_framebuffer = UNKNOWN;
+	this->viewport[0] = this->viewport[1] = this->viewport[2] = this->viewport[3] = -1;
+	memset(this->capabilities, 2, sizeof(this->capabilities));
+	this->depth_func = UNKNOWN;
+	this->depth_mask = -1;
+	this->color_mask = -1;
+	this->uniforms.clear();
+	this->current_uniforms = nullptr;
+}
+
+
+/// <summary>
+/// Counts a call that would not have changed anything, with the cache off it is made anyway
+/// </summary>
+/// <returns>Whether the call can be dropped</returns>
+bool GlState::Hit(GlStateCall kind)
+{
+	if (!this->enabled)
+	{
+		this->misses[kind]++;
+		return false;
+	}
+	this->hits[kind]++;
+	return true;
+}
+
+
+void GlState::Miss(GlStateCall kind)
+{
+	this->misses[kind]++;
+}
+
+
+#ifdef GL_STATE_VALIDATE
+/// <summary>
+/// Compares a value the cache dropped a call for with the one gl has, a difference means someone changed the state
+/// without going through the cache
+/// </summary>
+void GlState::Validate(const char * what, GLint cached, GLint driver)
+{
+	if (cached == driver)
+		return;
+	printf("Gl state desync: %s is %d, the cache had %d\n", what, driver, cached);
+	this->desyncs++;
+}
+
+
+void GlState::ValidateUniform(GLint location, const Uniform & value)
+{
+	unsigned char driver[GL_STATE_UNIFORM_BYTES];
+	if (value.type == UNIFORM_FLOAT)
+		glGetUniformfv(this->program, location, (GLfloat *)driver);
+	else if (value.type == UNIFORM_INT)
+		glGetUniformiv(this->program, location, (GLint *)driver);
+	else
+		glGetUniformuiv(this->program, location, (GLuint *)driver);
+
+	if (memcmp(driver, value.data, value.bytes) == 0)
+		return;
+	printf("Gl state desync: uniform %d of program %u differs from the cache\n", location, this->program);
+	this->desyncs++;
+}
+#endif
+
+
+/// <summary>
+/// Makes a texture unit active, the texture binds choose the unit themselves so nothing relies on the active one
+/// </summary>
+void GlState::SetActiveUnit(GLuint unit)
+{
+	if (unit == this->active_unit && Hit(CALL_TEXTURE))
+	{
+#ifdef GL_STATE_VALIDATE
+		Validate("active texture", GL_TEXTURE0 + unit, GetInteger(GL_ACTIVE_TEXTURE));
+#endif
+		return;
+	}
+	if (unit != this->active_unit)
+		Miss(CALL_TEXTURE);
+	this->active_unit = unit;
+	glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+
+void GlState::UseProgram(GLuint program)
+{
+	if (program == this->program && Hit(CALL_PROGRAM))
+	{
+#ifdef GL_STATE_VALIDATE
+		Validate("current program", program, GetInteger(GL_CURRENT_PROGRAM));
+#endif
+		return;
+	}
+	if (program != this->program)
+		Miss(CALL_PROGRAM);
+	this->program = program;
+	this->current_uniforms = &this->uniforms[program];
+	glUseProgram(program);
+}
+
+
+void GlState::BindVertexArray(GLuint vertex_array)
+{
+	if (vertex_array == this->vertex_array && Hit(CALL_VERTEX_ARRAY))
+	{
+#ifdef GL_STATE_VALIDATE
+		Validate("vertex array", vertex_array, GetInteger(GL_VERTEX_ARRAY_BINDING));
+#endif
+		return;
+	}
+	if (vertex_array != this->vertex_array)
+		Miss(CALL_VERTEX_ARRAY);
+	this->vertex_array = vertex_array;
+	glBindVertexArray(vertex_array);
+}
+
+
+/// <summary>
+/// Binds a texture to a unit, the unit is made active first (when it isn't already)
+/// Units and targets past the ones that are tracked are always bound
+/// </summary>
+/// <param name="unit">Unit index, not GL_TEXTURE0 + unit</param>
+/// <param name="target"></param>
+/// <param name="texture"></param>
+void GlState::BindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	const int index = Find(TEXTURE_TARGETS, target);
+	if (unit >= (GLuint)GL_STATE_TEXTURE_UNITS || index < 0)
+	{
+		SetActiveUnit(unit);
+		Miss(CALL_TEXTURE);
+		glBindTexture(target, texture);
+		return;
+	}
+
+	GLuint & bound = this->textures[unit][index];
+	if (texture == bound && Hit(CALL_TEXTURE))
+	{
+#ifdef GL_STATE_VALIDATE
+		const GLint active = GetInteger(GL_ACTIVE_TEXTURE);
+		glActiveTexture(GL_TEXTURE0 + unit);
+		Validate("texture binding", texture, GetInteger(TEXTURE_BINDINGS[index]));
+		glActiveTexture(active);
+#endif
+		return;
+	}
+	SetActiveUnit(unit);
+	if (texture != bound)
+		Miss(CALL_TEXTURE);
+	bound = texture;
+	glBindTexture(target, texture);
+}
+
+
+/// <summary>
+/// Binds a buffer to a generic target, the element array buffer is part of the vertex array and always bound
+/// </summary>
+void GlState::BindBuffer(GLenum target, GLuint buffer)
+{
+	const int index = Find(BUFFER_TARGETS, target);
+	if (index < 0)
+	{
+		Miss(CALL_BUFFER);
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	if (buffer == this->buffers[index] && Hit(CALL_BUFFER))
+	{
+#ifdef GL_STATE_VALIDATE
+		Validate("buffer binding", buffer, GetInteger(BUFFER_BINDINGS[index]));
+#endif
+		return;
+	}
+	if (buffer != this->buffers[index])
+		Miss(CALL_BUFFER);
+	this->buffers[index] = buffer;
+	glBindBuffer(target, buffer);
+}
+
+
+/// <summary>
+/// Binds a whole buffer to an indexed binding, like gl it binds the generic target as well
+/// </summary>
+void GlState::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	BindBufferRange(target, index, buffer, 0, 0);
+}
+
+
+/// <summary>
+/// Binds part of a buffer to an indexed binding, like gl it binds the generic target as well
+/// A size of 0 binds the whole buffer (glBindBufferBase)
+/// </summary>
+void GlState::BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	const int target_index = Find(INDEXED_TARGETS, target);
+	const int generic = Find(BUFFER_TARGETS, target);
+	if (target_index >= 0 && index < (GLuint)GL_STATE_BUFFER_INDICES)
+	{
+		Binding & bound = this->indexed[target_index][index];
+		if (bound.buffer == buffer && bound.offset == offset && bound.size == size && this->buffers[generic] == buffer && Hit(CALL_BUFFER))
+		{
+#ifdef GL_STATE_VALIDATE
+			GLint driver = 0;
+			glGetIntegeri_v(INDEXED_TARGETS[target_index] == GL_UNIFORM_BUFFER ? GL_UNIFORM_BUFFER_BINDING :
+				INDEXED_TARGETS[target_index] == GL_SHADER_STORAGE_BUFFER ? GL_SHADER_STORAGE_BUFFER_BINDING : GL_ATOMIC_COUNTER_BUFFER_BINDING, index, &driver);
+			Validate("indexed buffer binding", buffer, driver);
+#endif
+			return;
+		}
+		if (bound.buffer != buffer || bound.offset != offset || bound.size != size || this->buffers[generic] != buffer)
+			Miss(CALL_BUFFER);
+		bound = Binding{ buffer, offset, size };
+	}
+	else
+		Miss(CALL_BUFFER);
+
+	if (generic >= 0)
+		this->buffers[generic] = buffer;
+	if (size == 0)
+		glBindBufferBase(target, index, buffer);
+	else
+		glBindBufferRange(target, index, buffer, offset, size);
+}
+
+
+/// <summary>
+/// Binds a framebuffer, GL_FRAMEBUFFER binds it for drawing and reading
+/// </summary>
+void GlState::BindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	const bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	const bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	if ((!draw || this->draw_framebuffer == framebuffer) && (!read || this->read_framebuffer == framebuffer) && Hit(CALL_FRAMEBUFFER))
+	{
+#ifdef GL_STATE_VALIDATE
+		if (draw)
+			Validate("draw framebuffer", framebuffer, GetInteger(GL_DRAW_FRAMEBUFFER_BINDING));
+		if (read)
+			Validate("read framebuffer", framebuffer, GetInteger(GL_READ_FRAMEBUFFER_BINDING));
+#endif
+		return;
+	}
+	if ((draw && this->draw_framebuffer != framebuffer) || (read && this->read_framebuffer != framebuffer))
+		Miss(CALL_FRAMEBUFFER);
+	if (draw)
+		this->draw_framebuffer = framebuffer;
+	if (read)
+		this->read_framebuffer = framebuffer;
+	glBindFramebuffer(target, framebuffer);
+}
+
+
+void GlState::Enable(GLenum capability)
+{
+	const int index = Find(CAPABILITIES, capability);
+	if (index >= 0 && this->capabilities[index] == 1 && Hit(CALL_FIXED_FUNCTION))
+	{
+#ifdef GL_STATE_VALIDATE
+		Validate("capability", 1, glIsEnabled(capability));
+#endif
+		return;
+	}
+	if (index < 0 || this->capabilities[index] != 1)
+		Miss(CALL_FIXED_FUNCTION);
+	if (index >= 0)
+		this->capabilities[index] = 1;
+	glEnable(capability);
+}
+
+
+void GlState::Disable(GLenum capability)
+{
+	const int index = Find(CAPABILITIES, capability);
+	if (index >= 0 && this->capabilities[index] == 0 && Hit(CALL_FIXED_FUNCTION))
+	{
+#ifdef GL_STATE_VALIDATE
+		Validate("capability", 0, glIsEnabled(capability));
+#endif
+		return;
+	}
+	if (index < 0 || this->capabilities[index] != 0)
+		Miss(CALL_FIXED_FUNCTION);
+	if (index >= 0)
+		this->capabilities[index] = 0;
+	glDisable(capability);
+}
+
+
+void GlState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	const bool same = this->viewport[0] == x && this->viewport[1] == y && this->viewport[2] == width && this->viewport[3] == height;
+	if (same && Hit(CALL_FIXED_FUNCTION))
+	{
+#ifdef GL_STATE_VALIDATE
+		GLint driver[4];
+		glGetIntegerv(GL_VIEWPORT, driver);
+		Validate("viewport width", width, driver[2]);
+		Validate("viewport height", height, driver[3]);
+#endif
+		return;
+	}
+	if (!same)
+		Miss(CALL_FIXED_FUNCTION);
+	this->viewport[0] = x;
+	this->viewport[1] = y;
+	this->viewport[2] = width;
+	this->viewport[3] = height;
+	glViewport(x, y, width, height);
+}
+
+
+void GlState::DepthFunc(GLenum func)
+{
+	if (func == this->depth_func && Hit(CALL_FIXED_FUNCTION))
+	{
+#ifdef GL_STATE_VALIDATE
+		Validate("depth func", func, GetInteger(GL_DEPTH_FUNC));
+#endif
+		return;
+	}
+	if (func != this->depth_func)
+		Miss(CALL_FIXED_FUNCTION);
+	this->depth_func = func;
+	glDepthFunc(func);
+}
+
+
+void GlState::DepthMask(GLboolean mask)
+{
+	if (mask == this->depth_mask && Hit(CALL_FIXED_FUNCTION))
+	{
+#ifdef GL_STATE_VALIDATE
+		GLboolean driver = GL_FALSE;
+		glGetBooleanv(GL_DEPTH_WRITEMASK, &driver);
+		Validate("depth mask", mask, driver);
+#endif
+		return;
+	}
+	if (mask != this->depth_mask)
+		Miss(CALL_FIXED_FUNCTION);
+	this->depth_mask = mask;
+	glDepthMask(mask);
+}
+
+
+void GlState::ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+	const int mask = (red ? 1 : 0) | (green ? 2 : 0) | (blue ? 4 : 0) | (alpha ? 8 : 0);
+	if (mask == this->color_mask && Hit(CALL_FIXED_FUNCTION))
+	{
+#ifdef GL_STATE_VALIDATE
+		GLboolean driver[4];
+		glGetBooleanv(GL_COLOR_WRITEMASK, driver);
+		Validate("color mask", mask, (driver[0] ? 1 : 0) | (driver[1] ? 2 : 0) | (driver[2] ? 4 : 0) | (driver[3] ? 8 : 0));
+#endif
+		return;
+	}
+	if (mask != this->color_mask)
+		Miss(CALL_FIXED_FUNCTION);
+	this->color_mask = mask;
+	glColorMask(red, green, blue, alpha);
+}
+
+
+/// <summary>
+/// Returns the framebuffer that is drawn to
+/// </summary>
+GLuint GlState::DrawFramebuffer()
+{
+	if (this->draw_framebuffer == UNKNOWN)
+		this->draw_framebuffer = GetInteger(GL_DRAW_FRAMEBUFFER_BINDING);
+	return this->draw_framebuffer;
+}
+
+
+/// <summary>
+/// Returns the viewport as x, y, width and height
+/// </summary>
+void GlState::GetViewport(GLint * viewport)
+{
+	if (this->viewport[2] < 0)
+		glGetIntegerv(GL_VIEWPORT, this->viewport);
+	memcpy(viewport, this->viewport, sizeof(this->viewport));
+}
+
+
+bool GlState::IsEnabled(GLenum capability)
+{
+	const int index = Find(CAPABILITIES, capability);
+	if (index < 0)
+		return glIsEnabled(capability) == GL_TRUE;
+	if (this->capabilities[index] > 1)
+		this->capabilities[index] = glIsEnabled(capability) ? 1 : 0;
+	return this->capabilities[index] == 1;
+}
+
+
+/// <summary>
+/// Stores a uniform value of the current program
+/// </summary>
+/// <returns>Whether it differs from the value the program had, the caller sets it then</returns>
+bool GlState::SetUniform(GLint location, unsigned char type, const void * data, size_t bytes)
+{
+	if (this->current_uniforms == nullptr)
+	{
+		Miss(CALL_UNIFORM);
+		return true;
+	}
+
+	std::vector<Uniform> & values = *this->current_uniforms;
+	if (values.size() <= (size_t)location)
+		values.resize(location + 1, Uniform{ 0, 0, {} });
+
+	Uniform & value = values[location];
+	if (value.type == type && value.bytes == bytes && memcmp(value.data, data, bytes) == 0 && Hit(CALL_UNIFORM))
+	{
+#ifdef GL_STATE_VALIDATE
+		ValidateUniform(location, value);
+#endif
+		return false;
+	}
+	if (value.type != type || value.bytes != bytes || memcmp(value.data, data, bytes) != 0)
+		Miss(CALL_UNIFORM);
+	value.type = type;
+	value.bytes = (unsigned char)bytes;
+	memcpy(value.data, data, bytes);
+	return true;
+}
+
+
+void GlState::Uniform1i(GLint location, GLint x)
+{
+	if (location >= 0 && SetUniform(location, UNIFORM_INT, &x, sizeof(x)))
+		glUniform1i(location, x);
+}
+
+
+void GlState::Uniform1f(GLint location, GLfloat x)
+{
+	if (location >= 0 && SetUniform(location, UNIFORM_FLOAT, &x, sizeof(x)))
+		glUniform1f(location, x);
+}
+
+
+void GlState::Uniform2f(GLint location, GLfloat x, GLfloat y)
+{
+	const GLfloat value[2] = { x, y };
+	if (location >= 0 && SetUniform(location, UNIFORM_FLOAT, value, sizeof(value)))
+		glUniform2f(location, x, y);
+}
+
+
+/// <summary>
+/// Sets a vec2, arrays of them are not cached (their elements have locations of their own)
+/// </summary>
+void GlState::Uniform2fv(GLint location, GLsizei count, const GLfloat * value)
+{
+	if (location < 0)
+		return;
+	if (count != 1)
+	{
+		Miss(CALL_UNIFORM);
+		if (this->current_uniforms != nullptr)
+			this->current_uniforms->clear();
+		glUniform2fv(location, count, value);
+		return;
+	}
+	if (SetUniform(location, UNIFORM_FLOAT, value, 2 * sizeof(GLfloat)))
+		glUniform2fv(location, 1, value);
+}
+
+
+void GlState::Uniform3fv(GLint location, GLsizei count, const GLfloat * value)
+{
+	if (location < 0)
+		return;
+	if (count != 1)
+	{
+		Miss(CALL_UNIFORM);
+		if (this->current_uniforms != nullptr)
+			this->current_uniforms->clear();
+		glUniform3fv(location, count, value);
+		return;
+	}
+	if (SetUniform(location, UNIFORM_FLOAT, value, 3 * sizeof(GLfloat)))
+		glUniform3fv(location, 1, value);
+}
+
+
+void GlState::Uniform3ui(GLint location, GLuint x, GLuint y, GLuint z)
+{
+	const GLuint value[3] = { x, y, z };
+	if (location >= 0 && SetUniform(location, UNIFORM_UNSIGNED, value, sizeof(value)))
+		glUniform3ui(location, x, y, z);
+}
+
+
+/// <summary>
+/// Sets a mat4, transposed matrices are cached as they were passed since gl reads them back the other way around
+/// </summary>
+void GlState::UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat * value)
+{
+	if (location < 0)
+		return;
+	if (count != 1 || transpose)
+	{
+		Miss(CALL_UNIFORM);
+		if (this->current_uniforms != nullptr)
+			this->current_uniforms->clear();
+		glUniformMatrix4fv(location, count, transpose, value);
+		return;
+	}
+	if (SetUniform(location, UNIFORM_FLOAT, value, 16 * sizeof(GLfloat)))
+		glUniformMatrix4fv(location, 1, GL_FALSE, value);
+}
+
+
+/// <summary>
+/// Deletes a program, a new program can get its name so its uniform values are forgotten
+/// </summary>
+void GlState::DeleteProgram(GLuint program)
+{
+	this->uniforms.erase(program);
+	if (program == this->program)
+	{
+		// It stays in use until another program is bound, but its name may already be handed out again
+		this->program = UNKNOWN;
+		this->current_uniforms = nullptr;
+	}
+	glDeleteProgram(program);
+}
+
+
+/// <summary>
+/// Deletes vertex arrays, gl binds 0 in place of a bound one
+/// </summary>
+void GlState::DeleteVertexArrays(GLsizei count, const GLuint * vertex_arrays)
+{
+	for (GLsizei i = 0; i < count; i++)
+		if (vertex_arrays[i] != 0 && vertex_arrays[i] == this->vertex_array)
+			this->vertex_array = 0;
+	glDeleteVertexArrays(count, vertex_arrays);
+}
+
+
+/// <summary>
+/// Deletes textures, every unit they were bound to has 0 bound afterwards
+/// </summary>
+void GlState::DeleteTextures(GLsizei count, const GLuint * textures)
+{
+	for (GLsizei i = 0; i < count; i++)
+		for (auto & unit : this->textures)
+			for (auto & bound : unit)
+				if (textures[i] != 0 && bound == textures[i])
+					bound = 0;
+	glDeleteTextures(count, textures);
+}
+
+
+/// <summary>
+/// Deletes buffers, the generic bindings fall back to 0
+/// Drivers differ in what happens to the indexed bindings, those are forgotten
+/// </summary>
+void GlState::DeleteBuffers(GLsizei count, const GLuint * buffers)
+{
+	for (GLsizei i = 0; i < count; i++)
+	{
+		if (buffers[i] == 0)
+			continue;
+		for (auto & bound : this->buffers)
+			if (bound == buffers[i])
+				bound = 0;
+		for (auto & target : this->indexed)
+			for (auto & binding : target)
+				if (binding.buffer == buffers[i])
+					binding = Binding{ UNKNOWN, 0, 0 };
+	}
+	glDeleteBuffers(count, buffers);
+}
+
+
+/// <summary>
+/// Deletes framebuffers, the window is bound in place of a bound one
+/// </summary>
+void GlState::DeleteFramebuffers(GLsizei count, const GLuint * framebuffers)
+{
+	for (GLsizei i = 0; i < count; i++)
+	{
+		if (framebuffers[i] == 0)
+			continue;
+		if (this->draw_framebuffer == framebuffers[i])
+			this->draw_framebuffer = 0;
+		if (this->read_framebuffer == framebuffers[i])
+			this->read_framebuffer = 0;
+	}
+	glDeleteFramebuffers(count, framebuffers);
+}
+
+
+/// <summary>
+/// Closes the frame, the calls made and dropped go to the stats
+/// </summary>
+void GlState::EndFrame()
+{
+	long long hits = 0;
+	long long misses = 0;
+	for (int kind = 0; kind < CALL_KINDS; kind++)
+	{
+		hits += this->hits[kind];
+		misses += this->misses[kind];
+		this->total_hits[kind] += this->hits[kind];
+		this->total_misses[kind] += this->misses[kind];
+		this->hits[kind] = 0;
+		this->misses[kind] = 0;
+	}
+	stats.Add("gl calls", (double)misses);
+	stats.Add("gl redundant calls", (double)hits);
+}
+
+
+/// <summary>
+/// Returns the calls that reached gl so far
+/// </summary>
+long long GlState::Calls() const
+{
+	long long calls = 0;
+	for (int kind = 0; kind < CALL_KINDS; kind++)
+		calls += this->total_misses[kind] + this->misses[kind];
+	return calls;
+}
+
+
+/// <summary>
+/// Returns the calls that were dropped so far
+/// </summary>
+long long GlState::Skipped() const
+{
+	long long skipped = 0;
+	for (int kind = 0; kind < CALL_KINDS; kind++)
+		skipped += this->total_hits[kind] + this->hits[kind];
+	return skipped;
+}
+
+
+/// <summary>
+/// Prints how many calls of every kind were made and dropped since the start
+/// </summary>
+void GlState::PrintReport() const
+{
+	printf("---- gl state cache (%s)\n", this->enabled ? "on" : "off");
+	printf("  %-16s %14s %14s %8s\n", "kind", "calls", "dropped", "hit %");
+	for (int kind = 0; kind < CALL_KINDS; kind++)
+	{
+		const long long misses = this->total_misses[kind] + this->misses[kind];
+		const long long hits = this->total_hits[kind] + this->hits[kind];
+		printf("  %-16s %14lld %14lld %8.1f\n", CALL_NAMES[kind], misses, hits, misses + hits > 0 ? 100.0 * hits / (misses + hits) : 0.0);
+	}
+#ifdef GL_STATE_VALIDATE
+	printf("  %d desyncs with gl\n", this->desyncs);
+#endif
+}
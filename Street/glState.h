@@ -0,0 +1,134 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <GL/glew.h>
+
+
+// Texture units and indexed buffer bindings the cache keeps track of, higher ones go straight to the driver
+const int GL_STATE_TEXTURE_UNITS = 16;
+const int GL_STATE_BUFFER_INDICES = 16;
+
+// Biggest uniform value that is cached (a mat4), bigger arrays are always set
+const int GL_STATE_UNIFORM_BYTES = 64;
+
+// Debug builds compare every call the cache drops with what glGet says, a mismatch means a gl call went around the cache
+#ifdef _DEBUG
+#define GL_STATE_VALIDATE
+#endif
+
+// Kinds of calls the hits and misses are counted for
+enum GlStateCall
+{
+	CALL_PROGRAM,
+	CALL_VERTEX_ARRAY,
+	CALL_TEXTURE,
+	CALL_BUFFER,
+	CALL_FRAMEBUFFER,
+	CALL_FIXED_FUNCTION,	// Capabilities, viewport, depth and color masks
+	CALL_UNIFORM,
+	CALL_KINDS
+};
+
+// Shadow copy of the gl binding state and of the uniform values of every program
+// All binds and uniform writes go through it, calls that wouldn't change anything never reach the driver
+// Only the state of a single context is tracked, objects have to be deleted through it as well so a reused name isn't
+// mistaken for the deleted object. The element array buffer belongs to the vertex array and isn't tracked
+class GlState
+{
+private:
+	struct Binding
+	{
+		GLuint buffer;
+		GLintptr offset;
+		GLsizeiptr size;
+	};
+
+	struct Uniform
+	{
+		unsigned char type;		// 0 unknown, then float, int or unsigned
+		unsigned char bytes;
+		unsigned char data[GL_STATE_UNIFORM_BYTES];
+	};
+
+	// Every value starts out unknown (see Invalidate), the first call that sets it always goes through
+	bool enabled = true;
+	GLuint program;
+	GLuint vertex_array;
+	GLuint active_unit;
+	GLuint textures[GL_STATE_TEXTURE_UNITS][4];
+	GLuint buffers[8];
+	Binding indexed[3][GL_STATE_BUFFER_INDICES];
+	GLuint draw_framebuffer;
+	GLuint read_framebuffer;
+	GLint viewport[4];
+	unsigned char capabilities[6];
+	GLenum depth_func;
+	int depth_mask;
+	int color_mask;
+
+	// Uniform values of every program the cache has seen, they belong to the program so binding another keeps them
+	std::unordered_map<GLuint, std::vector<Uniform>> uniforms;
+	std::vector<Uniform> * current_uniforms = nullptr;
+
+	long long hits[CALL_KINDS] = {};
+	long long misses[CALL_KINDS] = {};
+	long long total_hits[CALL_KINDS] = {};
+	long long total_misses[CALL_KINDS] = {};
+	int desyncs = 0;
+
+	bool Hit(GlStateCall kind);
+	void Miss(GlStateCall kind);
+	void SetActiveUnit(GLuint unit);
+	bool SetUniform(GLint location, unsigned char type, const void * data, size_t bytes);
+#ifdef GL_STATE_VALIDATE
+	void Validate(const char * what, GLint cached, GLint driver);
+	void ValidateUniform(GLint location, const Uniform & value);
+#endif
+public:
+	GlState();
+
+	bool IsEnabled() const;
+	void Toggle();
+	void Invalidate();
+
+	void UseProgram(GLuint program);
+	void BindVertexArray(GLuint vertex_array);
+	void BindTexture(GLuint unit, GLenum target, GLuint texture);
+	void BindBuffer(GLenum target, GLuint buffer);
+	void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+	void BindFramebuffer(GLenum target, GLuint framebuffer);
+
+	void Enable(GLenum capability);
+	void Disable(GLenum capability);
+	void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void DepthFunc(GLenum func);
+	void DepthMask(GLboolean mask);
+	void ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+
+	// Current state, asked from gl once when the cache doesn't know it
+	GLuint DrawFramebuffer();
+	void GetViewport(GLint * viewport);
+	bool IsEnabled(GLenum capability);
+
+	void Uniform1i(GLint location, GLint x);
+	void Uniform1f(GLint location, GLfloat x);
+	void Uniform2f(GLint location, GLfloat x, GLfloat y);
+	void Uniform2fv(GLint location, GLsizei count, const GLfloat * value);
+	void Uniform3fv(GLint location, GLsizei count, const GLfloat * value);
+	void Uniform3ui(GLint location, GLuint x, GLuint y, GLuint z);
+	void UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat * value);
+
+	void DeleteProgram(GLuint program);
+	void DeleteVertexArrays(GLsizei count, const GLuint * vertex_arrays);
+	void DeleteTextures(GLsizei count, const GLuint * textures);
+	void DeleteBuffers(GLsizei count, const GLuint * buffers);
+	void DeleteFramebuffers(GLsizei count, const GLuint * framebuffers);
+
+	void EndFrame();
+	long long Calls() const;
+	long long Skipped() const;
+	void PrintReport() const;
+};
+
+extern GlState gl_state;
@@ -0,0 +1,245 @@
+#include <stdio.h>
+
+#include "glStorage.h"
+#include "glState.h"
+
+static StorageBackend backend = STORAGE_BIND;
+static long long calls = 0;
+
+static const char * BACKEND_NAMES[STORAGE_BACKENDS] = { "bind to edit", "direct state access" };
+
+
+const char * StorageBackendName(StorageBackend backend)
+{
+	return backend >= 0 && backend < STORAGE_BACKENDS ? BACKEND_NAMES[backend] : "unknown";
+}
+
+
+/// <summary>
+/// Whether the context can use a backend, the direct one needs direct state access and buffer storage
+/// </summary>
+bool IsStorageBackendSupported(StorageBackend backend)
+{
+	if (backend == STORAGE_DIRECT)
+		return (GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access) && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage);
+	return backend == STORAGE_BIND;
+}
+
+
+/// <summary>
+/// Picks the direct backend when the context has it, the bind backend otherwise
+/// </summary>
+void InitStorageBackend()
+{
+	SetStorageBackend(IsStorageBackendSupported(STORAGE_DIRECT) ? STORAGE_DIRECT : STORAGE_BIND);
+	printf("Gpu storage: %s\n", StorageBackendName(backend));
+}
+
+
+/// <summary>
+/// Switches the backend for everything created afterwards, an unsupported backend falls back to binding
+/// </summary>
+void SetStorageBackend(StorageBackend selected)
+{
+	backend = IsStorageBackendSupported(selected) ? selected : STORAGE_BIND;
+}
+
+
+StorageBackend GetStorageBackend()
+{
+	return backend;
+}
+
+
+long long StorageCalls()
+{
+	return calls;
+}
+
+
+/// <summary>
+/// Creates a buffer with its contents
+/// </summary>
+/// <param name="size">Bytes</param>
+/// <param name="data">Contents, nullptr to leave it undefined</param>
+/// <param name="flags">glBufferStorage flags, 0 for a buffer that is never written again</param>
+/// <param name="usage">glBufferData hint for the bind backend</param>
+/// <returns>The buffer</returns>
+GLuint CreateBuffer(GLsizeiptr size, const void * data, GLbitfield flags, GLenum usage)
+{
+	GLuint buffer;
+	if (backend == STORAGE_DIRECT)
+	{
+		// Immutable storage can't be empty, a mesh without lightmap uvs still gets its buffer
+		glCreateBuffers(1, &buffer);
+		glNamedBufferStorage(buffer, size > 0 ? size : 1, size > 0 ? data : nullptr, flags);
+		calls += 2;
+		return buffer;
+	}
+
+	// The copy write target isn't used for drawing, binding it disturbs nothing
+	glGenBuffers(1, &buffer);
+	gl_state.BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, data, usage);
+	gl_state.BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	calls += 4;
+	return buffer;
+}
+
+
+/// <summary>
+/// Creates a single level 2D texture and uploads its pixels
+/// </summary>
+/// <param name="internal_format">Format of the texture</param>
+/// <param name="width"></param>
+/// <param name="height"></param>
+/// <param name="format">Format of the pixels</param>
+/// <param name="type">Type of the pixels</param>
+/// <param name="pixels"></param>
+/// <returns>The texture</returns>
+GLuint CreateTexture2D(GLenum internal_format, int width, int height, GLenum format, GLenum type, const void * pixels)
+{
+	GLuint texture;
+	if (backend == STORAGE_DIRECT)
+	{
+		glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+		glTextureStorage2D(texture, 1, internal_format, width, height);
+		glTextureSubImage2D(texture, 0, 0, 0, width, height, format, type, pixels);
+		calls += 3;
+		return texture;
+	}
+
+	glGenTextures(1, &texture);
+	gl_state.BindTexture(0, GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, pixels);
+	gl_state.BindTexture(0, GL_TEXTURE_2D, 0);
+	calls += 4;
+	return texture;
+}
+
+
+/// <summary>
+/// Creates a single level texture to render to
+/// </summary>
+/// <param name="internal_format"></param>
+/// <param name="width"></param>
+/// <param name="height"></param>
+/// <param name="samples">Samples per pixel, above 1 it is a multisampled texture</param>
+/// <returns>The texture</returns>
+GLuint CreateTextureStorage(GLenum internal_format, int width, int height, int samples)
+{
+	const GLenum target = samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+	GLuint texture;
+	if (backend == STORAGE_DIRECT)
+	{
+		glCreateTextures(target, 1, &texture);
+		if (samples > 1)
+			glTextureStorage2DMultisample(texture, samples, internal_format, width, height, GL_TRUE);
+		else
+			glTextureStorage2D(texture, 1, internal_format, width, height);
+		calls += 2;
+		return texture;
+	}
+
+	glGenTextures(1, &texture);
+	gl_state.BindTexture(0, target, texture);
+	if (samples > 1)
+		glTexStorage2DMultisample(target, samples, internal_format, width, height, GL_TRUE);
+	else
+		glTexStorage2D(target, 1, internal_format, width, height);
+	gl_state.BindTexture(0, target, 0);
+	calls += 4;
+	return texture;
+}
+
+
+/// <summary>
+/// Sets the filtering and wrapping of a 2D texture
+/// </summary>
+/// <param name="texture"></param>
+/// <param name="filter">Minification and magnification filter</param>
+/// <param name="wrap">Wrapping of both axes</param>
+/// <param name="compare_func">Depth comparison of sampler2DShadow lookups, GL_NONE for none</param>
+void SetTextureSampling(GLuint texture, GLenum filter, GLenum wrap, GLenum compare_func)
+{
+	if (backend == STORAGE_DIRECT)
+	{
+		glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, filter);
+		glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, filter);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_S, wrap);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_T, wrap);
+		calls += 4;
+		if (compare_func != GL_NONE)
+		{
+			glTextureParameteri(texture, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTextureParameteri(texture, GL_TEXTURE_COMPARE_FUNC, compare_func);
+			calls += 2;
+		}
+		return;
+	}
+
+	gl_state.BindTexture(0, GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+	calls += 6;
+	if (compare_func != GL_NONE)
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, compare_func);
+		calls += 2;
+	}
+	gl_state.BindTexture(0, GL_TEXTURE_2D, 0);
+}
+
+
+/// <summary>
+/// Creates a vertex array that reads every stream from its own buffer, and draws with the index buffer
+/// </summary>
+/// <param name="streams"></param>
+/// <param name="count">Amount of streams</param>
+/// <param name="index_buffer"></param>
+/// <returns>The vertex array</returns>
+GLuint CreateVertexArray(const VertexStream * streams, int count, GLuint index_buffer)
+{
+	GLuint vertex_array;
+	if (backend == STORAGE_DIRECT)
+	{
+		glCreateVertexArrays(1, &vertex_array);
+		calls++;
+		for (int i = 0; i < count; i++)
+		{
+			if (streams[i].location < 0)
+				continue;
+			glVertexArrayVertexBuffer(vertex_array, i, streams[i].buffer, 0, streams[i].components * sizeof(GLfloat));
+			glVertexArrayAttribFormat(vertex_array, streams[i].location, streams[i].components, GL_FLOAT, GL_FALSE, 0);
+			glVertexArrayAttribBinding(vertex_array, streams[i].location, i);
+			glEnableVertexArrayAttrib(vertex_array, streams[i].location);
+			calls += 4;
+		}
+		glVertexArrayElementBuffer(vertex_array, index_buffer);
+		calls++;
+		return vertex_array;
+	}
+
+	glGenVertexArrays(1, &vertex_array);
+	gl_state.BindVertexArray(vertex_array);
+	calls += 2;
+	for (int i = 0; i < count; i++)
+	{
+		if (streams[i].location < 0)
+			continue;
+		gl_state.BindBuffer(GL_ARRAY_BUFFER, streams[i].buffer);
+		glVertexAttribPointer(streams[i].location, streams[i].components, GL_FLOAT, GL_FALSE, 0, 0);
+		glEnableVertexAttribArray(streams[i].location);
+		calls += 3;
+	}
+	gl_state.BindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// The vertex array remembers the index buffer
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	gl_state.BindVertexArray(0);
+	calls += 3;
+	return vertex_array;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <GL/glew.h>
+
+
+// How buffers, textures and vertex arrays are created and filled
+enum StorageBackend
+{
+	STORAGE_BIND,		// Bind to edit with mutable storage, works on every 4.3 context
+	STORAGE_DIRECT,		// Direct state access (4.5) with immutable storage, nothing is bound while loading
+	STORAGE_BACKENDS
+};
+
+// A vertex attribute that reads tightly packed floats from a buffer of its own
+struct VertexStream
+{
+	GLint location;		// Attribute location in the program, streams at -1 are skipped
+	GLint components;
+	GLuint buffer;
+};
+
+const char * StorageBackendName(StorageBackend backend);
+bool IsStorageBackendSupported(StorageBackend backend);
+
+// Picks the direct backend when the context has it, has to be called after glew is initialized
+void InitStorageBackend();
+void SetStorageBackend(StorageBackend backend);
+StorageBackend GetStorageBackend();
+
+// Gl calls the functions below made so far, for comparing the backends
+long long StorageCalls();
+
+// Buffer with its contents (data may be nullptr), flags are the glBufferStorage flags of the direct backend
+// and usage the glBufferData hint of the bind backend
+GLuint CreateBuffer(GLsizeiptr size, const void * data, GLbitfield flags, GLenum usage);
+
+// Single level 2D texture with its pixels, mutable (glTexImage2D) with the bind backend
+GLuint CreateTexture2D(GLenum internal_format, int width, int height, GLenum format, GLenum type, const void * pixels);
+
+// Single level render target, immutable with either backend so texture views can be made of it
+GLuint CreateTextureStorage(GLenum internal_format, int width, int height, int samples);
+
+// Filtering and wrapping of a texture, compare_func GL_NONE for textures that aren't sampled as shadows
+void SetTextureSampling(GLuint texture, GLenum filter, GLenum wrap, GLenum compare_func = GL_NONE);
+
+// Vertex array over the streams and an index buffer, every stream has binding point = its index in the array
+GLuint CreateVertexArray(const VertexStream * streams, int count, GLuint index_buffer);
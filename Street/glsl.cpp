@@ -1,25 +1,42 @@
+#include <string.h>
+#include <vector>
+
 #include "glsl.h"
+#include "assetPack.h"
 
 char* glsl::contents;
 
 char* glsl::readFile(const char* filename)
 {
+	// Sources in the asset pack come first
+	std::vector<unsigned char> packed;
+	if (asset_pack.Read(filename, packed))
+	{
+		char* source = new char[packed.size() + 1];
+		memcpy(source, packed.data(), packed.size());
+		source[packed.size()] = '\0';
+		return source;
+	}
+
 	// Open the file
 	FILE* fp = fopen(filename, "r");
+	if (fp == NULL)
+	{
+		// An empty source fails to compile, that prints the error of the shader
+		printf("Can't open shader %s\n", filename);
+		char* empty = new char[1];
+		empty[0] = '\0';
+		return empty;
+	}
 	// Move the file pointer to the end of the file and determing the length
 	fseek(fp, 0, SEEK_END);
 	long file_length = ftell(fp);
 	fseek(fp, 0, SEEK_SET);
 	char* contents = new char[file_length + 1];
-	// zero out memory
-	for (int i = 0; i < file_length + 1; i++) 
-	{
-		contents[i] = 0;
-	}
 	// Here's the actual read
-	fread(contents, 1, file_length, fp);
-	// This is how you denote the end of a string in C
-	contents[file_length + 1] = '\0';
+	size_t read = fread(contents, 1, file_length, fp);
+	// This is how you denote the end of a string in C, text mode can read fewer chars than the file is long
+	contents[read] = '\0';
 	fclose(fp);
 	return contents;
 }
@@ -37,7 +54,7 @@ bool glsl::compiledStatus(GLint shaderID)
 		char* msgBuffer = new char[logLength];
 		glGetShaderInfoLog(shaderID, logLength, NULL, msgBuffer);
 		printf("%s\n", msgBuffer);
-		delete (msgBuffer);
+		delete[] msgBuffer;
 		return false;
 	}
 }
@@ -60,7 +77,6 @@ GLuint glsl::makeFragmentShader(const char* shaderSource)
 	GLuint fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 	glShaderSource(fragmentShaderID, 1, (const GLchar**)&shaderSource, NULL);
 	glCompileShader(fragmentShaderID);
-	//delete[] source;
 	bool compiledCorrectly = compiledStatus(fragmentShaderID);
 	if (compiledCorrectly) {
 		return fragmentShaderID;
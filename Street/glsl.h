@@ -13,6 +13,7 @@ private:
 public:
 	glsl();
 	~glsl();
+	// The source as a zero terminated string, the caller frees it with delete[] once the shader is compiled
 	static char* readFile(const char* filename);
 	static bool compiledStatus(GLint shaderID);
 	static GLuint makeVertexShader(const char* shaderSource);
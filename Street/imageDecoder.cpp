@@ -0,0 +1,818 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "imageDecoder.h"
+#include "inflate.h"
+#include "pixelKernels.h"
+#include "mappedFile.h"
+#include "jobSystem.h"
+#include "assetPack.h"
+
+static const unsigned char PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+
+static uint32_t ReadLE16(const unsigned char * p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8;
+}
+
+
+static uint32_t ReadLE32(const unsigned char * p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static uint32_t ReadBE32(const unsigned char * p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+
+/// <summary>
+/// Prints why an image can't be decoded
+/// </summary>
+/// <returns>Always false</returns>
+static bool Fail(const char * path, const char * message)
+{
+	printf("%s: %s\n", path ? path : "image", message);
+	return false;
+}
+
+
+/// <summary>
+/// Sizes the pixels of the image, the size comes from the file so it is checked first
+/// </summary>
+/// <returns>Whether the size is valid</returns>
+static bool AllocateImage(Image & image, int64_t width, int64_t height)
+{
+	if (width <= 0 || height <= 0 || width > MAX_IMAGE_SIZE || height > MAX_IMAGE_SIZE)
+		return false;
+
+	image.width = (unsigned int)width;
+	image.height = (unsigned int)height;
+	image.has_alpha = false;
+	image.pixels.resize((size_t)width * (size_t)height * 4);
+	return true;
+}
+
+
+/// <summary>
+/// Scales a value of the given amount of bits up to 8 bits
+/// </summary>
+static inline unsigned char ScaleTo8(uint32_t value, int bits)
+{
+	if (bits >= 8)
+		return (unsigned char)(value >> (bits - 8));
+	return (unsigned char)(value * 255 / ((1u << bits) - 1));
+}
+
+
+/// <summary>
+/// Sets the alpha of count rgba pixels to opaque
+/// </summary>
+static void SetOpaque(unsigned char * rgba, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		rgba[i * 4 + 3] = 255;
+}
+
+
+// BMP
+
+// Position and width of one channel in a bit field pixel
+struct BitField
+{
+	int shift;
+	int bits;
+
+	BitField(uint32_t mask = 0) : shift(0), bits(0)
+	{
+		if (mask == 0)
+			return;
+		while (!(mask & 1))
+		{
+			mask >>= 1;
+			this->shift++;
+		}
+		while (mask & 1)
+		{
+			mask >>= 1;
+			this->bits++;
+		}
+	}
+
+	unsigned char Get(uint32_t pixel, unsigned char missing) const
+	{
+		if (this->bits == 0)
+			return missing;
+		return ScaleTo8((pixel >> this->shift) & ((1ull << this->bits) - 1), this->bits);
+	}
+};
+
+
+/// <summary>
+/// Expands the run length encoded indices of an 8 or 4 bit bmp, bottom row first
+/// </summary>
+static void DecodeBMPRLE(const unsigned char * p, const unsigned char * end, bool nibbles, int width, int height, std::vector<unsigned char> & indices)
+{
+	indices.assign((size_t)width * height, 0);
+	int x = 0;
+	int y = 0;
+	auto put = [&](unsigned char index) {
+		if (x < width && y < height)
+			indices[(size_t)y * width + x] = index;
+		x++;
+	};
+
+	while (end - p >= 2)
+	{
+		const int count = p[0];
+		const int value = p[1];
+		p += 2;
+
+		// Run of one value, for 4 bit images the two nibbles alternate
+		if (count > 0)
+		{
+			for (int i = 0; i < count; i++)
+				put(nibbles ? (unsigned char)(i & 1 ? value & 15 : value >> 4) : (unsigned char)value);
+			continue;
+		}
+
+		if (value == 0)
+		{
+			x = 0;
+			y++;
+		}
+		else if (value == 1)
+			break;
+		else if (value == 2)
+		{
+			if (end - p < 2)
+				break;
+			x += p[0];
+			y += p[1];
+			p += 2;
+		}
+		else
+		{
+			// Literal indices, padded to 16 bits
+			const int bytes = nibbles ? (value + 1) / 2 : value;
+			if (end - p < bytes)
+				break;
+			for (int i = 0; i < value; i++)
+				put(nibbles ? (unsigned char)(i & 1 ? p[i / 2] & 15 : p[i / 2] >> 4) : p[i]);
+			p += bytes + (bytes & 1);
+		}
+	}
+}
+
+
+static bool DecodeBMP(const unsigned char * data, size_t size, const char * path, Image & image)
+{
+	if (size < 26)
+		return Fail(path, "truncated bmp header");
+
+	const uint32_t pixel_offset = ReadLE32(data + 10);
+	const uint32_t header_size = ReadLE32(data + 14);
+	if (header_size < 12 || (header_size > 12 && header_size < 40) || 14 + (size_t)header_size > size)
+		return Fail(path, "unsupported bmp header");
+
+	int64_t width, height;
+	uint32_t bits, compression = 0, colors_used = 0;
+	uint32_t masks[4] = {};
+	size_t palette_offset = 14 + header_size;
+	if (header_size == 12)
+	{
+		// Os/2 core header
+		width = ReadLE16(data + 18);
+		height = (int16_t)ReadLE16(data + 20);
+		bits = ReadLE16(data + 24);
+	}
+	else
+	{
+		width = (int32_t)ReadLE32(data + 18);
+		height = (int32_t)ReadLE32(data + 22);
+		bits = ReadLE16(data + 28);
+		compression = ReadLE32(data + 30);
+		colors_used = ReadLE32(data + 46);
+
+		// The masks are part of the newer headers, the 40 byte header is followed by them
+		if (compression == 3 || compression == 6)
+		{
+			const int mask_count = compression == 6 || header_size >= 56 ? 4 : 3;
+			const size_t mask_offset = header_size >= 52 ? 54 : palette_offset;
+			if (mask_offset + mask_count * 4 > size)
+				return Fail(path, "truncated bmp masks");
+			for (int i = 0; i < mask_count; i++)
+				masks[i] = ReadLE32(data + mask_offset + i * 4);
+			if (header_size < 52)
+				palette_offset += mask_count * 4;
+		}
+	}
+
+	const bool top_down = height < 0;
+	height = top_down ? -height : height;
+	if (!AllocateImage(image, width, height))
+		return Fail(path, "invalid bmp size");
+
+	// Default layouts of the 16 and 32 bit images without masks
+	if (compression == 0 && bits == 16)
+	{
+		masks[0] = 0x7C00;
+		masks[1] = 0x03E0;
+		masks[2] = 0x001F;
+	}
+	else if (compression == 0 && bits == 32)
+	{
+		masks[0] = 0x00FF0000;
+		masks[1] = 0x0000FF00;
+		masks[2] = 0x000000FF;
+	}
+
+	const bool indexed = bits == 1 || bits == 2 || bits == 4 || bits == 8;
+	const bool valid = (compression == 0 && (indexed || bits == 16 || bits == 24 || bits == 32)) ||
+		(compression == 1 && bits == 8) || (compression == 2 && bits == 4) ||
+		((compression == 3 || compression == 6) && (bits == 16 || bits == 32));
+	if (!valid)
+		return Fail(path, "unsupported bmp format");
+
+	// Palette entries are bgr, followed by a reserved byte except in the core header
+	unsigned char palette[256][4] = {};
+	if (indexed)
+	{
+		const size_t entry_size = header_size == 12 ? 3 : 4;
+		size_t count = colors_used != 0 ? colors_used : (size_t)1 << bits;
+		count = std::min<size_t>(count, 256);
+		count = std::min(count, palette_offset < size ? (size - palette_offset) / entry_size : 0);
+		for (size_t i = 0; i < 256; i++)
+			palette[i][3] = 255;
+		for (size_t i = 0; i < count; i++)
+		{
+			const unsigned char * entry = data + palette_offset + i * entry_size;
+			palette[i][0] = entry[2];
+			palette[i][1] = entry[1];
+			palette[i][2] = entry[0];
+		}
+	}
+
+	if (pixel_offset >= size)
+		return Fail(path, "bmp without pixels");
+	const unsigned char * pixels = data + pixel_offset;
+	const size_t available = size - pixel_offset;
+	const size_t w = image.width;
+	const size_t h = image.height;
+
+	if (compression == 1 || compression == 2)
+	{
+		std::vector<unsigned char> indices;
+		DecodeBMPRLE(pixels, pixels + available, compression == 2, (int)w, (int)h, indices);
+		for (size_t i = 0; i < w * h; i++)
+			memcpy(&image.pixels[i * 4], palette[indices[i]], 4);
+	}
+	else
+	{
+		// Rows are padded to 4 bytes
+		const size_t stride = (w * bits + 31) / 32 * 4;
+		if (stride * h > available)
+			return Fail(path, "truncated bmp pixels");
+
+		const BitField red(masks[0]), green(masks[1]), blue(masks[2]), alpha(masks[3]);
+		const bool bgra = bits == 32 && masks[0] == 0x00FF0000 && masks[1] == 0x0000FF00 && masks[2] == 0x000000FF &&
+			(masks[3] == 0 || masks[3] == 0xFF000000);
+		image.has_alpha = masks[3] != 0;
+
+		for (size_t y = 0; y < h; y++)
+		{
+			const unsigned char * row = pixels + y * stride;
+			unsigned char * out = &image.pixels[y * w * 4];
+			if (bits == 24)
+				ExpandToRGBA(row, out, w, true);
+			else if (bgra)
+			{
+				memcpy(out, row, w * 4);
+				SwapRedBlue(out, w);
+				if (masks[3] == 0)
+					SetOpaque(out, w);
+			}
+			else if (bits == 16 || bits == 32)
+			{
+				for (size_t x = 0; x < w; x++, out += 4)
+				{
+					const uint32_t pixel = bits == 16 ? ReadLE16(row + x * 2) : ReadLE32(row + x * 4);
+					out[0] = red.Get(pixel, 0);
+					out[1] = green.Get(pixel, 0);
+					out[2] = blue.Get(pixel, 0);
+					out[3] = alpha.Get(pixel, 255);
+				}
+			}
+			else
+			{
+				const unsigned int index_mask = (1u << bits) - 1;
+				for (size_t x = 0; x < w; x++)
+				{
+					const size_t bit = x * bits;
+					const unsigned int index = (row[bit / 8] >> (8 - bits - bit % 8)) & index_mask;
+					memcpy(out + x * 4, palette[index], 4);
+				}
+			}
+		}
+	}
+
+	if (top_down)
+		FlipRows(image.pixels.data(), image.width * 4, image.height);
+	return true;
+}
+
+
+// TGA
+
+/// <summary>
+/// Converts one tga color (15, 16, 24 or 32 bits, stored as bgr(a)) to rgba
+/// </summary>
+static void TGAColor(const unsigned char * p, int bits, bool alpha, unsigned char * rgba)
+{
+	if (bits == 15 || bits == 16)
+	{
+		const uint32_t value = ReadLE16(p);
+		rgba[0] = ScaleTo8((value >> 10) & 31, 5);
+		rgba[1] = ScaleTo8((value >> 5) & 31, 5);
+		rgba[2] = ScaleTo8(value & 31, 5);
+		rgba[3] = alpha && bits == 16 && !(value & 0x8000) ? 0 : 255;
+		return;
+	}
+	rgba[0] = p[2];
+	rgba[1] = p[1];
+	rgba[2] = p[0];
+	rgba[3] = bits == 32 && alpha ? p[3] : 255;
+}
+
+
+static bool DecodeTGA(const unsigned char * data, size_t size, const char * path, Image & image)
+{
+	if (size < 18)
+		return Fail(path, "truncated tga header");
+
+	const int id_length = data[0];
+	const int map_type = data[1];
+	const int type = data[2];
+	const uint32_t map_first = ReadLE16(data + 3);
+	const uint32_t map_length = ReadLE16(data + 5);
+	const int map_bits = data[7];
+	const int bits = data[16];
+	const int descriptor = data[17];
+	const bool rle = type >= 9;
+	const int base = rle ? type - 8 : type;
+	const bool alpha = (descriptor & 15) != 0;
+
+	const bool valid = (base == 1 && map_type == 1 && (bits == 8 || bits == 16)) ||
+		(base == 2 && (bits == 15 || bits == 16 || bits == 24 || bits == 32)) ||
+		(base == 3 && (bits == 8 || bits == 16));
+	if (!valid || (map_type == 1 && map_bits != 15 && map_bits != 16 && map_bits != 24 && map_bits != 32))
+		return Fail(path, "unsupported tga format");
+	if (!AllocateImage(image, ReadLE16(data + 12), ReadLE16(data + 14)))
+		return Fail(path, "invalid tga size");
+
+	const unsigned char * p = data + 18 + id_length;
+	const unsigned char * end = data + size;
+
+	// The color map can be there even when the image doesn't use it
+	std::vector<unsigned char> palette;
+	if (map_type == 1)
+	{
+		const size_t entry_size = (map_bits + 7) / 8;
+		if ((size_t)(end - p) < map_length * entry_size)
+			return Fail(path, "truncated tga color map");
+		palette.resize(map_length * 4);
+		for (uint32_t i = 0; i < map_length; i++)
+			TGAColor(p + i * entry_size, map_bits, alpha, &palette[i * 4]);
+		p += map_length * entry_size;
+	}
+
+	// Expand the packets first, the rows are converted afterwards
+	const size_t w = image.width;
+	const size_t h = image.height;
+	const size_t pixel_size = (bits + 7) / 8;
+	const size_t raw_size = w * h * pixel_size;
+	std::vector<unsigned char> expanded;
+	const unsigned char * raw = p;
+	if (rle)
+	{
+		expanded.resize(raw_size);
+		size_t written = 0;
+		while (written < raw_size)
+		{
+			if (p >= end)
+				return Fail(path, "truncated tga packets");
+			const size_t count = std::min<size_t>((*p & 127) + 1, (raw_size - written) / pixel_size);
+			const bool run = (*p++ & 128) != 0;
+			const size_t bytes = run ? pixel_size : count * pixel_size;
+			if ((size_t)(end - p) < bytes)
+				return Fail(path, "truncated tga packets");
+			if (run)
+			{
+				for (size_t i = 0; i < count; i++)
+					memcpy(&expanded[written + i * pixel_size], p, pixel_size);
+			}
+			else
+				memcpy(&expanded[written], p, bytes);
+			written += count * pixel_size;
+			p += bytes;
+		}
+		raw = expanded.data();
+	}
+	else if ((size_t)(end - p) < raw_size)
+		return Fail(path, "truncated tga pixels");
+
+	image.has_alpha = alpha && (bits == 32 || bits == 16 || base == 1);
+	for (size_t y = 0; y < h; y++)
+	{
+		const unsigned char * row = raw + y * w * pixel_size;
+		unsigned char * out = &image.pixels[y * w * 4];
+		if (base == 2 && bits == 24)
+			ExpandToRGBA(row, out, w, true);
+		else if (base == 2 && bits == 32)
+		{
+			memcpy(out, row, w * 4);
+			SwapRedBlue(out, w);
+			if (!alpha)
+				SetOpaque(out, w);
+		}
+		else
+		{
+			for (size_t x = 0; x < w; x++, out += 4)
+			{
+				const unsigned char * pixel = row + x * pixel_size;
+				if (base == 2)
+					TGAColor(pixel, bits, alpha, out);
+				else if (base == 3)
+				{
+					out[0] = out[1] = out[2] = pixel[0];
+					out[3] = bits == 16 ? pixel[1] : 255;
+				}
+				else
+				{
+					const uint32_t index = (bits == 16 ? ReadLE16(pixel) : pixel[0]) - map_first;
+					if (index < map_length)
+						memcpy(out, &palette[index * 4], 4);
+					else
+						memset(out, 0, 4);
+				}
+			}
+		}
+	}
+	image.has_alpha = image.has_alpha || (base == 3 && bits == 16);
+
+	// Right to left rows are mirrored, top to bottom images flipped
+	if (descriptor & 16)
+	{
+		uint32_t * pixels = (uint32_t *)image.pixels.data();
+		for (size_t y = 0; y < h; y++)
+			std::reverse(pixels + y * w, pixels + (y + 1) * w);
+	}
+	if (descriptor & 32)
+		FlipRows(image.pixels.data(), w * 4, h);
+	return true;
+}
+
+
+// PNG
+
+struct PNGInfo
+{
+	uint32_t width;
+	uint32_t height;
+	int depth;
+	int color;
+	int channels;
+	unsigned char palette[256][4];
+	bool transparent;				// tRNS chunk, either alpha per palette entry or one transparent color
+	uint16_t transparent_color[3];
+};
+
+
+/// <summary>
+/// Sample of a grey, rgb or grey alpha image, 16 bit samples are big endian
+/// </summary>
+static inline uint32_t Sample(const unsigned char * row, size_t index, int depth)
+{
+	if (depth == 16)
+		return (uint32_t)row[index * 2] << 8 | row[index * 2 + 1];
+	if (depth == 8)
+		return row[index];
+	const size_t bit = index * depth;
+	return (row[bit / 8] >> (8 - depth - bit % 8)) & ((1u << depth) - 1);
+}
+
+
+/// <summary>
+/// Converts count pixels of an unfiltered row to rgba
+/// </summary>
+static void ConvertPNGRow(const PNGInfo & png, const unsigned char * row, size_t count, unsigned char * rgba)
+{
+	const int depth = png.depth;
+	switch (png.color)
+	{
+	case 6:
+		if (depth == 8)
+			memcpy(rgba, row, count * 4);
+		else
+		{
+			for (size_t i = 0; i < count * 4; i++)
+				rgba[i] = row[i * 2];
+		}
+		break;
+	case 2:
+		if (depth == 8 && !png.transparent)
+			ExpandToRGBA(row, rgba, count, false);
+		else
+		{
+			for (size_t i = 0; i < count; i++, rgba += 4)
+			{
+				const uint32_t r = Sample(row, i * 3, depth), g = Sample(row, i * 3 + 1, depth), b = Sample(row, i * 3 + 2, depth);
+				rgba[0] = ScaleTo8(r, depth);
+				rgba[1] = ScaleTo8(g, depth);
+				rgba[2] = ScaleTo8(b, depth);
+				rgba[3] = png.transparent && r == png.transparent_color[0] && g == png.transparent_color[1] && b == png.transparent_color[2] ? 0 : 255;
+			}
+		}
+		break;
+	case 0:
+		for (size_t i = 0; i < count; i++, rgba += 4)
+		{
+			const uint32_t grey = Sample(row, i, depth);
+			rgba[0] = rgba[1] = rgba[2] = ScaleTo8(grey, depth);
+			rgba[3] = png.transparent && grey == png.transparent_color[0] ? 0 : 255;
+		}
+		break;
+	case 4:
+		for (size_t i = 0; i < count; i++, rgba += 4)
+		{
+			rgba[0] = rgba[1] = rgba[2] = ScaleTo8(Sample(row, i * 2, depth), depth);
+			rgba[3] = ScaleTo8(Sample(row, i * 2 + 1, depth), depth);
+		}
+		break;
+	case 3:
+		for (size_t i = 0; i < count; i++)
+			memcpy(rgba + i * 4, png.palette[Sample(row, i, depth)], 4);
+		break;
+	}
+}
+
+
+static bool DecodePNG(const unsigned char * data, size_t size, const char * path, Image & image)
+{
+	PNGInfo png = {};
+	int interlace = 0;
+	bool header = false;
+	std::vector<std::pair<const unsigned char *, uint32_t>> idat;
+	size_t idat_size = 0;
+
+	const unsigned char * p = data + sizeof(PNG_SIGNATURE);
+	const unsigned char * end = data + size;
+	while (end - p >= 12)
+	{
+		const uint32_t length = ReadBE32(p);
+		const unsigned char * type = p + 4;
+		const unsigned char * chunk = p + 8;
+		if ((size_t)(end - chunk) < (size_t)length + 4)
+			return Fail(path, "truncated png chunk");
+		p = chunk + length + 4;
+
+		if (memcmp(type, "IHDR", 4) == 0)
+		{
+			if (length < 13)
+				return Fail(path, "invalid png header");
+			png.width = ReadBE32(chunk);
+			png.height = ReadBE32(chunk + 4);
+			png.depth = chunk[8];
+			png.color = chunk[9];
+			interlace = chunk[12];
+			header = true;
+
+			const int depth = png.depth;
+			const bool valid = chunk[10] == 0 && chunk[11] == 0 && interlace <= 1 &&
+				((png.color == 0 && (depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16)) ||
+				(png.color == 3 && (depth == 1 || depth == 2 || depth == 4 || depth == 8)) ||
+				((png.color == 2 || png.color == 4 || png.color == 6) && (depth == 8 || depth == 16)));
+			if (!valid)
+				return Fail(path, "unsupported png format");
+			static const int CHANNELS[7] = { 1, 0, 3, 1, 2, 0, 4 };
+			png.channels = CHANNELS[png.color];
+		}
+		else if (memcmp(type, "PLTE", 4) == 0)
+		{
+			for (uint32_t i = 0; i < length / 3 && i < 256; i++)
+			{
+				memcpy(png.palette[i], chunk + i * 3, 3);
+				png.palette[i][3] = 255;
+			}
+		}
+		else if (memcmp(type, "tRNS", 4) == 0)
+		{
+			png.transparent = true;
+			if (png.color == 3)
+			{
+				for (uint32_t i = 0; i < length && i < 256; i++)
+					png.palette[i][3] = chunk[i];
+			}
+			else
+			{
+				for (uint32_t i = 0; i < 3 && i * 2 + 1 < length; i++)
+					png.transparent_color[i] = (uint16_t)(chunk[i * 2] << 8 | chunk[i * 2 + 1]);
+			}
+		}
+		else if (memcmp(type, "IDAT", 4) == 0)
+		{
+			idat.push_back(std::make_pair(chunk, length));
+			idat_size += length;
+		}
+		else if (memcmp(type, "IEND", 4) == 0)
+			break;
+	}
+
+	if (!header || idat.empty())
+		return Fail(path, "png without header or pixels");
+	if (!AllocateImage(image, png.width, png.height))
+		return Fail(path, "invalid png size");
+	image.has_alpha = png.color == 4 || png.color == 6 || png.transparent;
+
+	// Adam7 passes, a non interlaced image is one pass over everything
+	static const int PASS_X[7] = { 0, 4, 0, 2, 0, 1, 0 };
+	static const int PASS_Y[7] = { 0, 0, 4, 0, 2, 0, 1 };
+	static const int PASS_DX[7] = { 8, 8, 4, 4, 2, 2, 1 };
+	static const int PASS_DY[7] = { 8, 8, 8, 4, 4, 2, 2 };
+	const int pass_count = interlace ? 7 : 1;
+	const size_t bits_per_pixel = (size_t)png.channels * png.depth;
+	const size_t stride = std::max<size_t>(1, bits_per_pixel / 8);
+
+	size_t pass_width[7], pass_height[7], expected = 0;
+	for (int pass = 0; pass < pass_count; pass++)
+	{
+		const size_t x0 = interlace ? PASS_X[pass] : 0, dx = interlace ? PASS_DX[pass] : 1;
+		const size_t y0 = interlace ? PASS_Y[pass] : 0, dy = interlace ? PASS_DY[pass] : 1;
+		pass_width[pass] = png.width > x0 ? (png.width - x0 + dx - 1) / dx : 0;
+		pass_height[pass] = png.height > y0 ? (png.height - y0 + dy - 1) / dy : 0;
+		if (pass_width[pass] > 0)
+			expected += pass_height[pass] * (1 + (pass_width[pass] * bits_per_pixel + 7) / 8);
+	}
+
+	// Most files have one IDAT chunk, more have to be joined before inflating
+	std::vector<unsigned char> joined;
+	const unsigned char * compressed = idat[0].first;
+	if (idat.size() > 1)
+	{
+		joined.reserve(idat_size);
+		for (auto & chunk : idat)
+			joined.insert(joined.end(), chunk.first, chunk.first + chunk.second);
+		compressed = joined.data();
+	}
+
+	std::vector<unsigned char> raw;
+	if (!ZlibInflate(compressed, idat_size, raw, expected) || raw.size() < expected)
+		return Fail(path, "corrupt png pixel data");
+
+	std::vector<unsigned char> scattered;
+	unsigned char * filtered = raw.data();
+	for (int pass = 0; pass < pass_count; pass++)
+	{
+		const size_t width = pass_width[pass];
+		if (width == 0 || pass_height[pass] == 0)
+			continue;
+
+		const size_t row_size = (width * bits_per_pixel + 7) / 8;
+		const unsigned char * previous = nullptr;
+		scattered.resize(width * 4);
+		for (size_t y = 0; y < pass_height[pass]; y++, filtered += row_size + 1)
+		{
+			unsigned char * row = filtered + 1;
+			if (!UnfilterPNGRow(filtered[0], row, previous, row_size, stride))
+				return Fail(path, "invalid png filter");
+			previous = row;
+
+			if (!interlace)
+			{
+				ConvertPNGRow(png, row, width, &image.pixels[y * png.width * 4]);
+				continue;
+			}
+
+			// Every pass fills a grid of pixels
+			ConvertPNGRow(png, row, width, scattered.data());
+			const size_t image_y = PASS_Y[pass] + y * PASS_DY[pass];
+			for (size_t x = 0; x < width; x++)
+				memcpy(&image.pixels[(image_y * png.width + PASS_X[pass] + x * PASS_DX[pass]) * 4], &scattered[x * 4], 4);
+		}
+	}
+
+	// Png stores the top row first
+	FlipRows(image.pixels.data(), image.width * 4, image.height);
+	return true;
+}
+
+
+/// <summary>
+/// Finds the format from the first bytes, tga has no signature so it goes by the extension
+/// </summary>
+ImageFormat DetectImageFormat(const unsigned char * data, size_t size, const char * path)
+{
+	if (size >= sizeof(PNG_SIGNATURE) && memcmp(data, PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) == 0)
+		return IMAGE_PNG;
+	if (size >= 2 && data[0] == 'B' && data[1] == 'M')
+		return IMAGE_BMP;
+
+	const char * extension = path ? strrchr(path, '.') : nullptr;
+	if (extension && strlen(extension) == 4 && tolower(extension[1]) == 't' && tolower(extension[2]) == 'g' && tolower(extension[3]) == 'a')
+		return IMAGE_TGA;
+	return IMAGE_UNKNOWN;
+}
+
+
+const char * ImageFormatName(ImageFormat format)
+{
+	switch (format)
+	{
+	case IMAGE_BMP:
+		return "bmp";
+	case IMAGE_TGA:
+		return "tga";
+	case IMAGE_PNG:
+		return "png";
+	default:
+		return "unknown";
+	}
+}
+
+
+/// <summary>
+/// Applies the conversions asked for after decoding
+/// </summary>
+static void ApplyFlags(Image & image, unsigned int flags)
+{
+	if ((flags & IMAGE_PREMULTIPLY) && image.has_alpha)
+		PremultiplyAlpha(image.pixels.data(), (size_t)image.width * image.height);
+}
+
+
+bool DecodeImage(const unsigned char * data, size_t size, const char * path, Image & image, unsigned int flags)
+{
+	bool ok = false;
+	switch (DetectImageFormat(data, size, path))
+	{
+	case IMAGE_PNG:
+		ok = DecodePNG(data, size, path, image);
+		break;
+	case IMAGE_BMP:
+		ok = DecodeBMP(data, size, path, image);
+		break;
+	case IMAGE_TGA:
+		ok = DecodeTGA(data, size, path, image);
+		break;
+	default:
+		return Fail(path, "unknown image format");
+	}
+
+	if (!ok)
+	{
+		image = Image();
+		return false;
+	}
+	ApplyFlags(image, flags);
+	return true;
+}
+
+
+bool ReadImage(const char * path, Image & image, unsigned int flags)
+{
+	// Already decoded in the asset pack
+	if (asset_pack.ReadTexture(path, image))
+	{
+		ApplyFlags(image, flags);
+		return true;
+	}
+
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		printf("%s could not be opened. Are you in the right directory ?\n", path);
+		return false;
+	}
+	return DecodeImage(file.Data(), file.Size(), path, image, flags);
+}
+
+
+void ReadImages(const std::vector<std::string> & paths, std::vector<Image> & images, unsigned int flags, JobSystem & jobs)
+{
+	images.assign(paths.size(), Image());
+	jobs.ParallelFor(paths.size(), 1, [&paths, &images, flags](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			ReadImage(paths[i].c_str(), images[i], flags);
+	});
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+class JobSystem;
+
+enum ImageFormat
+{
+	IMAGE_UNKNOWN,
+	IMAGE_BMP,
+	IMAGE_TGA,
+	IMAGE_PNG
+};
+
+// Conversions applied after decoding
+enum ImageFlags
+{
+	IMAGE_PREMULTIPLY = 1	// Multiply the color by the alpha, only done for images that have alpha
+};
+
+// Decoded image, ready to upload: 8 bit rgba with the bottom row first like gl expects
+// Every row is a multiple of 4 bytes so the default unpack alignment works
+struct Image
+{
+	unsigned int width = 0;
+	unsigned int height = 0;
+	bool has_alpha = false;
+	std::vector<unsigned char> pixels;
+};
+
+// Images bigger than this are rejected before anything is allocated
+const unsigned int MAX_IMAGE_SIZE = 16384;
+
+ImageFormat DetectImageFormat(const unsigned char * data, size_t size, const char * path);
+const char * ImageFormatName(ImageFormat format);
+
+// Decodes a png (all color types and bit depths, interlaced or not), tga (true color, grey and color mapped,
+// raw or rle) or bmp (1 to 32 bits per pixel, bit fields and rle) held in memory, makes no gl calls
+bool DecodeImage(const unsigned char * data, size_t size, const char * path, Image & image, unsigned int flags = 0);
+
+// Reads an image from the asset pack or the file system
+bool ReadImage(const char * path, Image & image, unsigned int flags = 0);
+
+// Reads a batch of images, one job per image
+// images[i] is left empty when paths[i] could not be read
+void ReadImages(const std::vector<std::string> & paths, std::vector<Image> & images, unsigned int flags, JobSystem & jobs);
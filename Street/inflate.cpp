@@ -0,0 +1,434 @@
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "inflate.h"
+
+// Codes up to this length are decoded with one table lookup, longer ones bit by bit
+const int FAST_BITS = 10;
+const int MAX_CODE_LENGTH = 15;
+
+// Base values and extra bits of the length (257..285) and distance (0..29) symbols
+static const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Order the code length code lengths are stored in
+static const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// Canonical huffman code
+// fast holds symbol << 4 | length for every code of at most FAST_BITS bits, indexed by the next input bits
+struct Huffman
+{
+	uint16_t fast[1 << FAST_BITS];
+	uint16_t count[MAX_CODE_LENGTH + 1];
+	uint16_t symbols[288];
+};
+
+// Input bits, least significant bit first
+// Reading past the end feeds zeros, overrun counts them so a truncated stream is still detected
+struct BitReader
+{
+	const unsigned char * in;
+	const unsigned char * end;
+	uint64_t bits;
+	int bit_count;
+	int overrun;
+
+	void Refill()
+	{
+		// Whole bytes from one unaligned load, leaves 56 to 63 bits in the buffer
+		if (this->end - this->in >= 8)
+		{
+			uint64_t next;
+			memcpy(&next, this->in, sizeof(next));
+			this->bits |= next << this->bit_count;
+			this->in += (63 - this->bit_count) >> 3;
+			this->bit_count |= 56;
+			return;
+		}
+
+		while (this->bit_count <= 56)
+		{
+			if (this->in < this->end)
+				this->bits |= (uint64_t)*this->in++ << this->bit_count;
+			else
+				this->overrun++;
+			this->bit_count += 8;
+		}
+	}
+
+	uint32_t Take(int count)
+	{
+		if (this->bit_count < count)
+			this->Refill();
+		uint32_t value = (uint32_t)(this->bits & ((1ull << count) - 1));
+		this->bits >>= count;
+		this->bit_count -= count;
+		return value;
+	}
+
+	// Whether bits were used that came after the end of the input
+	bool Overran() const
+	{
+		return this->overrun * 8 > this->bit_count;
+	}
+};
+
+
+/// <summary>
+/// Builds the decoding tables from the code length of every symbol
+/// </summary>
+/// <param name="huffman"></param>
+/// <param name="lengths">Code length per symbol, 0 for unused symbols</param>
+/// <param name="count">Amount of symbols</param>
+/// <returns>Whether the lengths describe a valid (possibly incomplete) code</returns>
+static bool BuildHuffman(Huffman & huffman, const uint8_t * lengths, int count)
+{
+	memset(huffman.count, 0, sizeof(huffman.count));
+	memset(huffman.fast, 0, sizeof(huffman.fast));
+	for (int i = 0; i < count; i++)
+		huffman.count[lengths[i]]++;
+	huffman.count[0] = 0;
+
+	// Too many codes of a length can't be decoded
+	int left = 1;
+	for (int length = 1; length <= MAX_CODE_LENGTH; length++)
+	{
+		left = (left << 1) - huffman.count[length];
+		if (left < 0)
+			return false;
+	}
+
+	// First code and first position in symbols of every length
+	uint16_t next_code[MAX_CODE_LENGTH + 1];
+	uint16_t offsets[MAX_CODE_LENGTH + 1];
+	int code = 0;
+	offsets[1] = 0;
+	for (int length = 1; length <= MAX_CODE_LENGTH; length++)
+	{
+		next_code[length] = (uint16_t)code;
+		code = (code + huffman.count[length]) << 1;
+		if (length < MAX_CODE_LENGTH)
+			offsets[length + 1] = offsets[length] + huffman.count[length];
+	}
+
+	for (int symbol = 0; symbol < count; symbol++)
+	{
+		const int length = lengths[symbol];
+		if (length == 0)
+			continue;
+		huffman.symbols[offsets[length]++] = (uint16_t)symbol;
+
+		const int value = next_code[length]++;
+		if (length > FAST_BITS)
+			continue;
+
+		// The code is stored most significant bit first, the stream is read least significant bit first
+		int reversed = 0;
+		for (int i = 0; i < length; i++)
+			reversed |= ((value >> i) & 1) << (length - 1 - i);
+		for (int i = reversed; i < (1 << FAST_BITS); i += 1 << length)
+			huffman.fast[i] = (uint16_t)(symbol << 4 | length);
+	}
+	return true;
+}
+
+
+/// <summary>
+/// Decodes one symbol
+/// </summary>
+/// <returns>The symbol, -1 for a code that isn't in the table</returns>
+static int Decode(BitReader & reader, const Huffman & huffman)
+{
+	if (reader.bit_count < MAX_CODE_LENGTH)
+		reader.Refill();
+
+	const uint16_t entry = huffman.fast[reader.bits & ((1 << FAST_BITS) - 1)];
+	if (entry)
+	{
+		const int length = entry & 15;
+		reader.bits >>= length;
+		reader.bit_count -= length;
+		return entry >> 4;
+	}
+
+	// Long code, walk the lengths one bit at a time
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for (int length = 1; length <= MAX_CODE_LENGTH; length++)
+	{
+		code |= (int)((reader.bits >> (length - 1)) & 1);
+		const int count = huffman.count[length];
+		if (code - first < count)
+		{
+			reader.bits >>= length;
+			reader.bit_count -= length;
+			return huffman.symbols[index + code - first];
+		}
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+
+/// <summary>
+/// The tables of the fixed code blocks, built once
+/// </summary>
+static void FixedTables(const Huffman *& literals, const Huffman *& distances)
+{
+	struct Tables
+	{
+		Huffman literals;
+		Huffman distances;
+		Tables()
+		{
+			uint8_t lengths[288];
+			memset(lengths, 8, 144);
+			memset(lengths + 144, 9, 112);
+			memset(lengths + 256, 7, 24);
+			memset(lengths + 280, 8, 8);
+			BuildHuffman(this->literals, lengths, 288);
+			memset(lengths, 5, 30);
+			BuildHuffman(this->distances, lengths, 30);
+		}
+	};
+	static const Tables tables;
+	literals = &tables.literals;
+	distances = &tables.distances;
+}
+
+
+/// <summary>
+/// Reads the code tables at the start of a dynamic block
+/// </summary>
+static bool ReadDynamicTables(BitReader & reader, Huffman & literals, Huffman & distances)
+{
+	const int literal_count = (int)reader.Take(5) + 257;
+	const int distance_count = (int)reader.Take(5) + 1;
+	const int code_length_count = (int)reader.Take(4) + 4;
+	if (literal_count > 286 || distance_count > 30)
+		return false;
+
+	uint8_t code_lengths[19] = {};
+	for (int i = 0; i < code_length_count; i++)
+		code_lengths[CODE_LENGTH_ORDER[i]] = (uint8_t)reader.Take(3);
+
+	Huffman code_length_code;
+	if (!BuildHuffman(code_length_code, code_lengths, 19))
+		return false;
+
+	// The literal and distance lengths are one sequence, repeats can cross from one to the other
+	uint8_t lengths[286 + 30];
+	int count = 0;
+	while (count < literal_count + distance_count)
+	{
+		const int symbol = Decode(reader, code_length_code);
+		if (symbol < 0)
+			return false;
+		if (symbol < 16)
+		{
+			lengths[count++] = (uint8_t)symbol;
+			continue;
+		}
+
+		uint8_t value = 0;
+		int repeat;
+		if (symbol == 16)
+		{
+			if (count == 0)
+				return false;
+			value = lengths[count - 1];
+			repeat = 3 + (int)reader.Take(2);
+		}
+		else if (symbol == 17)
+			repeat = 3 + (int)reader.Take(3);
+		else
+			repeat = 11 + (int)reader.Take(7);
+
+		if (count + repeat > literal_count + distance_count)
+			return false;
+		memset(lengths + count, value, repeat);
+		count += repeat;
+	}
+
+	// Without an end of block code the block never ends
+	if (lengths[256] == 0)
+		return false;
+
+	return BuildHuffman(literals, lengths, literal_count) && BuildHuffman(distances, lengths + literal_count, distance_count);
+}
+
+
+bool Inflate(const unsigned char * source, size_t size, std::vector<unsigned char> & out, size_t size_hint)
+{
+	BitReader reader = { source, source + size, 0, 0, 0 };
+
+	// The output grows in steps, written is the part that holds data
+	size_t written = 0;
+	out.resize(std::max<size_t>(size_hint + 258 + 8, 1024));
+	auto reserve = [&out, &written](size_t count) {
+		if (written + count > out.size())
+			out.resize(std::max(out.size() * 2, written + count));
+	};
+
+	// A known size is also the limit, corrupt or malicious data can't make the output grow without end
+	const size_t limit = size_hint != 0 ? size_hint : SIZE_MAX;
+
+	Huffman dynamic_literals, dynamic_distances;
+	bool final_block = false;
+	while (!final_block)
+	{
+		final_block = reader.Take(1) != 0;
+		const uint32_t type = reader.Take(2);
+
+		if (type == 0)
+		{
+			// Stored block, starts at the next byte
+			reader.Take(reader.bit_count & 7);
+			const uint32_t length = reader.Take(16);
+			const uint32_t inverted = reader.Take(16);
+			if (reader.Overran() || (length ^ 0xFFFF) != inverted)
+				return false;
+
+			if (written + length > limit)
+				return false;
+			reserve(length);
+			uint32_t copied = 0;
+			for (; copied < length && reader.bit_count >= 8; copied++)
+				out[written++] = (unsigned char)reader.Take(8);
+
+			// The bit buffer is empty now, the rest is copied straight from the input
+			// Refill loads a few bits past bit_count from the input that comes next, they must not stay behind
+			const uint32_t rest = length - copied;
+			if (rest > 0)
+				reader.bits = 0;
+			if (reader.Overran() || (size_t)(reader.end - reader.in) < rest)
+				return false;
+			memcpy(out.data() + written, reader.in, rest);
+			reader.in += rest;
+			written += rest;
+			continue;
+		}
+
+		const Huffman * literals;
+		const Huffman * distances;
+		if (type == 1)
+			FixedTables(literals, distances);
+		else if (type == 2)
+		{
+			if (!ReadDynamicTables(reader, dynamic_literals, dynamic_distances))
+				return false;
+			literals = &dynamic_literals;
+			distances = &dynamic_distances;
+		}
+		else
+			return false;
+
+		for (;;)
+		{
+			// Zeros past the end of the input decode to something, stop as soon as they are used
+			if (reader.Overran() || written > limit)
+				return false;
+
+			// Room for the longest match plus the 8 byte steps of the copy below
+			reserve(258 + 8);
+			unsigned char * to = out.data() + written;
+
+			const int symbol = Decode(reader, *literals);
+			if (symbol < 256)
+			{
+				if (symbol < 0)
+					return false;
+				*to = (unsigned char)symbol;
+				written++;
+				continue;
+			}
+			if (symbol == 256)
+				break;
+			if (symbol > 285)
+				return false;
+
+			const int length = LENGTH_BASE[symbol - 257] + (int)reader.Take(LENGTH_EXTRA[symbol - 257]);
+			const int distance_symbol = Decode(reader, *distances);
+			if (distance_symbol < 0 || distance_symbol > 29)
+				return false;
+			const size_t distance = DISTANCE_BASE[distance_symbol] + reader.Take(DISTANCE_EXTRA[distance_symbol]);
+			if (distance > written)
+				return false;
+
+			// 8 bytes at a time when the source is at least that far back, it may write a few bytes past the match
+			const unsigned char * from = to - distance;
+			if (distance >= 8)
+			{
+				for (int i = 0; i < length; i += 8)
+					memcpy(to + i, from + i, 8);
+			}
+			else if (distance == 1)
+				memset(to, *from, length);
+			else
+			{
+				// Overlapping copy, repeats the last distance bytes
+				for (int i = 0; i < length; i++)
+					to[i] = from[i];
+			}
+			written += length;
+		}
+
+		if (reader.Overran())
+			return false;
+	}
+
+	out.resize(written);
+	return !reader.Overran() && written <= limit;
+}
+
+
+/// <summary>
+/// Checksum of the zlib wrapper
+/// </summary>
+static uint32_t Adler32(const unsigned char * data, size_t size)
+{
+	uint32_t a = 1;
+	uint32_t b = 0;
+	while (size > 0)
+	{
+		// Largest block that can't overflow b before the modulo
+		const size_t block = std::min<size_t>(size, 5552);
+		for (size_t i = 0; i < block; i++)
+		{
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += block;
+		size -= block;
+	}
+	return b << 16 | a;
+}
+
+
+bool ZlibInflate(const unsigned char * source, size_t size, std::vector<unsigned char> & out, size_t size_hint)
+{
+	if (size < 6)
+		return false;
+
+	// Deflate with at most a 32KB window and no preset dictionary
+	const unsigned int method = source[0];
+	const unsigned int flags = source[1];
+	if ((method & 15) != 8 || (method >> 4) > 7 || (method << 8 | flags) % 31 != 0 || (flags & 32))
+		return false;
+
+	if (!Inflate(source + 2, size - 6, out, size_hint))
+		return false;
+
+	const unsigned char * checksum = source + size - 4;
+	const uint32_t expected = (uint32_t)checksum[0] << 24 | (uint32_t)checksum[1] << 16 | (uint32_t)checksum[2] << 8 | checksum[3];
+	return Adler32(out.data(), out.size()) == expected;
+}
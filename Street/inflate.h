@@ -0,0 +1,11 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+
+// Deflate decoder (rfc 1951), size_hint is the expected output size when it is known up front
+// A stream that decodes to more than a non zero size_hint is rejected
+bool Inflate(const unsigned char * source, size_t size, std::vector<unsigned char> & out, size_t size_hint = 0);
+
+// Deflate data in a zlib wrapper (rfc 1950), as stored in png files, the adler32 checksum is verified
+bool ZlibInflate(const unsigned char * source, size_t size, std::vector<unsigned char> & out, size_t size_hint = 0);
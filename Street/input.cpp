@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <ctype.h>
+#include <chrono>
+#include <algorithm>
+
+#include "input.h"
+#include "stats.h"
+
+
+/// <summary>
+/// Returns the time in milliseconds on a clock that never jumps
+/// </summary>
+double InputTime()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+InputQueue::InputQueue()
+{
+	this->head = 0;
+	this->tail = 0;
+}
+
+
+/// <summary>
+/// Adds an event, only the producer may call this
+/// </summary>
+/// <returns>False when the queue is full and the event was dropped</returns>
+bool InputQueue::Push(const InputEvent & event)
+{
+	const unsigned int tail = this->tail.load(std::memory_order_relaxed);
+	if (tail - this->head.load(std::memory_order_acquire) >= (unsigned int)INPUT_QUEUE_SIZE)
+		return false;
+
+	this->events[tail % INPUT_QUEUE_SIZE] = event;
+	this->tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+
+/// <summary>
+/// Takes the oldest event, only the consumer may call this
+/// </summary>
+/// <returns>False when the queue is empty</returns>
+bool InputQueue::Pop(InputEvent & event)
+{
+	const unsigned int head = this->head.load(std::memory_order_relaxed);
+	if (head == this->tail.load(std::memory_order_acquire))
+		return false;
+
+	event = this->events[head % INPUT_QUEUE_SIZE];
+	this->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+
+/// <summary>
+/// ctor
+/// </summary>
+Input::Input()
+{
+	this->latencies.reserve(INPUT_LATENCY_HISTORY);
+}
+
+
+/// <summary>
+/// Queues a key going down or up, keys are case insensitive so shift doesn't stop a movement
+/// </summary>
+/// <param name="key">Character glut reported</param>
+/// <param name="pressed"></param>
+void Input::OnKey(unsigned char key, bool pressed)
+{
+	const InputEvent event = { pressed ? INPUT_KEY_DOWN : INPUT_KEY_UP, tolower(key), 0.0f, 0.0f, InputTime() };
+	if (!this->queue.Push(event))
+		this->dropped++;
+}
+
+
+/// <summary>
+/// Queues the movement of the pointer since the position it was last reported at
+/// The window reports positions, the first one only gives the position the next one is measured from
+/// </summary>
+/// <param name="x">Window coordinates, y points down</param>
+/// <param name="y"></param>
+void Input::OnMouseMove(int x, int y)
+{
+	if (this->has_pointer && (x != this->pointer_x || y != this->pointer_y))
+	{
+		const InputEvent event = { INPUT_MOUSE_MOVE, 0, float(x - this->pointer_x), float(y - this->pointer_y), InputTime() };
+		if (!this->queue.Push(event))
+			this->dropped++;
+	}
+	this->has_pointer = true;
+	this->pointer_x = x;
+	this->pointer_y = y;
+}
+
+
+/// <summary>
+/// Tells the input the pointer was moved by the program, the event of the warp itself then moves nothing
+/// </summary>
+void Input::Recenter(int x, int y)
+{
+	this->pointer_x = x;
+	this->pointer_y = y;
+}
+
+
+/// <summary>
+/// Takes every event up to now, for every key the time it was held since the previous sample and the mouse movement
+/// </summary>
+/// <param name="now">Time of the sample (see InputTime)</param>
+void Input::Sample(double now)
+{
+	const double since = this->last_sample < 0.0 ? now : this->last_sample;
+	std::fill(this->held_ms, this->held_ms + INPUT_KEYS, 0.0);
+	this->mouse_dx = 0.0f;
+	this->mouse_dy = 0.0f;
+
+	int count = 0;
+	InputEvent event;
+	while (this->queue.Pop(event))
+	{
+		count++;
+		if (this->pending_since < 0.0)
+			this->pending_since = event.time;
+
+		const double time = std::min(std::max(event.time, since), now);
+		if (event.type == INPUT_KEY_DOWN && !this->down[event.key])
+		{
+			this->down[event.key] = true;
+			this->down_since[event.key] = time;
+		}
+		else if (event.type == INPUT_KEY_UP && this->down[event.key])
+		{
+			this->held_ms[event.key] += time - std::max(this->down_since[event.key], since);
+			this->down[event.key] = false;
+		}
+		else if (event.type == INPUT_MOUSE_MOVE)
+		{
+			this->mouse_dx += event.dx;
+			this->mouse_dy += event.dy;
+		}
+	}
+
+	for (int key = 0; key < INPUT_KEYS; key++)
+		if (this->down[key])
+			this->held_ms[key] += now - std::max(this->down_since[key], since);
+	this->last_sample = now;
+
+	stats.Add("input events", count);
+	if (this->dropped > 0)
+	{
+		stats.Add("input dropped events", this->dropped);
+		this->dropped = 0;
+	}
+}
+
+
+bool Input::IsDown(unsigned char key) const
+{
+	return this->down[tolower(key)];
+}
+
+
+/// <summary>
+/// Returns how many milliseconds a key was down between the last two samples
+/// </summary>
+double Input::HeldTime(unsigned char key) const
+{
+	return this->held_ms[tolower(key)];
+}
+
+
+/// <summary>
+/// Returns the pixels the mouse moved to the right between the last two samples
+/// </summary>
+float Input::MouseX() const
+{
+	return this->mouse_dx;
+}
+
+
+/// <summary>
+/// Returns the pixels the mouse moved down between the last two samples
+/// </summary>
+float Input::MouseY() const
+{
+	return this->mouse_dy;
+}
+
+
+/// <summary>
+/// Closes the latency of the input that went into the frame that was just handed to the window
+/// It ends when the swap returns, the time until the display scans it out isn't visible from here
+/// </summary>
+/// <param name="now">Time the swap returned (see InputTime)</param>
+void Input::Presented(double now)
+{
+	if (this->pending_since < 0.0)
+		return;
+
+	const float latency = (float)(now - this->pending_since);
+	this->pending_since = -1.0;
+
+	if ((int)this->latencies.size() < INPUT_LATENCY_HISTORY)
+		this->latencies.push_back(latency);
+	else
+		this->latencies[this->latency_next] = latency;
+	this->latency_next = (this->latency_next + 1) % INPUT_LATENCY_HISTORY;
+	this->latency_count++;
+	this->latency_sum += latency;
+	stats.Add("input latency ms", latency);
+}
+
+
+/// <summary>
+/// Prints the input to present latency of the frames input went into
+/// </summary>
+void Input::PrintLatency() const
+{
+	if (this->latencies.empty())
+	{
+		printf("No input was presented yet\n");
+		return;
+	}
+
+	std::vector<float> sorted = this->latencies;
+	std::sort(sorted.begin(), sorted.end());
+	printf("Input to present latency over %lld frames: avg %.2f ms, last %d frames p50 %.2f ms p99 %.2f ms max %.2f ms\n",
+		this->latency_count, this->latency_sum / this->latency_count, (int)sorted.size(),
+		sorted[sorted.size() / 2], sorted[(sorted.size() * 99) / 100], sorted.back());
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <vector>
+
+
+// Events the queue holds, when it is full newer events are dropped
+const int INPUT_QUEUE_SIZE = 1024;
+
+// Keys are the characters glut reports, lower case
+const int INPUT_KEYS = 256;
+
+// Latencies kept for the percentiles of the report
+const int INPUT_LATENCY_HISTORY = 1024;
+
+enum InputEventType
+{
+	INPUT_KEY_DOWN,
+	INPUT_KEY_UP,
+	INPUT_MOUSE_MOVE
+};
+
+// An event as the window reported it, with the time it came in (see InputTime)
+struct InputEvent
+{
+	InputEventType type;
+	int key;
+	float dx;
+	float dy;
+	double time;
+};
+
+// Milliseconds on a monotonic clock, the time events are stamped with
+double InputTime();
+
+// Lock free queue for a single producer (the window callbacks) and a single consumer (the frame)
+class InputQueue
+{
+private:
+	InputEvent events[INPUT_QUEUE_SIZE];
+	std::atomic<unsigned int> head;		// Next event to read, only the consumer moves it
+	std::atomic<unsigned int> tail;		// Next free slot, only the producer moves it
+public:
+	InputQueue();
+
+	bool Push(const InputEvent & event);
+	bool Pop(InputEvent & event);
+};
+
+// Collects the input of the window as timestamped events and turns them into what the frame needs right before
+// the view is built: how long every key was held since the previous sample and how far the mouse moved
+// Holding time is measured between the timestamps, so a tap shorter than a frame still moves the distance it was held
+// The mouse is relative, it stays hidden and is only put back in the middle when it gets near the edge of the window
+class Input
+{
+private:
+	InputQueue queue;
+
+	// Producer side, the last pointer position the window reported
+	bool has_pointer = false;
+	int pointer_x = 0;
+	int pointer_y = 0;
+	int dropped = 0;
+
+	// Consumer side
+	bool down[INPUT_KEYS] = {};
+	double down_since[INPUT_KEYS] = {};
+	double held_ms[INPUT_KEYS] = {};
+	float mouse_dx = 0.0f;
+	float mouse_dy = 0.0f;
+	double last_sample = -1.0;
+
+	// Oldest event that went into the view that is not on the screen yet
+	double pending_since = -1.0;
+	std::vector<float> latencies;
+	int latency_next = 0;
+	long long latency_count = 0;
+	double latency_sum = 0.0;
+public:
+	Input();
+
+	// Called from the window callbacks
+	void OnKey(unsigned char key, bool pressed);
+	void OnMouseMove(int x, int y);
+	void Recenter(int x, int y);
+
+	// Called by the frame
+	void Sample(double now);
+	bool IsDown(unsigned char key) const;
+	double HeldTime(unsigned char key) const;
+	float MouseX() const;
+	float MouseY() const;
+	void Presented(double now);
+	void PrintLatency() const;
+};
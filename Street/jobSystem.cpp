@@ -0,0 +1,270 @@
+#include <algorithm>
+
+#include "jobSystem.h"
+
+thread_local int JobSystem::worker_index = 0;
+
+
+bool JobRing::Empty() const
+{
+	return this->count == 0;
+}
+
+
+/// <summary>
+/// Adds a job at the back, a full ring is unrolled into one twice the size
+/// </summary>
+void JobRing::PushBack(Job && job)
+{
+	if (this->count == this->jobs.size())
+	{
+		std::vector<Job> grown(std::max<size_t>(16, this->jobs.size() * 2));
+		for (size_t i = 0; i < this->count; i++)
+			grown[i] = std::move(this->jobs[(this->first + i) % this->jobs.size()]);
+		this->jobs.swap(grown);
+		this->first = 0;
+	}
+	this->jobs[(this->first + this->count) % this->jobs.size()] = std::move(job);
+	this->count++;
+}
+
+
+void JobRing::PopBack(Job & job)
+{
+	this->count--;
+	job = std::move(this->jobs[(this->first + this->count) % this->jobs.size()]);
+}
+
+
+void JobRing::PopFront(Job & job)
+{
+	job = std::move(this->jobs[this->first]);
+	this->first = (this->first + 1) % this->jobs.size();
+	this->count--;
+}
+
+
+/// <summary>
+/// ctor, the system runs everything on the calling thread until Start is called
+/// </summary>
+JobSystem::JobSystem() : running(false), queued(0)
+{
+	this->workers.push_back(std::unique_ptr<Worker>(new Worker()));
+}
+
+
+JobSystem::~JobSystem()
+{
+	Stop();
+}
+
+
+/// <summary>
+/// Starts the worker threads
+/// </summary>
+/// <param name="thread_count">Total amount of threads including the calling one, 0 uses all cores</param>
+void JobSystem::Start(int thread_count)
+{
+	Stop();
+
+	if (thread_count <= 0)
+		thread_count = std::max(1, (int)std::thread::hardware_concurrency());
+
+	this->workers.clear();
+	for (int i = 0; i < thread_count; i++)
+		this->workers.push_back(std::unique_ptr<Worker>(new Worker()));
+
+	worker_index = 0;
+	this->running = true;
+	for (int i = 1; i < thread_count; i++)
+		this->threads.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+}
+
+
+/// <summary>
+/// Finishes the queued jobs and joins all worker threads
+/// </summary>
+void JobSystem::Stop()
+{
+	if (!this->running)
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(this->sleep_lock);
+		this->running = false;
+	}
+	this->wake.notify_all();
+
+	for (auto & thread : this->threads)
+		thread.join();
+	this->threads.clear();
+
+	// Anything left over runs on the calling thread
+	while (RunOne(0));
+}
+
+
+int JobSystem::ThreadCount() const
+{
+	return (int)this->workers.size();
+}
+
+
+/// <summary>
+/// Takes the most recently pushed job of a worker
+/// </summary>
+bool JobSystem::Pop(int worker, Job & job)
+{
+	Worker & own = *this->workers[worker];
+	std::lock_guard<std::mutex> guard(own.lock);
+	if (own.jobs.Empty())
+		return false;
+
+	own.jobs.PopBack(job);
+	return true;
+}
+
+
+/// <summary>
+/// Takes the oldest job of another worker
+/// </summary>
+bool JobSystem::Steal(int thief, Job & job)
+{
+	const int count = (int)this->workers.size();
+	for (int i = 1; i < count; i++)
+	{
+		Worker & victim = *this->workers[(thief + i) % count];
+		std::unique_lock<std::mutex> guard(victim.lock, std::try_to_lock);
+		if (!guard.owns_lock() || victim.jobs.Empty())
+			continue;
+
+		victim.jobs.PopFront(job);
+		return true;
+	}
+	return false;
+}
+
+
+/// <summary>
+/// Runs a single job, either an own one or a stolen one
+/// </summary>
+/// <param name="worker"></param>
+/// <returns>Whether a job was run</returns>
+bool JobSystem::RunOne(int worker)
+{
+	Job job;
+	if (!Pop(worker, job) && !Steal(worker, job))
+		return false;
+
+	this->queued--;
+	if (job.range != nullptr)
+		(*job.range)(job.begin, job.end);
+	else
+		job.func();
+	if (job.counter != nullptr)
+		job.counter->count--;
+	return true;
+}
+
+
+/// <summary>
+/// Keeps a worker thread busy, it sleeps when there is nothing to run
+/// </summary>
+/// <param name="worker"></param>
+void JobSystem::WorkerLoop(int worker)
+{
+	worker_index = worker;
+
+	while (this->running)
+	{
+		if (RunOne(worker))
+			continue;
+
+		std::unique_lock<std::mutex> guard(this->sleep_lock);
+		this->wake.wait(guard, [this] { return this->queued > 0 || !this->running; });
+	}
+}
+
+
+/// <summary>
+/// Queues a job on the ring of the calling thread
+/// </summary>
+/// <param name="func"></param>
+/// <param name="counter">Counter that is raised now and lowered once the job finished</param>
+void JobSystem::Run(std::function<void()> func, JobCounter * counter)
+{
+	// Without workers there is nobody to steal it
+	if (this->threads.empty())
+	{
+		func();
+		return;
+	}
+
+	this->Push(Job{ std::move(func), nullptr, 0, 0, counter });
+}
+
+
+/// <summary>
+/// Queues a job that has workers to run it
+/// </summary>
+void JobSystem::Push(Job && job)
+{
+	if (job.counter != nullptr)
+		job.counter->count++;
+
+	Worker & own = *this->workers[worker_index];
+	{
+		std::lock_guard<std::mutex> guard(own.lock);
+		own.jobs.PushBack(std::move(job));
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(this->sleep_lock);
+		this->queued++;
+	}
+	this->wake.notify_one();
+}
+
+
+/// <summary>
+/// Waits until all jobs of a counter finished, the waiting thread helps running jobs in the meantime
+/// </summary>
+/// <param name="counter"></param>
+void JobSystem::Wait(JobCounter & counter)
+{
+	while (counter.count > 0)
+	{
+		if (!RunOne(worker_index))
+			std::this_thread::yield();
+	}
+}
+
+
+/// <summary>
+/// Splits [0, count) into ranges of grain items and runs func on all of them in parallel
+/// </summary>
+/// <param name="count"></param>
+/// <param name="grain">Amount of items per job</param>
+/// <param name="func">Called with [begin, end) of every range, the ranges refer to it so it isn't copied</param>
+void JobSystem::ParallelFor(size_t count, size_t grain, const RangeFunc & func)
+{
+	if (count == 0)
+		return;
+	if (grain == 0)
+		grain = 1;
+
+	// Not worth splitting
+	if (count <= grain || this->threads.empty())
+	{
+		func(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (size_t begin = grain; begin < count; begin += grain)
+		this->Push(Job{ std::function<void()>(), &func, begin, std::min(count, begin + grain), &counter });
+
+	// The first range runs right here
+	func(0, grain);
+	Wait(counter);
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Counts the jobs that still have to finish, work that depends on them waits until it reaches zero
+struct JobCounter
+{
+	std::atomic<int> count;
+	JobCounter() : count(0) {}
+};
+
+// Reference to the function of a ParallelFor, it points at the function instead of copying it (ParallelFor waits
+// for its jobs before it returns), so a lambda with a few captures doesn't allocate like a std::function would
+class RangeFunc
+{
+private:
+	const void * func;
+	void(*call)(const void * func, size_t begin, size_t end);
+public:
+	template <typename F>
+	RangeFunc(const F & func) : func(&func), call([](const void * func, size_t begin, size_t end) { (*(const F *)func)(begin, end); }) {}
+
+	void operator()(size_t begin, size_t end) const
+	{
+		this->call(this->func, begin, end);
+	}
+};
+
+// Either a function of its own or a range of a ParallelFor
+struct Job
+{
+	std::function<void()> func;
+	const RangeFunc * range;
+	size_t begin;
+	size_t end;
+	JobCounter * counter;
+};
+
+// Jobs of a worker as a ring, it grows when it is full and never shrinks, so a steady frame doesn't allocate
+class JobRing
+{
+private:
+	std::vector<Job> jobs;
+	size_t first = 0;
+	size_t count = 0;
+public:
+	bool Empty() const;
+	void PushBack(Job && job);
+	void PopBack(Job & job);
+	void PopFront(Job & job);
+};
+
+// Work stealing scheduler
+// Every thread owns a ring of jobs, it takes its own jobs from the back and steals from the front of the others
+// The thread that starts the system (the glut thread) is worker 0 and only runs jobs while it waits
+class JobSystem
+{
+private:
+	struct Worker
+	{
+		JobRing jobs;
+		std::mutex lock;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+	std::atomic<bool> running;
+	std::atomic<int> queued;
+
+	std::mutex sleep_lock;
+	std::condition_variable wake;
+
+	static thread_local int worker_index;
+
+	bool Pop(int worker, Job & job);
+	bool Steal(int thief, Job & job);
+	bool RunOne(int worker);
+	void WorkerLoop(int worker);
+public:
+	JobSystem();
+	~JobSystem();
+
+	void Start(int thread_count = 0);
+	void Stop();
+	int ThreadCount() const;
+
+	void Run(std::function<void()> func, JobCounter * counter = nullptr);
+	void Push(Job && job);
+	void Wait(JobCounter & counter);
+	void ParallelFor(size_t count, size_t grain, const RangeFunc & func);
+};
@@ -0,0 +1,584 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "matrixKernels.h"
+#include "scene.h"
+#include "lightmapBaker.h"
+
+// Samples per texel for the bounced light and the part of the light a surface reflects
+const int BOUNCE_SAMPLES = 16;
+const float BOUNCE_ALBEDO = 0.5f;
+
+// Offset along the normal so rays don't hit the surface they start on
+const float RAY_OFFSET = 1e-3f;
+
+// A texel that has to be lit
+struct BakeTexel
+{
+	int page;
+	int x;
+	int y;
+	glm::vec3 position;
+	glm::vec3 normal;
+};
+
+// Where the tile of an object ended up
+struct BakePlacement
+{
+	int object;
+	int page;
+	int x;
+	int y;
+	int resolution;
+};
+
+struct BakePage
+{
+	std::vector<glm::vec3> color;
+	std::vector<unsigned char> covered;
+};
+
+static std::atomic<long long> ray_count;
+
+
+void GenerateLightmapUVs(Mesh & mesh)
+{
+	const size_t triangles = mesh.indices.size() / 3;
+	const size_t cells = (triangles + 1) / 2;
+	const int grid = std::max(1, (int)ceil(sqrt((double)cells)));
+	const float cell = 1.0f / grid;
+	const float gap = cell * 0.08f;
+
+	// Lightmap uv of every corner
+	std::vector<glm::vec2> corners(mesh.indices.size());
+	for (size_t t = 0; t < triangles; t++)
+	{
+		const int index = (int)(t / 2);
+		const float x0 = (index % grid) * cell;
+		const float y0 = (index / grid) * cell;
+		const unsigned int * tri = &mesh.indices[t * 3];
+
+		// Two halves of a quad (a, b, c) (a, c, d) share their diagonal
+		const bool quad = t % 2 == 0 ? t + 1 < triangles && tri[3] == tri[0] && tri[4] == tri[2] : tri[-3] == tri[0] && tri[-1] == tri[1];
+		if (quad && t % 2 == 0)
+		{
+			corners[t * 3 + 0] = glm::vec2(x0 + gap, y0 + gap);
+			corners[t * 3 + 1] = glm::vec2(x0 + cell - gap, y0 + gap);
+			corners[t * 3 + 2] = glm::vec2(x0 + cell - gap, y0 + cell - gap);
+		}
+		else if (quad)
+		{
+			corners[t * 3 + 0] = glm::vec2(x0 + gap, y0 + gap);
+			corners[t * 3 + 1] = glm::vec2(x0 + cell - gap, y0 + cell - gap);
+			corners[t * 3 + 2] = glm::vec2(x0 + gap, y0 + cell - gap);
+		}
+		else if (t % 2 == 0)
+		{
+			// Lower left half
+			corners[t * 3 + 0] = glm::vec2(x0 + gap, y0 + gap);
+			corners[t * 3 + 1] = glm::vec2(x0 + cell - 3 * gap, y0 + gap);
+			corners[t * 3 + 2] = glm::vec2(x0 + gap, y0 + cell - 3 * gap);
+		}
+		else
+		{
+			// Upper right half
+			corners[t * 3 + 0] = glm::vec2(x0 + cell - gap, y0 + cell - gap);
+			corners[t * 3 + 1] = glm::vec2(x0 + 3 * gap, y0 + cell - gap);
+			corners[t * 3 + 2] = glm::vec2(x0 + cell - gap, y0 + 3 * gap);
+		}
+	}
+
+	// Vertices are only shared by corners that got the same lightmap uv
+	struct Key
+	{
+		unsigned int vertex;
+		float u, v;
+		bool operator<(const Key & other) const
+		{
+			if (this->vertex != other.vertex)
+				return this->vertex < other.vertex;
+			return this->u != other.u ? this->u < other.u : this->v < other.v;
+		}
+	};
+	std::map<Key, unsigned int> vertex_of;
+	Mesh split;
+	split.indices.resize(mesh.indices.size());
+	for (size_t i = 0; i < mesh.indices.size(); i++)
+	{
+		const unsigned int vertex = mesh.indices[i];
+		auto found = vertex_of.insert(std::make_pair(Key{ vertex, corners[i].x, corners[i].y }, (unsigned int)split.vertices.size()));
+		if (found.second)
+		{
+			split.vertices.push_back(mesh.vertices[vertex]);
+			split.normals.push_back(mesh.normals[vertex]);
+			split.uvs.push_back(mesh.uvs[vertex]);
+			split.lightmap_uvs.push_back(corners[i]);
+		}
+		split.indices[i] = found.first->second;
+	}
+
+	mesh.vertices.swap(split.vertices);
+	mesh.normals.swap(split.normals);
+	mesh.uvs.swap(split.uvs);
+	mesh.lightmap_uvs.swap(split.lightmap_uvs);
+	mesh.indices.swap(split.indices);
+}
+
+
+int LightmapResolution(size_t triangle_count)
+{
+	const size_t cells = (triangle_count + 1) / 2;
+	const int grid = std::max(1, (int)ceil(sqrt((double)cells)));
+
+	int resolution = 32;
+	while (resolution < grid * 8 && resolution < 1024)
+		resolution *= 2;
+	return resolution;
+}
+
+
+/// <summary>
+/// Random number in [0, 1), every thread keeps its own state
+/// </summary>
+static float Random(unsigned int & state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return (state & 0xffffff) / (float)0x1000000;
+}
+
+
+/// <summary>
+/// Direction around a normal, distributed by the cosine of the angle with it
+/// </summary>
+static glm::vec3 CosineSample(const glm::vec3 & normal, unsigned int & state)
+{
+	const float r1 = Random(state);
+	const float r2 = Random(state);
+	const float phi = 6.2831853f * r1;
+	const float radius = sqrtf(r2);
+
+	glm::vec3 tangent = fabsf(normal.x) > 0.5f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+	tangent = glm::normalize(glm::cross(tangent, normal));
+	glm::vec3 bitangent = glm::cross(normal, tangent);
+
+	return glm::normalize(tangent * (cosf(phi) * radius) + bitangent * (sinf(phi) * radius) + normal * sqrtf(1.0f - r2));
+}
+
+
+/// <summary>
+/// Number of lanes set in a packet mask
+/// </summary>
+static int LaneCount(int mask)
+{
+	return (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+}
+
+
+/// <summary>
+/// Fills one lane of a packet
+/// </summary>
+static void SetRay(RayPacket & packet, int lane, const glm::vec3 & origin, const glm::vec3 & dir, float t_max)
+{
+	packet.origin_x[lane] = origin.x;
+	packet.origin_y[lane] = origin.y;
+	packet.origin_z[lane] = origin.z;
+	packet.dir_x[lane] = dir.x;
+	packet.dir_y[lane] = dir.y;
+	packet.dir_z[lane] = dir.z;
+	packet.t_max[lane] = t_max;
+}
+
+
+/// <summary>
+/// Light arriving at up to four points, with the same falloff as the fragment shader
+/// The main light has no range, point lights fade out towards their radius
+/// </summary>
+/// <param name="bvh"></param>
+/// <param name="lights">Main light first, then the point lights</param>
+/// <param name="positions"></param>
+/// <param name="normals"></param>
+/// <param name="active">Lanes in use</param>
+/// <param name="out">Receives the light per lane</param>
+static void DirectLight(const Bvh & bvh, const std::vector<LightSource> & lights, const glm::vec3 * positions, const glm::vec3 * normals, int active, glm::vec3 * out)
+{
+	for (int lane = 0; lane < 4; lane++)
+		out[lane] = glm::vec3(0.0f);
+
+	for (size_t l = 0; l < lights.size(); l++)
+	{
+		const LightSource & light = lights[l];
+		RayPacket packet = {};
+		float weight[4] = {};
+		int lanes = 0;
+
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (!(active & (1 << lane)))
+				continue;
+
+			glm::vec3 to_light = light.position - positions[lane];
+			float dist = glm::length(to_light);
+			if (dist <= 0.0f)
+				continue;
+			glm::vec3 dir = to_light / dist;
+
+			float n_dot_l = glm::dot(normals[lane], dir);
+			float falloff = light.radius > 0.0f ? glm::clamp(1.0f - dist / light.radius, 0.0f, 1.0f) : 1.0f;
+			if (n_dot_l <= 0.0f || falloff <= 0.0f)
+				continue;
+
+			weight[lane] = n_dot_l * falloff * falloff;
+			SetRay(packet, lane, positions[lane] + normals[lane] * RAY_OFFSET, dir, dist - RAY_OFFSET);
+			lanes |= 1 << lane;
+		}
+
+		if (lanes == 0)
+			continue;
+
+		PacketHit hit = bvh.Trace(packet, lanes, true);
+		ray_count += LaneCount(lanes);
+
+		for (int lane = 0; lane < 4; lane++)
+			if ((lanes & (1 << lane)) && !(hit.hits & (1 << lane)))
+				out[lane] += light.color * weight[lane];
+	}
+}
+
+
+/// <summary>
+/// Bakes four texels: direct light plus the direct light that reaches them after one bounce
+/// </summary>
+static void BakeTexels(const Bvh & bvh, const std::vector<LightSource> & lights, const BakeTexel * texels, int count, unsigned int seed, glm::vec3 * out)
+{
+	glm::vec3 positions[4], normals[4];
+	int active = 0;
+	for (int lane = 0; lane < count; lane++)
+	{
+		positions[lane] = texels[lane].position;
+		normals[lane] = texels[lane].normal;
+		active |= 1 << lane;
+	}
+
+	DirectLight(bvh, lights, positions, normals, active, out);
+
+	unsigned int state = seed * 747796405u + 2891336453u;
+	glm::vec3 bounce[4] = {};
+	for (int sample = 0; sample < BOUNCE_SAMPLES; sample++)
+	{
+		RayPacket packet = {};
+		glm::vec3 dirs[4];
+		for (int lane = 0; lane < count; lane++)
+		{
+			dirs[lane] = CosineSample(normals[lane], state);
+			SetRay(packet, lane, positions[lane] + normals[lane] * RAY_OFFSET, dirs[lane], 1e30f);
+		}
+
+		PacketHit hit = bvh.Trace(packet, active, false);
+		ray_count += count;
+		if (hit.hits == 0)
+			continue;
+
+		// Light the surfaces the bounce rays ended up on
+		glm::vec3 hit_positions[4], hit_normals[4], hit_light[4];
+		for (int lane = 0; lane < count; lane++)
+		{
+			if (!(hit.hits & (1 << lane)))
+				continue;
+
+			hit_positions[lane] = positions[lane] + normals[lane] * RAY_OFFSET + dirs[lane] * hit.t[lane];
+			hit_normals[lane] = bvh.Normal(hit.triangle[lane]);
+			if (glm::dot(hit_normals[lane], dirs[lane]) > 0.0f)
+				hit_normals[lane] = -hit_normals[lane];
+		}
+		DirectLight(bvh, lights, hit_positions, hit_normals, hit.hits, hit_light);
+
+		for (int lane = 0; lane < count; lane++)
+			if (hit.hits & (1 << lane))
+				bounce[lane] += hit_light[lane];
+	}
+
+	for (int lane = 0; lane < count; lane++)
+		out[lane] += bounce[lane] * (BOUNCE_ALBEDO / BOUNCE_SAMPLES);
+}
+
+
+/// <summary>
+/// Finds the texels covered by the triangles of an object and where they are in the world
+/// </summary>
+static void RasterizeObject(const Mesh & mesh, const glm::mat4 & world, const BakePlacement & placement, BakePage & page, std::vector<BakeTexel> & texels)
+{
+	glm::mat4 mv, normal_matrix;
+	BatchModelView(glm::mat4(), &world, sizeof(glm::mat4), &mv, &normal_matrix, 1);
+	const glm::mat3 normal_world = glm::mat3(normal_matrix);
+	const float res = (float)placement.resolution;
+
+	for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+	{
+		const unsigned int i0 = mesh.indices[t];
+		const unsigned int i1 = mesh.indices[t + 1];
+		const unsigned int i2 = mesh.indices[t + 2];
+		const glm::vec2 a = mesh.lightmap_uvs[i0] * res;
+		const glm::vec2 b = mesh.lightmap_uvs[i1] * res;
+		const glm::vec2 c = mesh.lightmap_uvs[i2] * res;
+		const float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+		if (fabsf(area) < 1e-8f)
+			continue;
+
+		const glm::vec3 p0 = glm::vec3(world * glm::vec4(mesh.vertices[i0], 1.0f));
+		const glm::vec3 p1 = glm::vec3(world * glm::vec4(mesh.vertices[i1], 1.0f));
+		const glm::vec3 p2 = glm::vec3(world * glm::vec4(mesh.vertices[i2], 1.0f));
+		const bool has_normals = mesh.normals.size() == mesh.vertices.size();
+		const glm::vec3 face_normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+
+		const int min_x = std::max(0, (int)floorf(std::min(a.x, std::min(b.x, c.x))));
+		const int max_x = std::min(placement.resolution - 1, (int)ceilf(std::max(a.x, std::max(b.x, c.x))));
+		const int min_y = std::max(0, (int)floorf(std::min(a.y, std::min(b.y, c.y))));
+		const int max_y = std::min(placement.resolution - 1, (int)ceilf(std::max(a.y, std::max(b.y, c.y))));
+
+		for (int y = min_y; y <= max_y; y++)
+		{
+			for (int x = min_x; x <= max_x; x++)
+			{
+				// Barycentric coordinates of the texel center, slightly conservative
+				const glm::vec2 p = glm::vec2(x + 0.5f, y + 0.5f);
+				const float w1 = ((p.x - a.x) * (c.y - a.y) - (c.x - a.x) * (p.y - a.y)) / area;
+				const float w2 = ((b.x - a.x) * (p.y - a.y) - (p.x - a.x) * (b.y - a.y)) / area;
+				const float w0 = 1.0f - w1 - w2;
+				if (w0 < -0.05f || w1 < -0.05f || w2 < -0.05f)
+					continue;
+
+				const int page_x = placement.x + x;
+				const int page_y = placement.y + y;
+				unsigned char & covered = page.covered[page_y * LIGHTMAP_PAGE_SIZE + page_x];
+				if (covered)
+					continue;
+				covered = 1;
+
+				glm::vec3 normal = face_normal;
+				if (has_normals)
+					normal = glm::normalize(normal_world * (mesh.normals[i0] * w0 + mesh.normals[i1] * w1 + mesh.normals[i2] * w2));
+
+				texels.push_back(BakeTexel{ placement.page, page_x, page_y, p0 * w0 + p1 * w1 + p2 * w2, normal });
+			}
+		}
+	}
+}
+
+
+/// <summary>
+/// Spreads the edges of every chart into the empty texels around it so bilinear filtering doesn't pick up black
+/// </summary>
+static void Dilate(BakePage & page, int passes)
+{
+	const int size = LIGHTMAP_PAGE_SIZE;
+	for (int pass = 0; pass < passes; pass++)
+	{
+		std::vector<unsigned char> covered = page.covered;
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				if (covered[y * size + x])
+					continue;
+
+				glm::vec3 sum = glm::vec3(0.0f);
+				int count = 0;
+				for (int dy = -1; dy <= 1; dy++)
+					for (int dx = -1; dx <= 1; dx++)
+					{
+						const int nx = x + dx, ny = y + dy;
+						if (nx < 0 || ny < 0 || nx >= size || ny >= size || !covered[ny * size + nx])
+							continue;
+						sum += page.color[ny * size + nx];
+						count++;
+					}
+
+				if (count > 0)
+				{
+					page.color[y * size + x] = sum / (float)count;
+					page.covered[y * size + x] = 1;
+				}
+			}
+		}
+	}
+}
+
+
+/// <summary>
+/// Writes a page as an uncompressed 24bpp bmp
+/// </summary>
+static bool WritePage(const BakePage & page, const std::string & path)
+{
+	const int size = LIGHTMAP_PAGE_SIZE;
+	const unsigned int image_size = size * size * 3;
+	unsigned char header[54] = { 'B', 'M' };
+	auto put = [&header](int offset, unsigned int value) {
+		for (int i = 0; i < 4; i++)
+			header[offset + i] = (unsigned char)(value >> (i * 8));
+	};
+	put(0x02, 54 + image_size);
+	put(0x0A, 54);
+	put(0x0E, 40);
+	put(0x12, size);
+	put(0x16, size);
+	header[0x1A] = 1;
+	header[0x1C] = 24;
+	put(0x22, image_size);
+
+	FILE * file = fopen(path.c_str(), "wb");
+	if (file == NULL)
+		return false;
+
+	std::vector<unsigned char> data(image_size);
+	for (int i = 0; i < size * size; i++)
+	{
+		glm::vec3 c = glm::clamp(page.color[i], 0.0f, 1.0f) * 255.0f;
+		data[i * 3 + 0] = (unsigned char)(c.z + 0.5f);
+		data[i * 3 + 1] = (unsigned char)(c.y + 0.5f);
+		data[i * 3 + 2] = (unsigned char)(c.x + 0.5f);
+	}
+
+	fwrite(header, 1, 54, file);
+	fwrite(data.data(), 1, data.size(), file);
+	fclose(file);
+	return true;
+}
+
+
+bool BakeLightmaps(Scene & scene, JobSystem & jobs, const char * directory)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	scene.UpdateHierarchy(jobs);
+
+	// Static geometry in world space for the bvh
+	std::vector<int> objects;
+	std::vector<glm::vec3> positions;
+	for (int object = 0; object < (int)scene.Size(); object++)
+	{
+		if (!scene.IsStatic(object))
+			continue;
+
+		objects.push_back(object);
+		const glm::mat4 & world = scene.GetTransform(object).GetWorldMatrix();
+		const Mesh & mesh = scene.GetMesh(scene.GetMeshId(object)).GetMesh();
+		for (unsigned int index : mesh.indices)
+			positions.push_back(glm::vec3(world * glm::vec4(mesh.vertices[index], 1.0f)));
+	}
+
+	Bvh bvh;
+	bvh.Build(positions);
+	printf("Baking %u static objects, %u triangles, %u bvh nodes\n", (unsigned)objects.size(), (unsigned)bvh.TriangleCount(), (unsigned)bvh.NodeCount());
+
+	// Pack the tiles on shelves
+	std::vector<BakePlacement> placements;
+	int page = 0, x = 0, y = 0, shelf = 0;
+	for (int object : objects)
+	{
+		const Mesh & mesh = scene.GetMesh(scene.GetMeshId(object)).GetMesh();
+		const int resolution = LightmapResolution(mesh.indices.size() / 3);
+
+		if (x + resolution > LIGHTMAP_PAGE_SIZE)
+		{
+			x = 0;
+			y += shelf;
+			shelf = 0;
+		}
+		if (y + resolution > LIGHTMAP_PAGE_SIZE)
+		{
+			page++;
+			x = y = shelf = 0;
+		}
+
+		placements.push_back(BakePlacement{ object, page, x, y, resolution });
+		x += resolution;
+		shelf = std::max(shelf, resolution);
+	}
+
+	std::vector<BakePage> pages(objects.empty() ? 0 : page + 1);
+	for (auto & p : pages)
+	{
+		p.color.assign(LIGHTMAP_PAGE_SIZE * LIGHTMAP_PAGE_SIZE, glm::vec3(0.0f));
+		p.covered.assign(LIGHTMAP_PAGE_SIZE * LIGHTMAP_PAGE_SIZE, 0);
+	}
+
+	std::vector<BakeTexel> texels;
+	for (auto & placement : placements)
+	{
+		const Mesh & mesh = scene.GetMesh(scene.GetMeshId(placement.object)).GetMesh();
+		RasterizeObject(mesh, scene.GetTransform(placement.object).GetWorldMatrix(), placement, pages[placement.page], texels);
+	}
+
+	// Main light first, then the lamp posts
+	std::vector<LightSource> lights;
+	lights.push_back(scene.GetLightSource());
+	lights.insert(lights.end(), scene.GetLights().begin(), scene.GetLights().end());
+
+	ray_count = 0;
+	auto trace_start = std::chrono::high_resolution_clock::now();
+	jobs.ParallelFor((texels.size() + 3) / 4, 64, [&](size_t begin, size_t end) {
+		for (size_t group = begin; group < end; group++)
+		{
+			const size_t first = group * 4;
+			const int count = (int)std::min((size_t)4, texels.size() - first);
+			glm::vec3 light[4];
+			BakeTexels(bvh, lights, &texels[first], count, (unsigned int)group + 1, light);
+
+			// Every texel belongs to exactly one group so there are no write conflicts
+			for (int lane = 0; lane < count; lane++)
+			{
+				const BakeTexel & texel = texels[first + lane];
+				pages[texel.page].color[texel.y * LIGHTMAP_PAGE_SIZE + texel.x] = light[lane];
+			}
+		}
+	});
+	double trace_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - trace_start).count();
+
+#ifdef _WIN32
+	_mkdir(directory);
+#else
+	mkdir(directory, 0755);
+#endif
+
+	bool ok = true;
+	for (size_t p = 0; p < pages.size(); p++)
+	{
+		Dilate(pages[p], 2);
+		ok = WritePage(pages[p], std::string(directory) + "/lightmap" + std::to_string(p) + ".bmp") && ok;
+	}
+
+	FILE * index = fopen((std::string(directory) + "/lightmaps.txt").c_str(), "w");
+	if (index == NULL)
+		return false;
+	fprintf(index, "pages %u\n", (unsigned)pages.size());
+	fprintf(index, "# object page scale_u scale_v offset_u offset_v\n");
+	for (auto & placement : placements)
+	{
+		const float scale = placement.resolution / (float)LIGHTMAP_PAGE_SIZE;
+		fprintf(index, "%d %d %f %f %f %f\n", placement.object, placement.page, scale, scale,
+			placement.x / (float)LIGHTMAP_PAGE_SIZE, placement.y / (float)LIGHTMAP_PAGE_SIZE);
+	}
+	fclose(index);
+
+	double total_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	printf("Baked %u texels into %u pages on %d threads\n", (unsigned)texels.size(), (unsigned)pages.size(), jobs.ThreadCount());
+	printf("  %lld rays in %.2f s: %.2f Mrays/s (total %.2f s)\n", (long long)ray_count, trace_seconds, ray_count / trace_seconds / 1e6, total_seconds);
+	return ok;
+}
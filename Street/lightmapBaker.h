@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "types.h"
+#include "jobSystem.h"
+
+class Scene;
+
+// Size of a lightmap atlas page in texels
+const int LIGHTMAP_PAGE_SIZE = 2048;
+
+// Generates the second uv set used by the lightmaps
+// Every pair of triangles gets its own cell in a grid, one triangle in each half, with a gap so texels don't bleed
+// The two halves of a quad share their diagonal and fill the cell. Vertices are split where corners get different cells
+void GenerateLightmapUVs(Mesh & mesh);
+
+// Size of the square lightmap tile of an object, enough for about 8x8 texels per grid cell
+int LightmapResolution(size_t triangle_count);
+
+// Bakes the direct light and one bounce of the main light and all point lights for every static object
+// Rays are traced in packets of four against a bvh of the static scene on all threads
+// Writes <directory>/lightmap<page>.bmp and <directory>/lightmaps.txt, the placement of every object in the pages
+bool BakeLightmaps(Scene & scene, JobSystem & jobs, const char * directory);
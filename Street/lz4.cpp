@@ -0,0 +1,187 @@
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "lz4.h"
+
+// Format limits, the last bytes of a block are always literals
+const size_t MIN_MATCH = 4;
+const size_t LAST_LITERALS = 5;
+const size_t MATCH_FIND_LIMIT = 12;
+const size_t MAX_OFFSET = 65535;
+const int HASH_BITS = 16;
+
+
+static uint32_t Read32(const unsigned char * p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+
+/// <summary>
+/// Writes a length that didn't fit in its 4 bits of the token
+/// </summary>
+static unsigned char * WriteLength(unsigned char * out, size_t length)
+{
+	for (; length >= 255; length -= 255)
+		*out++ = 255;
+	*out++ = (unsigned char)length;
+	return out;
+}
+
+
+/// <summary>
+/// Reads the rest of a length that filled its 4 bits of the token
+/// </summary>
+/// <returns>Whether the input was long enough</returns>
+static bool ReadLength(const unsigned char *& in, const unsigned char * end, size_t & length)
+{
+	unsigned char byte;
+	do
+	{
+		if (in >= end)
+			return false;
+		byte = *in++;
+		length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+
+/// <summary>
+/// Worst case size of a compressed block, for incompressible data
+/// </summary>
+size_t LZ4Bound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+
+/// <summary>
+/// Compresses a block with greedy matching on a hash of the next 4 bytes
+/// </summary>
+/// <param name="source"></param>
+/// <param name="size"></param>
+/// <param name="destination">At least LZ4Bound(size) bytes</param>
+/// <returns>Size of the compressed block</returns>
+size_t LZ4Compress(const unsigned char * source, size_t size, unsigned char * destination)
+{
+	std::vector<uint32_t> table((size_t)1 << HASH_BITS, UINT32_MAX);
+	unsigned char * out = destination;
+	size_t anchor = 0;
+	size_t position = 0;
+
+	if (size > MATCH_FIND_LIMIT)
+	{
+		const size_t limit = size - MATCH_FIND_LIMIT;
+		while (position < limit)
+		{
+			const uint32_t sequence = Read32(source + position);
+			const uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+			const uint32_t candidate = table[hash];
+			table[hash] = (uint32_t)position;
+
+			if (candidate == UINT32_MAX || position - candidate > MAX_OFFSET || Read32(source + candidate) != sequence)
+			{
+				position++;
+				continue;
+			}
+
+			// Longest match that still leaves the last literals
+			size_t length = MIN_MATCH;
+			const size_t max_length = size - LAST_LITERALS - position;
+			while (length < max_length && source[candidate + length] == source[position + length])
+				length++;
+
+			const size_t literals = position - anchor;
+			const size_t match = length - MIN_MATCH;
+			unsigned char * token = out++;
+			*token = (unsigned char)(((literals < 15 ? literals : 15) << 4) | (match < 15 ? match : 15));
+			if (literals >= 15)
+				out = WriteLength(out, literals - 15);
+			memcpy(out, source + anchor, literals);
+			out += literals;
+
+			const size_t offset = position - candidate;
+			*out++ = (unsigned char)(offset & 0xFF);
+			*out++ = (unsigned char)(offset >> 8);
+			if (match >= 15)
+				out = WriteLength(out, match - 15);
+
+			position += length;
+			anchor = position;
+		}
+	}
+
+	// Everything after the last match
+	const size_t literals = size - anchor;
+	*out++ = (unsigned char)((literals < 15 ? literals : 15) << 4);
+	if (literals >= 15)
+		out = WriteLength(out, literals - 15);
+	memcpy(out, source + anchor, literals);
+	out += literals;
+
+	return (size_t)(out - destination);
+}
+
+
+/// <summary>
+/// Decompresses a block, every length and offset is checked so a damaged block can't write outside the destination
+/// </summary>
+/// <param name="source"></param>
+/// <param name="packed_size">Size of the compressed block</param>
+/// <param name="destination"></param>
+/// <param name="size">Size of the original data</param>
+/// <returns>Whether the block decompressed to exactly size bytes</returns>
+bool LZ4Decompress(const unsigned char * source, size_t packed_size, unsigned char * destination, size_t size)
+{
+	const unsigned char * in = source;
+	const unsigned char * in_end = source + packed_size;
+	unsigned char * out = destination;
+	unsigned char * out_end = destination + size;
+
+	while (in < in_end)
+	{
+		const unsigned char token = *in++;
+
+		size_t literals = token >> 4;
+		if (literals == 15 && !ReadLength(in, in_end, literals))
+			return false;
+		if (literals > (size_t)(in_end - in) || literals > (size_t)(out_end - out))
+			return false;
+		memcpy(out, in, literals);
+		in += literals;
+		out += literals;
+
+		// The last sequence has no match
+		if (in == in_end)
+			break;
+
+		if (in_end - in < 2)
+			return false;
+		const size_t offset = in[0] | (in[1] << 8);
+		in += 2;
+		if (offset == 0 || offset > (size_t)(out - destination))
+			return false;
+
+		size_t length = token & 15;
+		if (length == 15 && !ReadLength(in, in_end, length))
+			return false;
+		length += MIN_MATCH;
+		if (length > (size_t)(out_end - out))
+			return false;
+
+		// Matches may overlap the bytes they produce
+		const unsigned char * match = out - offset;
+		if (offset >= length)
+			memcpy(out, match, length);
+		else
+			for (size_t i = 0; i < length; i++)
+				out[i] = match[i];
+		out += length;
+	}
+
+	return out == out_end;
+}
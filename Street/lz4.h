@@ -0,0 +1,8 @@
+#pragma once
+#include <stddef.h>
+
+
+// LZ4 block format (no frame), compatible with the reference implementation
+size_t LZ4Bound(size_t size);
+size_t LZ4Compress(const unsigned char * source, size_t size, unsigned char * destination);
+bool LZ4Decompress(const unsigned char * source, size_t packed_size, unsigned char * destination, size_t size);
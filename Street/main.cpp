@@ -1,21 +1,44 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <chrono>
+#include <thread>
 
 #include <GL/glew.h>
 #include <GL/freeglut.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtx/matrix_decompose.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "glsl.h"
 #include "objloader.hpp"
 #include "texture.hpp"
 #include "types.h"
-#include "modelRenderer.h"
+#include "transform.h"
+#include "scene.h"
 #include "player.h"
+#include "jobSystem.h"
+#include "benchmark.h"
+#include "stats.h"
+#include "lightmapBaker.h"
+#include "chunkStreamer.h"
+#include "sceneFile.h"
+#include "sceneCompiler.h"
+#include "assetPack.h"
+#include "dynamicResolution.h"
+#include "antiAliasing.h"
+#include "frameScheduler.h"
+#include "frameGraph.h"
+#include "glState.h"
+#include "glStorage.h"
+#include "input.h"
+#include "swarm.h"
+#include "allocationTracker.h"
 
 using namespace std;
 
@@ -24,20 +47,78 @@ const int WIDTH = 800;
 const int HEIGHT = 600;
 const int DELTA = 10;
 
+const float FOV = 45.0f;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+
+// Where the player starts, the street is loaded around it before the first frame
+const glm::vec3 SPAWN = glm::vec3(-5, 0, 100);
+
+// Description of the street and the compiled version that is mapped at runtime
+const char * SCENE_SOURCE = "Scenes/street.scene";
+const char * SCENE_BINARY = "Scenes/street.bin";
+
+// Keyframed clips, objects of the scene file play the clip their animation is named after
+const char * ANIMATION_SOURCE = "Scenes/street.anim";
+
+// Every asset in one file, made with --pack. The loose files are used when it isn't there
+const char * ASSET_PACK = "assets.pak";
+
+// Memory the streamed part of the street may use
+const size_t STREAM_BUDGET = 256 * 1024 * 1024;
+
 
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
 
-vector<ModelRenderer> models;
+Scene scene;
+JobSystem jobs;
+SceneFile scene_file;
+ChunkStreamer streamer(scene);
+DynamicResolution dynamic_resolution;
+AntiAliasing anti_aliasing;
+FrameScheduler frame_scheduler;
+FrameGraph frame_graph;
+Swarm swarm;
 LightSource lightSource;
-GLuint program_id;
 
 glm::mat4 iden, view, projection;
-glm::mat4 mv;
 
 
 Player player;
+Input input;
+
+// Set while the timer is stopped until there is input
+bool waiting_for_input = false;
+
+void Render(int n);
+
+
+/// <summary>
+/// Restarts the game loop when it was waiting for input
+/// </summary>
+void Wake()
+{
+	if (!waiting_for_input)
+		return;
+
+	// The time spent waiting is not movement time
+	lastFrame = glutGet(GLUT_ELAPSED_TIME) / 100.0f;
+	waiting_for_input = false;
+	glutTimerFunc(0, Render, 0);
+}
+
+
+/// <summary>
+/// Switches the anti aliasing, the msaa modes need the offscreen target with their amount of samples
+/// </summary>
+/// <param name="mode"></param>
+void SetAntiAliasing(AntiAliasingMode mode)
+{
+	anti_aliasing.SetMode(mode);
+	dynamic_resolution.SetSamples(AntiAliasingSamples(mode));
+}
 
 
 /// <summary>
@@ -48,93 +129,347 @@ Player player;
 /// <param name="b"></param>
 void keyboardHandler(unsigned char key, int a, int b)
 {
+	input.OnKey(key, true);
+
+	// Nearly every key changes what is shown, and the movement keys need the loop running
+	frame_scheduler.MarkDirty(DIRTY_SETTINGS);
+	Wake();
+
     if (key == 27) // ESC
         glutExit();
+	if (key == 98) // B.
+	{
+		swarm.Toggle();
+		printf("Swarm: %s, %d paper planes\n", swarm.IsEnabled() ? "on" : "off", swarm.Count());
+	}
 	if (key == 99) // C.
 		player.ToggleEagleEye();
+	if (key == 102) // F.
+		dynamic_resolution.CycleFilter();
+	if (key == 106) // J.
+		frame_graph.Print();
+	if (key == 104) // H.
+		dynamic_resolution.PrintHistory();
+	if (key == 105) // I.
+		stats.Toggle();
+	if (key == 107) // K.
+		scene.ToggleShadowCaching();
+	if (key == 103) // G.
+		frame_scheduler.TogglePartial();
+	if (key == 108) // L.
+	{
+		gl_state.PrintReport();
+		gl_state.Toggle();
+	}
+	if (key == 109) // M.
+	{
+		SetAntiAliasing(AntiAliasingMode((anti_aliasing.Mode() + 1) % AA_MODES));
+		printf("Anti aliasing: %s\n", AntiAliasingModeName(anti_aliasing.Mode()));
+	}
+	if (key == 110) // N.
+		frame_scheduler.Toggle();
+	if (key == 111) // O.
+		scene.ToggleOcclusionCulling();
+	if (key == 112) // P.
+		scene.CycleDepthMode();
+	if (key == 114) // R.
+		dynamic_resolution.Toggle();
+	if (key == 116) // T.
+		input.PrintLatency();
+	if (key == 118) // V.
+	{
+		// The anti aliasing pass is culled while the heat map is shown, its history is stale afterwards
+		scene.ToggleOverdraw();
+		anti_aliasing.SetMode(anti_aliasing.Mode());
+	}
 }
 
 
 /// <summary>
-/// Repeatable key handler
+/// Key release handler, the keys that are held move the player (see ApplyInput)
 /// </summary>
-void OnKeyDown()
+/// <param name="key"></param>
+/// <param name="a"></param>
+/// <param name="b"></param>
+void OnKeyUp(unsigned char key, int a, int b)
 {
-	if (GetAsyncKeyState(0x57)) // W.
-		player.Move(FORWARD, deltaTime);
-	if (GetAsyncKeyState(0x53)) // S.
-		player.Move(BACKWARD, deltaTime);
-	if (GetAsyncKeyState(0x41)) // A.
-		player.Move(LEFT, deltaTime);
-	if (GetAsyncKeyState(0x44)) // D.
-		player.Move(RIGHT, deltaTime);
-	if (GetAsyncKeyState(0x44)) // D.
-		player.Move(RIGHT, deltaTime);
+	input.OnKey(key, false);
 }
 
+
 /// <summary>
-/// Moves the players eyes according to the mouse position
-/// This fixes the mouse on the center of the screen
+/// Whether a movement key is held
+/// </summary>
+bool IsMoving()
+{
+	return input.IsDown('w') || input.IsDown('s') || input.IsDown('a') || input.IsDown('d');
+}
+
+
+/// <summary>
+/// Takes the input that came in since the last frame, as late as possible before the view is built
+/// The player moves for as long as the keys were held and looks as far as the mouse moved
+/// </summary>
+void ApplyInput()
+{
+	input.Sample(InputTime());
+
+	// Held time in the tenths of a second deltaTime is in (see Render)
+	const MovementDirections directions[] = { FORWARD, BACKWARD, LEFT, RIGHT };
+	const unsigned char keys[] = { 'w', 's', 'a', 'd' };
+	for (int i = 0; i < 4; i++)
+		if (input.HeldTime(keys[i]) > 0.0)
+			player.Move(directions[i], float(input.HeldTime(keys[i]) / 100.0));
+
+	if (input.MouseX() != 0.0f || input.MouseY() != 0.0f)
+		player.Look(input.MouseX(), -input.MouseY());
+}
+
+
+/// <summary>
+/// Queues the mouse movement, the pointer is hidden and moved back to the center before it leaves the window
 /// </summary>
 /// <param name="x"></param>
 /// <param name="y"></param>
 void OnMouseMove(int x, int y)
 {
-	float centerX = WIDTH / 2;
-	float centerY = HEIGHT / 2;
-	player.Look(x - centerX, centerY - y);
+	input.OnMouseMove(x, y);
+	Wake();
 
-	// Fix cursor in the center.
-	if (x != centerY || y != centerX)
+	// Warping on every event would throw away half of the events, the warp itself reports no movement
+	const int center_x = WIDTH / 2;
+	const int center_y = HEIGHT / 2;
+	if (abs(x - center_x) > WIDTH / 4 || abs(y - center_y) > HEIGHT / 4)
 	{
-		// Remove the mouse
-		glutSetCursor(GLUT_CURSOR_NONE);
-		glutWarpPointer(centerX, centerY);
+		glutWarpPointer(center_x, center_y);
+		input.Recenter(center_x, center_y);
 	}
 }
 
 
+// What a frame is drawn with, the frame graph is built from it
+struct FrameSettings
+{
+	int width;
+	int height;
+	int render_width;
+	int render_height;
+	int samples;
+	bool overdraw;
+
+	// Keep the frame for partial redraws, and redraw only the region in this one
+	bool keep_frame;
+	bool partial;
+	glm::ivec4 region;
+};
+
+
 /// <summary>
-/// This renders all models
+/// Describes the frame as passes of the frame graph, the passes only run in Execute
+/// Shadows, scene (depth pre-pass included), msaa resolve, anti aliasing and the upscale to the window
+/// With the overdraw view on the heat map is shown instead, the passes only the normal frame needs are culled
 /// </summary>
-void Render()
+/// <param name="graph">Graph that was just reset</param>
+/// <param name="settings"></param>
+/// <param name="aa">Anti aliasing that adds its pass</param>
+/// <param name="projection">Projection the scene is drawn with</param>
+/// <param name="view_projection">Unjittered projection * view of the frame</param>
+void BuildFrameGraph(FrameGraph & graph, const FrameSettings & settings, AntiAliasing & aa, const glm::mat4 & projection, const glm::mat4 & view_projection)
 {
-    glClearColor(0.0, 0.0, 0.0, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	const int render_width = settings.render_width;
+	const int render_height = settings.render_height;
+	const bool partial = settings.partial;
+	const glm::ivec4 region = settings.region;
+	const TextureDesc color_desc = { settings.width, settings.height, GL_RGBA8, settings.samples };
+	const TextureDesc frame_desc = { settings.width, settings.height, GL_RGBA8, 1 };
+	const TextureDesc depth_desc = { settings.width, settings.height, GL_DEPTH_COMPONENT24, settings.samples };
+	const TextureDesc counts_desc = { settings.width, settings.height, GL_R32UI, 1 };
+
+	const int back_buffer = graph.ImportBackBuffer("window", WIDTH, HEIGHT);
+	const int atlas = graph.ImportTexture("shadow atlas", scene.ShadowTexture(), TextureDesc{ 0, 0, GL_DEPTH_COMPONENT32F, 1 });
+
+	// A partial redraw keeps the rest of the frame before, without msaa the scene is drawn straight into the frame
+	const int frame = settings.keep_frame ? graph.RetainTexture("frame", frame_desc) : graph.CreateTexture("frame", frame_desc);
+	const int color = settings.samples > 1 ? graph.CreateTexture("msaa color", color_desc) : frame;
+	const int depth = graph.CreateTexture("depth", depth_desc);
+	const int counts = settings.overdraw ? graph.CreateTexture("overdraw counts", counts_desc) : -1;
+
+	int pass = graph.AddPass("shadows", [](FrameGraph &) {
+		scene.RenderShadows();
+	});
+	graph.Write(pass, atlas, ACCESS_ATTACHMENT);
+
+	pass = graph.AddPass("scene", [color, depth, counts, partial, region, projection](FrameGraph & graph) {
+		dynamic_resolution.Begin(graph.Framebuffer(color, depth), partial ? &region : nullptr);
+		scene.Render(projection, counts >= 0 ? graph.Texture(counts) : 0);
+		if (swarm.IsEnabled())
+			swarm.Render(view, projection, lightSource.position, jobs);
+		gl_state.Disable(GL_SCISSOR_TEST);
+	});
+	graph.Read(pass, atlas, ACCESS_SAMPLED);
+	graph.Write(pass, color, ACCESS_ATTACHMENT);
+	graph.Write(pass, depth, ACCESS_ATTACHMENT);
+	if (counts >= 0)
+		graph.Write(pass, counts, ACCESS_IMAGE);
 
-	OnKeyDown();
+	if (color != frame)
+	{
+		pass = graph.AddPass("msaa resolve", [color, frame, partial, region](FrameGraph & graph) {
+			const GLuint multisampled = graph.Framebuffer(color);
+			dynamic_resolution.Resolve(multisampled, graph.Framebuffer(frame), partial ? &region : nullptr);
+		});
+		graph.Read(pass, color, ACCESS_BLIT);
+		graph.Write(pass, frame, ACCESS_BLIT);
+	}
 
-	// Timing
-	const float currentFrame = glutGet(GLUT_ELAPSED_TIME) / 100.0f;
-	deltaTime = currentFrame - lastFrame;
-	lastFrame = currentFrame;
+	int shown = aa.AddPass(graph, frame, depth, render_width, render_height, view_projection);
+	if (counts >= 0)
+	{
+		shown = graph.CreateTexture("heat map", frame_desc);
+		pass = graph.AddPass("overdraw", [counts, shown](FrameGraph & graph) {
+			graph.Framebuffer(shown);
+			scene.RenderOverdraw(graph.Texture(counts));
+		});
+		graph.Read(pass, counts, ACCESS_IMAGE);
+		graph.Write(pass, shown, ACCESS_ATTACHMENT);
+	}
+
+	pass = graph.AddPass("upscale", [shown, back_buffer](FrameGraph & graph) {
+		graph.Framebuffer(back_buffer);
+		dynamic_resolution.Present(graph.Texture(shown));
+	});
+	graph.Read(pass, shown, ACCESS_SAMPLED);
+	graph.Write(pass, back_buffer, ACCESS_ATTACHMENT);
+}
 
+
+/// <summary>
+/// Updates the world and draws the frame seen by the player into the window, as far as anything changed
+/// </summary>
+/// <returns>How much of the frame was drawn</returns>
+FrameAction DrawFrame()
+{
+	ApplyInput();
 	view = player.LookingAt();
-	projection = glm::perspective(glm::radians(45.0f), float(WIDTH) / HEIGHT, 0.1f, 100.0f);
+	projection = glm::perspective(glm::radians(FOV), float(WIDTH) / HEIGHT, NEAR_PLANE, FAR_PLANE);
+
+	// The scene is drawn at the scale the frame time allows and stretched over the window afterwards
+	const int render_width = dynamic_resolution.RenderWidth();
+	const int render_height = dynamic_resolution.RenderHeight();
+	scene.SetProjection(glm::radians(FOV), float(WIDTH) / HEIGHT, NEAR_PLANE, FAR_PLANE, render_width, render_height);
+
+	// Culling uses the real projection, only the drawing is jittered
+	streamer.Update(player.position);
+	scene.AdvanceAnimations(deltaTime / 10.0f);
+	scene.Update(view, projection, jobs);
 
-	for (auto & model : models) {
-		model.UpdateView(projection, view * model.model);
-		model.Render();
+	// The swarm flies all over the view, a frame with it is never partial. Long waits are not flying time
+	if (swarm.IsEnabled())
+	{
+		swarm.Update(std::min(deltaTime / 10.0f, 0.1f), jobs);
+		frame_scheduler.MarkDirty(DIRTY_ANIMATION);
 	}
 
-	glutSwapBuffers();
+	// The temporal history needs every pixel of every frame, and keeps converging after the last change
+	const bool temporal = anti_aliasing.Mode() == AA_TEMPORAL;
+	const bool allow_partial = !temporal && !swarm.IsEnabled();
+	const FrameAction action = frame_scheduler.Decide(scene, projection * view, render_width, render_height, temporal ? 2 * TEMPORAL_SAMPLES : 0, allow_partial);
+	if (action != FRAME_SKIP)
+	{
+		FrameSettings settings;
+		settings.width = dynamic_resolution.Width();
+		settings.height = dynamic_resolution.Height();
+		settings.render_width = render_width;
+		settings.render_height = render_height;
+		settings.samples = dynamic_resolution.Samples();
+		settings.overdraw = scene.IsOverdrawEnabled();
+		settings.keep_frame = frame_scheduler.IsPartial();
+		settings.partial = action == FRAME_PARTIAL;
+		settings.region = action == FRAME_PARTIAL ? frame_scheduler.Region() : glm::ivec4(0, 0, render_width, render_height);
+
+		frame_graph.Reset();
+		BuildFrameGraph(frame_graph, settings, anti_aliasing, anti_aliasing.Jitter(projection, render_width, render_height), projection * view);
+		if (frame_graph.Compile())
+		{
+			dynamic_resolution.BeginFrame();
+			frame_graph.Execute();
+			dynamic_resolution.EndFrame();
+			glutSwapBuffers();
+			input.Presented(InputTime());
+		}
+	}
+	frame_scheduler.EndTick(action, dynamic_resolution.TakeGpuTime());
+	return action;
+}
+
+
+/// <summary>
+/// Whether the game loop has to keep ticking, without animations, streaming or input it can wait
+/// </summary>
+/// <param name="moving">Whether a movement key is held</param>
+bool NeedsTicks(bool moving)
+{
+	return moving || frame_scheduler.NeedsFrames() || scene.AnimatedCount() > 0 || streamer.IsBusy() || swarm.IsEnabled();
+}
+
+
+/// <summary>
+/// Draws the window again when it was uncovered or resized, the frame targets don't outlive the frame
+/// </summary>
+void OnDisplay()
+{
+	frame_scheduler.MarkDirty(DIRTY_SETTINGS);
+	Wake();
+}
+
+
+/// <summary>
+/// This renders all models
+/// </summary>
+/// <returns>Whether the loop has to keep running, false when it can wait for input</returns>
+bool Render()
+{
+	// Timing
+	const float currentFrame = glutGet(GLUT_ELAPSED_TIME) / 100.0f;
+	deltaTime = currentFrame - lastFrame;
+	lastFrame = currentFrame;
+
+	// A steady frame shouldn't touch the heap, anything it does allocate shows up here
+	// The peak is reset every frame so it shows the most the heap held during this one
+	ResetAllocationPeak();
+	const AllocationCounts start = GetAllocationCounts();
+	DrawFrame();
+	const AllocationCounts allocated = AllocationsSince(start);
+
+	stats.Add("frame ms", deltaTime * 100.0f);
+	stats.Add("allocations", (double)allocated.allocations);
+	stats.Add("allocated KB", allocated.bytes / 1024.0);
+	stats.Add("peak live KB", allocated.peak_bytes / 1024.0);
+	gl_state.EndFrame();
+	stats.EndFrame();
+
+	return NeedsTicks(IsMoving());
 }
 
 
 /// <summary>
-/// The main game loop
+/// The main game loop, it stops while nothing moves and input restarts it (see Wake)
 /// </summary>
 /// <param name="n"></param>
 void Render(int n)
 {
-    Render();
+    if (!Render())
+	{
+		waiting_for_input = true;
+		return;
+	}
     glutTimerFunc(DELTA, Render, 0);
 }
 
 
 /// <summary>
 /// Initializes glut and glew
-/// This also sets a few game settings like anti aliasing
+/// The window gets no depth or msaa of its own, the scene is drawn offscreen (see DynamicResolution)
 /// </summary>
 /// <param name="argc"></param>
 /// <param name="argv"></param>
@@ -142,314 +477,480 @@ void InitGlutGlew(int argc, char **argv)
 {
 	glutInit(&argc, argv);
 
-	glutSetOption(GLUT_MULTISAMPLE, 16);
-	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH | GLUT_MULTISAMPLE);
+	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
 	glutInitWindowSize(WIDTH, HEIGHT);
 	glutCreateWindow("Bart de Lange: RainbowLane");
 
 	glutMotionFunc(OnMouseMove);
 	glutPassiveMotionFunc(OnMouseMove);
 
-	glutDisplayFunc(Render);
+	glutDisplayFunc(OnDisplay);
 	glutKeyboardFunc(keyboardHandler);
+	glutKeyboardUpFunc(OnKeyUp);
+	glutIgnoreKeyRepeat(1);
+	glutSetCursor(GLUT_CURSOR_NONE);
 	glutTimerFunc(DELTA, Render, 0);
 
-	glEnable(GL_MULTISAMPLE);
-	glEnable(GL_DEPTH_TEST);
-	glClear(GL_DEPTH_BUFFER_BIT);
+	gl_state.Enable(GL_MULTISAMPLE);
+	gl_state.Enable(GL_DEPTH_TEST);
 
 	glewInit();
+	InitStorageBackend();
 }
 
 
+// The paper plane, the swarm is drawn with its mesh
+int paper_object = -1;
+
+
 /// <summary>
-/// Creates two "simple" houses
+/// Maps the compiled scene, it is compiled first when the description changed
 /// </summary>
-void CreateHouses()
+/// <returns>Whether the scene is there</returns>
+bool OpenScene()
 {
-	glm::mat4 model;
-
-	// Init house 1
-	model = glm::translate(iden, glm::vec3(0, -0.9, 0));
-	model = glm::rotate(model, glm::radians(-180.0f), glm::vec3(0, 1, 0));
-	ModelRenderer &house1 = ModelRenderer("House1", model, projection, view * model, lightSource);
-	house1.ParseObject("Objects/house1.obj");
-	house1.SetMaterial(Material{
-		glm::vec3(0.2, 0.2, 0.2),
-		glm::vec3(0.9, 0.9, 0.9),
-		glm::vec3(1.0, 1.0, 1.0),
-		128
-		});
-	// The texture maping does not work in gl while it does in blender, opengl, windows 3dviewer, ...
-	house1.SetTexture("Textures/house1.bmp");
-	house1.Initialize();
-	models.push_back(house1);
-
-	// Init house 2
-	model = glm::translate(iden, glm::vec3(0.5, -1.3, 5));
-	model = glm::scale(model, glm::vec3(0.5));
-	model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0, 1, 0));
-	ModelRenderer &house2 = ModelRenderer("House2", model, projection, view * model, lightSource);
-	house2.ParseObject("Objects/house2.obj");
-	house2.SetMaterial(Material{
-		glm::vec3(0.2, 0.2, 0.2),
-		glm::vec3(0.9, 0.9, 0.9),
-		glm::vec3(1.0, 1.0, 1.0),
-		128
-		});
-	house2.SetTexture("Textures/house2.bmp"); // Same texture issue
-	house2.Initialize();
-	models.push_back(house2);
+	if (IsSceneOutdated(SCENE_SOURCE, SCENE_BINARY) && !CompileScene(SCENE_SOURCE, SCENE_BINARY))
+		return false;
+	return scene_file.Open(SCENE_BINARY);
+}
 
-	// Repeat them a couple of times
-	for (int i = 0; i < 15; i++)
-	{
-		float spacing = 12.5f;
 
-		house1.model = glm::translate(house1.model, glm::vec3(0, 0, -spacing));
-		house2.model = glm::translate(house2.model, glm::vec3(spacing * 2, 0, 0));
-		
-		models.push_back(house1);
-		models.push_back(house2);
+/// <summary>
+/// Adds the single objects of the scene file (the ones that are not part of a row)
+/// </summary>
+/// <param name="material_base">Scene index of the first material of the file</param>
+void CreateSceneObjects(int material_base)
+{
+	for (size_t i = 0; i < scene_file.InstanceCount(); i++)
+	{
+		const SceneInstance & instance = scene_file.GetInstance(i);
+		const SceneMesh & mesh = scene_file.GetMesh(instance.mesh);
+		const Transform transform = SceneFile::ToTransform(instance.transform);
+
+		int mesh_id = scene.LoadMesh(mesh.name, mesh.object_path, mesh.texture_path[0] ? mesh.texture_path : nullptr);
+		int object = scene.AddObject(mesh_id, material_base + instance.material, transform, (unsigned char)instance.flags);
+
+		const int clip = instance.animation[0] ? scene.GetAnimator().FindClip(instance.animation) : -1;
+		if (clip >= 0)
+		{
+			scene.PlayClip(object, clip);
+			if (strcmp(instance.animation, "fly") == 0)
+				paper_object = object;
+		}
+		else if (instance.animation[0])
+		{
+			printf("Unknown animation %s\n", instance.animation);
+		}
 	}
 }
 
 
 /// <summary>
-/// Creates a road with lamp posts next to it (on the oposite of the houses and point towards them)
+/// Initializes the models that need to be rendered
 /// </summary>
-void CreateRoad()
+void InitModels()
 {
-	glm::mat4 model;
-
-	// Create plane for the houses
-	model = glm::translate(iden, glm::vec3(1.5, -1.8, 0));
-	model = glm::scale(model, glm::vec3(4));
-	ModelRenderer &brick = ModelRenderer("Brick", model, projection, view * model, lightSource);
-	brick.ParseObject("Objects/street.obj");
-	brick.SetMaterial(Material{
-		glm::vec3(0.5, 0.0, 0.0),
-		glm::vec3(1.0, 0.0, 0.0),
-		glm::vec3(1.0, 1.0, 1.0),
-		128
-	});
-	brick.SetTexture("Textures/grass.bmp");
-	brick.Initialize();
-	models.push_back(brick);
-	for (int i = 0; i < 24; i++)
-	{
-		float spacing = 2.0f;
+	if (asset_pack.Open(ASSET_PACK))
+		printf("Loading assets from %s\n", ASSET_PACK);
 
-		brick.model = glm::translate(brick.model, glm::vec3(0, 0, spacing));
+	scene.Initialize();
+	scene.SetLightSource(lightSource);
+	scene.SetProjection(glm::radians(FOV), float(WIDTH) / HEIGHT, NEAR_PLANE, FAR_PLANE, WIDTH, HEIGHT);
 
-		models.push_back(brick);
+	if (!OpenScene())
+	{
+		printf("Unable to load %s\n", SCENE_BINARY);
+		return;
 	}
+	int material_base = scene.AddMaterials(scene_file);
 
+	// The street streams in chunks, the ones around the spawn are there before anything else is added
+	// so the object order (and with it the baked lightmaps) stays the same
+	streamer.SetMemoryBudget(STREAM_BUDGET);
+	streamer.Start(scene_file, material_base);
+	streamer.Flush(SPAWN);
+	scene.GetAnimator().LoadClips(ANIMATION_SOURCE);
+	CreateSceneObjects(material_base);
 
-	// Create road
-	model = glm::translate(iden, glm::vec3(-6.5, -1.8, 0));
-	model = glm::scale(model, glm::vec3(4));
-	ModelRenderer &street = ModelRenderer("Street", model, projection, view * model, lightSource);
-	street.ParseObject("Objects/street.obj");
-	street.SetMaterial(Material{
-		glm::vec3(0.5, 0.0, 0.0),
-		glm::vec3(1.0, 0.0, 0.0),
-		glm::vec3(1.0, 1.0, 1.0),
-		128
-	});
-	street.SetTexture("Textures/street.bmp");
-	street.Initialize();
-	models.push_back(street);
-	for (int i = 0; i < 24; i++)
-	{
-		float spacing = 2.0f;
+	scene.PrintMemoryReport();
+}
 
-		street.model = glm::translate(street.model, glm::vec3(0, 0, spacing));
 
-		models.push_back(street);
-	}
+/// <summary>
+/// Builds the street without a window and bakes the lighting of everything that doesn't move
+/// </summary>
+/// <returns>Exit code</returns>
+int Bake()
+{
+	jobs.Start();
+	lightSource.position = glm::vec3(-8.0, 2.0, 8.0);
+	scene.SetHeadless(true);
+	InitModels();
 
+	return BakeLightmaps(scene, jobs, "Lightmaps") ? 0 : 1;
+}
 
-	// Create plane for next to the street
-	model = glm::translate(iden, glm::vec3(-14.5, -1.8, 0));
-	model = glm::scale(model, glm::vec3(4));
-	ModelRenderer &brick2 = ModelRenderer("Brick", model, projection, view * model, lightSource);
-	brick2.ParseObject("Objects/street.obj");
-	brick2.SetMaterial(Material{
-		glm::vec3(0.5, 0.0, 0.0),
-		glm::vec3(1.0, 0.0, 0.0),
-		glm::vec3(1.0, 1.0, 1.0),
-		128
-		});
-	brick2.SetTexture("Textures/grass.bmp");
-	brick2.Initialize();
-	models.push_back(brick2);
-	for (int i = 0; i < 24; i++)
+
+/// <summary>
+/// Packs the assets of the scene and the shaders into one asset pack
+/// </summary>
+/// <param name="pack_path">Where the pack is written</param>
+/// <returns>Exit code</returns>
+int Pack(const char * pack_path)
+{
+	if (!OpenScene())
 	{
-		float spacing = 2.0f;
+		printf("Unable to load %s\n", SCENE_BINARY);
+		return 1;
+	}
 
-		brick2.model = glm::translate(brick2.model, glm::vec3(0, 0, spacing));
+	jobs.Start();
+	std::vector<PackSource> sources;
+	CollectPackSources(scene_file, sources);
+	sources.push_back(PackSource{ ANIMATION_SOURCE, PACK_RAW });
+	return BuildAssetPack(pack_path, sources, jobs) ? 0 : 1;
+}
 
-		models.push_back(brick2);
-	}
 
+/// <summary>
+/// Loads the street and sets up the renderer, the window has to be there
+/// </summary>
+void InitGame()
+{
+	jobs.Start();
+	lightSource.position = glm::vec3(-8.0, 2.0, 8.0);
+	player = Player(SPAWN);
+	player.SetMaxBounds(-20, 20, -FLT_MAX, FLT_MAX);
+	InitModels();
+	scene.LoadLightmaps("Lightmaps", jobs);
 
-	// Create streetlamps
-	model = glm::translate(iden, glm::vec3(-10, -1.45, 0));
-	model = glm::scale(model, glm::vec3(0.6));
-	ModelRenderer &lamppost = ModelRenderer("Lamppost", model, projection, view * model, lightSource);
-	lamppost.ParseObject("Objects/lamppost.obj");
-	lamppost.SetMaterial(Material{
-		glm::vec3(0.5, 0.0, 0.0),
-		glm::vec3(1.0, 0.0, 0.0),
-		glm::vec3(1.0, 1.0, 1.0),
-		128
-	});
-	lamppost.Initialize();
-	models.push_back(lamppost);
-	for (int i = 0; i < 6; i++)
-	{
-		float spacing = 12.5f;
-
-		float r = ((float)(rand() % 255)) / 255; // red component of color
-		float g = ((float)(rand() % 255)) / 255; // green component of color
-		float b = ((float)(rand() % 255)) / 255; // blue component of color
-
-		lamppost.model = glm::translate(lamppost.model, glm::vec3(0, 0, spacing * 4));
-		lamppost.SetMaterial(Material{
-			glm::vec3(r, g, b),
-			glm::vec3(r + 0.2, g + 0.2, b + 0.2),
-			glm::vec3(1.0, 1.0, 1.0),
-			128
-		});
+	dynamic_resolution.Initialize(WIDTH, HEIGHT, AntiAliasingSamples(anti_aliasing.Mode()));
+	anti_aliasing.Initialize();
 
-		models.push_back(lamppost);
+	if (paper_object >= 0)
+	{
+		swarm.Initialize(scene.GetMesh(scene.GetMeshId(paper_object)), scene.GetTransform(paper_object).GetScale().x);
+		swarm.Spawn(SWARM_DEFAULT_AGENTS, 1);
 	}
 }
 
 
 /// <summary>
-/// Creates the initial model matrix needed for the plane
+/// Renders the street from the spawn in every anti aliasing mode and compares the frame time
+/// and the memory of the framebuffers, this one needs a window
 /// </summary>
-/// <returns></returns>
-glm::mat4 CreatePaperMatrix()
+/// <returns>Exit code</returns>
+int BenchAntiAliasing(int argc, char ** argv)
 {
-	glm::mat4 model = glm::mat4();
-	model = glm::scale(model, glm::vec3(100));
-	model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	model = glm::translate(model, glm::vec3(0.0, 0.08, 0.5));
-	return model;
+	const int warmup = 30;
+	const int frames = 300;
+
+	InitGlutGlew(argc, argv);
+	InitGame();
+
+	// Every mode shades the same amount of pixels in every frame
+	dynamic_resolution.Toggle();
+	frame_scheduler.Toggle();
+
+	printf("Anti aliasing at %dx%d, %d frames per mode\n", WIDTH, HEIGHT, frames);
+	printf("mode          frame ms     gpu ms   framebuffers MB\n");
+	for (int mode = 0; mode < AA_MODES; mode++)
+	{
+		SetAntiAliasing((AntiAliasingMode)mode);
+
+		double gpu_ms = 0.0;
+		std::chrono::high_resolution_clock::time_point start;
+		for (int frame = 0; frame < warmup + frames; frame++)
+		{
+			if (frame == warmup)
+			{
+				glFinish();
+				dynamic_resolution.TakeGpuTime();
+				start = std::chrono::high_resolution_clock::now();
+			}
+			DrawFrame();
+			glutMainLoopEvent();
+			gl_state.EndFrame();
+			stats.EndFrame();
+			if (frame >= warmup)
+				gpu_ms += dynamic_resolution.TakeGpuTime();
+		}
+		glFinish();
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		const size_t bytes = frame_graph.AllocatedBytes();
+		printf("%-12s %9.3f %10.3f %17.2f\n", AntiAliasingModeName((AntiAliasingMode)mode), ms / frames, gpu_ms / frames, bytes / (1024.0 * 1024.0));
+	}
+
+	// What the window used to have, color and depth for each of 16 samples
+	printf("%-12s %9s %10s %17.2f\n", "16x window", "-", "-", WIDTH * HEIGHT * 16 * (4 + 4) / (1024.0 * 1024.0));
+	return 0;
 }
 
 
 /// <summary>
-/// Flying animation for the paper plane
+/// Stands still at the spawn with rendering on demand off and on, and measures how busy the cpu and gpu are
+/// The loop ticks like the timer would, and only while the scheduler wants it to
 /// </summary>
-/// <param name="model">The target of the animation (this is parsed by reference)</param>
-bool is_positive_rotating = false;
-bool passed_treshhold = true;
-float rotation_speed = 0.5f;
-void FlyAnim(ModelRenderer &model)
+int BenchIdle(int argc, char ** argv)
 {
-	// Decompose all transformation proterties into readable vars
-	glm::vec3 scale;
-	glm::quat rotation;
-	glm::vec3 translation;
-	glm::vec3 skew;
-	glm::vec4 perspective;
-	glm::decompose(model.model, scale, rotation, translation, skew, perspective);
-
-	float rot = abs(rotation.y);
-
-	if (rot > 0.5f) {
-		if (rot > 0.9f)
-			passed_treshhold = true;
-		else
-			passed_treshhold = false;
-	}
-	else
-	{
-		if (rot < 0.05f)
-			passed_treshhold = true;
-		else
-			passed_treshhold = false;
-	}
+	const double seconds = 5.0;
 
+	InitGlutGlew(argc, argv);
+	InitGame();
 
-	// Wobble effect
-	if (rot > 0.5f) 
-	{
-		if (rot < 0.99f)
-			if (passed_treshhold)
-				is_positive_rotating = !is_positive_rotating;
-	}
-	else
+	printf("Standing still for %.0f seconds per mode, a tick every %d ms\n", seconds, DELTA);
+	printf("mode        ticks    drawn  partial  skipped    cpu %%    gpu %%\n");
+	frame_scheduler.Toggle();
+	for (int on = 0; on < 2; on++)
 	{
-		if (rot > 0.1f)
-			if (passed_treshhold)
-				is_positive_rotating = !is_positive_rotating;
+		frame_scheduler.Toggle();
+		int ticks = 0;
+		int actions[3] = {};
+		double gpu_ms = 0.0;
+		glFinish();
+		dynamic_resolution.TakeGpuTime();
+		const double cpu_start = GetProcessCpuTime();
+		const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		std::chrono::high_resolution_clock::time_point next = start;
+
+		bool ticking = true;
+		while (std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() < seconds)
+		{
+			if (ticking)
+			{
+				const float currentFrame = glutGet(GLUT_ELAPSED_TIME) / 100.0f;
+				deltaTime = currentFrame - lastFrame;
+				lastFrame = currentFrame;
+
+				actions[DrawFrame()]++;
+				gl_state.EndFrame();
+				stats.EndFrame();
+				gpu_ms += dynamic_resolution.TakeGpuTime();
+				ticks++;
+				ticking = NeedsTicks(false);
+			}
+			glutMainLoopEvent();
+			next += std::chrono::milliseconds(DELTA);
+			std::this_thread::sleep_until(next);
+		}
+		glFinish();
+		gpu_ms += dynamic_resolution.TakeGpuTime();
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		const double cpu_ms = GetProcessCpuTime() - cpu_start;
+
+		printf("%-9s %7d %8d %8d %8d %8.1f %8.1f\n", on ? "on demand" : "always", ticks, actions[FRAME_FULL], actions[FRAME_PARTIAL], actions[FRAME_SKIP],
+			100.0 * cpu_ms / ms, 100.0 * gpu_ms / ms);
 	}
+	if (scene.AnimatedCount() > 0)
+		printf("%d animated objects keep the loop ticking, frames are only drawn while they are in view\n", (int)scene.AnimatedCount());
+	return 0;
+}
 
-	if (is_positive_rotating)
-		rotation_speed = abs(rotation_speed);
-	else
-		rotation_speed = -abs(rotation_speed);
 
-	model.model = glm::rotate(model.model, glm::radians(rotation_speed), glm::vec3(0.0f, 1.0f, 0.0f));
+/// <summary>
+/// Renders the street from the spawn with the gl state cache on and off, and compares the gl calls that are made
+/// and the cpu time of a frame. Every anti aliasing mode is drawn so all passes are in it, this one needs a window
+/// </summary>
+/// <returns>Exit code</returns>
+int BenchGlState(int argc, char ** argv)
+{
+	const int warmup = 30;
+	const int frames = 200;
 
-	// Keep it moving
-	if (translation.z > 250) {
-		model.model = CreatePaperMatrix();
-	}
+	InitGlutGlew(argc, argv);
+	InitGame();
 
-	model.model = glm::translate(model.model, glm::vec3(0.0f, 0.0f, -0.005f));
+	// Every frame is drawn in full at the full resolution
+	dynamic_resolution.Toggle();
+	frame_scheduler.Toggle();
+
+	printf("Gl state cache at %dx%d, %d frames per mode\n", WIDTH, HEIGHT, frames);
+	printf("mode         cache   calls/frame  dropped/frame   cpu ms/frame\n");
+	for (int mode = 0; mode < AA_MODES; mode++)
+	{
+		SetAntiAliasing((AntiAliasingMode)mode);
+		for (int on = 1; on >= 0; on--)
+		{
+			if (gl_state.IsEnabled() != (on != 0))
+				gl_state.Toggle();
+
+			long long calls = 0;
+			long long skipped = 0;
+			double cpu_ms = 0.0;
+			for (int frame = 0; frame < warmup + frames; frame++)
+			{
+				if (frame == warmup)
+				{
+					glFinish();
+					calls = gl_state.Calls();
+					skipped = gl_state.Skipped();
+				}
+
+				// Only the recording of the frame, the wait for the gpu in the swap is not what the cache saves
+				const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+				DrawFrame();
+				if (frame >= warmup)
+					cpu_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+				glutMainLoopEvent();
+				gl_state.EndFrame();
+				stats.EndFrame();
+			}
+			glFinish();
+
+			printf("%-12s %5s %13.1f %14.1f %14.3f\n", AntiAliasingModeName((AntiAliasingMode)mode), on ? "on" : "off",
+				(gl_state.Calls() - calls) / (double)frames, (gl_state.Skipped() - skipped) / (double)frames, cpu_ms / frames);
+		}
+	}
+	if (!gl_state.IsEnabled())
+		gl_state.Toggle();
+	gl_state.PrintReport();
+	return 0;
 }
 
 
 /// <summary>
-/// Creates a paper plane that flies around
+/// Uploads every mesh and texture of the street with both storage backends and compares the time it takes
+/// and the gl calls it needs. The files are read once up front, only the upload is measured. Needs a window
 /// </summary>
-void CreatePaperPlane()
+/// <returns>Exit code</returns>
+int BenchStorage(int argc, char ** argv)
 {
-	// Create plane 
-	glm::mat4 model = CreatePaperMatrix();
-	ModelRenderer &plane = ModelRenderer("Brick", model, projection, view * model, lightSource);
-	plane.ParseObject("Objects/paper_airplane.obj");
-	plane.SetMaterial(Material{
-		glm::vec3(0.5, 0.0, 0.0),
-		glm::vec3(1.0, 0.0, 0.0),
-		glm::vec3(1.0, 1.0, 1.0),
-		128
-	});
-	plane.SetTexture("Textures/paper.bmp");
-	plane.EnableTransformation(&FlyAnim);
-	plane.Initialize();
-	models.push_back(plane);
-}
+	const int rounds = 5;
+
+	InitGlutGlew(argc, argv);
+	if (!OpenScene())
+	{
+		printf("Unable to load %s\n", SCENE_BINARY);
+		return 1;
+	}
+	scene.Initialize();
+
+	std::vector<ModelRenderer> parsed;
+	size_t vertices = 0;
+	for (size_t i = 0; i < scene_file.MeshCount(); i++)
+	{
+		const SceneMesh & mesh = scene_file.GetMesh(i);
+		parsed.push_back(ModelRenderer(mesh.name));
+		parsed.back().ParseObject(mesh.object_path);
+		parsed.back().SetTexture(mesh.texture_path[0] ? mesh.texture_path : nullptr);
+		vertices += parsed.back().GetMesh().vertices.size();
+	}
 
+	printf("Uploading %d meshes (%d vertices) with their textures, %d rounds per backend\n", (int)parsed.size(), (int)vertices, rounds);
+	printf("backend                upload ms   gl calls   binds\n");
+	const StorageBackend selected = GetStorageBackend();
+	for (int b = 0; b < STORAGE_BACKENDS; b++)
+	{
+		const StorageBackend backend = (StorageBackend)b;
+		if (!IsStorageBackendSupported(backend))
+		{
+			printf("%-20s %11s\n", StorageBackendName(backend), "not supported");
+			continue;
+		}
+		SetStorageBackend(backend);
+
+		double ms = 0.0;
+		const long long calls = StorageCalls();
+		const long long binds = gl_state.Calls() + gl_state.Skipped();
+		for (int round = 0; round < rounds; round++)
+		{
+			std::vector<ModelRenderer> meshes = parsed;
+			glFinish();
+			const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			for (ModelRenderer & mesh : meshes)
+				mesh.Initialize(scene.Program());
+			glFinish();
+			ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			for (ModelRenderer & mesh : meshes)
+				mesh.Release();
+		}
+		printf("%-20s %11.3f %10lld %7lld\n", StorageBackendName(backend), ms / rounds, (StorageCalls() - calls) / rounds,
+			(gl_state.Calls() + gl_state.Skipped() - binds) / rounds);
+	}
+	SetStorageBackend(selected);
+	return 0;
+}
 
 
 /// <summary>
-/// Initializes the models that need to be rendered
+/// Builds the frame graph of every anti aliasing mode, with and without the overdraw view, and compares the memory
+/// of the render targets with the memory they took when every pass owned its targets
+/// Only compiles the graphs, it needs no window
 /// </summary>
-void InitModels()
+int BenchFrameGraph()
 {
-	CreateHouses();
-	CreateRoad();
-	CreatePaperPlane();
+	printf("Frame graph at %dx%d\n", WIDTH, HEIGHT);
+	printf("mode       overdraw  passes  culled  barriers  declared MB  allocated MB  saved MB\n");
+
+	FrameSettings settings = {};
+	settings.width = settings.render_width = WIDTH;
+	settings.height = settings.render_height = HEIGHT;
+	const glm::mat4 projection = glm::perspective(glm::radians(FOV), float(WIDTH) / HEIGHT, NEAR_PLANE, FAR_PLANE);
+
+	size_t most_declared = 0;
+	size_t most_allocated = 0;
+	for (int mode = 0; mode < AA_MODES; mode++)
+	{
+		for (int overdraw = 0; overdraw < 2; overdraw++)
+		{
+			AntiAliasing aa;
+			aa.SetMode((AntiAliasingMode)mode);
+			settings.samples = AntiAliasingSamples((AntiAliasingMode)mode);
+			settings.overdraw = overdraw != 0;
+
+			FrameGraph graph;
+			BuildFrameGraph(graph, settings, aa, projection, projection);
+			if (!graph.Compile())
+				return 1;
+
+			const double mb = 1024.0 * 1024.0;
+			printf("%-10s %8s %7d %7d %9d %12.2f %13.2f %9.2f\n", AntiAliasingModeName((AntiAliasingMode)mode), overdraw ? "on" : "off",
+				graph.PassCount(), graph.CulledCount(), graph.BarrierCount(), graph.DeclaredBytes() / mb, graph.AllocatedBytes() / mb,
+				(graph.DeclaredBytes() - graph.AllocatedBytes()) / mb);
+			most_declared = std::max(most_declared, graph.DeclaredBytes());
+			most_allocated = std::max(most_allocated, graph.AllocatedBytes());
+
+			if (mode == AA_FXAA && overdraw)
+				graph.Print();
+		}
+	}
+	printf("Peak render target memory %.2f MB, %.2f MB without the frame graph\n", most_allocated / (1024.0 * 1024.0), most_declared / (1024.0 * 1024.0));
+	return 0;
 }
 
 
 int main(int argc, char ** argv)
 {
+	// The anti aliasing, idle, gl state and storage benchmarks use the real street, they need the window the other ones do without
+	if (argc > 2 && strcmp(argv[1], "--bench") == 0 && strcmp(argv[2], "aa") == 0)
+		return BenchAntiAliasing(argc, argv);
+	if (argc > 2 && strcmp(argv[1], "--bench") == 0 && strcmp(argv[2], "idle") == 0)
+		return BenchIdle(argc, argv);
+	if (argc > 2 && strcmp(argv[1], "--bench") == 0 && strcmp(argv[2], "glstate") == 0)
+		return BenchGlState(argc, argv);
+	if (argc > 2 && strcmp(argv[1], "--bench") == 0 && strcmp(argv[2], "storage") == 0)
+		return BenchStorage(argc, argv);
+	if (argc > 2 && strcmp(argv[1], "--bench") == 0 && strcmp(argv[2], "framegraph") == 0)
+		return BenchFrameGraph();
+	if (argc > 2 && strcmp(argv[1], "--bench") == 0)
+		return RunBenchmark(argv[2]);
+	if (argc > 1 && strcmp(argv[1], "--bake") == 0)
+		return Bake();
+	if (argc > 1 && strcmp(argv[1], "--pack") == 0)
+		return Pack(argc > 2 ? argv[2] : ASSET_PACK);
+	if (argc > 1 && strcmp(argv[1], "--compile-scene") == 0)
+		return CompileScene(argc > 2 ? argv[2] : SCENE_SOURCE, argc > 3 ? argv[3] : SCENE_BINARY) ? 0 : 1;
+
     InitGlutGlew(argc, argv);
-	lightSource.position = glm::vec3(-8.0, 2.0, 8.0);
-	player = Player(glm::vec3(-5, 0, 100));
-	player.SetMaxBounds(25, 175, 25, 175);
-    InitModels();
+	InitGame();
+	PrintAllocations("Startup", GetAllocationCounts());
 
+#ifdef _WIN32
     HWND hWnd = GetConsoleWindow();
     ShowWindow(hWnd, SW_SHOW);
+#endif
 
     glutMainLoop();
 
@@ -0,0 +1,114 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mappedFile.h"
+
+
+MappedFile::~MappedFile()
+{
+	this->Close();
+}
+
+
+/// <summary>
+/// Maps a whole file, a file that is already open is closed first
+/// </summary>
+/// <param name="path"></param>
+/// <returns>Whether the file could be mapped, empty files can't</returns>
+bool MappedFile::Open(const char * path)
+{
+	this->Close();
+
+#ifdef _WIN32
+	this->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (this->file == INVALID_HANDLE_VALUE)
+	{
+		this->file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(this->file, &file_size) || file_size.QuadPart == 0)
+	{
+		this->Close();
+		return false;
+	}
+
+	this->mapping = CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (this->mapping == NULL)
+	{
+		this->Close();
+		return false;
+	}
+
+	this->data = (const unsigned char *)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+	this->size = (size_t)file_size.QuadPart;
+#else
+	this->file = open(path, O_RDONLY);
+	if (this->file < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(this->file, &info) != 0 || info.st_size == 0)
+	{
+		this->Close();
+		return false;
+	}
+
+	void * view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, this->file, 0);
+	this->data = view == MAP_FAILED ? nullptr : (const unsigned char *)view;
+	this->size = (size_t)info.st_size;
+#endif
+
+	if (this->data == nullptr)
+	{
+		this->Close();
+		return false;
+	}
+	return true;
+}
+
+
+/// <summary>
+/// Unmaps the file, pointers into it are invalid afterwards
+/// </summary>
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (this->data)
+		UnmapViewOfFile(this->data);
+	if (this->mapping)
+		CloseHandle(this->mapping);
+	if (this->file)
+		CloseHandle(this->file);
+	this->mapping = nullptr;
+	this->file = nullptr;
+#else
+	if (this->data)
+		munmap((void *)this->data, this->size);
+	if (this->file >= 0)
+		close(this->file);
+	this->file = -1;
+#endif
+
+	this->data = nullptr;
+	this->size = 0;
+}
+
+
+const unsigned char * MappedFile::Data() const
+{
+	return this->data;
+}
+
+
+size_t MappedFile::Size() const
+{
+	return this->size;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <stddef.h>
+
+
+// A read only file mapped into memory, the pages are loaded by the os when they are first touched
+class MappedFile
+{
+private:
+	const unsigned char * data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void * file = nullptr;
+	void * mapping = nullptr;
+#else
+	int file = -1;
+#endif
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+	~MappedFile();
+
+	bool Open(const char * path);
+	void Close();
+	const unsigned char * Data() const;
+	size_t Size() const;
+};
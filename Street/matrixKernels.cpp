@@ -0,0 +1,234 @@
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "matrixKernels.h"
+
+static KernelPath kernel_path = DetectKernelPath();
+
+
+/// <summary>
+/// Checks which instruction sets the cpu (and os) support
+/// </summary>
+/// <returns>The fastest usable path</returns>
+KernelPath DetectKernelPath()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] >= 7)
+	{
+		__cpuid(info, 1);
+		const bool fma = (info[2] & (1 << 12)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		__cpuidex(info, 7, 0);
+		const bool avx2 = (info[1] & (1 << 5)) != 0;
+
+		// The os has to save the ymm registers on a context switch
+		if (fma && osxsave && avx && avx2 && (_xgetbv(0) & 6) == 6)
+			return KERNEL_AVX2;
+	}
+	return KERNEL_SSE;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return KERNEL_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return KERNEL_SSE;
+	return KERNEL_SCALAR;
+#endif
+}
+
+
+KernelPath GetKernelPath()
+{
+	return kernel_path;
+}
+
+
+/// <summary>
+/// Forces a path, used to compare the paths against each other
+/// Paths the cpu doesn't support fall back to the detected one
+/// </summary>
+/// <param name="path"></param>
+void SetKernelPath(KernelPath path)
+{
+	kernel_path = path <= DetectKernelPath() ? path : DetectKernelPath();
+}
+
+
+const char * KernelPathName(KernelPath path)
+{
+	switch (path)
+	{
+	case KERNEL_SCALAR:
+		return "scalar";
+	case KERNEL_SSE:
+		return "sse";
+	case KERNEL_AVX2:
+		return "avx2";
+	}
+	return "unknown";
+}
+
+
+/// <summary>
+/// Reference implementation, used when there is no simd support
+/// </summary>
+static void ModelViewScalar(const glm::mat4 & view, const glm::mat4 & model, glm::mat4 & mv, glm::mat4 * normal)
+{
+	for (int c = 0; c < 4; c++)
+		for (int r = 0; r < 4; r++)
+			mv[c][r] = view[0][r] * model[c][0] + view[1][r] * model[c][1] + view[2][r] * model[c][2] + view[3][r] * model[c][3];
+
+	if (normal == nullptr)
+		return;
+
+	// The inverse transpose of a 3x3 matrix are the cross products of its columns divided by the determinant
+	glm::vec3 a = glm::vec3(mv[0]);
+	glm::vec3 b = glm::vec3(mv[1]);
+	glm::vec3 c = glm::vec3(mv[2]);
+	glm::vec3 bc = glm::cross(b, c);
+	float inv_det = 1.0f / glm::dot(a, bc);
+
+	(*normal)[0] = glm::vec4(bc * inv_det, 0.0f);
+	(*normal)[1] = glm::vec4(glm::cross(c, a) * inv_det, 0.0f);
+	(*normal)[2] = glm::vec4(glm::cross(a, b) * inv_det, 0.0f);
+	(*normal)[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+
+/// <summary>
+/// Cross product of the xyz parts, w ends up 0
+/// </summary>
+static inline __m128 Cross(__m128 a, __m128 b)
+{
+	__m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+
+/// <summary>
+/// Writes the inverse transpose of the upper 3x3 of mv (given as columns)
+/// </summary>
+static inline void NormalMatrixSSE(__m128 a, __m128 b, __m128 c, float * out)
+{
+	const __m128 xyz_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	a = _mm_and_ps(a, xyz_mask);
+	b = _mm_and_ps(b, xyz_mask);
+	c = _mm_and_ps(c, xyz_mask);
+
+	__m128 bc = Cross(b, c);
+	__m128 ca = Cross(c, a);
+	__m128 ab = Cross(a, b);
+
+	// det = dot(a, b x c), summed into every lane
+	__m128 det = _mm_mul_ps(a, bc);
+	det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(2, 3, 0, 1)));
+	det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(1, 0, 3, 2)));
+	__m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	_mm_storeu_ps(out + 0, _mm_mul_ps(bc, inv_det));
+	_mm_storeu_ps(out + 4, _mm_mul_ps(ca, inv_det));
+	_mm_storeu_ps(out + 8, _mm_mul_ps(ab, inv_det));
+	_mm_storeu_ps(out + 12, _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f));
+}
+
+
+/// <summary>
+/// One matrix per iteration, every column of mv is a sum of the view columns weighted by a model column
+/// </summary>
+static void BatchSSE(const glm::mat4 & view, const char * models, size_t model_stride, glm::mat4 * mvs, glm::mat4 * normals, size_t count)
+{
+	const float * v = &view[0][0];
+	const __m128 v0 = _mm_loadu_ps(v + 0);
+	const __m128 v1 = _mm_loadu_ps(v + 4);
+	const __m128 v2 = _mm_loadu_ps(v + 8);
+	const __m128 v3 = _mm_loadu_ps(v + 12);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const float * m = (const float *)(models + i * model_stride);
+		float * out = &mvs[i][0][0];
+
+		__m128 columns[4];
+		for (int c = 0; c < 4; c++)
+		{
+			__m128 col = _mm_loadu_ps(m + c * 4);
+			__m128 r = _mm_mul_ps(v0, _mm_shuffle_ps(col, col, _MM_SHUFFLE(0, 0, 0, 0)));
+			r = _mm_add_ps(r, _mm_mul_ps(v1, _mm_shuffle_ps(col, col, _MM_SHUFFLE(1, 1, 1, 1))));
+			r = _mm_add_ps(r, _mm_mul_ps(v2, _mm_shuffle_ps(col, col, _MM_SHUFFLE(2, 2, 2, 2))));
+			r = _mm_add_ps(r, _mm_mul_ps(v3, _mm_shuffle_ps(col, col, _MM_SHUFFLE(3, 3, 3, 3))));
+			_mm_storeu_ps(out + c * 4, r);
+			columns[c] = r;
+		}
+
+		if (normals != nullptr)
+			NormalMatrixSSE(columns[0], columns[1], columns[2], &normals[i][0][0]);
+	}
+}
+
+
+/// <summary>
+/// Two columns per instruction, the view columns are repeated in both 128 bit lanes
+/// and the permute broadcasts one element of each model column within its own lane
+/// </summary>
+KERNEL_TARGET_AVX2
+static void BatchAVX2(const glm::mat4 & view, const char * models, size_t model_stride, glm::mat4 * mvs, glm::mat4 * normals, size_t count)
+{
+	const float * v = &view[0][0];
+	const __m256 v0 = _mm256_broadcast_ps((const __m128 *)(v + 0));
+	const __m256 v1 = _mm256_broadcast_ps((const __m128 *)(v + 4));
+	const __m256 v2 = _mm256_broadcast_ps((const __m128 *)(v + 8));
+	const __m256 v3 = _mm256_broadcast_ps((const __m128 *)(v + 12));
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const float * m = (const float *)(models + i * model_stride);
+		float * out = &mvs[i][0][0];
+
+		__m256 halves[2];
+		for (int h = 0; h < 2; h++)
+		{
+			__m256 cols = _mm256_loadu_ps(m + h * 8);
+			__m256 r = _mm256_mul_ps(v0, _mm256_permute_ps(cols, _MM_SHUFFLE(0, 0, 0, 0)));
+			r = _mm256_fmadd_ps(v1, _mm256_permute_ps(cols, _MM_SHUFFLE(1, 1, 1, 1)), r);
+			r = _mm256_fmadd_ps(v2, _mm256_permute_ps(cols, _MM_SHUFFLE(2, 2, 2, 2)), r);
+			r = _mm256_fmadd_ps(v3, _mm256_permute_ps(cols, _MM_SHUFFLE(3, 3, 3, 3)), r);
+			_mm256_storeu_ps(out + h * 8, r);
+			halves[h] = r;
+		}
+
+		if (normals != nullptr)
+			NormalMatrixSSE(_mm256_castps256_ps128(halves[0]), _mm256_extractf128_ps(halves[0], 1), _mm256_castps256_ps128(halves[1]), &normals[i][0][0]);
+	}
+}
+
+
+void BatchModelView(const glm::mat4 & view, const glm::mat4 * models, size_t model_stride, glm::mat4 * mvs, glm::mat4 * normals, size_t count)
+{
+	const char * bytes = (const char *)models;
+
+	switch (kernel_path)
+	{
+	case KERNEL_AVX2:
+		BatchAVX2(view, bytes, model_stride, mvs, normals, count);
+		break;
+	case KERNEL_SSE:
+		BatchSSE(view, bytes, model_stride, mvs, normals, count);
+		break;
+	default:
+		for (size_t i = 0; i < count; i++)
+		{
+			const glm::mat4 & model = *(const glm::mat4 *)(bytes + i * model_stride);
+			ModelViewScalar(view, model, mvs[i], normals != nullptr ? &normals[i] : nullptr);
+		}
+		break;
+	}
+}
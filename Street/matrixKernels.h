@@ -0,0 +1,32 @@
+#pragma once
+#include <stddef.h>
+#include <glm/glm.hpp>
+
+
+// Instruction sets the batch kernels can run on
+enum KernelPath
+{
+	KERNEL_SCALAR,
+	KERNEL_SSE,
+	KERNEL_AVX2
+};
+
+// Functions of the avx2 path, the compiler may only use those instructions in them
+// The path is only picked when the cpu has avx2 and fma (msvc needs no attribute for the intrinsics)
+#ifdef _MSC_VER
+#define KERNEL_TARGET_AVX2
+#else
+#define KERNEL_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+KernelPath DetectKernelPath();
+KernelPath GetKernelPath();
+void SetKernelPath(KernelPath path);
+const char * KernelPathName(KernelPath path);
+
+// Calculates for count matrices:
+// - mvs[i] = view * model[i]
+// - normals[i] = inverse transpose of the upper 3x3 of mvs[i] (stored in the upper 3x3 of a mat4)
+// The models are read with a stride in bytes so they can live inside a bigger struct
+// normals can be nullptr when only the mv matrices are needed
+void BatchModelView(const glm::mat4 & view, const glm::mat4 * models, size_t model_stride, glm::mat4 * mvs, glm::mat4 * normals, size_t count);
@@ -1,4 +1,5 @@
 #include <vector>
+#include <algorithm>
 
 #include <GL/glew.h>
 #include <GL/freeglut.h>
@@ -11,246 +12,321 @@
 #include "objloader.hpp"
 #include "texture.hpp"
 #include "modelRenderer.h"
-
-const char * fragshader_name = "fragmentshader.fsh";
-const char * vertexshader_name = "vertexshader.vsh";
+#include "lightmapBaker.h"
+#include "assetPack.h"
+#include "glState.h"
+#include "glStorage.h"
 
 
 /// <summary>
 /// ctor
 /// </summary>
 /// <param name="name">Name of the modal</param>
-/// <param name="model">Where we are looking from/at</param>
-/// <param name="projection">Where we are looking from/at</param>
-/// <param name="mv">Mat4 view * Model</param>
-/// <param name="lightSource"></param>
-ModelRenderer::ModelRenderer(const char * name, glm::mat4 model, glm::mat4 projection, glm::mat4 mv, LightSource lightSource)
+ModelRenderer::ModelRenderer(const char * name)
 {
 	this->model_name = name;
-	this->model = model;
-	this->projection = projection;
-	this->mv = mv;
-	this->light_source = lightSource;
+	this->vao = 0;
+	this->depth_vao = 0;
+	this->texture_id = 0;
+	this->bounds = Bounds{ glm::vec3(0.0f), 0.0f, glm::vec3(0.0f), glm::vec3(0.0f) };
+}
+
 
-	InitShaders();
+/// <summary>
+/// Calculates the box of all vertices and a bounding sphere around it
+/// </summary>
+void ModelRenderer::CalculateBounds()
+{
+	if (this->mesh.vertices.empty())
+		return;
+
+	glm::vec3 min = this->mesh.vertices[0];
+	glm::vec3 max = this->mesh.vertices[0];
+	for (auto & vertex : this->mesh.vertices)
+	{
+		min = glm::min(min, vertex);
+		max = glm::max(max, vertex);
+	}
+
+	this->bounds.box_min = min;
+	this->bounds.box_max = max;
+	this->bounds.center = (min + max) * 0.5f;
+	this->bounds.radius = 0.0f;
+	for (auto & vertex : this->mesh.vertices)
+		this->bounds.radius = std::max(this->bounds.radius, glm::length(vertex - this->bounds.center));
 }
 
 
 /// <summary>
-/// Inititalizes the shader files used by the model
+/// Binds the texture and the vao, the material ranges can be drawn afterwards
 /// </summary>
-void ModelRenderer::InitShaders()
+void ModelRenderer::Bind()
 {
-	char * vertexshader = glsl::readFile(vertexshader_name);
-	GLuint vsh_id = glsl::makeVertexShader(vertexshader);
+	gl_state.BindTexture(0, GL_TEXTURE_2D, this->Texture());
+	this->BindGeometry();
+}
 
-	char * fragshader = glsl::readFile(fragshader_name);
-	GLuint fsh_id = glsl::makeFragmentShader(fragshader);
 
-	this->shader_id = glsl::makeShaderProgram(vsh_id, fsh_id);
+/// <summary>
+/// Binds only the vao, for drawing the ranges with the textures of their materials
+/// </summary>
+void ModelRenderer::BindGeometry()
+{
+	gl_state.BindVertexArray(this->vao);
 }
 
 
 /// <summary>
-/// Transforms the model if transformations are enabled
+/// Draws one material range, the model has to be bound
 /// </summary>
-void ModelRenderer::TranformObject()
+/// <param name="range">First index and index count of the range</param>
+void ModelRenderer::DrawRange(const MeshRange & range)
 {
-	if (should_transform)
-		tranformFunc(*this);
+	glDrawElements(GL_TRIANGLES, range.count, GL_UNSIGNED_INT, (const void *)(range.first * sizeof(unsigned int)));
 }
 
 
 /// <summary>
-/// Draws the modal
+/// Draws the modal, all material ranges at once
 /// </summary>
 void ModelRenderer::DrawModel()
 {
-	// Rebind texture
-	glBindTexture(GL_TEXTURE_2D, this->texture_id);
-
-	// Send vao
-	glBindVertexArray(this->vao);
-	glDrawArrays(GL_TRIANGLES, 0, this->mesh.vertices.size());
-	glBindVertexArray(0);
+	this->Bind();
+	glDrawElements(GL_TRIANGLES, this->index_count, GL_UNSIGNED_INT, 0);
+	gl_state.BindVertexArray(0);
 }
 
 
 /// <summary>
-/// Fills all needed uniforms
+/// Draws only the positions of the modal, for passes that write nothing but depth
+/// The vao stays bound so a caster drawn in several tiles binds it once, the pass unbinds it at the end
 /// </summary>
-void ModelRenderer::FillUniforms()
+void ModelRenderer::DrawDepth()
 {
-	glUseProgram(this->shader_id);
-	glUniformMatrix4fv(this->uniforms.mv, 1, GL_FALSE, glm::value_ptr(this->mv));
-	glUniformMatrix4fv(this->uniforms.proj, 1, GL_FALSE, glm::value_ptr(this->projection));
-	glUniform3fv(this->uniforms.light_pos, 1, glm::value_ptr(this->light_source.position));
-	glUniform3fv(this->uniforms.material_ambient, 1, glm::value_ptr(this->material.ambient_color));
-	glUniform3fv(this->uniforms.material_diffuse, 1, glm::value_ptr(this->material.diffuse_color));
-	glUniform3fv(this->uniforms.material_specular, 1, glm::value_ptr(this->material.specular));
-	glUniform1f(this->uniforms.material_power, this->material.power);
-	glUniform1i(this->uniforms.has_texture, this->has_texture);
+	gl_state.BindVertexArray(this->depth_vao);
+	glDrawElements(GL_TRIANGLES, this->index_count, GL_UNSIGNED_INT, 0);
 }
 
 
 /// <summary>
 /// Initializes the buffers used by the model
 /// </summary>
-void ModelRenderer::InitBuffers()
+/// <param name="shader_id">The program the vertex attributes are bound to</param>
+void ModelRenderer::InitBuffers(GLuint shader_id)
 {
-	GLuint position_id;
-	GLuint normal_id;
-	GLuint uv_id;
-	GLuint vbo_vertices;
-	GLuint vbo_normals;
-	GLuint vbo_uvs;
-
-	// vbo for vertices
-	glGenBuffers(1, &vbo_vertices);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_vertices);
-	glBufferData(GL_ARRAY_BUFFER, this->mesh.vertices.size() * sizeof(glm::vec3), &(this->mesh.vertices[0]), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	// vbo for normals
-	glGenBuffers(1, &vbo_normals);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_normals);
-	glBufferData(GL_ARRAY_BUFFER, this->mesh.normals.size() * sizeof(glm::vec3), &(this->mesh.normals[0]), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	// vbo for uvs
-	glGenBuffers(1, &vbo_uvs);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_uvs);
-	glBufferData(GL_ARRAY_BUFFER, this->mesh.uvs.size() * sizeof(glm::vec2), &(this->mesh.uvs[0]), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	// Get vertex attributes
-	position_id = glGetAttribLocation(this->shader_id, "position");
-	normal_id = glGetAttribLocation(this->shader_id, "normal");
-	uv_id = glGetAttribLocation(this->shader_id, "uv");
-
-	// Allocate memory for vao
-	glGenVertexArrays(1, &this->vao);
-
-	// Init binding to the vao
-	glBindVertexArray(this->vao);
-
-	// Bind vertices to the vao
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_vertices);
-	glVertexAttribPointer(position_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(position_id);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_normals);
-	glVertexAttribPointer(normal_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(normal_id);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_uvs);
-	glVertexAttribPointer(uv_id, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(uv_id);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	// Stop binding to the vao
-	glBindVertexArray(0);
-
-	glUseProgram(this->shader_id);
-
-	// Save uniform variables
-	this->uniforms.mv = glGetUniformLocation(this->shader_id, "mv");
-	this->uniforms.proj = glGetUniformLocation(this->shader_id, "projection");
-	this->uniforms.light_pos = glGetUniformLocation(this->shader_id, "light_pos");
-	this->uniforms.material_ambient = glGetUniformLocation(this->shader_id, "mat_ambient");
-	this->uniforms.material_diffuse = glGetUniformLocation(this->shader_id, "mat_diffuse");
-	this->uniforms.material_specular = glGetUniformLocation(this->shader_id, "mat_specular");
-	this->uniforms.material_power = glGetUniformLocation(this->shader_id, "mat_power");
-	this->uniforms.has_texture = glGetUniformLocation(this->shader_id, "has_texture");
+	// Kept so the buffers can be released again, none of them changes after the upload
+	this->buffers[0] = CreateBuffer(this->mesh.vertices.size() * sizeof(glm::vec3), this->mesh.vertices.data(), 0, GL_STATIC_DRAW);
+	this->buffers[1] = CreateBuffer(this->mesh.normals.size() * sizeof(glm::vec3), this->mesh.normals.data(), 0, GL_STATIC_DRAW);
+	this->buffers[2] = CreateBuffer(this->mesh.uvs.size() * sizeof(glm::vec2), this->mesh.uvs.data(), 0, GL_STATIC_DRAW);
+	this->buffers[3] = CreateBuffer(this->mesh.lightmap_uvs.size() * sizeof(glm::vec2), this->mesh.lightmap_uvs.data(), 0, GL_STATIC_DRAW);
+
+	// One index buffer for all material ranges
+	this->buffers[4] = CreateBuffer(this->mesh.indices.size() * sizeof(unsigned int), this->mesh.indices.data(), 0, GL_STATIC_DRAW);
+
+	const VertexStream streams[] = {
+		{ glGetAttribLocation(shader_id, "position"), 3, this->buffers[0] },
+		{ glGetAttribLocation(shader_id, "normal"), 3, this->buffers[1] },
+		{ glGetAttribLocation(shader_id, "uv"), 2, this->buffers[2] },
+		{ glGetAttribLocation(shader_id, "lightmap_uv"), 2, this->buffers[3] }
+	};
+	this->vao = CreateVertexArray(streams, 4, this->buffers[4]);
+
+	// Position only stream, the depth programs pin position to location 0
+	const VertexStream positions = { 0, 3, this->buffers[0] };
+	this->depth_vao = CreateVertexArray(&positions, 1, this->buffers[4]);
 }
 
 
 /// <summary>
 /// Initializes the model
+/// The cpu side copy of the mesh is released once it is on the gpu
 /// </summary>
-void ModelRenderer::Initialize()
+/// <param name="shader_id">The program the model will be drawn with</param>
+void ModelRenderer::Initialize(GLuint shader_id)
 {
-	// This currently only initializes the buffers but can be use to call more stuff when all vars are set
-	this->InitBuffers();
+	this->vertex_count = (GLsizei)this->mesh.vertices.size();
+	this->index_count = (GLsizei)this->mesh.indices.size();
+	this->InitBuffers(shader_id);
+	this->mesh = Mesh();
+
+	if (!this->texture_image.pixels.empty())
+	{
+		this->texture_id = createTexture(this->texture_image);
+		this->texture_image = Image();
+	}
+
+	this->material_textures.assign(this->material_images.size(), 0);
+	for (size_t m = 0; m < this->material_images.size(); m++)
+	{
+		if (this->material_images[m].pixels.empty())
+			continue;
+		this->material_textures[m] = createTexture(this->material_images[m]);
+		this->material_texture_bytes += this->material_images[m].pixels.size();
+	}
+	this->material_images.clear();
 }
 
 
 /// <summary>
-/// Parses an obj file and fill the mesh
+/// Deletes the gpu resources of the model, it can't be drawn afterwards
+/// </summary>
+void ModelRenderer::Release()
+{
+	if (this->vao)
+	{
+		gl_state.DeleteVertexArrays(1, &this->vao);
+		gl_state.DeleteVertexArrays(1, &this->depth_vao);
+		gl_state.DeleteBuffers(5, this->buffers);
+	}
+	if (this->texture_id)
+		gl_state.DeleteTextures(1, &this->texture_id);
+	for (GLuint texture : this->material_textures)
+		if (texture)
+			gl_state.DeleteTextures(1, &texture);
+
+	this->vao = 0;
+	this->depth_vao = 0;
+	this->texture_id = 0;
+	this->vertex_count = 0;
+	this->index_count = 0;
+	this->mesh = Mesh();
+	this->texture_image = Image();
+	this->material_images.clear();
+	this->material_textures.clear();
+	this->material_texture_bytes = 0;
+}
+
+
+/// <summary>
+/// Parses an obj file (and its mtl libraries) and fill the mesh, the parsed version in the asset pack is used when there is one
 /// </summary>
 /// <param name="object_path">The path to the obj file</param>
 void ModelRenderer::ParseObject(const char * object_path)
 {
-	vector<glm::vec3> vertices;
-	vector<glm::vec3> normals;
-	vector<glm::vec2> uvs;
+	if (!asset_pack.ReadMesh(object_path, this->mesh))
+		loadOBJ(object_path, this->mesh);
 
-	bool res = loadOBJ(object_path, vertices, uvs, normals);
+	this->ranges = this->mesh.ranges;
+	this->materials = this->mesh.materials;
+	this->CalculateBounds();
 
-	this->mesh = Mesh{ vertices, normals, uvs };
+	// Generated the same way by the baker, so they line up with the baked pages
+	GenerateLightmapUVs(this->mesh);
 }
 
 
 /// <summary>
-/// Loads the texture the model will use
+/// Loads the texture the model will use, it is uploaded together with the mesh
+/// Without a texture of its own every material is drawn with its own diffuse map
+/// Only reads the files so it can run on a loader thread
 /// </summary>
-/// <param name="texture_path">The path to the textue</param>
+/// <param name="texture_path">The path to the textue, nullptr for the maps of the materials</param>
 void ModelRenderer::SetTexture(const char * texture_path)
 {
-	this->has_texture = 1;
-	this->texture_id = loadBMP(texture_path);
+	if (texture_path == nullptr)
+	{
+		this->material_images.assign(this->mesh.textures.size(), Image());
+		for (size_t m = 0; m < this->mesh.textures.size(); m++)
+			if (!this->mesh.textures[m].empty() && ReadImage(this->mesh.textures[m].c_str(), this->material_images[m]))
+				this->has_texture = 1;
+		return;
+	}
+
+	if (ReadImage(texture_path, this->texture_image))
+	{
+		this->texture_width = this->texture_image.width;
+		this->texture_height = this->texture_image.height;
+		this->has_texture = 1;
+	}
+}
+
+
+int ModelRenderer::HasTexture() const
+{
+	return this->has_texture;
+}
+
+
+GLsizei ModelRenderer::VertexCount() const
+{
+	return this->vertex_count;
+}
+
+
+GLsizei ModelRenderer::IndexCount() const
+{
+	return this->index_count;
 }
 
 
 /// <summary>
-/// Sets the material used by the model
+/// Buffer of a vertex stream, for drawing the mesh with other vertex arrays
 /// </summary>
-/// <param name="mat">The material</param>
-void ModelRenderer::SetMaterial(Material mat)
+/// <param name="stream">0 positions, 1 normals, 2 uvs, 3 lightmap uvs, 4 the indices</param>
+GLuint ModelRenderer::Buffer(int stream) const
 {
-	this->material = mat;
+	return this->buffers[stream];
 }
 
 
 /// <summary>
-/// Enables the use of looped transformations
+/// Texture of the model, the first map of its materials when it has none of its own
 /// </summary>
-/// <param name="func">The transformation that executes every loop</param>
-void ModelRenderer::EnableTransformation(transFunc func)
+GLuint ModelRenderer::Texture() const
 {
-	this->should_transform = true;
-	this->tranformFunc = func;
+	if (this->texture_id)
+		return this->texture_id;
+	for (GLuint texture : this->material_textures)
+		if (texture)
+			return texture;
+	return 0;
 }
 
 
 /// <summary>
-/// Disables transformation
+/// Texture a material range is drawn with, the texture of the model or else the map of the material of the range
 /// </summary>
-void ModelRenderer::DisableTransformation()
+/// <returns>0 when the range has no texture</returns>
+GLuint ModelRenderer::RangeTexture(const MeshRange & range) const
 {
-	this->should_transform = false;
+	if (this->texture_id || range.material < 0 || range.material >= (int)this->material_textures.size())
+		return this->texture_id;
+	return this->material_textures[range.material];
+}
+
+
+const std::vector<MeshRange> & ModelRenderer::Ranges() const
+{
+	return this->ranges;
+}
+
+
+const std::vector<Material> & ModelRenderer::Materials() const
+{
+	return this->materials;
 }
 
 
 /// <summary>
-/// Updates the matrices needed to project the object to a players f.o.v.
+/// The cpu side mesh, empty once the model is on the gpu
 /// </summary>
-/// <param name="proj"></param>
-/// <param name="mv"></param>
-void ModelRenderer::UpdateView(glm::mat4 proj, glm::mat4 mv)
+const Mesh & ModelRenderer::GetMesh() const
 {
-	this->projection = proj;
-	this->mv = mv;
+	return this->mesh;
 }
 
 
 /// <summary>
-/// Renders the model
+/// Bytes the model takes on the gpu, plus whatever is still waiting for upload on the cpu
 /// </summary>
-void ModelRenderer::Render()
+size_t ModelRenderer::MemoryBytes() const
 {
-	this->TranformObject();
-	this->FillUniforms();
-	this->DrawModel();
+	const size_t vertex_size = 2 * sizeof(glm::vec3) + 2 * sizeof(glm::vec2);
+	size_t bytes = this->vertex_count * vertex_size + this->index_count * sizeof(unsigned int)
+		+ this->mesh.vertices.size() * vertex_size + this->mesh.indices.size() * sizeof(unsigned int) + this->texture_image.pixels.size();
+	if (this->texture_id)
+		bytes += (size_t)this->texture_width * this->texture_height * 4;
+	for (const Image & image : this->material_images)
+		bytes += image.pixels.size();
+	return bytes + this->material_texture_bytes;
 }
-
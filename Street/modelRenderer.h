@@ -2,53 +2,69 @@
 #include <vector>
 #include <glm/glm.hpp>
 #include "types.h"
+#include "imageDecoder.h"
 
 
-class ModelRenderer;
-typedef void(*transFunc)(ModelRenderer &model);
-
+// A mesh living on the gpu, shared by every object in the scene that uses it
 class ModelRenderer
 {
 private:
-	ObjectUniforms uniforms;
-	LightSource light_source;
-	Material material;
 	int has_texture = 0;
 
-	// The model itself (vertices, normals, uvs, ...)
+	// The model itself (vertices, normals, uvs, ...), only kept until it is uploaded or when baking
 	Mesh mesh;
+	GLsizei vertex_count = 0;
+	GLsizei index_count = 0;
+
+	// Material ranges of the index buffer and the materials of the mtl libraries, kept after the upload
+	std::vector<MeshRange> ranges;
+	std::vector<Material> materials;
+
+	// Decoded texture, only kept until it is uploaded
+	Image texture_image;
+	unsigned int texture_width = 0;
+	unsigned int texture_height = 0;
 
-	// Transformation
-	bool should_transform = false;
-	transFunc tranformFunc;
+	// Diffuse maps of the materials, used when the model has no texture of its own
+	// Decoded ones are only kept until they are uploaded, materials without a map have none
+	std::vector<Image> material_images;
+	std::vector<GLuint> material_textures;
+	size_t material_texture_bytes = 0;
 
 	// Shader related
-	GLuint shader_id;
 	GLuint vao;
+	GLuint depth_vao; // Positions only, for the depth pre-pass and the shadows
+	GLuint buffers[5] = {};
 	GLuint texture_id;
 
 
-	void InitShaders();
-	void InitBuffers();
-	void TranformObject();
-	void DrawModel();
-	void FillUniforms();
+	void CalculateBounds();
+	void InitBuffers(GLuint shader_id);
 public:
-	ModelRenderer(const char * name, glm::mat4 model, glm::mat4 projection, glm::mat4 mv, LightSource light_source);
+	ModelRenderer(const char * name);
 	std::string model_name;
 
-	// Position and transformations
-	glm::mat4 projection;
-	glm::mat4 mv;
-	glm::mat4 model;
+	// Bounding sphere and box in model space
+	Bounds bounds;
 
 
-	void Initialize();
+	void Initialize(GLuint shader_id);
+	void Release();
 	void ParseObject(const char * objectPath);
 	void SetTexture(const char * texturePath);
-	void SetMaterial(Material mat);
-	void EnableTransformation(transFunc func);
-	void DisableTransformation();
-	void UpdateView(glm::mat4 proj, glm::mat4 mv);
-	void Render();
-};
\ No newline at end of file
+	int HasTexture() const;
+	GLsizei VertexCount() const;
+	GLsizei IndexCount() const;
+	GLuint Buffer(int stream) const;
+	GLuint Texture() const;
+	GLuint RangeTexture(const MeshRange & range) const;
+	const std::vector<MeshRange> & Ranges() const;
+	const std::vector<Material> & Materials() const;
+	const Mesh & GetMesh() const;
+	size_t MemoryBytes() const;
+	void Bind();
+	void BindGeometry();
+	void DrawRange(const MeshRange & range);
+	void DrawModel();
+	void DrawDepth();
+};
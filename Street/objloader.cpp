@@ -1,110 +1,279 @@
 #include <vector>
 #include <stdio.h>
+#include <ctype.h>
 #include <string>
 #include <cstring>
+#include <unordered_map>
+
+#include <GL/glew.h>
 
 #include <glm/glm.hpp>
 
 #include "objloader.hpp"
+#include "frameArena.h"
+#include "blockPool.h"
 
-// Very, VERY simple OBJ loader.
+// Simple OBJ loader.
+// Reads positions, uvs and normals, faces of any size in every index format (v, v/vt, v//vn, v/vt/vn, negative indices)
+// and the materials of the mtl libraries. Polygons are triangulated as a fan, identical corners share a vertex
+// and the triangles are grouped by material so every material is one range of the index buffer.
 // Here is a short list of features a real function would provide : 
-// - Binary files. Reading a model should be just a few memcpy's away, not parsing a file at runtime. In short : OBJ is not very great.
+// - Binary files. Reading a model should be just a few memcpy's away, not parsing a file at runtime (see the asset pack)
 // - Animations & bones (includes bones weights)
 // - Multiple UVs
-// - All attributes should be optional, not "forced"
-// - More stable. Change a line in the OBJ file and it crashes.
-// - More secure. Change another line and you can inject code.
-// - Loading from memory, stream, etc
+// - Concave polygons, a fan only works for convex ones
+
+// A corner of a face, indices start at 0 and are -1 when missing
+struct ObjCorner
+{
+	int vertex;
+	int uv;
+	int normal;
+
+	bool operator==(const ObjCorner & other) const
+	{
+		return this->vertex == other.vertex && this->uv == other.uv && this->normal == other.normal;
+	}
+};
+
+struct ObjCornerHash
+{
+	size_t operator()(const ObjCorner & corner) const
+	{
+		return ((size_t)corner.vertex * 73856093u) ^ ((size_t)corner.uv * 19349663u) ^ ((size_t)corner.normal * 83492791u);
+	}
+};
+
+
+/// <summary>
+/// Turns a 1 based (or negative, relative to the end) obj index into a 0 based one
+/// </summary>
+static int ResolveIndex(int index, size_t count)
+{
+	if (index > 0)
+		return index <= (int)count ? index - 1 : -1;
+	if (index < 0)
+		return (int)count + index >= 0 ? (int)count + index : -1;
+	return -1;
+}
+
+
+/// <summary>
+/// Directory part of a path, with the trailing slash
+/// </summary>
+static std::string Directory(const char * path)
+{
+	std::string directory = path;
+	size_t slash = directory.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+}
+
+
+/// <summary>
+/// Reads the materials of an mtl library: ambient, diffuse and specular color, the specular exponent and the diffuse map
+/// </summary>
+/// <param name="path"></param>
+/// <param name="out_names">Receives the material names</param>
+/// <param name="out_materials">Receives the materials</param>
+/// <param name="out_textures">Receives the diffuse map of every material (relative to the library), empty without one</param>
+/// <returns>Whether the library could be opened</returns>
+bool loadMTL(
+	const char * path,
+	std::vector<std::string> & out_names,
+	std::vector<Material> & out_materials,
+	std::vector<std::string> & out_textures
+){
+	FILE * file = fopen(path, "r");
+	if (file == NULL){
+		printf("Impossible to open the material library %s\n", path);
+		return false;
+	}
+
+	char line[1024];
+	while (fgets(line, sizeof(line), file)){
+		char keyword[64] = "";
+		char value[512] = "";
+		if (sscanf(line, " %63s", keyword) != 1)
+			continue;
+
+		if (strcmp(keyword, "newmtl") == 0 && sscanf(line, " %*s %511s", value) == 1){
+			out_names.push_back(value);
+			out_materials.push_back(Material{ glm::vec3(0.2f), glm::vec3(0.8f), glm::vec3(1.0f), 128 });
+			out_textures.push_back(std::string());
+			continue;
+		}
+		if (out_materials.empty())
+			continue;
+
+		Material & material = out_materials.back();
+		if (strcmp(keyword, "Ka") == 0)
+			sscanf(line, " %*s %f %f %f", &material.ambient_color.x, &material.ambient_color.y, &material.ambient_color.z);
+		else if (strcmp(keyword, "Kd") == 0)
+			sscanf(line, " %*s %f %f %f", &material.diffuse_color.x, &material.diffuse_color.y, &material.diffuse_color.z);
+		else if (strcmp(keyword, "Ks") == 0)
+			sscanf(line, " %*s %f %f %f", &material.specular.x, &material.specular.y, &material.specular.z);
+		else if (strcmp(keyword, "Ns") == 0)
+			sscanf(line, " %*s %f", &material.power);
+		else if (strcmp(keyword, "map_Kd") == 0){
+			// Options come before the file name, the name is the last word
+			char * end = line + strlen(line);
+			while (end > line && isspace((unsigned char)end[-1]))
+				*--end = '\0';
+			char * name = end;
+			while (name > line && !isspace((unsigned char)name[-1]))
+				name--;
+			out_textures.back() = Directory(path) + name;
+		}
+	}
+
+	fclose(file);
+	return true;
+}
+
 
+/// <summary>
+/// Loads an obj file into an indexed mesh with one range per material
+/// </summary>
+/// <param name="path"></param>
+/// <param name="out_mesh">Receives the mesh, lightmap uvs are left empty</param>
+/// <returns>Whether the file could be read</returns>
 bool loadOBJ(
 	const char * path, 
-	std::vector<glm::vec3> & out_vertices, 
-	std::vector<glm::vec2> & out_uvs,
-	std::vector<glm::vec3> & out_normals
+	Mesh & out_mesh
 ){
 	printf("Loading OBJ file %s...\n", path);
 
-	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-	std::vector<glm::vec3> temp_vertices; 
-	std::vector<glm::vec2> temp_uvs;
-	std::vector<glm::vec3> temp_normals;
+	// What only lives during the load comes from an arena that is freed at once when it returns
+	FrameArena scratch(1024 * 1024);
+	ArenaVector<glm::vec3> temp_vertices{ ArenaAllocator<glm::vec3>(scratch) };
+	ArenaVector<glm::vec2> temp_uvs{ ArenaAllocator<glm::vec2>(scratch) };
+	ArenaVector<glm::vec3> temp_normals{ ArenaAllocator<glm::vec3>(scratch) };
+
+	std::vector<std::string> material_names;
+	std::vector<Material> materials;
+	std::vector<std::string> textures;
+
+	// Triangles (three corners each) per material, slot 0 is for faces without a known material
+	const ArenaAllocator<ObjCorner> corners(scratch);
+	ArenaVector<ArenaVector<ObjCorner>> triangles(1, ArenaVector<ObjCorner>(corners), corners);
+	int current = 0;
+
+	out_mesh = Mesh();
 
 	FILE * file = fopen(path, "r");
 	if( file == NULL ){
-		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
-		getchar();
+		printf("Impossible to open the file ! Are you in the right path ?\n");
 		return false;
 	}
 
-	while( 1 ){
-
-		char lineHeader[128];
-		// read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break; // EOF = End Of File. Quit the loop.
+	char line[4096];
+	ArenaVector<ObjCorner> face(corners);
+	while (fgets(line, sizeof(line), file)){
+		char keyword[64] = "";
+		if (sscanf(line, " %63s", keyword) != 1)
+			continue;
+		const char * rest = strstr(line, keyword) + strlen(keyword);
 
-		// else : parse lineHeader
-		
-		if ( strcmp( lineHeader, "v" ) == 0 ){
+		if ( strcmp( keyword, "v" ) == 0 ){
 			glm::vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
+			sscanf(rest, "%f %f %f", &vertex.x, &vertex.y, &vertex.z );
 			temp_vertices.push_back(vertex);
-		}else if ( strcmp( lineHeader, "vt" ) == 0 ){
+		}else if ( strcmp( keyword, "vt" ) == 0 ){
 			glm::vec2 uv;
-			fscanf(file, "%f %f\n", &uv.x, &uv.y );
+			sscanf(rest, "%f %f", &uv.x, &uv.y );
 			// uv.y = -uv.y; // This is the culprit for the textures not loading A SINGLE LINE OF CODE DAMNIT....
 			temp_uvs.push_back(uv);
-		}else if ( strcmp( lineHeader, "vn" ) == 0 ){
+		}else if ( strcmp( keyword, "vn" ) == 0 ){
 			glm::vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
+			sscanf(rest, "%f %f %f", &normal.x, &normal.y, &normal.z );
 			temp_normals.push_back(normal);
-		}else if ( strcmp( lineHeader, "f" ) == 0 ){
-			std::string vertex1, vertex2, vertex3;
-			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-			int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2] );
-			if (matches != 9){
-				printf("File can't be read by our simple parser :-( Try exporting with other options\n");
-				return false;
+		}else if ( strcmp( keyword, "mtllib" ) == 0 ){
+			char library[512];
+			if (sscanf(rest, " %511s", library) == 1)
+				loadMTL((Directory(path) + library).c_str(), material_names, materials, textures);
+		}else if ( strcmp( keyword, "usemtl" ) == 0 ){
+			char name[512] = "";
+			sscanf(rest, " %511s", name);
+			current = 0;
+			for (size_t m = 0; m < material_names.size(); m++)
+				if (material_names[m] == name)
+					current = (int)m + 1;
+			if (triangles.size() <= (size_t)current)
+				triangles.resize(current + 1, ArenaVector<ObjCorner>(corners));
+		}else if ( strcmp( keyword, "f" ) == 0 ){
+			// Every corner is v, v/vt, v//vn or v/vt/vn
+			face.clear();
+			char word[128];
+			int consumed = 0;
+			while (sscanf(rest, " %127s%n", word, &consumed) == 1){
+				rest += consumed;
+				int v = 0, vt = 0, vn = 0;
+				if (sscanf(word, "%d/%d/%d", &v, &vt, &vn) != 3 && sscanf(word, "%d//%d", &v, &vn) != 2 && sscanf(word, "%d/%d", &v, &vt) != 2)
+					sscanf(word, "%d", &v);
+				ObjCorner corner = { ResolveIndex(v, temp_vertices.size()), ResolveIndex(vt, temp_uvs.size()), ResolveIndex(vn, temp_normals.size()) };
+				if (corner.vertex < 0){
+					printf("%s: face with a vertex that doesn't exist, skipped\n", path);
+					face.clear();
+					break;
+				}
+				face.push_back(corner);
+			}
+
+			// Faces without normals get the normal of the face
+			if (face.size() >= 3 && face[0].normal < 0){
+				const glm::vec3 & a = temp_vertices[face[0].vertex];
+				glm::vec3 normal = glm::cross(temp_vertices[face[1].vertex] - a, temp_vertices[face[2].vertex] - a);
+				temp_normals.push_back(glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 1.0f, 0.0f));
+				for (auto & corner : face)
+					if (corner.normal < 0)
+						corner.normal = (int)temp_normals.size() - 1;
 			}
-			vertexIndices.push_back(vertexIndex[0]);
-			vertexIndices.push_back(vertexIndex[1]);
-			vertexIndices.push_back(vertexIndex[2]);
-			uvIndices    .push_back(uvIndex[0]);
-			uvIndices    .push_back(uvIndex[1]);
-			uvIndices    .push_back(uvIndex[2]);
-			normalIndices.push_back(normalIndex[0]);
-			normalIndices.push_back(normalIndex[1]);
-			normalIndices.push_back(normalIndex[2]);
-		}else{
-			// Probably a comment, eat up the rest of the line
-			char stupidBuffer[1000];
-			fgets(stupidBuffer, 1000, file);
-		}
 
+			for (size_t i = 1; i + 1 < face.size(); i++){
+				triangles[current].push_back(face[0]);
+				triangles[current].push_back(face[i]);
+				triangles[current].push_back(face[i + 1]);
+			}
+		}
+		// Anything else (comments, objects, groups, smoothing) is ignored
 	}
+	fclose(file);
 
-	// For each vertex of each triangle
-	for( unsigned int i=0; i<vertexIndices.size(); i++ ){
-
-		// Get the indices of its attributes
-		unsigned int vertexIndex = vertexIndices[i];
-		unsigned int uvIndex = uvIndices[i];
-		unsigned int normalIndex = normalIndices[i];
-		
-		// Get the attributes thanks to the index
-		glm::vec3 vertex = temp_vertices[ vertexIndex-1 ];
-		glm::vec2 uv = temp_uvs[ uvIndex-1 ];
-		glm::vec3 normal = temp_normals[ normalIndex-1 ];
-		
-		// Put the attributes in buffers
-		out_vertices.push_back(vertex);
-		out_uvs     .push_back(uv);
-		out_normals .push_back(normal);
-	
+	// One vertex per distinct corner, the triangles of a material follow each other
+	// The entries of the map come from a pool (blocks with room for the entry, its link and hash) instead of an allocation each
+	size_t corner_count = 0;
+	for (auto & material : triangles)
+		corner_count += material.size();
+	out_mesh.indices.reserve(corner_count);
+	out_mesh.vertices.reserve(temp_vertices.size());
+	out_mesh.uvs.reserve(temp_vertices.size());
+	out_mesh.normals.reserve(temp_vertices.size());
+
+	typedef std::pair<const ObjCorner, unsigned int> CornerVertex;
+	BlockPool entries(48, 4096);
+	std::unordered_map<ObjCorner, unsigned int, ObjCornerHash, std::equal_to<ObjCorner>, PoolAllocator<CornerVertex>> vertex_of(
+		corner_count, ObjCornerHash(), std::equal_to<ObjCorner>(), PoolAllocator<CornerVertex>(entries));
+	for (size_t m = 0; m < triangles.size(); m++){
+		if (triangles[m].empty())
+			continue;
+
+		MeshRange range = { (unsigned int)out_mesh.indices.size(), (unsigned int)triangles[m].size(), (int)m - 1 };
+		for (auto & corner : triangles[m]){
+			auto found = vertex_of.find(corner);
+			if (found == vertex_of.end()){
+				found = vertex_of.insert(std::make_pair(corner, (unsigned int)out_mesh.vertices.size())).first;
+				out_mesh.vertices.push_back(temp_vertices[corner.vertex]);
+				out_mesh.uvs.push_back(corner.uv >= 0 ? temp_uvs[corner.uv] : glm::vec2(0.0f));
+				out_mesh.normals.push_back(corner.normal >= 0 ? temp_normals[corner.normal] : glm::vec3(0.0f, 1.0f, 0.0f));
+			}
+			out_mesh.indices.push_back(found->second);
+		}
+		out_mesh.ranges.push_back(range);
 	}
 
+	out_mesh.materials = materials;
+	out_mesh.textures = textures;
+
 	return true;
 }
 
@@ -2,12 +2,18 @@
 #define OBJLOADER_H
 
 #include <vector>
+#include "types.h"
 
 bool loadOBJ(
 	const char * path, 
-	std::vector<glm::vec3> & out_vertices, 
-	std::vector<glm::vec2> & out_uvs, 
-	std::vector<glm::vec3> & out_normals
+	Mesh & out_mesh
+);
+
+bool loadMTL(
+	const char * path,
+	std::vector<std::string> & out_names,
+	std::vector<Material> & out_materials,
+	std::vector<std::string> & out_textures
 );
 
 
@@ -20,4 +26,4 @@ bool loadAssImp(
 	std::vector<glm::vec3> & normals
 );
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,244 @@
+#include <math.h>
+#include <algorithm>
+#include <emmintrin.h>
+
+#include "occlusionCuller.h"
+
+// Corners closer than this (clip w) make a box unusable, it would have to be clipped against the near plane
+const float OCCLUSION_MIN_W = 1e-3f;
+
+// The 12 triangles of a box, corner i has bit 0 = x, bit 1 = y, bit 2 = z of the max corner
+static const int BOX_TRIANGLES[12][3] = {
+	{ 0, 1, 3 }, { 0, 3, 2 }, { 4, 6, 7 }, { 4, 7, 5 },
+	{ 0, 4, 5 }, { 0, 5, 1 }, { 2, 3, 7 }, { 2, 7, 6 },
+	{ 0, 2, 6 }, { 0, 6, 4 }, { 1, 5, 7 }, { 1, 7, 3 }
+};
+
+
+/// <summary>
+/// ctor, allocates the depth buffer and the pyramid
+/// </summary>
+OcclusionCuller::OcclusionCuller()
+{
+	int width = OCCLUSION_WIDTH;
+	int height = OCCLUSION_HEIGHT;
+	while (true)
+	{
+		this->levels.push_back(std::vector<float>(width * height, 1.0f));
+		this->level_widths.push_back(width);
+		this->level_heights.push_back(height);
+		if (width == 1 && height == 1)
+			break;
+		width = std::max(1, (width + 1) / 2);
+		height = std::max(1, (height + 1) / 2);
+	}
+}
+
+
+bool OcclusionCuller::IsEnabled() const
+{
+	return this->enabled;
+}
+
+
+void OcclusionCuller::Toggle()
+{
+	this->enabled = !this->enabled;
+}
+
+
+/// <summary>
+/// Clears the depth buffer for a new frame
+/// </summary>
+/// <param name="view_projection">projection * view</param>
+void OcclusionCuller::Begin(const glm::mat4 & view_projection)
+{
+	this->view_projection = view_projection;
+	std::fill(this->levels[0].begin(), this->levels[0].end(), 1.0f);
+}
+
+
+/// <summary>
+/// Projects the corners of a box to the depth buffer (x and y in pixels, z in [0, 1])
+/// </summary>
+/// <returns>False when a corner is behind the camera</returns>
+bool OcclusionCuller::ProjectBox(const glm::mat4 & world, const glm::vec3 & box_min, const glm::vec3 & box_max, glm::vec3 * corners) const
+{
+	const glm::mat4 clip = this->view_projection * world;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec4 corner = glm::vec4(i & 1 ? box_max.x : box_min.x, i & 2 ? box_max.y : box_min.y, i & 4 ? box_max.z : box_min.z, 1.0f);
+		glm::vec4 p = clip * corner;
+		if (p.w < OCCLUSION_MIN_W)
+			return false;
+
+		corners[i] = glm::vec3(
+			(p.x / p.w * 0.5f + 0.5f) * OCCLUSION_WIDTH,
+			(p.y / p.w * 0.5f + 0.5f) * OCCLUSION_HEIGHT,
+			p.z / p.w * 0.5f + 0.5f);
+	}
+	return true;
+}
+
+
+/// <summary>
+/// Rasterizes a triangle into level 0, four pixels at a time
+/// A pixel is covered when its center is inside, the closest depth wins
+/// </summary>
+void OcclusionCuller::RasterizeTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (fabsf(area) < 1e-6f)
+		return;
+	if (area < 0.0f)
+	{
+		std::swap(b, c);
+		area = -area;
+	}
+
+	const int min_x = std::max(0, (int)floorf(std::min(a.x, std::min(b.x, c.x)))) & ~3;
+	const int max_x = std::min(OCCLUSION_WIDTH - 1, (int)ceilf(std::max(a.x, std::max(b.x, c.x))));
+	const int min_y = std::max(0, (int)floorf(std::min(a.y, std::min(b.y, c.y))));
+	const int max_y = std::min(OCCLUSION_HEIGHT - 1, (int)ceilf(std::max(a.y, std::max(b.y, c.y))));
+	if (min_x > max_x || min_y > max_y)
+		return;
+
+	// Edge functions w = dx * (py - y0) - dy * (px - x0), opposite of a, b and c
+	const float inv_area = 1.0f / area;
+	const glm::vec2 e0 = glm::vec2(c.x - b.x, c.y - b.y);
+	const glm::vec2 e1 = glm::vec2(a.x - c.x, a.y - c.y);
+	const glm::vec2 e2 = glm::vec2(b.x - a.x, b.y - a.y);
+
+	const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 za = _mm_set1_ps(a.z * inv_area);
+	const __m128 zb = _mm_set1_ps(b.z * inv_area);
+	const __m128 zc = _mm_set1_ps(c.z * inv_area);
+
+	std::vector<float> & depth = this->levels[0];
+	for (int y = min_y; y <= max_y; y++)
+	{
+		const float py = y + 0.5f;
+		const __m128 row0 = _mm_set1_ps(e0.x * (py - b.y));
+		const __m128 row1 = _mm_set1_ps(e1.x * (py - c.y));
+		const __m128 row2 = _mm_set1_ps(e2.x * (py - a.y));
+		float * line = &depth[y * OCCLUSION_WIDTH];
+
+		for (int x = min_x; x <= max_x; x += 4)
+		{
+			const __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+			const __m128 w0 = _mm_sub_ps(row0, _mm_mul_ps(_mm_set1_ps(e0.y), _mm_sub_ps(px, _mm_set1_ps(b.x))));
+			const __m128 w1 = _mm_sub_ps(row1, _mm_mul_ps(_mm_set1_ps(e1.y), _mm_sub_ps(px, _mm_set1_ps(c.x))));
+			const __m128 w2 = _mm_sub_ps(row2, _mm_mul_ps(_mm_set1_ps(e2.y), _mm_sub_ps(px, _mm_set1_ps(a.x))));
+
+			const __m128 inside = _mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_and_ps(_mm_cmpge_ps(w1, zero), _mm_cmpge_ps(w2, zero)));
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+
+			const __m128 z = _mm_add_ps(_mm_mul_ps(w0, za), _mm_add_ps(_mm_mul_ps(w1, zb), _mm_mul_ps(w2, zc)));
+			const __m128 current = _mm_loadu_ps(line + x);
+			const __m128 closest = _mm_min_ps(current, z);
+			_mm_storeu_ps(line + x, _mm_or_ps(_mm_and_ps(inside, closest), _mm_andnot_ps(inside, current)));
+		}
+	}
+}
+
+
+/// <summary>
+/// Rasterizes the shrunk box of an occluder
+/// </summary>
+/// <param name="world">World matrix of the occluder</param>
+/// <param name="box_min">Model space box of the mesh</param>
+/// <param name="box_max"></param>
+/// <returns>False when the box was skipped because it crosses the near plane</returns>
+bool OcclusionCuller::AddOccluder(const glm::mat4 & world, const glm::vec3 & box_min, const glm::vec3 & box_max)
+{
+	const glm::vec3 center = (box_min + box_max) * 0.5f;
+	const glm::vec3 half = (box_max - box_min) * (0.5f * OCCLUDER_SHRINK);
+
+	glm::vec3 corners[8];
+	if (!this->ProjectBox(world, center - half, center + half, corners))
+		return false;
+
+	for (auto & triangle : BOX_TRIANGLES)
+		this->RasterizeTriangle(corners[triangle[0]], corners[triangle[1]], corners[triangle[2]]);
+	return true;
+}
+
+
+/// <summary>
+/// Builds the max depth pyramid from the rasterized occluders
+/// </summary>
+void OcclusionCuller::BuildPyramid()
+{
+	for (size_t level = 1; level < this->levels.size(); level++)
+	{
+		const std::vector<float> & source = this->levels[level - 1];
+		std::vector<float> & target = this->levels[level];
+		const int source_width = this->level_widths[level - 1];
+		const int source_height = this->level_heights[level - 1];
+		const int width = this->level_widths[level];
+		const int height = this->level_heights[level];
+
+		for (int y = 0; y < height; y++)
+		{
+			const float * row0 = &source[std::min(y * 2, source_height - 1) * source_width];
+			const float * row1 = &source[std::min(y * 2 + 1, source_height - 1) * source_width];
+			for (int x = 0; x < width; x++)
+			{
+				const int x0 = std::min(x * 2, source_width - 1);
+				const int x1 = std::min(x * 2 + 1, source_width - 1);
+				target[y * width + x] = std::max(std::max(row0[x0], row0[x1]), std::max(row1[x0], row1[x1]));
+			}
+		}
+	}
+}
+
+
+/// <summary>
+/// Tests the screen rectangle of a box against the pyramid
+/// The level is picked so the rectangle covers at most 2x2 texels
+/// </summary>
+/// <param name="world">World matrix of the object</param>
+/// <param name="box_min">Model space box of the mesh</param>
+/// <param name="box_max"></param>
+/// <returns>True when the box is behind the occluders everywhere</returns>
+bool OcclusionCuller::IsOccluded(const glm::mat4 & world, const glm::vec3 & box_min, const glm::vec3 & box_max) const
+{
+	glm::vec3 corners[8];
+	if (!this->ProjectBox(world, box_min, box_max, corners))
+		return false;
+
+	glm::vec3 min = corners[0], max = corners[0];
+	for (int i = 1; i < 8; i++)
+	{
+		min = glm::min(min, corners[i]);
+		max = glm::max(max, corners[i]);
+	}
+
+	int x0 = std::max(0, (int)floorf(min.x));
+	int y0 = std::max(0, (int)floorf(min.y));
+	int x1 = std::min(OCCLUSION_WIDTH - 1, (int)floorf(max.x));
+	int y1 = std::min(OCCLUSION_HEIGHT - 1, (int)floorf(max.y));
+	if (x0 > x1 || y0 > y1)
+		return false;
+
+	const int size = std::max(x1 - x0, y1 - y0) + 1;
+	int level = 0;
+	while ((size >> level) > 2 && level + 1 < (int)this->levels.size())
+		level++;
+
+	x0 >>= level;
+	y0 >>= level;
+	x1 >>= level;
+	y1 >>= level;
+
+	const std::vector<float> & depth = this->levels[level];
+	const int width = this->level_widths[level];
+	float farthest = 0.0f;
+	for (int y = y0; y <= y1; y++)
+		for (int x = x0; x <= x1; x++)
+			farthest = std::max(farthest, depth[y * width + x]);
+
+	return min.z > farthest;
+}
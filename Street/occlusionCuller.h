@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+
+// Size of the cpu depth buffer, the width has to be a multiple of 4 for the simd rasterizer
+const int OCCLUSION_WIDTH = 256;
+const int OCCLUSION_HEIGHT = 192;
+
+// Occluder boxes are shrunk towards their center so they never cover more than the mesh itself
+const float OCCLUDER_SHRINK = 0.85f;
+
+// Software occlusion culling
+// Boxes of the big occluders (the houses) are rasterized into a small depth buffer on the cpu,
+// a max depth pyramid on top of it lets every object test its screen rectangle with a handful of reads
+class OcclusionCuller
+{
+private:
+	// Level 0 is the rasterized depth, every next level keeps the farthest depth of 2x2 texels
+	std::vector<std::vector<float>> levels;
+	std::vector<int> level_widths;
+	std::vector<int> level_heights;
+
+	glm::mat4 view_projection;
+	bool enabled = true;
+
+	bool ProjectBox(const glm::mat4 & world, const glm::vec3 & box_min, const glm::vec3 & box_max, glm::vec3 * corners) const;
+	void RasterizeTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c);
+public:
+	OcclusionCuller();
+
+	bool IsEnabled() const;
+	void Toggle();
+
+	void Begin(const glm::mat4 & view_projection);
+	bool AddOccluder(const glm::mat4 & world, const glm::vec3 & box_min, const glm::vec3 & box_max);
+	void BuildPyramid();
+	bool IsOccluded(const glm::mat4 & world, const glm::vec3 & box_min, const glm::vec3 & box_max) const;
+};
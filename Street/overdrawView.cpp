@@ -0,0 +1,110 @@
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "glsl.h"
+#include "stats.h"
+#include "overdrawView.h"
+#include "glState.h"
+#include "glStorage.h"
+
+const char * overdraw_fragshader_name = "overdraw.fsh";
+const char * overdraw_vertexshader_name = "overdraw.vsh";
+
+
+OverdrawView::~OverdrawView()
+{
+	if (this->counter_buffer)
+		gl_state.DeleteBuffers(1, &this->counter_buffer);
+	if (this->vao)
+		gl_state.DeleteVertexArrays(1, &this->vao);
+}
+
+
+bool OverdrawView::IsEnabled() const
+{
+	return this->enabled;
+}
+
+
+void OverdrawView::Toggle()
+{
+	this->enabled = !this->enabled;
+}
+
+
+/// <summary>
+/// Builds the program and the counter the first time the view is used
+/// </summary>
+void OverdrawView::Initialize()
+{
+	char * vertexshader = glsl::readFile(overdraw_vertexshader_name);
+	GLuint vsh_id = glsl::makeVertexShader(vertexshader);
+	delete[] vertexshader;
+
+	char * fragshader = glsl::readFile(overdraw_fragshader_name);
+	GLuint fsh_id = glsl::makeFragmentShader(fragshader);
+	delete[] fragshader;
+
+	this->program = glsl::makeShaderProgram(vsh_id, fsh_id);
+
+	glGenVertexArrays(1, &this->vao);
+	this->counter_buffer = CreateBuffer(sizeof(GLuint), nullptr, GL_DYNAMIC_STORAGE_BIT, GL_DYNAMIC_READ);
+}
+
+
+/// <summary>
+/// Clears the counts and binds them for the main pass
+/// </summary>
+/// <param name="counts">R32UI texture at least the size of the framebuffer</param>
+/// <param name="width">Width of the rendered part of the framebuffer</param>
+/// <param name="height">Height of the rendered part of the framebuffer</param>
+void OverdrawView::Begin(GLuint counts, int width, int height)
+{
+	if (this->program == 0)
+		this->Initialize();
+	this->width = width;
+	this->height = height;
+
+	// glClearTexImage is 4.4, uploading zeros works everywhere
+	std::vector<GLuint> zeros(width * height, 0);
+	gl_state.BindTexture(0, GL_TEXTURE_2D, counts);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED_INTEGER, GL_UNSIGNED_INT, zeros.data());
+	gl_state.BindTexture(0, GL_TEXTURE_2D, 0);
+
+	GLuint zero = 0;
+	gl_state.BindBuffer(GL_ATOMIC_COUNTER_BUFFER, this->counter_buffer);
+	glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &zero);
+	gl_state.BindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+	glBindImageTexture(OVERDRAW_IMAGE_UNIT, counts, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+	gl_state.BindBufferBase(GL_ATOMIC_COUNTER_BUFFER, OVERDRAW_COUNTER_BINDING, this->counter_buffer);
+}
+
+
+/// <summary>
+/// Draws the heat map over the bound framebuffer and adds the average fragments per pixel to the stats
+/// Reading the counter back stalls the pipeline, this is a debug view
+/// </summary>
+/// <param name="counts">The texture Begin cleared</param>
+void OverdrawView::End(GLuint counts)
+{
+	glMemoryBarrier(GL_ATOMIC_COUNTER_BARRIER_BIT);
+	glBindImageTexture(OVERDRAW_IMAGE_UNIT, counts, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32UI);
+
+	gl_state.Viewport(0, 0, this->width, this->height);
+	gl_state.Disable(GL_DEPTH_TEST);
+	gl_state.UseProgram(this->program);
+	gl_state.BindVertexArray(this->vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	gl_state.BindVertexArray(0);
+	gl_state.Enable(GL_DEPTH_TEST);
+
+	GLuint fragments = 0;
+	gl_state.BindBuffer(GL_ATOMIC_COUNTER_BUFFER, this->counter_buffer);
+	glGetBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &fragments);
+	gl_state.BindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+	stats.Add("shaded fragments", fragments);
+	stats.Add("fragments per pixel", fragments / (double)(this->width * this->height));
+}
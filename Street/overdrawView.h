@@ -0,0 +1,31 @@
+#pragma once
+#include <GL/glew.h>
+
+
+// Image unit and atomic counter binding the main fragment shader counts shaded fragments with
+const GLuint OVERDRAW_IMAGE_UNIT = 0;
+const GLuint OVERDRAW_COUNTER_BINDING = 0;
+
+// Debug view that shows how many fragments were shaded for every pixel
+// The main fragment shader adds one per fragment, afterwards the counts are drawn as a heat map over the frame
+// The R32UI count texture is a transient of the frame graph, the barrier between counting and drawing comes from there too
+class OverdrawView
+{
+private:
+	GLuint counter_buffer = 0;
+	GLuint program = 0;
+	GLuint vao = 0;
+	int width = 0;
+	int height = 0;
+	bool enabled = false;
+
+	void Initialize();
+public:
+	~OverdrawView();
+
+	bool IsEnabled() const;
+	void Toggle();
+
+	void Begin(GLuint counts, int width, int height);
+	void End(GLuint counts);
+};
@@ -0,0 +1,406 @@
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#include "matrixKernels.h"
+#include "pixelKernels.h"
+
+
+/// <summary>
+/// Rounded c * a / 255 for values up to 255 * 255
+/// </summary>
+static inline unsigned char Multiply255(unsigned int c, unsigned int a)
+{
+	const unsigned int product = c * a + 128;
+	return (unsigned char)((product + (product >> 8)) >> 8);
+}
+
+
+static void ExpandScalar(const unsigned char * source, unsigned char * rgba, size_t count, bool swap_red_blue)
+{
+	const int r = swap_red_blue ? 2 : 0;
+	for (size_t i = 0; i < count; i++, source += 3, rgba += 4)
+	{
+		rgba[0] = source[r];
+		rgba[1] = source[1];
+		rgba[2] = source[2 - r];
+		rgba[3] = 255;
+	}
+}
+
+
+/// <summary>
+/// 8 pixels per iteration, every 128 bit lane shuffles 4 pixels (12 bytes) into place
+/// Loads 4 bytes past the 8 pixels, the last few pixels go through the scalar loop
+/// </summary>
+KERNEL_TARGET_AVX2
+static void ExpandAVX2(const unsigned char * source, unsigned char * rgba, size_t count, bool swap_red_blue)
+{
+	const __m256i shuffle = swap_red_blue
+		? _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+		: _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+
+	size_t i = 0;
+	for (; i + 10 <= count; i += 8)
+	{
+		const __m128i low = _mm_loadu_si128((const __m128i *)(source + i * 3));
+		const __m128i high = _mm_loadu_si128((const __m128i *)(source + i * 3 + 12));
+		__m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+		pixels = _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha);
+		_mm256_storeu_si256((__m256i *)(rgba + i * 4), pixels);
+	}
+	ExpandScalar(source + i * 3, rgba + i * 4, count - i, swap_red_blue);
+}
+
+
+void ExpandToRGBA(const unsigned char * source, unsigned char * rgba, size_t count, bool swap_red_blue)
+{
+	// Sse2 has no byte shuffle, the sse path uses the scalar loop
+	if (GetKernelPath() == KERNEL_AVX2)
+		ExpandAVX2(source, rgba, count, swap_red_blue);
+	else
+		ExpandScalar(source, rgba, count, swap_red_blue);
+}
+
+
+static void SwapScalar(unsigned char * pixels, size_t count)
+{
+	for (size_t i = 0; i < count; i++, pixels += 4)
+	{
+		const unsigned char red = pixels[0];
+		pixels[0] = pixels[2];
+		pixels[2] = red;
+	}
+}
+
+
+/// <summary>
+/// Green and alpha stay, the bytes at 0 and 2 of every 32 bit pixel are shifted into each others place
+/// </summary>
+static void SwapSSE(unsigned char * pixels, size_t count)
+{
+	const __m128i red_blue = _mm_set1_epi32(0x00FF00FF);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128i x = _mm_loadu_si128((const __m128i *)(pixels + i * 4));
+		const __m128i rb = _mm_and_si128(x, red_blue);
+		const __m128i ga = _mm_andnot_si128(red_blue, x);
+		const __m128i swapped = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+		_mm_storeu_si128((__m128i *)(pixels + i * 4), _mm_or_si128(ga, swapped));
+	}
+	SwapScalar(pixels + i * 4, count - i);
+}
+
+
+KERNEL_TARGET_AVX2
+static void SwapAVX2(unsigned char * pixels, size_t count)
+{
+	const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256i x = _mm256_loadu_si256((const __m256i *)(pixels + i * 4));
+		_mm256_storeu_si256((__m256i *)(pixels + i * 4), _mm256_shuffle_epi8(x, shuffle));
+	}
+	SwapScalar(pixels + i * 4, count - i);
+}
+
+
+void SwapRedBlue(unsigned char * pixels, size_t count)
+{
+	switch (GetKernelPath())
+	{
+	case KERNEL_AVX2:
+		SwapAVX2(pixels, count);
+		break;
+	case KERNEL_SSE:
+		SwapSSE(pixels, count);
+		break;
+	default:
+		SwapScalar(pixels, count);
+		break;
+	}
+}
+
+
+static void PremultiplyScalar(unsigned char * rgba, size_t count)
+{
+	for (size_t i = 0; i < count; i++, rgba += 4)
+	{
+		const unsigned int alpha = rgba[3];
+		rgba[0] = Multiply255(rgba[0], alpha);
+		rgba[1] = Multiply255(rgba[1], alpha);
+		rgba[2] = Multiply255(rgba[2], alpha);
+	}
+}
+
+
+/// <summary>
+/// Two pixels per 16 bit register, the alpha of a pixel is broadcast over its channels
+/// and the alpha channel itself is multiplied by 255 so it comes out unchanged
+/// </summary>
+static inline __m128i MultiplyAlphaSSE(__m128i channels, __m128i keep_alpha, __m128i opaque)
+{
+	__m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(channels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	alpha = _mm_or_si128(_mm_and_si128(alpha, keep_alpha), opaque);
+	__m128i product = _mm_add_epi16(_mm_mullo_epi16(channels, alpha), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+}
+
+
+static void PremultiplySSE(unsigned char * rgba, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i keep_alpha = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+	const __m128i opaque = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128i x = _mm_loadu_si128((const __m128i *)(rgba + i * 4));
+		const __m128i low = MultiplyAlphaSSE(_mm_unpacklo_epi8(x, zero), keep_alpha, opaque);
+		const __m128i high = MultiplyAlphaSSE(_mm_unpackhi_epi8(x, zero), keep_alpha, opaque);
+		_mm_storeu_si128((__m128i *)(rgba + i * 4), _mm_packus_epi16(low, high));
+	}
+	PremultiplyScalar(rgba + i * 4, count - i);
+}
+
+
+KERNEL_TARGET_AVX2
+static inline __m256i MultiplyAlphaAVX2(__m256i channels, __m256i keep_alpha, __m256i opaque)
+{
+	__m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(channels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	alpha = _mm256_or_si256(_mm256_and_si256(alpha, keep_alpha), opaque);
+	__m256i product = _mm256_add_epi16(_mm256_mullo_epi16(channels, alpha), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(product, _mm256_srli_epi16(product, 8)), 8);
+}
+
+
+/// <summary>
+/// Same as the sse version on 8 pixels, unpack and pack both work per 128 bit lane so the order is kept
+/// </summary>
+KERNEL_TARGET_AVX2
+static void PremultiplyAVX2(unsigned char * rgba, size_t count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i keep_alpha = _mm256_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0);
+	const __m256i opaque = _mm256_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256i x = _mm256_loadu_si256((const __m256i *)(rgba + i * 4));
+		const __m256i low = MultiplyAlphaAVX2(_mm256_unpacklo_epi8(x, zero), keep_alpha, opaque);
+		const __m256i high = MultiplyAlphaAVX2(_mm256_unpackhi_epi8(x, zero), keep_alpha, opaque);
+		_mm256_storeu_si256((__m256i *)(rgba + i * 4), _mm256_packus_epi16(low, high));
+	}
+	PremultiplyScalar(rgba + i * 4, count - i);
+}
+
+
+void PremultiplyAlpha(unsigned char * rgba, size_t count)
+{
+	switch (GetKernelPath())
+	{
+	case KERNEL_AVX2:
+		PremultiplyAVX2(rgba, count);
+		break;
+	case KERNEL_SSE:
+		PremultiplySSE(rgba, count);
+		break;
+	default:
+		PremultiplyScalar(rgba, count);
+		break;
+	}
+}
+
+
+static void SwapRowsScalar(unsigned char * a, unsigned char * b, size_t size)
+{
+	unsigned char temp[256];
+	while (size > 0)
+	{
+		const size_t block = size < sizeof(temp) ? size : sizeof(temp);
+		memcpy(temp, a, block);
+		memcpy(a, b, block);
+		memcpy(b, temp, block);
+		a += block;
+		b += block;
+		size -= block;
+	}
+}
+
+
+static void SwapRowsSSE(unsigned char * a, unsigned char * b, size_t size)
+{
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		const __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+		const __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+		_mm_storeu_si128((__m128i *)(a + i), y);
+		_mm_storeu_si128((__m128i *)(b + i), x);
+	}
+	SwapRowsScalar(a + i, b + i, size - i);
+}
+
+
+KERNEL_TARGET_AVX2
+static void SwapRowsAVX2(unsigned char * a, unsigned char * b, size_t size)
+{
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32)
+	{
+		const __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+		const __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+		_mm256_storeu_si256((__m256i *)(a + i), y);
+		_mm256_storeu_si256((__m256i *)(b + i), x);
+	}
+	SwapRowsScalar(a + i, b + i, size - i);
+}
+
+
+void FlipRows(unsigned char * pixels, size_t row_bytes, size_t rows)
+{
+	if (rows < 2)
+		return;
+
+	const KernelPath path = GetKernelPath();
+	for (size_t top = 0, bottom = rows - 1; top < bottom; top++, bottom--)
+	{
+		unsigned char * a = pixels + top * row_bytes;
+		unsigned char * b = pixels + bottom * row_bytes;
+		if (path == KERNEL_AVX2)
+			SwapRowsAVX2(a, b, row_bytes);
+		else if (path == KERNEL_SSE)
+			SwapRowsSSE(a, b, row_bytes);
+		else
+			SwapRowsScalar(a, b, row_bytes);
+	}
+}
+
+
+static bool UnfilterScalar(int filter, unsigned char * row, const unsigned char * previous, size_t size, size_t stride)
+{
+	// Above the first row everything is 0, up and paeth become sub and average only looks left
+	if (previous == nullptr && filter >= 2)
+	{
+		if (filter == 2)
+			return true;
+		if (filter == 3)
+		{
+			for (size_t i = stride; i < size; i++)
+				row[i] += row[i - stride] >> 1;
+			return true;
+		}
+		filter = 1;
+	}
+
+	switch (filter)
+	{
+	case 0:
+		break;
+	case 1:
+		for (size_t i = stride; i < size; i++)
+			row[i] += row[i - stride];
+		break;
+	case 2:
+		for (size_t i = 0; i < size; i++)
+			row[i] += previous[i];
+		break;
+	case 3:
+		for (size_t i = 0; i < stride; i++)
+			row[i] += previous[i] >> 1;
+		for (size_t i = stride; i < size; i++)
+			row[i] += (unsigned char)(((unsigned int)row[i - stride] + previous[i]) >> 1);
+		break;
+	case 4:
+		for (size_t i = 0; i < stride; i++)
+			row[i] += previous[i];
+		for (size_t i = stride; i < size; i++)
+		{
+			const int a = row[i - stride], b = previous[i], c = previous[i - stride];
+			const int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+			row[i] += (unsigned char)(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+		}
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+
+/// <summary>
+/// Absolute value of 16 bit lanes
+/// </summary>
+static inline __m128i Abs16(__m128i x)
+{
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+
+static inline __m128i Load4(const unsigned char * p)
+{
+	int value;
+	memcpy(&value, p, sizeof(value));
+	return _mm_unpacklo_epi8(_mm_cvtsi32_si128(value), _mm_setzero_si128());
+}
+
+
+static inline void Store4(unsigned char * p, __m128i x)
+{
+	const int value = _mm_cvtsi128_si32(_mm_packus_epi16(x, x));
+	memcpy(p, &value, sizeof(value));
+}
+
+
+/// <summary>
+/// Average and paeth of rgba8 rows, one pixel per step in 16 bit lanes
+/// Every pixel depends on the one left of it so only the 4 channels run in parallel
+/// </summary>
+static bool UnfilterSSE(int filter, unsigned char * row, const unsigned char * previous, size_t size)
+{
+	const __m128i mask = _mm_set1_epi16(255);
+	__m128i a = _mm_setzero_si128();
+	__m128i c = _mm_setzero_si128();
+	if (filter == 3)
+	{
+		for (size_t i = 0; i < size; i += 4)
+		{
+			const __m128i b = Load4(previous + i);
+			a = _mm_and_si128(_mm_add_epi16(Load4(row + i), _mm_srli_epi16(_mm_add_epi16(a, b), 1)), mask);
+			Store4(row + i, a);
+		}
+		return true;
+	}
+
+	// Ties go to a, then b, then c
+	for (size_t i = 0; i < size; i += 4)
+	{
+		const __m128i b = Load4(previous + i);
+		const __m128i pa_signed = _mm_sub_epi16(b, c);
+		const __m128i pb_signed = _mm_sub_epi16(a, c);
+		const __m128i pa = Abs16(pa_signed);
+		const __m128i pb = Abs16(pb_signed);
+		const __m128i pc = Abs16(_mm_add_epi16(pa_signed, pb_signed));
+		const __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		const __m128i use_a = _mm_cmpeq_epi16(smallest, pa);
+		const __m128i use_b = _mm_andnot_si128(use_a, _mm_cmpeq_epi16(smallest, pb));
+		const __m128i use_c = _mm_andnot_si128(_mm_or_si128(use_a, use_b), _mm_set1_epi16(-1));
+		const __m128i nearest = _mm_or_si128(_mm_or_si128(_mm_and_si128(use_a, a), _mm_and_si128(use_b, b)), _mm_and_si128(use_c, c));
+		a = _mm_and_si128(_mm_add_epi16(Load4(row + i), nearest), mask);
+		Store4(row + i, a);
+		c = b;
+	}
+	return true;
+}
+
+
+bool UnfilterPNGRow(int filter, unsigned char * row, const unsigned char * previous, size_t size, size_t stride)
+{
+	if (stride == 4 && previous != nullptr && (filter == 3 || filter == 4) && GetKernelPath() != KERNEL_SCALAR)
+		return UnfilterSSE(filter, row, previous, size);
+	return UnfilterScalar(filter, row, previous, size, stride);
+}
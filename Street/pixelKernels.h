@@ -0,0 +1,21 @@
+#pragma once
+#include <stddef.h>
+
+
+// Pixel conversions of the image decoders, they run on the path chosen in matrixKernels (GetKernelPath)
+
+// Widens count 3 byte pixels to 4 bytes with an opaque alpha, swap_red_blue turns bgr into rgba
+void ExpandToRGBA(const unsigned char * source, unsigned char * rgba, size_t count, bool swap_red_blue);
+
+// Swaps the first and third byte of count 4 byte pixels, bgra <-> rgba
+void SwapRedBlue(unsigned char * pixels, size_t count);
+
+// Multiplies the color of count rgba pixels by their alpha
+void PremultiplyAlpha(unsigned char * rgba, size_t count);
+
+// Mirrors the rows, the first row becomes the last
+void FlipRows(unsigned char * pixels, size_t row_bytes, size_t rows);
+
+// Undoes the png filter of one row in place, previous is the unfiltered row above (nullptr for the first row)
+// stride is the amount of bytes per pixel (at least 1), returns whether the filter type is valid
+bool UnfilterPNGRow(int filter, unsigned char * row, const unsigned char * previous, size_t size, size_t stride);
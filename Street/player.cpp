@@ -52,11 +52,18 @@ Player::Player(glm::vec3 position, glm::vec3 playerHeight, float zAngle, float y
 }
 
 
+/// <summary>
+/// Limits where the player can walk
+/// </summary>
+/// <param name="minX"></param>
+/// <param name="maxX"></param>
+/// <param name="minZ"></param>
+/// <param name="maxZ"></param>
 void Player::SetMaxBounds(float minX, float maxX, float minZ, float maxZ)
 {
-	this->maxX = minX;
+	this->minX = minX;
 	this->maxX = maxX;
-	this->maxZ = minZ;
+	this->minZ = minZ;
 	this->maxZ = maxZ;
 }
 
@@ -108,10 +115,10 @@ void Player::Move(MovementDirections direction, float deltaTime)
 	// Restrict player in fields
 	if (this->position.x > maxX)
 		this->position.x = maxX;
+	if (this->position.x < minX)
+		this->position.x = minX;
 	if (this->position.z > maxZ)
 		this->position.z = maxZ;
-	if (this->position.z < minX)
-		this->position.z = minX;
 	if (this->position.z < minZ)
 		this->position.z = minZ;
 
@@ -0,0 +1,1285 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "glsl.h"
+#include "texture.hpp"
+#include "matrixKernels.h"
+#include "scene.h"
+#include "stats.h"
+#include "glState.h"
+#include "glStorage.h"
+
+const char * fragshader_name = "fragmentshader.fsh";
+const char * vertexshader_name = "vertexshader.vsh";
+const char * depth_fragshader_name = "depth.fsh";
+const char * depth_vertexshader_name = "depth.vsh";
+
+// Amount of objects a single job updates and culls
+const size_t OBJECTS_PER_JOB = 1024;
+
+// Texture unit the lightmap pages are bound to
+const GLint LIGHTMAP_TEXTURE_UNIT = 1;
+
+// Texture unit of the shadow atlas
+const GLint SHADOW_TEXTURE_UNIT = 2;
+
+// Uniform block binding of ObjectBlock and the worst case offset alignment of a block
+const GLuint OBJECT_BLOCK_BINDING = 0;
+const GLsizeiptr OBJECT_BLOCK_STRIDE = 256;
+
+
+/// <summary>
+/// Extracts the (normalized) frustum planes from the rows of the clip matrix
+/// </summary>
+/// <param name="clip">projection * view</param>
+/// <param name="planes">Receives left, right, bottom, top, near and far</param>
+static void ExtractFrustum(const glm::mat4 & clip, glm::vec4 * planes)
+{
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[3] + rows[2];
+	planes[5] = rows[3] - rows[2];
+	for (int i = 0; i < 6; i++)
+		planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+}
+
+
+/// <summary>
+/// Whether a sphere is (partly) inside a frustum
+/// </summary>
+/// <param name="planes">The six frustum planes</param>
+/// <param name="center"></param>
+/// <param name="radius"></param>
+/// <returns></returns>
+static bool SphereInFrustum(const glm::vec4 * planes, const glm::vec3 & center, float radius)
+{
+	for (int p = 0; p < 6; p++)
+		if (glm::dot(glm::vec3(planes[p]), center) + planes[p].w < -radius)
+			return false;
+	return true;
+}
+
+
+/// <summary>
+/// Inititalizes the shader program shared by all objects
+/// </summary>
+void Scene::InitShaders()
+{
+	char * vertexshader = glsl::readFile(vertexshader_name);
+	GLuint vsh_id = glsl::makeVertexShader(vertexshader);
+	delete[] vertexshader;
+
+	char * fragshader = glsl::readFile(fragshader_name);
+	GLuint fsh_id = glsl::makeFragmentShader(fragshader);
+	delete[] fragshader;
+
+	this->shader_id = glsl::makeShaderProgram(vsh_id, fsh_id);
+
+	gl_state.UseProgram(this->shader_id);
+
+	// Save uniform variables
+	this->uniforms.proj = glGetUniformLocation(this->shader_id, "projection");
+	this->uniforms.light_pos = glGetUniformLocation(this->shader_id, "light_pos");
+	this->uniforms.material_ambient = glGetUniformLocation(this->shader_id, "mat_ambient");
+	this->uniforms.material_diffuse = glGetUniformLocation(this->shader_id, "mat_diffuse");
+	this->uniforms.material_specular = glGetUniformLocation(this->shader_id, "mat_specular");
+	this->uniforms.material_power = glGetUniformLocation(this->shader_id, "mat_power");
+	this->uniforms.has_texture = glGetUniformLocation(this->shader_id, "has_texture");
+	this->uniforms.cluster_count = glGetUniformLocation(this->shader_id, "cluster_count");
+	this->uniforms.cluster_tile_size = glGetUniformLocation(this->shader_id, "cluster_tile_size");
+	this->uniforms.cluster_depth = glGetUniformLocation(this->shader_id, "cluster_depth");
+	this->uniforms.view_inverse = glGetUniformLocation(this->shader_id, "view_inverse");
+	this->uniforms.shadow_light_count = glGetUniformLocation(this->shader_id, "shadow_light_count");
+	this->uniforms.overdraw_enabled = glGetUniformLocation(this->shader_id, "overdraw_enabled");
+
+	gl_state.Uniform1i(glGetUniformLocation(this->shader_id, "texsampler"), 0);
+	gl_state.Uniform1i(glGetUniformLocation(this->shader_id, "lightmap"), LIGHTMAP_TEXTURE_UNIT);
+	gl_state.Uniform1i(glGetUniformLocation(this->shader_id, "shadow_atlas"), SHADOW_TEXTURE_UNIT);
+
+	// Position only program of the depth pre-pass
+	char * depth_vertexshader = glsl::readFile(depth_vertexshader_name);
+	GLuint depth_vsh_id = glsl::makeVertexShader(depth_vertexshader);
+	delete[] depth_vertexshader;
+
+	char * depth_fragshader = glsl::readFile(depth_fragshader_name);
+	GLuint depth_fsh_id = glsl::makeFragmentShader(depth_fragshader);
+	delete[] depth_fragshader;
+
+	this->depth_program = glsl::makeShaderProgram(depth_vsh_id, depth_fsh_id);
+	this->depth_projection = glGetUniformLocation(this->depth_program, "projection");
+}
+
+
+/// <summary>
+/// Headless scenes never touch gl, meshes keep their cpu side data instead of being uploaded
+/// Has to be set before anything is loaded
+/// </summary>
+/// <param name="headless"></param>
+void Scene::SetHeadless(bool headless)
+{
+	this->headless = headless;
+}
+
+
+/// <summary>
+/// Initializes the scene, has to be called after glew is initialized
+/// </summary>
+void Scene::Initialize()
+{
+	if (this->headless)
+		return;
+
+	this->InitShaders();
+	this->object_stream.Initialize(GL_UNIFORM_BUFFER, 128 * OBJECT_BLOCK_STRIDE);
+	this->light_stream.Initialize(GL_SHADER_STORAGE_BUFFER, 64 * 1024);
+	this->shadows.Initialize();
+}
+
+
+/// <summary>
+/// Loads a mesh (and its texture) once, objects using the same obj file share it
+/// </summary>
+/// <param name="name">Name of the mesh</param>
+/// <param name="object_path">The path to the obj file</param>
+/// <param name="texture_path">The path to the texture, nullptr for the maps of the materials</param>
+/// <returns>The mesh handle</returns>
+int Scene::LoadMesh(const char * name, const char * object_path, const char * texture_path)
+{
+	std::string key = std::string(object_path) + "|" + (texture_path ? texture_path : "");
+	for (size_t i = 0; i < this->mesh_paths.size(); i++)
+		if (this->mesh_paths[i] == key)
+			return (int)i;
+
+	ModelRenderer mesh(name);
+	mesh.ParseObject(object_path);
+	if (!this->headless)
+	{
+		mesh.SetTexture(texture_path);
+		mesh.Initialize(this->shader_id);
+	}
+
+	this->meshes.push_back(mesh);
+	this->mesh_paths.push_back(key);
+	return (int)this->meshes.size() - 1;
+}
+
+
+/// <summary>
+/// Adds a mesh that was prepared by the caller
+/// </summary>
+/// <param name="mesh"></param>
+/// <returns>The mesh handle</returns>
+int Scene::AddMesh(const ModelRenderer & mesh)
+{
+	this->meshes.push_back(mesh);
+	this->mesh_paths.push_back(mesh.model_name);
+	return (int)this->meshes.size() - 1;
+}
+
+
+/// <summary>
+/// Uploads a mesh that was parsed elsewhere (on a loader thread) and adds it, released slots are reused
+/// </summary>
+/// <param name="mesh">Parsed mesh, its texture read but not uploaded</param>
+/// <param name="key">Key LoadMesh finds it by</param>
+/// <returns>The mesh handle</returns>
+int Scene::UploadMesh(ModelRenderer & mesh, const std::string & key)
+{
+	if (!this->headless)
+		mesh.Initialize(this->shader_id);
+
+	if (!this->free_meshes.empty())
+	{
+		int slot = this->free_meshes.back();
+		this->free_meshes.pop_back();
+		this->meshes[slot] = mesh;
+		this->mesh_paths[slot] = key;
+		return slot;
+	}
+
+	this->meshes.push_back(mesh);
+	this->mesh_paths.push_back(key);
+	return (int)this->meshes.size() - 1;
+}
+
+
+/// <summary>
+/// Deletes the gpu resources of a mesh, no object may use it anymore
+/// </summary>
+/// <param name="mesh"></param>
+void Scene::ReleaseMesh(int mesh)
+{
+	this->meshes[mesh].Release();
+	this->mesh_paths[mesh].clear();
+	this->free_meshes.push_back(mesh);
+}
+
+
+/// <summary>
+/// Adds a material objects can refer to
+/// </summary>
+/// <param name="material"></param>
+/// <returns>The material index</returns>
+int Scene::AddMaterial(Material material)
+{
+	this->materials.push_back(material);
+	return (int)this->materials.size() - 1;
+}
+
+
+/// <summary>
+/// Adds the material table of a scene file in one go
+/// </summary>
+/// <param name="file"></param>
+/// <returns>Index of the first material, material i of the file is this plus i</returns>
+int Scene::AddMaterials(const SceneFile & file)
+{
+	int first = (int)this->materials.size();
+	this->materials.reserve(first + file.MaterialCount());
+	for (size_t i = 0; i < file.MaterialCount(); i++)
+		this->materials.push_back(file.GetMaterial(i));
+	return first;
+}
+
+
+/// <summary>
+/// Adds an object to the scene
+/// </summary>
+/// <param name="mesh">Mesh handle returned by LoadMesh</param>
+/// <param name="material">Material index returned by AddMaterial</param>
+/// <param name="transform">Position, rotation and scale, a parent has to be added before its children</param>
+/// <param name="object_flags">ObjectFlags</param>
+/// <returns>The object index</returns>
+int Scene::AddObject(int mesh, int material, Transform transform, unsigned char object_flags)
+{
+	// Root objects can take the slot of a removed object, children have to stay behind their parent
+	if (transform.parent < 0 && !this->free_objects.empty())
+	{
+		int object = this->free_objects.back();
+		this->free_objects.pop_back();
+
+		this->transforms[object] = transform;
+		this->mesh_ids[object] = mesh;
+		this->material_ids[object] = material;
+		this->flags[object] = object_flags;
+		this->lightmap_pages[object] = -1;
+		this->lightmap_st[object] = glm::vec4(0.0f);
+		this->content_changed = true;
+		if (!(object_flags & OBJECT_ANIMATED))
+			this->shadows.InvalidateStatic();
+		return object;
+	}
+
+	int object = (int)this->transforms.size();
+
+	this->transforms.push_back(transform);
+	this->mvs.push_back(glm::mat4());
+	this->normals.push_back(glm::mat4());
+	this->mesh_ids.push_back(mesh);
+	this->material_ids.push_back(material);
+	this->flags.push_back(object_flags);
+	this->lightmap_pages.push_back(-1);
+	this->lightmap_st.push_back(glm::vec4(0.0f));
+
+	if (transform.parent >= 0)
+		this->children.push_back(object);
+
+	this->content_changed = true;
+	if (!(object_flags & OBJECT_ANIMATED))
+		this->shadows.InvalidateStatic();
+	return object;
+}
+
+
+/// <summary>
+/// Removes an object, it is hidden until AddObject reuses its slot
+/// Children of the object are not removed with it
+/// </summary>
+/// <param name="object"></param>
+void Scene::RemoveObject(int object)
+{
+	if (this->flags[object] & OBJECT_ANIMATED)
+	{
+		for (size_t i = 0; i < this->animated.size(); i++)
+		{
+			if (this->animated[i] == object)
+			{
+				this->animated.erase(this->animated.begin() + i);
+				this->animations.erase(this->animations.begin() + i);
+				break;
+			}
+		}
+		this->animator.Stop(object);
+	}
+	else
+	{
+		// The cached atlas still holds its shadow
+		this->shadows.InvalidateStatic();
+	}
+
+	this->flags[object] = OBJECT_HIDDEN;
+	this->lightmap_pages[object] = -1;
+	if (this->transforms[object].parent < 0)
+		this->free_objects.push_back(object);
+	this->content_changed = true;
+}
+
+
+/// <summary>
+/// Enables the use of looped transformations for an object
+/// </summary>
+/// <param name="object"></param>
+/// <param name="func">The transformation that executes every loop</param>
+void Scene::SetAnimation(int object, transFunc func)
+{
+	if (!(this->flags[object] & OBJECT_ANIMATED))
+	{
+		this->animated.push_back(object);
+		this->animations.push_back(func);
+		this->flags[object] |= OBJECT_ANIMATED;
+		return;
+	}
+
+	for (size_t i = 0; i < this->animated.size(); i++)
+		if (this->animated[i] == object)
+			this->animations[i] = func;
+}
+
+
+/// <summary>
+/// Plays a keyframed clip on an object, channels without keys keep the values the object has now
+/// </summary>
+/// <param name="object"></param>
+/// <param name="clip">Index of a clip of the animator</param>
+/// <param name="start_time">Seconds into the clip</param>
+/// <param name="speed">1 for the speed the clip was made for</param>
+void Scene::PlayClip(int object, int clip, float start_time, float speed)
+{
+	this->animator.Play(object, clip, this->transforms[object], start_time, speed);
+	this->flags[object] |= OBJECT_ANIMATED;
+}
+
+
+/// <summary>
+/// Blends an object from the clip it plays to another one
+/// </summary>
+/// <param name="object">An object that plays a clip</param>
+/// <param name="clip"></param>
+/// <param name="seconds">Length of the fade</param>
+void Scene::CrossFade(int object, int clip, float seconds)
+{
+	this->animator.CrossFade(object, clip, seconds);
+}
+
+
+/// <summary>
+/// Moves the clips forward in the next update
+/// </summary>
+/// <param name="seconds"></param>
+void Scene::AdvanceAnimations(float seconds)
+{
+	this->animation_seconds += seconds;
+}
+
+
+Animator & Scene::GetAnimator()
+{
+	return this->animator;
+}
+
+
+void Scene::SetLightSource(LightSource light_source)
+{
+	this->light_source = light_source;
+	this->content_changed = true;
+}
+
+
+/// <summary>
+/// Adds a point light, only the clusters it reaches will evaluate it
+/// </summary>
+/// <param name="light">World space position, color and range</param>
+/// <returns>The light index</returns>
+int Scene::AddLight(LightSource light)
+{
+	this->lights.push_back(light);
+	this->content_changed = true;
+	return (int)this->lights.size() - 1;
+}
+
+
+/// <summary>
+/// Removes all point lights
+/// </summary>
+void Scene::ClearLights()
+{
+	this->lights.clear();
+	this->content_changed = true;
+}
+
+
+/// <summary>
+/// Sets the projection the light clusters are built for
+/// </summary>
+/// <param name="fov">Vertical field of view in radians</param>
+/// <param name="aspect"></param>
+/// <param name="near_plane"></param>
+/// <param name="far_plane"></param>
+/// <param name="width">Width of the framebuffer</param>
+/// <param name="height">Height of the framebuffer</param>
+void Scene::SetProjection(float fov, float aspect, float near_plane, float far_plane, int width, int height)
+{
+	this->clusters.SetProjection(fov, aspect, near_plane, far_plane, width, height);
+	this->width = width;
+	this->height = height;
+}
+
+
+/// <summary>
+/// Loads the lightmaps written by the baker, objects without one keep the dynamic lighting
+/// </summary>
+/// <param name="directory">Directory with lightmaps.txt and the pages</param>
+/// <param name="jobs">Decodes the pages</param>
+/// <returns>Whether lightmaps were found</returns>
+bool Scene::LoadLightmaps(const char * directory, JobSystem & jobs)
+{
+	FILE * file = fopen((std::string(directory) + "/lightmaps.txt").c_str(), "r");
+	if (file == NULL)
+		return false;
+
+	unsigned int pages = 0;
+	if (fscanf(file, "pages %u\n", &pages) != 1)
+	{
+		fclose(file);
+		return false;
+	}
+
+	// The pages are decoded in parallel, only the upload has to happen on this thread
+	std::vector<std::string> paths;
+	std::vector<Image> images;
+	for (unsigned int p = 0; p < pages; p++)
+		paths.push_back(std::string(directory) + "/lightmap" + std::to_string(p) + ".bmp");
+	ReadImages(paths, images, 0, jobs);
+
+	for (unsigned int p = 0; p < pages; p++)
+	{
+		GLuint texture = createTexture(images[p]);
+		SetTextureSampling(texture, GL_LINEAR, GL_CLAMP_TO_EDGE);
+		this->lightmap_textures.push_back(texture);
+	}
+
+	// Skip the comment line
+	char line[256];
+	fgets(line, sizeof(line), file);
+
+	int object, page, baked = 0;
+	glm::vec4 st;
+	while (fscanf(file, "%d %d %f %f %f %f", &object, &page, &st.x, &st.y, &st.z, &st.w) == 6)
+	{
+		if (object < 0 || object >= (int)this->Size() || page < 0 || page >= (int)pages)
+			continue;
+		this->lightmap_pages[object] = page;
+		this->lightmap_st[object] = st;
+		baked++;
+	}
+	fclose(file);
+	this->content_changed = true;
+
+	printf("Lightmaps: %d objects baked in %u pages\n", baked, pages);
+	return true;
+}
+
+
+Transform & Scene::GetTransform(int object)
+{
+	return this->transforms[object];
+}
+
+
+int Scene::GetMeshId(int object) const
+{
+	return this->mesh_ids[object];
+}
+
+
+const ModelRenderer & Scene::GetMesh(int mesh) const
+{
+	return this->meshes[mesh];
+}
+
+
+/// <summary>
+/// Static objects never move and can have their lighting baked
+/// </summary>
+/// <param name="object"></param>
+/// <returns></returns>
+bool Scene::IsStatic(int object) const
+{
+	return !(this->flags[object] & (OBJECT_ANIMATED | OBJECT_HIDDEN));
+}
+
+
+const LightSource & Scene::GetLightSource() const
+{
+	return this->light_source;
+}
+
+
+const std::vector<LightSource> & Scene::GetLights() const
+{
+	return this->lights;
+}
+
+
+size_t Scene::Size() const
+{
+	return this->transforms.size();
+}
+
+
+/// <summary>
+/// Bytes every object takes in the scene arrays
+/// </summary>
+size_t Scene::BytesPerObject() const
+{
+	return sizeof(Transform) + 2 * sizeof(glm::mat4) + 3 * sizeof(int) + sizeof(glm::vec4) + sizeof(unsigned char);
+}
+
+
+/// <summary>
+/// The objects that passed culling during the last Update, in draw order
+/// </summary>
+/// <returns></returns>
+const std::vector<int> & Scene::DrawList() const
+{
+	return this->draw_list;
+}
+
+
+/// <summary>
+/// Visible objects that moved in the last update
+/// </summary>
+const std::vector<int> & Scene::MovedList() const
+{
+	return this->moved_list;
+}
+
+
+/// <summary>
+/// Amount of objects with an animation, they change every update
+/// </summary>
+size_t Scene::AnimatedCount() const
+{
+	return this->animated.size() + this->animator.Count();
+}
+
+
+/// <summary>
+/// Returns whether objects, lights or lightmaps were added or removed since the last call
+/// </summary>
+bool Scene::TakeContentChanged()
+{
+	const bool changed = this->content_changed;
+	this->content_changed = false;
+	return changed;
+}
+
+
+/// <summary>
+/// Adds the screen rectangle of a sphere to a region
+/// </summary>
+/// <returns>False when the sphere reaches behind the camera, the rectangle is unbounded then</returns>
+static bool AddSphereToRegion(const glm::mat4 & view_projection, const glm::vec3 & center, float radius, glm::vec2 & low, glm::vec2 & high)
+{
+	for (int corner = 0; corner < 8; corner++)
+	{
+		const glm::vec3 offset = glm::vec3(corner & 1 ? radius : -radius, corner & 2 ? radius : -radius, corner & 4 ? radius : -radius);
+		const glm::vec4 clip = view_projection * glm::vec4(center + offset, 1.0f);
+		if (clip.w <= 0.0f)
+			return false;
+		const glm::vec2 ndc = glm::vec2(clip) / clip.w;
+		low = glm::min(low, ndc);
+		high = glm::max(high, ndc);
+	}
+	return true;
+}
+
+
+/// <summary>
+/// Screen region the moved objects and the shadows they throw on the ground cover
+/// The shadows are the spheres of the objects projected from every shadow casting light onto y = 0
+/// </summary>
+/// <param name="view_projection">projection * view</param>
+/// <param name="width">Width of the framebuffer</param>
+/// <param name="height">Height of the framebuffer</param>
+/// <param name="region">Receives the pixels x0, y0, x1, y1 (exclusive)</param>
+/// <returns>Whether anything moved on screen</returns>
+bool Scene::MovedRegion(const glm::mat4 & view_projection, int width, int height, glm::ivec4 & region) const
+{
+	if (this->moved_list.empty())
+		return false;
+
+	// The main light and the point lights that have a place in the shadow atlas
+	const int casting_lights = std::max(1, std::min((int)this->lights.size() + 1, this->shadows.LightCount()));
+
+	glm::vec2 low = glm::vec2(1.0f);
+	glm::vec2 high = glm::vec2(-1.0f);
+	bool bounded = true;
+	for (int i : this->moved_list)
+	{
+		glm::vec3 center;
+		float radius;
+		this->WorldBounds(i, center, radius);
+		bounded = bounded && AddSphereToRegion(view_projection, center, radius, low, high);
+
+		// The shadow lies between the object and where it reaches the ground, the rectangle of both covers it
+		for (int l = 0; l < casting_lights; l++)
+		{
+			const glm::vec3 & light = l == 0 ? this->light_source.position : this->lights[l - 1].position;
+
+			// Lights below the object throw its shadow up, away from the street
+			if (light.y <= center.y + radius)
+				continue;
+
+			// Shadows stretched this far cover most of the street anyway
+			const float stretch = light.y / (light.y - center.y);
+			if (stretch > 20.0f)
+			{
+				bounded = false;
+				break;
+			}
+			const glm::vec3 shadow = light + (center - light) * stretch;
+			bounded = bounded && AddSphereToRegion(view_projection, glm::vec3(shadow.x, 0.0f, shadow.z), radius * stretch, low, high);
+		}
+	}
+
+	if (!bounded)
+	{
+		low = glm::vec2(-1.0f);
+		high = glm::vec2(1.0f);
+	}
+	low = glm::clamp(low, glm::vec2(-1.0f), glm::vec2(1.0f));
+	high = glm::clamp(high, glm::vec2(-1.0f), glm::vec2(1.0f));
+	if (low.x >= high.x || low.y >= high.y)
+		return false;
+
+	// One pixel extra for the rounding and the filtering of the edges
+	region.x = std::max(0, (int)floorf((low.x * 0.5f + 0.5f) * width) - 1);
+	region.y = std::max(0, (int)floorf((low.y * 0.5f + 0.5f) * height) - 1);
+	region.z = std::min(width, (int)ceilf((high.x * 0.5f + 0.5f) * width) + 1);
+	region.w = std::min(height, (int)ceilf((high.y * 0.5f + 0.5f) * height) + 1);
+	return true;
+}
+
+
+/// <summary>
+/// Runs the transformations of all animated objects and poses the objects that play a clip
+/// </summary>
+/// <param name="jobs"></param>
+void Scene::Animate(JobSystem & jobs)
+{
+	jobs.ParallelFor(this->animated.size(), 64, [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			this->animations[i](this->transforms[this->animated[i]]);
+	});
+
+	this->animator.Update(this->animation_seconds, this->transforms, jobs);
+	this->animation_seconds = 0.0f;
+}
+
+
+/// <summary>
+/// Rebuilds the world matrices that changed
+/// Roots don't depend on anything and are updated in parallel, the children follow in a single ordered pass
+/// (parents are always stored in front of their children)
+/// </summary>
+/// <param name="jobs"></param>
+void Scene::UpdateHierarchy(JobSystem & jobs)
+{
+	jobs.ParallelFor(this->transforms.size(), OBJECTS_PER_JOB, [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			if (this->transforms[i].parent < 0)
+				this->transforms[i].Update(nullptr);
+	});
+
+	for (int child : this->children)
+	{
+		Transform & transform = this->transforms[child];
+		transform.Update(&this->transforms[transform.parent]);
+	}
+}
+
+
+/// <summary>
+/// Recalculates the mv and normal matrices, static objects keep theirs as long as the view doesn't change
+/// </summary>
+/// <param name="begin">First object</param>
+/// <param name="end">One past the last object</param>
+/// <param name="view"></param>
+void Scene::UpdateViews(size_t begin, size_t end, const glm::mat4 & view)
+{
+	if (this->view_changed)
+	{
+		BatchModelView(view, &this->transforms[begin].GetWorldMatrix(), sizeof(Transform), &this->mvs[begin], &this->normals[begin], end - begin);
+		return;
+	}
+
+	for (size_t i = begin; i < end; i++)
+		if (this->transforms[i].HasChanged())
+			BatchModelView(view, &this->transforms[i].GetWorldMatrix(), sizeof(Transform), &this->mvs[i], &this->normals[i], 1);
+}
+
+
+/// <summary>
+/// Marks every object whose bounding sphere is (partly) inside the view frustum as visible
+/// </summary>
+/// <param name="begin">First object</param>
+/// <param name="end">One past the last object</param>
+/// <param name="planes">The six frustum planes</param>
+/// <param name="visible">Receives the visible objects</param>
+void Scene::Cull(size_t begin, size_t end, const glm::vec4 * planes, std::vector<int> & visible, std::vector<int> & moved)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		this->flags[i] &= ~OBJECT_VISIBLE;
+		if (this->flags[i] & OBJECT_HIDDEN)
+			continue;
+
+		glm::vec3 center;
+		float radius;
+		this->WorldBounds((int)i, center, radius);
+
+		if (SphereInFrustum(planes, center, radius))
+		{
+			this->flags[i] |= OBJECT_VISIBLE;
+			visible.push_back((int)i);
+			if (this->transforms[i].HasChanged())
+				moved.push_back((int)i);
+		}
+	}
+}
+
+
+/// <summary>
+/// Removes the objects hidden behind the occluders from the draw list
+/// The occluders are rasterized on the cpu, then every visible object is tested against the depth pyramid
+/// </summary>
+/// <param name="view_projection">projection * view</param>
+void Scene::CullOccluded(const glm::mat4 & view_projection)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	this->occlusion.Begin(view_projection);
+	int occluders = 0;
+	for (int i : this->draw_list)
+	{
+		if (!(this->flags[i] & OBJECT_OCCLUDER))
+			continue;
+
+		const Bounds & bounds = this->meshes[this->mesh_ids[i]].bounds;
+		if (this->occlusion.AddOccluder(this->transforms[i].GetWorldMatrix(), bounds.box_min, bounds.box_max))
+			occluders++;
+	}
+	this->occlusion.BuildPyramid();
+
+	// Occluders are tested as well, their own box is always in front of their shrunk occluder box
+	size_t kept = 0;
+	for (int i : this->draw_list)
+	{
+		const Bounds & bounds = this->meshes[this->mesh_ids[i]].bounds;
+		if (this->occlusion.IsOccluded(this->transforms[i].GetWorldMatrix(), bounds.box_min, bounds.box_max))
+			this->flags[i] &= ~OBJECT_VISIBLE;
+		else
+			this->draw_list[kept++] = i;
+	}
+	const size_t occluded = this->draw_list.size() - kept;
+	this->draw_list.resize(kept);
+
+	stats.Add("occluders", occluders);
+	stats.Add("occluded objects", (double)occluded);
+	stats.Add("occlusion ms", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+}
+
+
+/// <summary>
+/// Sorts the draw list on the view depth of the objects, closest first
+/// </summary>
+void Scene::SortFrontToBack()
+{
+	// The camera looks down -z, the closest object has the largest z
+	std::sort(this->draw_list.begin(), this->draw_list.end(), [this](int a, int b) {
+		return this->mvs[a][3].z > this->mvs[b][3].z;
+	});
+}
+
+
+/// <summary>
+/// Writes the depth of all visible objects with the position only program
+/// </summary>
+/// <param name="projection"></param>
+void Scene::RenderDepthPrepass(const glm::mat4 & projection)
+{
+	gl_state.UseProgram(this->depth_program);
+	gl_state.UniformMatrix4fv(this->depth_projection, 1, GL_FALSE, glm::value_ptr(projection));
+	gl_state.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	for (size_t k = 0; k < this->draw_list.size(); k++)
+	{
+		gl_state.BindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BLOCK_BINDING, this->object_stream.Buffer(), this->block_offsets[k], sizeof(ObjectBlock));
+		this->meshes[this->mesh_ids[this->draw_list[k]]].DrawDepth();
+	}
+	gl_state.BindVertexArray(0);
+
+	gl_state.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	stats.Add("prepass draws", (double)this->draw_list.size());
+}
+
+
+/// <summary>
+/// Bounding sphere of an object in world space
+/// </summary>
+/// <param name="object"></param>
+/// <param name="center"></param>
+/// <param name="radius"></param>
+void Scene::WorldBounds(int object, glm::vec3 & center, float & radius) const
+{
+	const Bounds & bounds = this->meshes[this->mesh_ids[object]].bounds;
+	const glm::mat4 & world = this->transforms[object].GetWorldMatrix();
+	float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+
+	center = glm::vec3(world * glm::vec4(bounds.center, 1.0f));
+	radius = bounds.radius * scale;
+}
+
+
+/// <summary>
+/// Collects the animated objects and their bounds, the shadow pass tests them against every tile
+/// An object can run a transformation and play a clip at once, it is only taken once
+/// </summary>
+void Scene::GatherDynamicCasters()
+{
+	this->dynamic_casters.clear();
+	for (int object : this->animated)
+		if (!(this->flags[object] & OBJECT_HIDDEN))
+			this->dynamic_casters.push_back(object);
+	for (int object : this->animator.Objects())
+		if (!(this->flags[object] & OBJECT_HIDDEN))
+			this->dynamic_casters.push_back(object);
+	std::sort(this->dynamic_casters.begin(), this->dynamic_casters.end());
+	this->dynamic_casters.erase(std::unique(this->dynamic_casters.begin(), this->dynamic_casters.end()), this->dynamic_casters.end());
+
+	this->dynamic_bounds.resize(this->dynamic_casters.size());
+	for (size_t k = 0; k < this->dynamic_casters.size(); k++)
+	{
+		glm::vec3 center;
+		float radius;
+		this->WorldBounds(this->dynamic_casters[k], center, radius);
+		this->dynamic_bounds[k] = glm::vec4(center, radius);
+	}
+}
+
+
+/// <summary>
+/// Draws the static casters that are inside a shadow tile
+/// </summary>
+/// <param name="tile">Tile in the shadow atlas</param>
+/// <returns>Amount of casters in the tile</returns>
+int Scene::DrawStaticCasters(int tile)
+{
+	const glm::mat4 & view_projection = this->shadows.TileViewProjection(tile);
+	glm::vec4 planes[6];
+	ExtractFrustum(view_projection, planes);
+
+	int casters = 0;
+	for (int i = 0; i < (int)this->Size(); i++)
+	{
+		if (this->flags[i] & (OBJECT_HIDDEN | OBJECT_ANIMATED))
+			continue;
+
+		glm::vec3 center;
+		float radius;
+		this->WorldBounds(i, center, radius);
+		if (!SphereInFrustum(planes, center, radius))
+			continue;
+
+		casters++;
+		this->shadows.DrawCaster(view_projection * this->transforms[i].GetWorldMatrix(), this->meshes[this->mesh_ids[i]]);
+	}
+	return casters;
+}
+
+
+/// <summary>
+/// Draws the dynamic casters that are inside a shadow tile, GatherDynamicCasters has to run first
+/// </summary>
+/// <param name="tile">Tile in the shadow atlas</param>
+/// <param name="count_only">Only count the casters</param>
+/// <returns>Amount of casters in the tile</returns>
+int Scene::DrawDynamicCasters(int tile, bool count_only)
+{
+	const glm::mat4 & view_projection = this->shadows.TileViewProjection(tile);
+	glm::vec4 planes[6];
+	ExtractFrustum(view_projection, planes);
+
+	int casters = 0;
+	for (size_t k = 0; k < this->dynamic_casters.size(); k++)
+	{
+		const glm::vec4 & bounds = this->dynamic_bounds[k];
+		if (!SphereInFrustum(planes, glm::vec3(bounds), bounds.w))
+			continue;
+
+		casters++;
+		if (count_only)
+			continue;
+		const int i = this->dynamic_casters[k];
+		this->shadows.DrawCaster(view_projection * this->transforms[i].GetWorldMatrix(), this->meshes[this->mesh_ids[i]]);
+	}
+	return casters;
+}
+
+
+/// <summary>
+/// Renders the shadow atlas
+/// Static casters come from the cache, only the tiles the dynamic casters are in get redrawn
+/// </summary>
+void Scene::RenderShadows()
+{
+	this->shadows.SetLights(this->light_source, this->lights);
+	const int tiles = this->shadows.TileCount();
+	int draws = 0;
+
+	this->shadows.Begin();
+	if (this->shadows.BeginStatic())
+	{
+		for (int tile = 0; tile < tiles; tile++)
+		{
+			this->shadows.DrawTile(tile);
+			draws += this->DrawStaticCasters(tile);
+		}
+	}
+
+	this->GatherDynamicCasters();
+	this->shadow_tiles.clear();
+	for (int tile = 0; tile < tiles; tile++)
+		if (this->DrawDynamicCasters(tile, true) > 0)
+			this->shadow_tiles.push_back(tile);
+
+	this->shadows.BeginDynamic(this->shadow_tiles);
+	for (int tile : this->shadow_tiles)
+	{
+		this->shadows.DrawTile(tile);
+		draws += this->DrawDynamicCasters(tile, false);
+	}
+	this->shadows.End();
+
+	stats.Add("shadow draws", draws);
+	stats.Add("shadow dynamic tiles", (double)this->shadow_tiles.size());
+}
+
+
+/// <summary>
+/// Places the lights in the shadow atlas without drawing it, RenderShadows does this itself
+/// Headless scenes have no atlas to draw but the lights still decide which shadows moving objects throw
+/// </summary>
+void Scene::UpdateShadowLights()
+{
+	this->shadows.UpdateLights(this->light_source, this->lights);
+}
+
+
+/// <summary>
+/// Switches shadow caching on or off, the stats show the difference in draws and time
+/// </summary>
+void Scene::ToggleShadowCaching()
+{
+	this->shadows.ToggleCaching();
+	printf("Shadow caching %s\n", this->shadows.IsCaching() ? "on" : "off");
+}
+
+
+/// <summary>
+/// Switches occlusion culling on or off, frustum culling always runs
+/// </summary>
+void Scene::ToggleOcclusionCulling()
+{
+	this->occlusion.Toggle();
+	printf("Occlusion culling %s\n", this->occlusion.IsEnabled() ? "on" : "off");
+}
+
+
+void Scene::SetDepthMode(DepthMode mode)
+{
+	this->depth_mode = mode;
+}
+
+
+/// <summary>
+/// Goes to the next depth mode
+/// </summary>
+void Scene::CycleDepthMode()
+{
+	static const char * names[] = { "default", "depth pre-pass", "front to back" };
+
+	this->depth_mode = (DepthMode)((this->depth_mode + 1) % 3);
+	printf("Depth mode: %s\n", names[this->depth_mode]);
+}
+
+
+/// <summary>
+/// Draws the fragment counts of Render as a heat map over the frame
+/// </summary>
+/// <param name="overdraw_counts">The texture Render counted in</param>
+void Scene::RenderOverdraw(GLuint overdraw_counts)
+{
+	this->overdraw.End(overdraw_counts);
+}
+
+
+GLuint Scene::ShadowTexture() const
+{
+	return this->shadows.Texture();
+}
+
+
+/// <summary>
+/// Returns the program the meshes are drawn with, their vertex arrays follow its attribute locations
+/// </summary>
+GLuint Scene::Program() const
+{
+	return this->shader_id;
+}
+
+
+bool Scene::IsOverdrawEnabled() const
+{
+	return this->overdraw.IsEnabled();
+}
+
+
+/// <summary>
+/// Shows the fragments shaded per pixel instead of the scene
+/// </summary>
+void Scene::ToggleOverdraw()
+{
+	this->overdraw.Toggle();
+	printf("Overdraw view %s\n", this->overdraw.IsEnabled() ? "on" : "off");
+}
+
+
+/// <summary>
+/// Updates all objects for the next frame
+/// Everything runs on the job system, only the gl calls in Render are left for the glut thread
+/// </summary>
+/// <param name="view"></param>
+/// <param name="projection"></param>
+/// <param name="jobs"></param>
+void Scene::Update(const glm::mat4 & view, const glm::mat4 & projection, JobSystem & jobs)
+{
+	this->Animate(jobs);
+	this->UpdateHierarchy(jobs);
+
+	this->view_changed = this->view_changed || view != this->last_view;
+	this->last_view = view;
+
+	glm::vec4 planes[6];
+	ExtractFrustum(projection * view, planes);
+
+	// Every range builds its own part of the draw list
+	// The lists have room for all objects, so turning the view never makes a frame allocate
+	const size_t count = this->transforms.size();
+	this->draw_ranges.resize((count + OBJECTS_PER_JOB - 1) / OBJECTS_PER_JOB);
+	this->moved_ranges.resize(this->draw_ranges.size());
+	this->draw_list.reserve(count);
+	this->moved_list.reserve(count);
+	jobs.ParallelFor(count, OBJECTS_PER_JOB, [this, &view, &planes](size_t begin, size_t end) {
+		std::vector<int> & visible = this->draw_ranges[begin / OBJECTS_PER_JOB];
+		std::vector<int> & moved = this->moved_ranges[begin / OBJECTS_PER_JOB];
+		visible.clear();
+		moved.clear();
+		visible.reserve(end - begin);
+		moved.reserve(end - begin);
+
+		this->UpdateViews(begin, end, view);
+		this->Cull(begin, end, planes, visible, moved);
+	});
+	this->view_changed = false;
+
+	this->draw_list.clear();
+	for (auto & range : this->draw_ranges)
+		this->draw_list.insert(this->draw_list.end(), range.begin(), range.end());
+
+	if (this->occlusion.IsEnabled())
+		this->CullOccluded(projection * view);
+
+	// Moved objects the occlusion culling removed don't change the frame
+	this->moved_list.clear();
+	for (auto & range : this->moved_ranges)
+		for (int i : range)
+			if (this->flags[i] & OBJECT_VISIBLE)
+				this->moved_list.push_back(i);
+	if (this->depth_mode == DEPTH_FRONT_TO_BACK)
+		this->SortFrontToBack();
+
+	this->clusters.Assign(this->lights, view, jobs);
+	stats.Add("light indices", (double)this->clusters.IndexCount());
+	stats.Add("max lights per cluster", this->clusters.MaxLightsPerCluster());
+}
+
+
+/// <summary>
+/// Renders all visible objects, the shadow atlas has to be rendered already (RenderShadows)
+/// </summary>
+/// <param name="projection"></param>
+/// <param name="overdraw_counts">R32UI texture the overdraw view counts fragments in, 0 when it is off</param>
+void Scene::Render(const glm::mat4 & projection, GLuint overdraw_counts)
+{
+	// The main light is placed in the world, the shaders light in view space
+	const glm::vec3 light_pos = glm::vec3(this->last_view * glm::vec4(this->light_source.position, 1.0f));
+
+	gl_state.UseProgram(this->shader_id);
+	gl_state.UniformMatrix4fv(this->uniforms.proj, 1, GL_FALSE, glm::value_ptr(projection));
+	gl_state.Uniform3fv(this->uniforms.light_pos, 1, glm::value_ptr(light_pos));
+	gl_state.UniformMatrix4fv(this->uniforms.view_inverse, 1, GL_FALSE, glm::value_ptr(glm::inverse(this->last_view)));
+
+	// Shadows
+	gl_state.Uniform1i(this->uniforms.shadow_light_count, this->shadows.LightCount());
+	gl_state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, SHADOW_BUFFER_BINDING, this->shadows.MatrixBuffer());
+	gl_state.BindTexture(SHADOW_TEXTURE_UNIT, GL_TEXTURE_2D, this->shadows.Texture());
+
+	// Point lights
+	this->clusters.Upload(this->light_stream);
+	this->light_stream.Flush();
+	gl_state.Uniform3ui(this->uniforms.cluster_count, CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+	gl_state.Uniform2fv(this->uniforms.cluster_tile_size, 1, glm::value_ptr(this->clusters.TileSize()));
+	gl_state.Uniform2fv(this->uniforms.cluster_depth, 1, glm::value_ptr(this->clusters.DepthScaleBias()));
+
+	// Write the matrices of all visible objects straight into the mapped stream buffer
+	const size_t count = this->draw_list.size();
+	this->object_stream.Reserve((GLsizeiptr)count * OBJECT_BLOCK_STRIDE);
+	this->object_stream.BeginFrame();
+	this->block_offsets.resize(count);
+	for (size_t k = 0; k < count; k++)
+	{
+		const int i = this->draw_list[k];
+		StreamAllocation block = this->object_stream.Allocate(sizeof(ObjectBlock));
+		if (block.data == nullptr)
+		{
+			// The segment could not hold all blocks, nothing is drawn this frame
+			this->object_stream.EndFrame();
+			this->light_stream.EndFrame();
+			return;
+		}
+
+		ObjectBlock * data = (ObjectBlock *)block.data;
+		data->mv = this->mvs[i];
+		data->normal_matrix = this->normals[i];
+		data->lightmap_st = this->lightmap_st[i];
+		data->lightmap_params = glm::vec4(this->lightmap_pages[i] >= 0 ? 1.0f : 0.0f, 0.0f, 0.0f, 0.0f);
+		this->block_offsets[k] = block.offset;
+	}
+	this->object_stream.Flush();
+
+	if (this->depth_mode == DEPTH_PREPASS)
+	{
+		this->RenderDepthPrepass(projection);
+		gl_state.UseProgram(this->shader_id);
+		gl_state.DepthFunc(GL_EQUAL);
+		gl_state.DepthMask(GL_FALSE);
+	}
+
+	if (overdraw_counts)
+		this->overdraw.Begin(overdraw_counts, this->width, this->height);
+	gl_state.Uniform1i(this->uniforms.overdraw_enabled, overdraw_counts ? 1 : 0);
+
+	const Material * current_material = nullptr;
+	GLuint current_texture = 0;
+	for (size_t k = 0; k < count; k++)
+	{
+		const int i = this->draw_list[k];
+		gl_state.BindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BLOCK_BINDING, this->object_stream.Buffer(), this->block_offsets[k], sizeof(ObjectBlock));
+
+		// Neighbouring objects mostly share their lightmap page, the state cache drops the bind then
+		if (this->lightmap_pages[i] >= 0)
+			gl_state.BindTexture(LIGHTMAP_TEXTURE_UNIT, GL_TEXTURE_2D, this->lightmap_textures[this->lightmap_pages[i]]);
+
+		ModelRenderer & mesh = this->meshes[this->mesh_ids[i]];
+		mesh.BindGeometry();
+
+		// One draw per material range, ranges without a material of their own use the material of the object
+		for (const MeshRange & range : mesh.Ranges())
+		{
+			const Material * material = range.material >= 0 ? &mesh.Materials()[range.material] : &this->materials[this->material_ids[i]];
+
+			// Neighbouring objects and ranges mostly share their material, every material can have a diffuse map of its own
+			const GLuint texture = mesh.RangeTexture(range);
+			if (material != current_material || texture != current_texture)
+			{
+				gl_state.BindTexture(0, GL_TEXTURE_2D, texture);
+				gl_state.Uniform1i(this->uniforms.has_texture, texture != 0 ? 1 : 0);
+				gl_state.Uniform3fv(this->uniforms.material_ambient, 1, glm::value_ptr(material->ambient_color));
+				gl_state.Uniform3fv(this->uniforms.material_diffuse, 1, glm::value_ptr(material->diffuse_color));
+				gl_state.Uniform3fv(this->uniforms.material_specular, 1, glm::value_ptr(material->specular));
+				gl_state.Uniform1f(this->uniforms.material_power, material->power);
+				current_material = material;
+				current_texture = texture;
+			}
+			mesh.DrawRange(range);
+		}
+	}
+	gl_state.BindVertexArray(0);
+
+	if (this->depth_mode == DEPTH_PREPASS)
+	{
+		gl_state.DepthFunc(GL_LESS);
+		gl_state.DepthMask(GL_TRUE);
+	}
+
+	this->object_stream.EndFrame();
+	this->light_stream.EndFrame();
+}
+
+
+/// <summary>
+/// Prints how much memory the scene uses compared to keeping a full ModelRenderer (mesh included) per object
+/// </summary>
+void Scene::PrintMemoryReport() const
+{
+	const size_t count = this->transforms.size();
+	const size_t vertex_size = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
+
+	// Every object used to carry its own mesh, uniforms, light, material, name and matrices
+	const size_t object_overhead = sizeof(Mesh) + sizeof(ObjectUniforms) + sizeof(LightSource) + sizeof(Material)
+		+ 3 * sizeof(glm::mat4) + sizeof(std::string) + 3 * sizeof(GLuint) + sizeof(int) + sizeof(bool) + sizeof(transFunc);
+	size_t per_object_layout = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		const ModelRenderer & mesh = this->meshes[this->mesh_ids[i]];
+		per_object_layout += object_overhead + mesh.model_name.size() + mesh.VertexCount() * vertex_size;
+	}
+
+	const size_t per_object = this->BytesPerObject();
+	size_t shared = this->materials.size() * sizeof(Material) + this->animated.size() * (sizeof(int) + sizeof(transFunc));
+	for (auto & mesh : this->meshes)
+		shared += sizeof(ModelRenderer) + mesh.model_name.size();
+	const size_t scene_layout = count * per_object + shared;
+
+	printf("Scene: %u objects, %u meshes, %u materials\n", (unsigned)count, (unsigned)this->meshes.size(), (unsigned)this->materials.size());
+	printf("  vector<ModelRenderer> layout: %10u bytes\n", (unsigned)per_object_layout);
+	printf("  scene arrays:                 %10u bytes (%u per object)\n", (unsigned)scene_layout, (unsigned)per_object);
+	printf("  process resident memory:      %10u bytes\n", (unsigned)GetResidentMemory());
+}
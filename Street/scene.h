@@ -0,0 +1,184 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+#include "types.h"
+#include "transform.h"
+#include "modelRenderer.h"
+#include "jobSystem.h"
+#include "streamBuffer.h"
+#include "clusteredLights.h"
+#include "shadowAtlas.h"
+#include "occlusionCuller.h"
+#include "overdrawView.h"
+#include "sceneFile.h"
+#include "animation.h"
+
+
+typedef void(*transFunc)(Transform &transform);
+
+// Per object flags
+enum ObjectFlags
+{
+	OBJECT_VISIBLE = 1,		// Passed culling this frame
+	OBJECT_ANIMATED = 2,	// Has a transformation that runs every loop
+	OBJECT_HIDDEN = 4,		// Never rendered
+	OBJECT_OCCLUDER = 8		// Big and solid, hides the objects behind it
+};
+
+// How the opaque objects are drawn
+enum DepthMode
+{
+	DEPTH_DEFAULT,			// In object order, grouped by material
+	DEPTH_PREPASS,			// Depth only pass first, then shading with GL_EQUAL so every pixel is shaded once
+	DEPTH_FRONT_TO_BACK		// Sorted by view depth so early depth testing rejects most hidden fragments
+};
+
+// All objects in the world, stored as one array per property (index i of every array is object i)
+// Meshes and materials are shared, objects only refer to them by index
+class Scene
+{
+private:
+	// Shared resources
+	std::vector<ModelRenderer> meshes;
+	std::vector<std::string> mesh_paths;
+	std::vector<Material> materials;
+
+	// Per object data
+	std::vector<Transform> transforms;
+	std::vector<glm::mat4> mvs;
+	std::vector<glm::mat4> normals;
+	std::vector<int> mesh_ids;
+	std::vector<int> material_ids;
+	std::vector<unsigned char> flags;
+
+	// Objects with a parent, in the order they were added
+	std::vector<int> children;
+
+	// Slots of removed root objects and released meshes, reused before the arrays grow
+	std::vector<int> free_objects;
+	std::vector<int> free_meshes;
+
+	// Visible objects in draw order, built per range of objects and then joined
+	std::vector<int> draw_list;
+	std::vector<std::vector<int>> draw_ranges;
+
+	// Visible objects whose world matrix changed this frame, built the same way
+	std::vector<int> moved_list;
+	std::vector<std::vector<int>> moved_ranges;
+
+	// Set when objects, lights or lightmaps were added or removed, cleared by TakeContentChanged
+	bool content_changed = true;
+
+	// Animated objects and the transformation they run
+	std::vector<int> animated;
+	std::vector<transFunc> animations;
+
+	// Keyframed clips and the seconds they move forward in the next update
+	Animator animator;
+	float animation_seconds = 0.0f;
+
+	// Shader related
+	ObjectUniforms uniforms;
+	StreamBuffer object_stream;
+	std::vector<GLintptr> block_offsets;
+	GLuint shader_id;
+	LightSource light_source;
+
+	// Point lights, assigned to clusters every frame
+	std::vector<LightSource> lights;
+	ClusteredLights clusters;
+	StreamBuffer light_stream;
+
+	OcclusionCuller occlusion;
+
+	// Overdraw reduction and the view that measures it
+	DepthMode depth_mode = DEPTH_DEFAULT;
+	GLuint depth_program = 0;
+	GLint depth_projection = -1;
+	OverdrawView overdraw;
+	int width = 1;
+	int height = 1;
+
+	// Shadows of the main light and the point lights, tiles with a dynamic caster in them this frame
+	ShadowAtlas shadows;
+	std::vector<int> shadow_tiles;
+
+	// Objects that move and their world bounding spheres, gathered once per shadow pass for all tiles
+	std::vector<int> dynamic_casters;
+	std::vector<glm::vec4> dynamic_bounds;
+
+	// Baked lighting, page -1 for objects without a lightmap
+	std::vector<int> lightmap_pages;
+	std::vector<glm::vec4> lightmap_st;
+	std::vector<GLuint> lightmap_textures;
+
+	glm::mat4 last_view;
+	bool view_changed = true;
+
+	// Only keeps the cpu side of meshes, for tools that run without a gl context
+	bool headless = false;
+
+	void InitShaders();
+	void Animate(JobSystem & jobs);
+	void UpdateViews(size_t begin, size_t end, const glm::mat4 & view);
+	void Cull(size_t begin, size_t end, const glm::vec4 * planes, std::vector<int> & visible, std::vector<int> & moved);
+	void CullOccluded(const glm::mat4 & view_projection);
+	void SortFrontToBack();
+	void RenderDepthPrepass(const glm::mat4 & projection);
+	void WorldBounds(int object, glm::vec3 & center, float & radius) const;
+	void GatherDynamicCasters();
+	int DrawStaticCasters(int tile);
+	int DrawDynamicCasters(int tile, bool count_only);
+public:
+	void SetHeadless(bool headless);
+	void Initialize();
+	int LoadMesh(const char * name, const char * object_path, const char * texture_path);
+	int AddMesh(const ModelRenderer & mesh);
+	int UploadMesh(ModelRenderer & mesh, const std::string & key);
+	void ReleaseMesh(int mesh);
+	int AddMaterial(Material material);
+	int AddMaterials(const SceneFile & file);
+	int AddObject(int mesh, int material, Transform transform, unsigned char object_flags = 0);
+	void RemoveObject(int object);
+	void SetAnimation(int object, transFunc func);
+	void PlayClip(int object, int clip, float start_time = 0.0f, float speed = 1.0f);
+	void CrossFade(int object, int clip, float seconds);
+	void AdvanceAnimations(float seconds);
+	Animator & GetAnimator();
+	void SetLightSource(LightSource light_source);
+	int AddLight(LightSource light);
+	void ClearLights();
+	void SetProjection(float fov, float aspect, float near_plane, float far_plane, int width, int height);
+	bool LoadLightmaps(const char * directory, JobSystem & jobs);
+	Transform & GetTransform(int object);
+	int GetMeshId(int object) const;
+	const ModelRenderer & GetMesh(int mesh) const;
+	bool IsStatic(int object) const;
+	const LightSource & GetLightSource() const;
+	const std::vector<LightSource> & GetLights() const;
+	size_t Size() const;
+	size_t BytesPerObject() const;
+
+	const std::vector<int> & DrawList() const;
+	const std::vector<int> & MovedList() const;
+	size_t AnimatedCount() const;
+	bool TakeContentChanged();
+	bool MovedRegion(const glm::mat4 & view_projection, int width, int height, glm::ivec4 & region) const;
+
+	void UpdateHierarchy(JobSystem & jobs);
+	void Update(const glm::mat4 & view, const glm::mat4 & projection, JobSystem & jobs);
+	void RenderShadows();
+	void UpdateShadowLights();
+	void Render(const glm::mat4 & projection, GLuint overdraw_counts = 0);
+	void RenderOverdraw(GLuint overdraw_counts);
+	GLuint ShadowTexture() const;
+	GLuint Program() const;
+	bool IsOverdrawEnabled() const;
+	void ToggleShadowCaching();
+	void ToggleOcclusionCulling();
+	void SetDepthMode(DepthMode mode);
+	void CycleDepthMode();
+	void ToggleOverdraw();
+	void PrintMemoryReport() const;
+};
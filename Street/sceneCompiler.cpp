@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "sceneFile.h"
+#include "sceneCompiler.h"
+
+// Object flag names, the values match ObjectFlags in scene.h
+const uint32_t SCENE_FLAG_OCCLUDER = 8;
+
+
+// A scene description being parsed, names resolve to table indices as they are declared
+struct SceneSource
+{
+	std::vector<std::string> mesh_names;
+	std::vector<SceneMesh> meshes;
+	std::vector<std::string> material_names;
+	std::vector<uint32_t> material_first;
+	std::vector<uint32_t> material_counts;
+	std::vector<SceneMaterial> materials;
+	std::vector<SceneRow> rows;
+	std::vector<SceneInstance> instances;
+};
+
+
+// Words of one line with the position of the next one
+struct Tokens
+{
+	std::vector<std::string> words;
+	size_t next = 0;
+
+	bool Done() const { return this->next >= this->words.size(); }
+	const std::string & Peek() const { return this->words[this->next]; }
+	std::string Take() { return this->Done() ? std::string() : this->words[this->next++]; }
+
+	bool NextIsNumber() const
+	{
+		if (this->Done())
+			return false;
+		char * end = nullptr;
+		strtod(this->Peek().c_str(), &end);
+		return end != this->Peek().c_str() && *end == '\0';
+	}
+
+	bool Number(float & value)
+	{
+		if (!this->NextIsNumber())
+			return false;
+		value = (float)atof(this->Take().c_str());
+		return true;
+	}
+
+	bool Numbers(float * values, int count)
+	{
+		for (int i = 0; i < count; i++)
+			if (!this->Number(values[i]))
+				return false;
+		return true;
+	}
+};
+
+
+/// <summary>
+/// Sets the error of a line
+/// </summary>
+/// <returns>false</returns>
+static bool Fail(std::string & error, const std::string & message)
+{
+	error = message;
+	return false;
+}
+
+
+/// <summary>
+/// Copies a name into a fixed size field
+/// </summary>
+/// <returns>Whether it fits</returns>
+static bool CopyName(char * field, const std::string & name)
+{
+	if (name.size() >= SCENE_NAME_LENGTH)
+		return false;
+	memset(field, 0, SCENE_NAME_LENGTH);
+	memcpy(field, name.c_str(), name.size());
+	return true;
+}
+
+
+/// <summary>
+/// Finds a declared name
+/// </summary>
+/// <returns>The index or -1</returns>
+static int FindName(const std::vector<std::string> & names, const std::string & name)
+{
+	for (size_t i = 0; i < names.size(); i++)
+		if (names[i] == name)
+			return (int)i;
+	return -1;
+}
+
+
+/// <summary>
+/// Random generator for the palettes, the same seed always gives the same colors
+/// </summary>
+static uint32_t NextRandom(uint32_t & state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+
+/// <summary>
+/// Parses the transform keywords (position, rotation in degrees, scale) and the ones shared by rows and objects
+/// </summary>
+/// <param name="tokens">The line, positioned at the keyword</param>
+/// <param name="position">Receives the translation</param>
+/// <param name="euler">Receives the rotation</param>
+/// <param name="scale">Receives the scale</param>
+/// <param name="flags">Receives the object flags</param>
+/// <param name="error">Set when the keyword is known but its values are wrong</param>
+/// <returns>Whether the keyword was consumed</returns>
+static bool ParseObjectKeyword(Tokens & tokens, glm::vec3 & position, glm::vec3 & euler, glm::vec3 & scale, uint32_t & flags, std::string & error)
+{
+	const std::string keyword = tokens.Peek();
+	if (keyword == "position" || keyword == "rotation")
+	{
+		tokens.Take();
+		glm::vec3 & target = keyword == "position" ? position : euler;
+		if (!tokens.Numbers(&target.x, 3))
+			error = keyword + " needs x y z";
+		return true;
+	}
+	if (keyword == "scale")
+	{
+		tokens.Take();
+		float values[3];
+		if (!tokens.Number(values[0]))
+			error = "scale needs one or three values";
+		else if (tokens.NextIsNumber())
+		{
+			if (!tokens.Numbers(values + 1, 2))
+				error = "scale needs one or three values";
+			scale = glm::vec3(values[0], values[1], values[2]);
+		}
+		else
+			scale = glm::vec3(values[0]);
+		return true;
+	}
+	if (keyword == "occluder")
+	{
+		tokens.Take();
+		flags |= SCENE_FLAG_OCCLUDER;
+		return true;
+	}
+	return false;
+}
+
+
+/// <summary>
+/// Fills a stored transform from the parsed values
+/// </summary>
+static SceneTransform MakeTransform(const glm::vec3 & position, const glm::vec3 & euler, const glm::vec3 & scale)
+{
+	glm::quat rotation = glm::quat(glm::vec3(glm::radians(euler.x), glm::radians(euler.y), glm::radians(euler.z)));
+	return SceneTransform{
+		{ position.x, position.y, position.z },
+		{ rotation.x, rotation.y, rotation.z, rotation.w },
+		{ scale.x, scale.y, scale.z }
+	};
+}
+
+
+/// <summary>
+/// Parses one line of a scene description
+/// </summary>
+/// <param name="tokens">The words of the line</param>
+/// <param name="source">Receives the declarations</param>
+/// <param name="error">Receives the reason when the line is wrong</param>
+/// <returns>Whether the line is valid</returns>
+static bool ParseLine(Tokens & tokens, SceneSource & source, std::string & error)
+{
+	const std::string command = tokens.Take();
+
+	if (command == "mesh")
+	{
+		// mesh <name> <obj> [texture]
+		SceneMesh mesh;
+		std::string name = tokens.Take();
+		std::string object_path = tokens.Take();
+		std::string texture_path = tokens.Take();
+		if (name.empty() || object_path.empty())
+			return Fail(error, "mesh needs a name and an obj file");
+		if (FindName(source.mesh_names, name) >= 0)
+			return Fail(error, "mesh " + name + " is declared twice");
+		if (!CopyName(mesh.name, name) || !CopyName(mesh.object_path, object_path) || !CopyName(mesh.texture_path, texture_path))
+			return Fail(error, "name or path is too long");
+
+		source.mesh_names.push_back(name);
+		source.meshes.push_back(mesh);
+	}
+	else if (command == "material" || command == "palette")
+	{
+		// material <name> [ambient r g b] [diffuse r g b] [specular r g b] [power p]
+		// palette <name> <count> [seed n] [specular r g b] [power p], random colors with a brighter diffuse
+		std::string name = tokens.Take();
+		if (name.empty())
+			return Fail(error, command + " needs a name");
+		if (FindName(source.material_names, name) >= 0)
+			return Fail(error, "material " + name + " is declared twice");
+
+		float count = 1;
+		if (command == "palette" && (!tokens.Number(count) || count < 1))
+			return Fail(error, "palette needs a count");
+
+		SceneMaterial material = { { 0, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 }, 128 };
+		float seed = 1;
+		while (!tokens.Done())
+		{
+			std::string keyword = tokens.Take();
+			bool ok;
+			if (keyword == "ambient")
+				ok = tokens.Numbers(material.ambient, 3);
+			else if (keyword == "diffuse")
+				ok = tokens.Numbers(material.diffuse, 3);
+			else if (keyword == "specular")
+				ok = tokens.Numbers(material.specular, 3);
+			else if (keyword == "power")
+				ok = tokens.Number(material.power);
+			else if (keyword == "seed" && command == "palette")
+				ok = tokens.Number(seed) && seed >= 1;
+			else
+				return Fail(error, "unknown keyword " + keyword);
+			if (!ok)
+				return Fail(error, "wrong values for " + keyword);
+		}
+
+		source.material_names.push_back(name);
+		source.material_first.push_back((uint32_t)source.materials.size());
+		source.material_counts.push_back((uint32_t)count);
+
+		uint32_t state = (uint32_t)seed;
+		for (int i = 0; i < (int)count; i++)
+		{
+			if (command == "palette")
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					material.ambient[c] = (NextRandom(state) % 255) / 255.0f;
+					material.diffuse[c] = material.ambient[c] + 0.2f;
+				}
+			}
+			source.materials.push_back(material);
+		}
+	}
+	else if (command == "row" || command == "object")
+	{
+		// row <mesh> <material> <transform> every <spacing> [from k] [to k] [occluder] [light x y z radius r]
+		// object <mesh> <material> <transform> [occluder] [animation name]
+		int mesh = FindName(source.mesh_names, tokens.Take());
+		int material = FindName(source.material_names, tokens.Take());
+		if (mesh < 0 || material < 0)
+			return Fail(error, command + " needs a declared mesh and material");
+
+		glm::vec3 position(0.0f), euler(0.0f), scale(1.0f), light_offset(0.0f);
+		uint32_t flags = 0;
+		float spacing = 0, light_radius = 0;
+		int32_t first = INT32_MIN, last = INT32_MAX;
+		std::string animation;
+		while (!tokens.Done())
+		{
+			if (ParseObjectKeyword(tokens, position, euler, scale, flags, error))
+			{
+				if (!error.empty())
+					return false;
+				continue;
+			}
+
+			std::string keyword = tokens.Take();
+			bool ok;
+			if (command == "row" && keyword == "every")
+				ok = tokens.Number(spacing) && spacing > 0;
+			else if (command == "row" && (keyword == "from" || keyword == "to"))
+			{
+				float bound = 0;
+				ok = tokens.Number(bound);
+				(keyword == "from" ? first : last) = (int32_t)bound;
+			}
+			else if (command == "row" && keyword == "light")
+				ok = tokens.Numbers(&light_offset.x, 3) && tokens.Take() == "radius" && tokens.Number(light_radius);
+			else if (command == "object" && keyword == "animation")
+				ok = !(animation = tokens.Take()).empty() && animation.size() < SCENE_NAME_LENGTH;
+			else
+				return Fail(error, "unknown keyword " + keyword);
+			if (!ok)
+				return Fail(error, "wrong values for " + keyword);
+		}
+
+		if (command == "row")
+		{
+			if (spacing <= 0)
+				return Fail(error, "row needs every <spacing>");
+
+			SceneRow row;
+			row.transform = MakeTransform(position, euler, scale);
+			row.mesh = (uint32_t)mesh;
+			row.material = source.material_first[material];
+			row.material_count = source.material_counts[material];
+			row.flags = flags;
+			row.spacing = spacing;
+			row.first = first;
+			row.last = last;
+			row.light_offset[0] = light_offset.x;
+			row.light_offset[1] = light_offset.y;
+			row.light_offset[2] = light_offset.z;
+			row.light_radius = light_radius;
+			source.rows.push_back(row);
+		}
+		else
+		{
+			SceneInstance instance;
+			instance.transform = MakeTransform(position, euler, scale);
+			instance.mesh = (uint32_t)mesh;
+			instance.material = source.material_first[material];
+			instance.flags = flags;
+			CopyName(instance.animation, animation);
+			source.instances.push_back(instance);
+		}
+	}
+	else
+		return Fail(error, "unknown command " + command);
+
+	return true;
+}
+
+
+/// <summary>
+/// Appends a table to the output, returns where it starts
+/// </summary>
+template <typename T>
+static uint32_t WriteTable(std::vector<unsigned char> & output, const std::vector<T> & table)
+{
+	uint32_t offset = (uint32_t)output.size();
+	const unsigned char * bytes = (const unsigned char *)table.data();
+	output.insert(output.end(), bytes, bytes + table.size() * sizeof(T));
+	return offset;
+}
+
+
+/// <summary>
+/// Compiles a text scene description into a binary scene that is mapped at runtime
+/// Lines are "mesh", "material", "palette", "row" and "object" declarations, # starts a comment
+/// </summary>
+/// <param name="source_path">Path to the scene description</param>
+/// <param name="binary_path">Path of the compiled scene</param>
+/// <returns>Whether the scene compiled, errors are printed with their line</returns>
+bool CompileScene(const char * source_path, const char * binary_path)
+{
+	FILE * file = fopen(source_path, "r");
+	if (file == NULL)
+	{
+		printf("Impossible to open %s\n", source_path);
+		return false;
+	}
+
+	SceneSource source;
+	char buffer[1024];
+	int line = 0;
+	bool ok = true;
+	while (fgets(buffer, sizeof(buffer), file))
+	{
+		line++;
+		char * comment = strchr(buffer, '#');
+		if (comment)
+			*comment = '\0';
+
+		Tokens tokens;
+		std::istringstream words(buffer);
+		std::string word;
+		while (words >> word)
+			tokens.words.push_back(word);
+		if (tokens.Done())
+			continue;
+
+		std::string error;
+		if (!ParseLine(tokens, source, error))
+		{
+			printf("%s:%d: %s\n", source_path, line, error.c_str());
+			ok = false;
+		}
+	}
+	fclose(file);
+	if (!ok)
+		return false;
+
+	// Header first, the tables follow in order
+	std::vector<unsigned char> output(sizeof(SceneHeader));
+	SceneHeader header;
+	header.magic = SCENE_MAGIC;
+	header.version = SCENE_VERSION;
+	header.mesh_count = (uint32_t)source.meshes.size();
+	header.mesh_offset = WriteTable(output, source.meshes);
+	header.material_count = (uint32_t)source.materials.size();
+	header.material_offset = WriteTable(output, source.materials);
+	header.row_count = (uint32_t)source.rows.size();
+	header.row_offset = WriteTable(output, source.rows);
+	header.instance_count = (uint32_t)source.instances.size();
+	header.instance_offset = WriteTable(output, source.instances);
+	memcpy(output.data(), &header, sizeof(header));
+
+	file = fopen(binary_path, "wb");
+	if (file == NULL)
+	{
+		printf("Impossible to write %s\n", binary_path);
+		return false;
+	}
+	ok = fwrite(output.data(), 1, output.size(), file) == output.size();
+	fclose(file);
+
+	printf("Compiled %s: %u meshes, %u materials, %u rows, %u objects (%u bytes)\n", source_path,
+		header.mesh_count, header.material_count, header.row_count, header.instance_count, (unsigned)output.size());
+	return ok;
+}
+
+
+/// <summary>
+/// Whether the compiled scene is missing or older than its description
+/// </summary>
+/// <param name="source_path"></param>
+/// <param name="binary_path"></param>
+bool IsSceneOutdated(const char * source_path, const char * binary_path)
+{
+	struct stat source, binary;
+	if (stat(binary_path, &binary) != 0)
+		return true;
+	if (stat(source_path, &source) != 0)
+		return false;
+	return source.st_mtime > binary.st_mtime;
+}
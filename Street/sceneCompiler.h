@@ -0,0 +1,5 @@
+#pragma once
+
+
+bool CompileScene(const char * source_path, const char * binary_path);
+bool IsSceneOutdated(const char * source_path, const char * binary_path);
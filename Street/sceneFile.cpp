@@ -0,0 +1,148 @@
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "sceneFile.h"
+
+
+/// <summary>
+/// Checks whether a table of count entries fits in the file
+/// </summary>
+static bool TableFits(size_t file_size, uint32_t offset, uint32_t count, size_t entry_size)
+{
+	return offset % 4 == 0 && offset <= file_size && (file_size - offset) / entry_size >= count;
+}
+
+
+/// <summary>
+/// Maps a compiled scene and checks its header, nothing is copied
+/// </summary>
+/// <param name="path">Path to the compiled scene</param>
+/// <returns>Whether the file is a valid scene of this version</returns>
+bool SceneFile::Open(const char * path)
+{
+	this->header = nullptr;
+	if (!this->file.Open(path))
+		return false;
+
+	const SceneHeader * header = (const SceneHeader *)this->file.Data();
+	const size_t size = this->file.Size();
+	if (size < sizeof(SceneHeader) || header->magic != SCENE_MAGIC || header->version != SCENE_VERSION ||
+		!TableFits(size, header->mesh_offset, header->mesh_count, sizeof(SceneMesh)) ||
+		!TableFits(size, header->material_offset, header->material_count, sizeof(SceneMaterial)) ||
+		!TableFits(size, header->row_offset, header->row_count, sizeof(SceneRow)) ||
+		!TableFits(size, header->instance_offset, header->instance_count, sizeof(SceneInstance)))
+	{
+		printf("%s is not a compiled scene of version %u\n", path, SCENE_VERSION);
+		this->file.Close();
+		return false;
+	}
+
+	// Indices are checked once here so the tables can be used without checks
+	for (size_t i = 0; i < header->row_count; i++)
+	{
+		const SceneRow & row = this->Table<SceneRow>(header->row_offset)[i];
+		if (row.mesh >= header->mesh_count || row.material_count == 0 || row.material + row.material_count > header->material_count)
+		{
+			printf("%s: row %u refers to a mesh or material that doesn't exist\n", path, (unsigned)i);
+			this->file.Close();
+			return false;
+		}
+	}
+	for (size_t i = 0; i < header->instance_count; i++)
+	{
+		const SceneInstance & instance = this->Table<SceneInstance>(header->instance_offset)[i];
+		if (instance.mesh >= header->mesh_count || instance.material >= header->material_count)
+		{
+			printf("%s: object %u refers to a mesh or material that doesn't exist\n", path, (unsigned)i);
+			this->file.Close();
+			return false;
+		}
+	}
+
+	this->header = header;
+	return true;
+}
+
+
+size_t SceneFile::MeshCount() const
+{
+	return this->header ? this->header->mesh_count : 0;
+}
+
+
+const SceneMesh & SceneFile::GetMesh(size_t mesh) const
+{
+	return this->Table<SceneMesh>(this->header->mesh_offset)[mesh];
+}
+
+
+size_t SceneFile::MaterialCount() const
+{
+	return this->header ? this->header->material_count : 0;
+}
+
+
+Material SceneFile::GetMaterial(size_t material) const
+{
+	const SceneMaterial & m = this->Table<SceneMaterial>(this->header->material_offset)[material];
+	return Material{
+		glm::vec3(m.ambient[0], m.ambient[1], m.ambient[2]),
+		glm::vec3(m.diffuse[0], m.diffuse[1], m.diffuse[2]),
+		glm::vec3(m.specular[0], m.specular[1], m.specular[2]),
+		m.power
+	};
+}
+
+
+size_t SceneFile::RowCount() const
+{
+	return this->header ? this->header->row_count : 0;
+}
+
+
+const SceneRow & SceneFile::GetRow(size_t row) const
+{
+	return this->Table<SceneRow>(this->header->row_offset)[row];
+}
+
+
+size_t SceneFile::InstanceCount() const
+{
+	return this->header ? this->header->instance_count : 0;
+}
+
+
+const SceneInstance & SceneFile::GetInstance(size_t instance) const
+{
+	return this->Table<SceneInstance>(this->header->instance_offset)[instance];
+}
+
+
+/// <summary>
+/// Makes a root transform from a stored one
+/// </summary>
+Transform SceneFile::ToTransform(const SceneTransform & transform)
+{
+	return Transform(
+		glm::vec3(transform.position[0], transform.position[1], transform.position[2]),
+		glm::quat(transform.rotation[3], transform.rotation[0], transform.rotation[1], transform.rotation[2]),
+		glm::vec3(transform.scale[0], transform.scale[1], transform.scale[2]));
+}
+
+
+/// <summary>
+/// The material copy k of a row uses, rows with several materials scatter them over the copies
+/// </summary>
+/// <param name="row"></param>
+/// <param name="copy">Index of the copy along the row</param>
+/// <returns>Material index in the scene file</returns>
+int SceneFile::RowMaterial(const SceneRow & row, int copy)
+{
+	if (row.material_count == 1)
+		return (int)row.material;
+	return (int)(row.material + (((unsigned int)copy * 2654435761u) >> 16) % row.material_count);
+}
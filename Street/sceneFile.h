@@ -0,0 +1,104 @@
+#pragma once
+#include <stdint.h>
+#include "types.h"
+#include "transform.h"
+#include "mappedFile.h"
+
+
+// Compiled scene, written by CompileScene and used straight from the mapping at runtime
+// Every table entry is made of 4 byte fields so the layout is the same for every compiler
+const uint32_t SCENE_MAGIC = 0x314E4353; // "SCN1"
+const uint32_t SCENE_VERSION = 1;
+const int SCENE_NAME_LENGTH = 64;
+
+struct SceneHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t mesh_count;
+	uint32_t mesh_offset;
+	uint32_t material_count;
+	uint32_t material_offset;
+	uint32_t row_count;
+	uint32_t row_offset;
+	uint32_t instance_count;
+	uint32_t instance_offset;
+};
+
+// Mesh and texture file, an empty texture path means the mesh has none
+struct SceneMesh
+{
+	char name[SCENE_NAME_LENGTH];
+	char object_path[SCENE_NAME_LENGTH];
+	char texture_path[SCENE_NAME_LENGTH];
+};
+
+struct SceneMaterial
+{
+	float ambient[3];
+	float diffuse[3];
+	float specular[3];
+	float power;
+};
+
+struct SceneTransform
+{
+	float position[3];
+	float rotation[4]; // Quaternion x, y, z, w
+	float scale[3];
+};
+
+// An object repeated along the street (z), copy k is moved k * spacing from the transform
+// Copies outside [first, last] are skipped. With more than one material every copy picks one of them
+struct SceneRow
+{
+	SceneTransform transform;
+	uint32_t mesh;
+	uint32_t material;
+	uint32_t material_count;
+	uint32_t flags;
+	float spacing;
+	int32_t first;
+	int32_t last;
+	float light_offset[3];	// Position of the light relative to the copy
+	float light_radius;		// 0 when the row gives no light
+};
+
+// A single object, animations are looked up by name
+struct SceneInstance
+{
+	SceneTransform transform;
+	uint32_t mesh;
+	uint32_t material;
+	uint32_t flags;
+	char animation[SCENE_NAME_LENGTH];
+};
+
+
+// A compiled scene file, mapped read only
+class SceneFile
+{
+private:
+	MappedFile file;
+	const SceneHeader * header = nullptr;
+
+	template <typename T>
+	const T * Table(uint32_t offset) const
+	{
+		return (const T *)(this->file.Data() + offset);
+	}
+public:
+	bool Open(const char * path);
+
+	size_t MeshCount() const;
+	const SceneMesh & GetMesh(size_t mesh) const;
+	size_t MaterialCount() const;
+	Material GetMaterial(size_t material) const;
+	size_t RowCount() const;
+	const SceneRow & GetRow(size_t row) const;
+	size_t InstanceCount() const;
+	const SceneInstance & GetInstance(size_t instance) const;
+
+	static Transform ToTransform(const SceneTransform & transform);
+	static int RowMaterial(const SceneRow & row, int copy);
+};
@@ -0,0 +1,341 @@
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "glsl.h"
+#include "stats.h"
+#include "shadowAtlas.h"
+#include "glState.h"
+#include "glStorage.h"
+
+const char * shadow_fragshader_name = "shadow.fsh";
+const char * shadow_vertexshader_name = "shadow.vsh";
+
+const int SHADOW_ATLAS_SIZE = SHADOW_TILE_SIZE * SHADOW_TILES_PER_ROW;
+
+
+/// <summary>
+/// Creates a depth texture the size of the atlas
+/// </summary>
+/// <param name="compare">Set up for sampler2DShadow lookups</param>
+static GLuint CreateDepthTexture(bool compare)
+{
+	GLuint texture = CreateTextureStorage(GL_DEPTH_COMPONENT32F, SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE, 1);
+	SetTextureSampling(texture, compare ? GL_LINEAR : GL_NEAREST, GL_CLAMP_TO_EDGE, compare ? GL_LEQUAL : GL_NONE);
+	return texture;
+}
+
+
+/// <summary>
+/// Creates a depth only framebuffer around a texture
+/// </summary>
+static GLuint CreateDepthFramebuffer(GLuint texture)
+{
+	GLuint fbo;
+	glGenFramebuffers(1, &fbo);
+	gl_state.BindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	gl_state.BindFramebuffer(GL_FRAMEBUFFER, 0);
+	return fbo;
+}
+
+
+/// <summary>
+/// Creates the atlases, the depth program and the timer queries, has to be called after glew is initialized
+/// </summary>
+void ShadowAtlas::Initialize()
+{
+	this->static_texture = CreateDepthTexture(false);
+	this->frame_texture = CreateDepthTexture(true);
+	this->static_fbo = CreateDepthFramebuffer(this->static_texture);
+	this->frame_fbo = CreateDepthFramebuffer(this->frame_texture);
+
+	char * vertexshader = glsl::readFile(shadow_vertexshader_name);
+	GLuint vsh_id = glsl::makeVertexShader(vertexshader);
+	delete[] vertexshader;
+
+	char * fragshader = glsl::readFile(shadow_fragshader_name);
+	GLuint fsh_id = glsl::makeFragmentShader(fragshader);
+	delete[] fragshader;
+
+	this->program = glsl::makeShaderProgram(vsh_id, fsh_id);
+	this->mvp_location = glGetUniformLocation(this->program, "mvp");
+
+	glGenBuffers(1, &this->matrix_buffer);
+	glGenQueries(QUERIES, this->queries);
+}
+
+
+/// <summary>
+/// Places the lights in the atlas, the matrices only change (and the cache is only redrawn) when a light moved
+/// The cpu side of SetLights without gl calls, the lights are compared in place so an unchanged frame doesn't allocate
+/// </summary>
+/// <param name="main_light">Gets the first six tiles</param>
+/// <param name="lights">Point lights, lights that don't fit in the atlas cast no shadows</param>
+/// <returns>Whether the lights changed</returns>
+bool ShadowAtlas::UpdateLights(const LightSource & main_light, const std::vector<LightSource> & lights)
+{
+	const int count = (int)std::min<size_t>(lights.size() + 1, SHADOW_MAX_LIGHTS);
+	auto key = [&](int l) {
+		return l == 0 ? glm::vec4(main_light.position, SHADOW_MAIN_LIGHT_RANGE) : glm::vec4(lights[l - 1].position, lights[l - 1].radius);
+	};
+
+	bool changed = count != (int)this->light_keys.size();
+	for (int l = 0; l < count && !changed; l++)
+		changed = key(l) != this->light_keys[l];
+	if (!changed)
+		return false;
+
+	this->light_keys.resize(count);
+	for (int l = 0; l < count; l++)
+		this->light_keys[l] = key(l);
+	this->light_count = count;
+	this->static_dirty = true;
+
+	static const glm::vec3 directions[SHADOW_FACES] = {
+		glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)
+	};
+
+	const float tile_scale = 1.0f / SHADOW_TILES_PER_ROW;
+	this->atlas_matrices.clear();
+	this->view_projections.clear();
+	for (int l = 0; l < this->light_count; l++)
+	{
+		const glm::vec3 position = glm::vec3(this->light_keys[l]);
+		const glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.05f, this->light_keys[l].w);
+
+		for (int face = 0; face < SHADOW_FACES; face++)
+		{
+			const glm::vec3 up = face == 2 || face == 3 ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+			const glm::mat4 view_projection = projection * glm::lookAt(position, position + directions[face], up);
+			this->view_projections.push_back(view_projection);
+
+			// Clip space to the tile in the atlas, depth to [0, 1]
+			const int tile = l * SHADOW_FACES + face;
+			const glm::vec2 offset = glm::vec2(tile % SHADOW_TILES_PER_ROW, tile / SHADOW_TILES_PER_ROW) * tile_scale;
+			const glm::mat4 bias = glm::translate(glm::mat4(), glm::vec3(offset + glm::vec2(0.5f * tile_scale), 0.5f))
+				* glm::scale(glm::mat4(), glm::vec3(0.5f * tile_scale, 0.5f * tile_scale, 0.5f));
+			this->atlas_matrices.push_back(bias * view_projection);
+		}
+	}
+	this->upload_pending = true;
+	return true;
+}
+
+
+/// <summary>
+/// Places the lights in the atlas and uploads the matrices of the tiles when they changed
+/// </summary>
+/// <param name="main_light">Gets the first six tiles</param>
+/// <param name="lights">Point lights, lights that don't fit in the atlas cast no shadows</param>
+void ShadowAtlas::SetLights(const LightSource & main_light, const std::vector<LightSource> & lights)
+{
+	this->UpdateLights(main_light, lights);
+	if (!this->upload_pending)
+		return;
+
+	gl_state.BindBuffer(GL_SHADER_STORAGE_BUFFER, this->matrix_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, this->atlas_matrices.size() * sizeof(glm::mat4), this->atlas_matrices.data(), GL_STATIC_DRAW);
+	gl_state.BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	this->upload_pending = false;
+}
+
+
+bool ShadowAtlas::IsCaching() const
+{
+	return this->caching;
+}
+
+
+/// <summary>
+/// Switches between the cached atlas and redrawing every caster every frame
+/// </summary>
+void ShadowAtlas::ToggleCaching()
+{
+	this->caching = !this->caching;
+	this->static_dirty = true;
+}
+
+
+/// <summary>
+/// Redraws the cached static casters next frame, for when static casters were added or removed
+/// </summary>
+void ShadowAtlas::InvalidateStatic()
+{
+	this->static_dirty = true;
+}
+
+
+/// <summary>
+/// Lights with shadows, the main light is light 0 and point light i is light i + 1
+/// </summary>
+int ShadowAtlas::LightCount() const
+{
+	return this->light_count;
+}
+
+
+int ShadowAtlas::TileCount() const
+{
+	return this->light_count * SHADOW_FACES;
+}
+
+
+const glm::mat4 & ShadowAtlas::TileViewProjection(int tile) const
+{
+	return this->view_projections[tile];
+}
+
+
+/// <summary>
+/// The atlas the shader samples
+/// </summary>
+GLuint ShadowAtlas::Texture() const
+{
+	return this->frame_texture;
+}
+
+
+/// <summary>
+/// World to atlas matrix of every tile
+/// </summary>
+GLuint ShadowAtlas::MatrixBuffer() const
+{
+	return this->matrix_buffer;
+}
+
+
+/// <summary>
+/// Copies a tile of the cached static casters into the frame atlas
+/// </summary>
+void ShadowAtlas::CopyTile(int tile)
+{
+	const int x = (tile % SHADOW_TILES_PER_ROW) * SHADOW_TILE_SIZE;
+	const int y = (tile / SHADOW_TILES_PER_ROW) * SHADOW_TILE_SIZE;
+	glCopyImageSubData(this->static_texture, GL_TEXTURE_2D, 0, x, y, 0,
+		this->frame_texture, GL_TEXTURE_2D, 0, x, y, 0, SHADOW_TILE_SIZE, SHADOW_TILE_SIZE, 1);
+}
+
+
+/// <summary>
+/// Starts the shadow pass
+/// </summary>
+void ShadowAtlas::Begin()
+{
+	this->cpu_start = GetWallTime();
+	this->static_drawn = false;
+
+	glBeginQuery(GL_TIME_ELAPSED, this->queries[this->query_frame % QUERIES]);
+	gl_state.GetViewport(this->viewport);
+	this->framebuffer = gl_state.DrawFramebuffer();
+
+	// A partly redrawn frame must not cut off the atlas
+	this->scissor = gl_state.IsEnabled(GL_SCISSOR_TEST);
+	gl_state.Disable(GL_SCISSOR_TEST);
+	gl_state.UseProgram(this->program);
+	gl_state.Enable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.0f, 4.0f);
+}
+
+
+/// <summary>
+/// Binds the target for the static casters
+/// </summary>
+/// <returns>Whether the static casters have to be drawn, false while the cache is valid</returns>
+bool ShadowAtlas::BeginStatic()
+{
+	if (this->caching && !this->static_dirty)
+		return false;
+
+	gl_state.BindFramebuffer(GL_FRAMEBUFFER, this->caching ? this->static_fbo : this->frame_fbo);
+	gl_state.Viewport(0, 0, SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	this->static_dirty = false;
+	this->static_drawn = true;
+	return true;
+}
+
+
+/// <summary>
+/// Binds the frame atlas for the dynamic casters and restores the tiles they were drawn in last frame
+/// </summary>
+/// <param name="tiles">Tiles with a dynamic caster in them this frame</param>
+void ShadowAtlas::BeginDynamic(const std::vector<int> & tiles)
+{
+	if (this->caching)
+	{
+		if (this->static_drawn)
+		{
+			glCopyImageSubData(this->static_texture, GL_TEXTURE_2D, 0, 0, 0, 0,
+				this->frame_texture, GL_TEXTURE_2D, 0, 0, 0, 0, SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE, 1);
+		}
+		else
+		{
+			for (int tile : this->dirty_tiles)
+				this->CopyTile(tile);
+		}
+		stats.Add("shadow restored tiles", this->static_drawn ? (double)this->TileCount() : (double)this->dirty_tiles.size());
+	}
+	this->dirty_tiles = tiles;
+
+	gl_state.BindFramebuffer(GL_FRAMEBUFFER, this->frame_fbo);
+}
+
+
+/// <summary>
+/// Limits drawing to a single tile
+/// </summary>
+void ShadowAtlas::DrawTile(int tile)
+{
+	gl_state.Viewport((tile % SHADOW_TILES_PER_ROW) * SHADOW_TILE_SIZE, (tile / SHADOW_TILES_PER_ROW) * SHADOW_TILE_SIZE, SHADOW_TILE_SIZE, SHADOW_TILE_SIZE);
+}
+
+
+/// <summary>
+/// Draws the depth of a caster into the current tile
+/// </summary>
+/// <param name="mvp">Tile view projection * world</param>
+/// <param name="mesh"></param>
+void ShadowAtlas::DrawCaster(const glm::mat4 & mvp, ModelRenderer & mesh)
+{
+	gl_state.UniformMatrix4fv(this->mvp_location, 1, GL_FALSE, glm::value_ptr(mvp));
+	mesh.DrawDepth();
+}
+
+
+/// <summary>
+/// Ends the shadow pass and restores the framebuffer the frame is drawn in
+/// </summary>
+void ShadowAtlas::End()
+{
+	gl_state.BindVertexArray(0);
+	gl_state.Disable(GL_POLYGON_OFFSET_FILL);
+	gl_state.BindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+	gl_state.Viewport(this->viewport[0], this->viewport[1], this->viewport[2], this->viewport[3]);
+	if (this->scissor)
+		gl_state.Enable(GL_SCISSOR_TEST);
+	glEndQuery(GL_TIME_ELAPSED);
+
+	// Result of a query from a few frames ago, skipped when the gpu isn't done with it yet
+	this->query_frame++;
+	if (this->query_frame >= QUERIES)
+	{
+		GLuint query = this->queries[this->query_frame % QUERIES];
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			stats.Add("shadow gpu ms", elapsed / 1e6);
+		}
+	}
+	stats.Add("shadow cpu ms", GetWallTime() - this->cpu_start);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "types.h"
+#include "modelRenderer.h"
+
+
+// Every light gets six cube faces in the atlas, the main light first and then the point lights
+const int SHADOW_TILE_SIZE = 512;
+const int SHADOW_TILES_PER_ROW = 8;
+const int SHADOW_FACES = 6;
+const int SHADOW_MAX_LIGHTS = SHADOW_TILES_PER_ROW * SHADOW_TILES_PER_ROW / SHADOW_FACES;
+
+// Shader storage binding of the world to atlas matrices
+const unsigned int SHADOW_BUFFER_BINDING = 4;
+
+// Range of the main light, it has no radius of its own
+const float SHADOW_MAIN_LIGHT_RANGE = 100.0f;
+
+// Depth maps of all lights in one texture
+// Static casters are rendered into a cached atlas that is only redrawn when the lights or the static casters change,
+// every frame the tiles dynamic casters touch are restored from the cache and the dynamic casters are drawn on top
+class ShadowAtlas
+{
+private:
+	// Cached static casters and the atlas the shader samples
+	GLuint static_texture = 0;
+	GLuint frame_texture = 0;
+	GLuint static_fbo = 0;
+	GLuint frame_fbo = 0;
+
+	GLuint program = 0;
+	GLint mvp_location = -1;
+	GLuint matrix_buffer = 0;
+
+	std::vector<glm::vec4> light_keys;
+	std::vector<glm::mat4> view_projections;
+	int light_count = 0;
+
+	// World to atlas matrices, waiting for SetLights to upload them when upload_pending is set
+	std::vector<glm::mat4> atlas_matrices;
+	bool upload_pending = false;
+
+	bool caching = true;
+	bool static_dirty = true;
+
+	// Tiles with dynamic casters in them, they have to be restored from the cache next frame
+	std::vector<int> dirty_tiles;
+
+	// Gpu timer of the shadow pass, read a few frames later so it never stalls
+	static const int QUERIES = 3;
+	GLuint queries[QUERIES] = {};
+	int query_frame = 0;
+
+	// Set when the static casters were drawn this frame, the whole atlas has to be refreshed
+	bool static_drawn = false;
+	GLint viewport[4] = {};
+	GLuint framebuffer = 0;
+	bool scissor = false;
+	double cpu_start = 0.0;
+
+	void CopyTile(int tile);
+public:
+	void Initialize();
+	bool UpdateLights(const LightSource & main_light, const std::vector<LightSource> & lights);
+	void SetLights(const LightSource & main_light, const std::vector<LightSource> & lights);
+
+	bool IsCaching() const;
+	void ToggleCaching();
+	void InvalidateStatic();
+	int LightCount() const;
+	int TileCount() const;
+	const glm::mat4 & TileViewProjection(int tile) const;
+	GLuint Texture() const;
+	GLuint MatrixBuffer() const;
+
+	void Begin();
+	bool BeginStatic();
+	void BeginDynamic(const std::vector<int> & tiles);
+	void DrawTile(int tile);
+	void DrawCaster(const glm::mat4 & mvp, ModelRenderer & mesh);
+	void End();
+};
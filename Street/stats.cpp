@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+
+#include "stats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <unistd.h>
+#endif
+
+Stats stats;
+
+
+/// <summary>
+/// ctor
+/// </summary>
+/// <param name="interval">Amount of frames between two prints</param>
+Stats::Stats(int interval)
+{
+	this->interval = interval;
+}
+
+
+/// <summary>
+/// Finds a counter, it is created on first use
+/// </summary>
+Stats::Counter & Stats::Find(const char * name)
+{
+	for (auto & counter : this->counters)
+		if (counter.name == name)
+			return counter;
+
+	this->counters.push_back(Counter{ name, 0.0, 0.0, 0.0 });
+	return this->counters.back();
+}
+
+
+/// <summary>
+/// Adds a value to a counter for the current frame
+/// </summary>
+/// <param name="name"></param>
+/// <param name="value"></param>
+void Stats::Add(const char * name, double value)
+{
+	Find(name).frame += value;
+}
+
+
+/// <summary>
+/// Returns the value a counter has so far this frame
+/// </summary>
+double Stats::Get(const char * name)
+{
+	return Find(name).frame;
+}
+
+
+bool Stats::IsEnabled() const
+{
+	return this->enabled;
+}
+
+
+/// <summary>
+/// Toggles printing to the console
+/// </summary>
+void Stats::Toggle()
+{
+	this->enabled = !this->enabled;
+}
+
+
+/// <summary>
+/// Closes the frame, the counters are accumulated and reset
+/// </summary>
+void Stats::EndFrame()
+{
+	for (auto & counter : this->counters)
+	{
+		counter.sum += counter.frame;
+		counter.max = std::max(counter.max, counter.frame);
+		counter.frame = 0.0;
+	}
+
+	if (++this->frames < this->interval)
+		return;
+
+	if (this->enabled)
+		Print();
+
+	for (auto & counter : this->counters)
+	{
+		counter.sum = 0.0;
+		counter.max = 0.0;
+	}
+	this->frames = 0;
+}
+
+
+/// <summary>
+/// Prints the average and peak per frame of every counter
+/// </summary>
+void Stats::Print()
+{
+	if (this->frames == 0)
+		return;
+
+	printf("---- stats over %d frames (avg / max per frame)\n", this->frames);
+	for (auto & counter : this->counters)
+		printf("  %-32s %14.3f %14.3f\n", counter.name.c_str(), counter.sum / this->frames, counter.max);
+}
+
+
+/// <summary>
+/// Returns the resident memory (working set) of the process in bytes
+/// </summary>
+/// <returns></returns>
+size_t GetResidentMemory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.WorkingSetSize;
+	return 0;
+#else
+	long pages = 0;
+	FILE * file = fopen("/proc/self/statm", "r");
+	if (file == NULL)
+		return 0;
+	if (fscanf(file, "%*s %ld", &pages) != 1)
+		pages = 0;
+	fclose(file);
+	return (size_t)pages * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+
+/// <summary>
+/// Current time in milliseconds, only the difference between two calls means something
+/// </summary>
+double GetWallTime()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+
+/// <summary>
+/// Returns the cpu time of all threads of the process in milliseconds
+/// </summary>
+/// <returns></returns>
+double GetProcessCpuTime()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+		return 0.0;
+	const unsigned long long kernel_time = ((unsigned long long)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+	const unsigned long long user_time = ((unsigned long long)user.dwHighDateTime << 32) | user.dwLowDateTime;
+	return (kernel_time + user_time) / 1e4;
+#else
+	struct timespec time;
+	if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0)
+		return 0.0;
+	return time.tv_sec * 1e3 + time.tv_nsec / 1e6;
+#endif
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+
+// Per frame counters, averaged over an interval and printed to the console when enabled
+class Stats
+{
+private:
+	struct Counter
+	{
+		std::string name;
+		double frame;
+		double sum;
+		double max;
+	};
+
+	std::vector<Counter> counters;
+	int frames = 0;
+	int interval;
+	bool enabled = false;
+
+	Counter & Find(const char * name);
+public:
+	Stats(int interval = 100);
+
+	void Add(const char * name, double value);
+	double Get(const char * name);
+	bool IsEnabled() const;
+	void Toggle();
+	void EndFrame();
+	void Print();
+};
+
+extern Stats stats;
+
+// Resident memory (working set) of the process in bytes
+size_t GetResidentMemory();
+
+// Current time in milliseconds, for measuring how long something took
+double GetWallTime();
+
+// Cpu time the process used so far (all threads, user and kernel) in milliseconds
+double GetProcessCpuTime();
@@ -0,0 +1,205 @@
+#include <chrono>
+
+#include "stats.h"
+#include "streamBuffer.h"
+#include "glState.h"
+
+
+StreamBuffer::~StreamBuffer()
+{
+	Release();
+}
+
+
+/// <summary>
+/// Creates the buffer
+/// </summary>
+/// <param name="target">GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER or GL_ARRAY_BUFFER</param>
+/// <param name="segment_size">Amount of bytes that can be written per frame</param>
+void StreamBuffer::Initialize(GLenum target, GLsizeiptr segment_size)
+{
+	this->target = target;
+
+	// Ranges that are bound to a uniform or storage block have to start at an aligned offset
+	GLint align = 16;
+	if (target == GL_UNIFORM_BUFFER)
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+	else if (target == GL_SHADER_STORAGE_BUFFER)
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &align);
+	this->alignment = align > 0 ? align : 16;
+	this->segment_size = (segment_size + this->alignment - 1) / this->alignment * this->alignment;
+
+	const GLsizeiptr total = this->segment_size * SEGMENTS;
+	this->persistent = GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
+
+	glGenBuffers(1, &this->buffer);
+	gl_state.BindBuffer(target, this->buffer);
+	if (this->persistent)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(target, total, nullptr, flags);
+		this->mapped = (char *)glMapBufferRange(target, 0, total, flags);
+	}
+	else
+	{
+		glBufferData(target, total, nullptr, GL_STREAM_DRAW);
+	}
+	gl_state.BindBuffer(target, 0);
+
+	this->segment = 0;
+	this->offset = 0;
+}
+
+
+/// <summary>
+/// Makes sure a frame can hold at least segment_size bytes, the buffer is recreated when it is too small
+/// </summary>
+/// <param name="segment_size"></param>
+void StreamBuffer::Reserve(GLsizeiptr segment_size)
+{
+	if (segment_size <= this->segment_size)
+		return;
+
+	Release();
+	Initialize(this->target, segment_size + segment_size / 2);
+}
+
+
+/// <summary>
+/// Deletes the buffer and its fences
+/// </summary>
+void StreamBuffer::Release()
+{
+	for (auto & fence : this->fences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+		fence = 0;
+	}
+
+	if (this->buffer == 0)
+		return;
+
+	if (this->mapped != nullptr || this->segment_data != nullptr)
+	{
+		gl_state.BindBuffer(this->target, this->buffer);
+		glUnmapBuffer(this->target);
+		gl_state.BindBuffer(this->target, 0);
+	}
+	gl_state.DeleteBuffers(1, &this->buffer);
+
+	this->buffer = 0;
+	this->mapped = nullptr;
+	this->segment_data = nullptr;
+	this->segment_size = 0;
+}
+
+
+GLuint StreamBuffer::Buffer() const
+{
+	return this->buffer;
+}
+
+
+GLsizeiptr StreamBuffer::SegmentSize() const
+{
+	return this->segment_size;
+}
+
+
+/// <summary>
+/// Waits until the gpu finished reading a segment, the time spent waiting is counted as a stall
+/// </summary>
+/// <param name="segment"></param>
+void StreamBuffer::WaitForSegment(int segment)
+{
+	GLsync & fence = this->fences[segment];
+	if (!fence)
+		return;
+
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		do
+		{
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+		stats.Add("stream stall ms", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+	}
+
+	glDeleteSync(fence);
+	fence = 0;
+}
+
+
+/// <summary>
+/// Starts writing to the next segment
+/// </summary>
+void StreamBuffer::BeginFrame()
+{
+	WaitForSegment(this->segment);
+	this->offset = 0;
+
+	if (this->persistent)
+	{
+		this->segment_data = this->mapped + this->segment * this->segment_size;
+		return;
+	}
+
+	// The fence already made sure the gpu is done with this range
+	gl_state.BindBuffer(this->target, this->buffer);
+	this->segment_data = (char *)glMapBufferRange(this->target, this->segment * this->segment_size, this->segment_size,
+		GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	gl_state.BindBuffer(this->target, 0);
+}
+
+
+/// <summary>
+/// Hands out a piece of the current segment
+/// </summary>
+/// <param name="size">Size in bytes</param>
+/// <param name="alignment">Minimum alignment, the binding alignment of the target is always respected</param>
+/// <returns>The allocation, data is nullptr when the segment is full</returns>
+StreamAllocation StreamBuffer::Allocate(GLsizeiptr size, GLsizeiptr alignment)
+{
+	if (alignment < this->alignment)
+		alignment = this->alignment;
+
+	GLsizeiptr start = (this->offset + alignment - 1) / alignment * alignment;
+	if (this->segment_data == nullptr || start + size > this->segment_size)
+		return StreamAllocation{ nullptr, 0, 0 };
+
+	this->offset = start + size;
+	stats.Add("stream bytes", (double)size);
+
+	return StreamAllocation{ this->segment_data + start, this->segment * this->segment_size + start, size };
+}
+
+
+/// <summary>
+/// Makes the writes of this frame visible to the gpu, has to be called before drawing with them
+/// A coherent persistent mapping doesn't need anything
+/// </summary>
+void StreamBuffer::Flush()
+{
+	if (this->persistent || this->segment_data == nullptr)
+		return;
+
+	gl_state.BindBuffer(this->target, this->buffer);
+	glUnmapBuffer(this->target);
+	gl_state.BindBuffer(this->target, 0);
+	this->segment_data = nullptr;
+}
+
+
+/// <summary>
+/// Fences the segment of this frame and moves on to the next one
+/// </summary>
+void StreamBuffer::EndFrame()
+{
+	Flush();
+
+	this->fences[this->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	this->segment = (this->segment + 1) % SEGMENTS;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <GL/glew.h>
+
+
+// A piece of a stream buffer the cpu can write to directly
+struct StreamAllocation
+{
+	void * data;
+	GLintptr offset;
+	GLsizeiptr size;
+};
+
+// Ring buffer for data that changes every frame
+// The buffer is split in three segments (one per frame in flight) and stays mapped for its whole life,
+// a fence per segment makes sure the gpu is done reading before the cpu writes it again
+class StreamBuffer
+{
+private:
+	static const int SEGMENTS = 3;
+
+	GLuint buffer = 0;
+	GLenum target = GL_UNIFORM_BUFFER;
+	GLsizeiptr segment_size = 0;
+	GLsizeiptr alignment = 1;
+
+	// Persistent mapping (GL 4.4), otherwise the segment is mapped unsynchronized every frame
+	bool persistent = false;
+	char * mapped = nullptr;
+	char * segment_data = nullptr;
+
+	int segment = 0;
+	GLsizeiptr offset = 0;
+	GLsync fences[SEGMENTS] = {};
+
+	void WaitForSegment(int segment);
+	void Release();
+public:
+	~StreamBuffer();
+
+	void Initialize(GLenum target, GLsizeiptr segment_size);
+	void Reserve(GLsizeiptr segment_size);
+	GLuint Buffer() const;
+	GLsizeiptr SegmentSize() const;
+
+	void BeginFrame();
+	StreamAllocation Allocate(GLsizeiptr size, GLsizeiptr alignment = 16);
+	void Flush();
+	void EndFrame();
+};
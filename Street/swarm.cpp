@@ -0,0 +1,725 @@
+#include <math.h>
+#include <random>
+#include <algorithm>
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "glsl.h"
+#include "stats.h"
+#include "swarm.h"
+#include "modelRenderer.h"
+#include "matrixKernels.h"
+#include "glState.h"
+#include "glStorage.h"
+
+const char * swarm_fragshader_name = "swarm.fsh";
+const char * swarm_vertexshader_name = "swarm.vsh";
+
+// Planes per job, a multiple of 8 so only the last range has a tail the simd kernels don't cover
+const size_t SWARM_GRAIN = 1024;
+
+// Position of the padding after the candidates, far outside every neighbour radius
+const float FAR_AWAY = 1e15f;
+
+const float TWO_PI = 6.28318531f;
+
+
+// Planes in the cells around the one a plane is in, copied next to each other and padded to a multiple of 8
+struct Candidates
+{
+	std::vector<float> x, y, z, vx, vy, vz;
+	int count = 0;
+
+	void Clear()
+	{
+		this->count = 0;
+	}
+
+	// Room for all planes of the swarm (and the padding), however they bunch up the candidates fit
+	void Reserve(int planes)
+	{
+		if ((int)this->x.size() < planes + 8)
+		{
+			for (auto stream : { &this->x, &this->y, &this->z, &this->vx, &this->vy, &this->vz })
+				stream->resize(planes + 8);
+		}
+	}
+
+	void Append(const std::vector<float> * streams, unsigned int begin, unsigned int end)
+	{
+		for (unsigned int j = begin; j < end; j++, this->count++)
+		{
+			this->x[this->count] = streams[SWARM_X][j];
+			this->y[this->count] = streams[SWARM_Y][j];
+			this->z[this->count] = streams[SWARM_Z][j];
+			this->vx[this->count] = streams[SWARM_VX][j];
+			this->vy[this->count] = streams[SWARM_VY][j];
+			this->vz[this->count] = streams[SWARM_VZ][j];
+		}
+	}
+
+	/// <returns>The padded count</returns>
+	int Pad()
+	{
+		int padded = (this->count + 7) & ~7;
+		for (int j = this->count; j < padded; j++)
+		{
+			this->x[j] = this->y[j] = this->z[j] = FAR_AWAY;
+			this->vx[j] = this->vy[j] = this->vz[j] = 0.0f;
+		}
+		return padded;
+	}
+};
+
+// What a plane sees of its neighbours
+struct FlockSums
+{
+	float count;
+	glm::vec3 offset;		// Sum of the offsets to the neighbours
+	glm::vec3 velocity;		// Sum of their velocities
+	glm::vec3 separation;	// Away from the planes that are too close, stronger the closer they are
+};
+
+
+/// <summary>
+/// Reference implementation, used when there is no simd support
+/// </summary>
+static void FlockScalar(const Candidates & nearby, int count, const glm::vec3 & p, float radius2, float separation2, FlockSums & sums)
+{
+	sums = FlockSums{ 0.0f, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f) };
+	for (int j = 0; j < count; j++)
+	{
+		const glm::vec3 d = glm::vec3(nearby.x[j], nearby.y[j], nearby.z[j]) - p;
+		const float d2 = glm::dot(d, d);
+		if (d2 >= radius2 || d2 <= 0.0f)
+			continue;
+
+		sums.count += 1.0f;
+		sums.offset += d;
+		sums.velocity += glm::vec3(nearby.vx[j], nearby.vy[j], nearby.vz[j]);
+		if (d2 < separation2)
+			sums.separation -= d / d2;
+	}
+}
+
+
+/// <summary>
+/// Adds up the four lanes
+/// </summary>
+static inline float Sum4(__m128 v)
+{
+	v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+	v = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(v);
+}
+
+
+/// <summary>
+/// Four candidates per iteration, the ones outside the radius (and the plane itself) are masked out
+/// A masked lane can be nan (0 / 0 for the plane itself), the and with the mask still clears it
+/// </summary>
+static void FlockSSE(const Candidates & nearby, int count, const glm::vec3 & p, float radius2, float separation2, FlockSums & sums)
+{
+	const __m128 px = _mm_set1_ps(p.x);
+	const __m128 py = _mm_set1_ps(p.y);
+	const __m128 pz = _mm_set1_ps(p.z);
+	const __m128 r2 = _mm_set1_ps(radius2);
+	const __m128 s2 = _mm_set1_ps(separation2);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	__m128 n = zero, ox = zero, oy = zero, oz = zero, vx = zero, vy = zero, vz = zero, sx = zero, sy = zero, sz = zero;
+	for (int j = 0; j < count; j += 4)
+	{
+		const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&nearby.x[j]), px);
+		const __m128 dy = _mm_sub_ps(_mm_loadu_ps(&nearby.y[j]), py);
+		const __m128 dz = _mm_sub_ps(_mm_loadu_ps(&nearby.z[j]), pz);
+		const __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		const __m128 in = _mm_and_ps(_mm_cmplt_ps(d2, r2), _mm_cmpgt_ps(d2, zero));
+		const __m128 close = _mm_and_ps(in, _mm_cmplt_ps(d2, s2));
+		const __m128 inv = _mm_div_ps(one, d2);
+
+		n = _mm_add_ps(n, _mm_and_ps(in, one));
+		ox = _mm_add_ps(ox, _mm_and_ps(in, dx));
+		oy = _mm_add_ps(oy, _mm_and_ps(in, dy));
+		oz = _mm_add_ps(oz, _mm_and_ps(in, dz));
+		vx = _mm_add_ps(vx, _mm_and_ps(in, _mm_loadu_ps(&nearby.vx[j])));
+		vy = _mm_add_ps(vy, _mm_and_ps(in, _mm_loadu_ps(&nearby.vy[j])));
+		vz = _mm_add_ps(vz, _mm_and_ps(in, _mm_loadu_ps(&nearby.vz[j])));
+		sx = _mm_sub_ps(sx, _mm_and_ps(close, _mm_mul_ps(dx, inv)));
+		sy = _mm_sub_ps(sy, _mm_and_ps(close, _mm_mul_ps(dy, inv)));
+		sz = _mm_sub_ps(sz, _mm_and_ps(close, _mm_mul_ps(dz, inv)));
+	}
+
+	sums.count = Sum4(n);
+	sums.offset = glm::vec3(Sum4(ox), Sum4(oy), Sum4(oz));
+	sums.velocity = glm::vec3(Sum4(vx), Sum4(vy), Sum4(vz));
+	sums.separation = glm::vec3(Sum4(sx), Sum4(sy), Sum4(sz));
+}
+
+
+/// <summary>
+/// Adds up the eight lanes
+/// </summary>
+KERNEL_TARGET_AVX2
+static inline float Sum8(__m256 v)
+{
+	return Sum4(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+
+/// <summary>
+/// Same as the sse kernel with eight candidates per iteration
+/// </summary>
+KERNEL_TARGET_AVX2
+static void FlockAVX2(const Candidates & nearby, int count, const glm::vec3 & p, float radius2, float separation2, FlockSums & sums)
+{
+	const __m256 px = _mm256_set1_ps(p.x);
+	const __m256 py = _mm256_set1_ps(p.y);
+	const __m256 pz = _mm256_set1_ps(p.z);
+	const __m256 r2 = _mm256_set1_ps(radius2);
+	const __m256 s2 = _mm256_set1_ps(separation2);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	__m256 n = zero, ox = zero, oy = zero, oz = zero, vx = zero, vy = zero, vz = zero, sx = zero, sy = zero, sz = zero;
+	for (int j = 0; j < count; j += 8)
+	{
+		const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&nearby.x[j]), px);
+		const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&nearby.y[j]), py);
+		const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(&nearby.z[j]), pz);
+		const __m256 d2 = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+		const __m256 in = _mm256_and_ps(_mm256_cmp_ps(d2, r2, _CMP_LT_OQ), _mm256_cmp_ps(d2, zero, _CMP_GT_OQ));
+		const __m256 close = _mm256_and_ps(in, _mm256_cmp_ps(d2, s2, _CMP_LT_OQ));
+		const __m256 inv = _mm256_div_ps(one, d2);
+
+		n = _mm256_add_ps(n, _mm256_and_ps(in, one));
+		ox = _mm256_add_ps(ox, _mm256_and_ps(in, dx));
+		oy = _mm256_add_ps(oy, _mm256_and_ps(in, dy));
+		oz = _mm256_add_ps(oz, _mm256_and_ps(in, dz));
+		vx = _mm256_add_ps(vx, _mm256_and_ps(in, _mm256_loadu_ps(&nearby.vx[j])));
+		vy = _mm256_add_ps(vy, _mm256_and_ps(in, _mm256_loadu_ps(&nearby.vy[j])));
+		vz = _mm256_add_ps(vz, _mm256_and_ps(in, _mm256_loadu_ps(&nearby.vz[j])));
+		sx = _mm256_sub_ps(sx, _mm256_and_ps(close, _mm256_mul_ps(dx, inv)));
+		sy = _mm256_sub_ps(sy, _mm256_and_ps(close, _mm256_mul_ps(dy, inv)));
+		sz = _mm256_sub_ps(sz, _mm256_and_ps(close, _mm256_mul_ps(dz, inv)));
+	}
+
+	sums.count = Sum8(n);
+	sums.offset = glm::vec3(Sum8(ox), Sum8(oy), Sum8(oz));
+	sums.velocity = glm::vec3(Sum8(vx), Sum8(vy), Sum8(vz));
+	sums.separation = glm::vec3(Sum8(sx), Sum8(sy), Sum8(sz));
+}
+
+
+// Arrays the integration reads and writes
+struct IntegrateArrays
+{
+	float * s[SWARM_STREAMS];
+	const float * ax;
+	const float * ay;
+	const float * az;
+};
+
+
+/// <summary>
+/// Reference implementation, also does the tails of the simd kernels
+/// Steers, pulls planes that left the box back in, keeps the speed between the limits, moves and wobbles
+/// </summary>
+static void IntegrateScalar(const IntegrateArrays & a, size_t begin, size_t end, const SwarmSettings & settings, float dt)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		glm::vec3 p = glm::vec3(a.s[SWARM_X][i], a.s[SWARM_Y][i], a.s[SWARM_Z][i]);
+		glm::vec3 v = glm::vec3(a.s[SWARM_VX][i], a.s[SWARM_VY][i], a.s[SWARM_VZ][i]);
+
+		v += glm::vec3(a.ax[i], a.ay[i], a.az[i]) * dt;
+		v += (glm::clamp(p, settings.bounds_min, settings.bounds_max) - p) * (settings.bounds_force * dt);
+
+		const float speed = sqrtf(glm::dot(v, v));
+		v *= std::min(std::max(speed, settings.min_speed), settings.max_speed) / std::max(speed, 1e-6f);
+		p += v * dt;
+
+		float phase = a.s[SWARM_PHASE][i] + a.s[SWARM_WOBBLE][i] * dt;
+		if (phase > TWO_PI)
+			phase -= TWO_PI;
+
+		a.s[SWARM_X][i] = p.x;
+		a.s[SWARM_Y][i] = p.y;
+		a.s[SWARM_Z][i] = p.z;
+		a.s[SWARM_VX][i] = v.x;
+		a.s[SWARM_VY][i] = v.y;
+		a.s[SWARM_VZ][i] = v.z;
+		a.s[SWARM_PHASE][i] = phase;
+	}
+}
+
+
+/// <summary>
+/// Four planes per iteration
+/// </summary>
+static void IntegrateSSE(const IntegrateArrays & a, size_t begin, size_t end, const SwarmSettings & settings, float dt)
+{
+	const __m128 t = _mm_set1_ps(dt);
+	const __m128 pull = _mm_set1_ps(settings.bounds_force * dt);
+	const __m128 min_speed = _mm_set1_ps(settings.min_speed);
+	const __m128 max_speed = _mm_set1_ps(settings.max_speed);
+	const __m128 epsilon = _mm_set1_ps(1e-6f);
+	const __m128 two_pi = _mm_set1_ps(TWO_PI);
+	const __m128 lo[3] = { _mm_set1_ps(settings.bounds_min.x), _mm_set1_ps(settings.bounds_min.y), _mm_set1_ps(settings.bounds_min.z) };
+	const __m128 hi[3] = { _mm_set1_ps(settings.bounds_max.x), _mm_set1_ps(settings.bounds_max.y), _mm_set1_ps(settings.bounds_max.z) };
+	const float * steer[3] = { a.ax, a.ay, a.az };
+
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 p[3], v[3];
+		for (int c = 0; c < 3; c++)
+		{
+			p[c] = _mm_loadu_ps(a.s[SWARM_X + c] + i);
+			v[c] = _mm_add_ps(_mm_loadu_ps(a.s[SWARM_VX + c] + i), _mm_mul_ps(_mm_loadu_ps(steer[c] + i), t));
+			const __m128 inside = _mm_min_ps(_mm_max_ps(p[c], lo[c]), hi[c]);
+			v[c] = _mm_add_ps(v[c], _mm_mul_ps(_mm_sub_ps(inside, p[c]), pull));
+		}
+
+		const __m128 speed = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(v[0], v[0]), _mm_mul_ps(v[1], v[1])), _mm_mul_ps(v[2], v[2])));
+		const __m128 limit = _mm_div_ps(_mm_min_ps(_mm_max_ps(speed, min_speed), max_speed), _mm_max_ps(speed, epsilon));
+		for (int c = 0; c < 3; c++)
+		{
+			v[c] = _mm_mul_ps(v[c], limit);
+			_mm_storeu_ps(a.s[SWARM_X + c] + i, _mm_add_ps(p[c], _mm_mul_ps(v[c], t)));
+			_mm_storeu_ps(a.s[SWARM_VX + c] + i, v[c]);
+		}
+
+		__m128 phase = _mm_add_ps(_mm_loadu_ps(a.s[SWARM_PHASE] + i), _mm_mul_ps(_mm_loadu_ps(a.s[SWARM_WOBBLE] + i), t));
+		phase = _mm_sub_ps(phase, _mm_and_ps(_mm_cmpgt_ps(phase, two_pi), two_pi));
+		_mm_storeu_ps(a.s[SWARM_PHASE] + i, phase);
+	}
+	IntegrateScalar(a, i, end, settings, dt);
+}
+
+
+/// <summary>
+/// Eight planes per iteration
+/// </summary>
+KERNEL_TARGET_AVX2
+static void IntegrateAVX2(const IntegrateArrays & a, size_t begin, size_t end, const SwarmSettings & settings, float dt)
+{
+	const __m256 t = _mm256_set1_ps(dt);
+	const __m256 pull = _mm256_set1_ps(settings.bounds_force * dt);
+	const __m256 min_speed = _mm256_set1_ps(settings.min_speed);
+	const __m256 max_speed = _mm256_set1_ps(settings.max_speed);
+	const __m256 epsilon = _mm256_set1_ps(1e-6f);
+	const __m256 two_pi = _mm256_set1_ps(TWO_PI);
+	const __m256 lo[3] = { _mm256_set1_ps(settings.bounds_min.x), _mm256_set1_ps(settings.bounds_min.y), _mm256_set1_ps(settings.bounds_min.z) };
+	const __m256 hi[3] = { _mm256_set1_ps(settings.bounds_max.x), _mm256_set1_ps(settings.bounds_max.y), _mm256_set1_ps(settings.bounds_max.z) };
+	const float * steer[3] = { a.ax, a.ay, a.az };
+
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 p[3], v[3];
+		for (int c = 0; c < 3; c++)
+		{
+			p[c] = _mm256_loadu_ps(a.s[SWARM_X + c] + i);
+			v[c] = _mm256_fmadd_ps(_mm256_loadu_ps(steer[c] + i), t, _mm256_loadu_ps(a.s[SWARM_VX + c] + i));
+			const __m256 inside = _mm256_min_ps(_mm256_max_ps(p[c], lo[c]), hi[c]);
+			v[c] = _mm256_fmadd_ps(_mm256_sub_ps(inside, p[c]), pull, v[c]);
+		}
+
+		const __m256 speed = _mm256_sqrt_ps(_mm256_fmadd_ps(v[2], v[2], _mm256_fmadd_ps(v[1], v[1], _mm256_mul_ps(v[0], v[0]))));
+		const __m256 limit = _mm256_div_ps(_mm256_min_ps(_mm256_max_ps(speed, min_speed), max_speed), _mm256_max_ps(speed, epsilon));
+		for (int c = 0; c < 3; c++)
+		{
+			v[c] = _mm256_mul_ps(v[c], limit);
+			_mm256_storeu_ps(a.s[SWARM_X + c] + i, _mm256_fmadd_ps(v[c], t, p[c]));
+			_mm256_storeu_ps(a.s[SWARM_VX + c] + i, v[c]);
+		}
+
+		__m256 phase = _mm256_fmadd_ps(_mm256_loadu_ps(a.s[SWARM_WOBBLE] + i), t, _mm256_loadu_ps(a.s[SWARM_PHASE] + i));
+		phase = _mm256_sub_ps(phase, _mm256_and_ps(_mm256_cmp_ps(phase, two_pi, _CMP_GT_OQ), two_pi));
+		_mm256_storeu_ps(a.s[SWARM_PHASE] + i, phase);
+	}
+	IntegrateScalar(a, i, end, settings, dt);
+}
+
+
+Swarm::~Swarm()
+{
+	if (this->program)
+		gl_state.DeleteProgram(this->program);
+	if (this->vao)
+		gl_state.DeleteVertexArrays(1, &this->vao);
+}
+
+
+/// <summary>
+/// Replaces the swarm with planes at random places in the box, flying in random directions
+/// </summary>
+/// <param name="count">Amount of planes</param>
+/// <param name="seed">The same seed gives the same swarm</param>
+void Swarm::Spawn(int count, unsigned int seed)
+{
+	this->count = count;
+	for (int s = 0; s < SWARM_STREAMS; s++)
+	{
+		this->streams[s].resize(count);
+		this->sorted[s].resize(count);
+	}
+	this->ax.assign(count, 0.0f);
+	this->ay.assign(count, 0.0f);
+	this->az.assign(count, 0.0f);
+	this->neighbours.assign(count, 0);
+	this->agent_bucket.resize(count);
+
+	// About two buckets per plane keeps the collisions of the hash rare
+	unsigned int buckets = 1024;
+	while (buckets < (unsigned int)count * 2)
+		buckets *= 2;
+	this->bucket_mask = buckets - 1;
+	this->bucket_start.assign(buckets + 1, 0);
+	this->bucket_fill.assign(buckets, 0);
+
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	const glm::vec3 size = this->settings.bounds_max - this->settings.bounds_min;
+	for (int i = 0; i < count; i++)
+	{
+		const glm::vec3 p = this->settings.bounds_min + size * glm::vec3(unit(random), unit(random), unit(random));
+		glm::vec3 direction = glm::vec3(unit(random), unit(random), unit(random)) * 2.0f - 1.0f;
+		if (glm::dot(direction, direction) < 1e-4f)
+			direction = glm::vec3(0.0f, 0.0f, 1.0f);
+		const glm::vec3 v = glm::normalize(direction) * (this->settings.min_speed + (this->settings.max_speed - this->settings.min_speed) * unit(random));
+
+		this->streams[SWARM_X][i] = p.x;
+		this->streams[SWARM_Y][i] = p.y;
+		this->streams[SWARM_Z][i] = p.z;
+		this->streams[SWARM_VX][i] = v.x;
+		this->streams[SWARM_VY][i] = v.y;
+		this->streams[SWARM_VZ][i] = v.z;
+		this->streams[SWARM_PHASE][i] = TWO_PI * unit(random);
+		this->streams[SWARM_WOBBLE][i] = 2.0f + 2.0f * unit(random);
+	}
+}
+
+
+int Swarm::Count() const
+{
+	return this->count;
+}
+
+
+SwarmSettings & Swarm::Settings()
+{
+	return this->settings;
+}
+
+
+const SwarmTimes & Swarm::Times() const
+{
+	return this->times;
+}
+
+
+/// <summary>
+/// Position of a plane, planes change index every update as they are sorted by their bucket
+/// </summary>
+glm::vec3 Swarm::Position(int agent) const
+{
+	return glm::vec3(this->streams[SWARM_X][agent], this->streams[SWARM_Y][agent], this->streams[SWARM_Z][agent]);
+}
+
+
+glm::vec3 Swarm::Velocity(int agent) const
+{
+	return glm::vec3(this->streams[SWARM_VX][agent], this->streams[SWARM_VY][agent], this->streams[SWARM_VZ][agent]);
+}
+
+
+bool Swarm::IsEnabled() const
+{
+	return this->enabled;
+}
+
+
+void Swarm::Toggle()
+{
+	this->enabled = !this->enabled;
+}
+
+
+/// <summary>
+/// Bucket of a cell of the grid, cells that collide share a bucket and only cost some extra distance tests
+/// </summary>
+static inline unsigned int CellBucket(int x, int y, int z, unsigned int mask)
+{
+	return (((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u) ^ ((unsigned int)z * 83492791u)) & mask;
+}
+
+
+unsigned int Swarm::Bucket(float x, float y, float z) const
+{
+	const float inv_cell = 1.0f / this->settings.neighbour_radius;
+	return CellBucket((int)floorf(x * inv_cell), (int)floorf(y * inv_cell), (int)floorf(z * inv_cell), this->bucket_mask);
+}
+
+
+/// <summary>
+/// Sorts the planes by their bucket (a counting sort), afterwards the planes of a bucket are one range of the arrays
+/// </summary>
+void Swarm::BuildHash(JobSystem & jobs)
+{
+	const std::vector<float> & x = this->streams[SWARM_X];
+	const std::vector<float> & y = this->streams[SWARM_Y];
+	const std::vector<float> & z = this->streams[SWARM_Z];
+	jobs.ParallelFor(this->count, SWARM_GRAIN, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			this->agent_bucket[i] = this->Bucket(x[i], y[i], z[i]);
+	});
+
+	// Count, prefix sum and the slot of every plane
+	const unsigned int buckets = this->bucket_mask + 1;
+	std::fill(this->bucket_start.begin(), this->bucket_start.end(), 0);
+	for (int i = 0; i < this->count; i++)
+		this->bucket_start[this->agent_bucket[i] + 1]++;
+	for (unsigned int b = 0; b < buckets; b++)
+		this->bucket_start[b + 1] += this->bucket_start[b];
+	std::copy(this->bucket_start.begin(), this->bucket_start.begin() + buckets, this->bucket_fill.begin());
+	for (int i = 0; i < this->count; i++)
+		this->agent_bucket[i] = this->bucket_fill[this->agent_bucket[i]]++;
+
+	jobs.ParallelFor(this->count, SWARM_GRAIN, [this](size_t begin, size_t end) {
+		for (int s = 0; s < SWARM_STREAMS; s++)
+		{
+			const float * from = this->streams[s].data();
+			float * to = this->sorted[s].data();
+			for (size_t i = begin; i < end; i++)
+				to[this->agent_bucket[i]] = from[i];
+		}
+	});
+	for (int s = 0; s < SWARM_STREAMS; s++)
+		this->streams[s].swap(this->sorted[s]);
+}
+
+
+/// <summary>
+/// Steering of a range of planes from the planes in the 27 cells around them
+/// </summary>
+void Swarm::Flock(size_t begin, size_t end)
+{
+	const SwarmSettings & settings = this->settings;
+	const float inv_cell = 1.0f / settings.neighbour_radius;
+	const float radius2 = settings.neighbour_radius * settings.neighbour_radius;
+	const float separation2 = settings.separation_radius * settings.separation_radius;
+
+	void (*kernel)(const Candidates &, int, const glm::vec3 &, float, float, FlockSums &) = FlockScalar;
+	if (GetKernelPath() == KERNEL_AVX2)
+		kernel = FlockAVX2;
+	else if (GetKernelPath() == KERNEL_SSE)
+		kernel = FlockSSE;
+
+	// Kept per thread, it only grows with the swarm so the updates don't allocate
+	static thread_local Candidates nearby;
+	nearby.Reserve(this->count);
+	int padded = 0;
+	glm::ivec3 last_cell;
+	for (size_t i = begin; i < end; i++)
+	{
+		const glm::vec3 p = this->Position((int)i);
+		const glm::ivec3 cell = glm::ivec3((int)floorf(p.x * inv_cell), (int)floorf(p.y * inv_cell), (int)floorf(p.z * inv_cell));
+
+		// The planes of a cell follow each other after the sort, they share their candidates
+		if (i == begin || cell.x != last_cell.x || cell.y != last_cell.y || cell.z != last_cell.z)
+		{
+			// Colliding cells share a bucket, it is only read once
+			unsigned int visited[27];
+			int visited_count = 0;
+			nearby.Clear();
+			for (int dz = -1; dz <= 1; dz++)
+				for (int dy = -1; dy <= 1; dy++)
+					for (int dx = -1; dx <= 1; dx++)
+					{
+						const unsigned int bucket = CellBucket(cell.x + dx, cell.y + dy, cell.z + dz, this->bucket_mask);
+						if (std::find(visited, visited + visited_count, bucket) != visited + visited_count)
+							continue;
+						visited[visited_count++] = bucket;
+						nearby.Append(this->streams, this->bucket_start[bucket], this->bucket_start[bucket + 1]);
+					}
+			padded = nearby.Pad();
+			last_cell = cell;
+		}
+
+		FlockSums sums;
+		kernel(nearby, padded, p, radius2, separation2, sums);
+
+		glm::vec3 steer = sums.separation * settings.separation;
+		if (sums.count > 0.0f)
+		{
+			const float inv = 1.0f / sums.count;
+			steer += sums.offset * (inv * settings.cohesion);
+			steer += (sums.velocity * inv - this->Velocity((int)i)) * settings.alignment;
+		}
+		this->ax[i] = steer.x;
+		this->ay[i] = steer.y;
+		this->az[i] = steer.z;
+		this->neighbours[i] = (int)sums.count;
+	}
+}
+
+
+/// <summary>
+/// Moves a range of planes with the steering of the flock pass
+/// </summary>
+void Swarm::Integrate(size_t begin, size_t end, float dt)
+{
+	IntegrateArrays arrays;
+	for (int s = 0; s < SWARM_STREAMS; s++)
+		arrays.s[s] = this->streams[s].data();
+	arrays.ax = this->ax.data();
+	arrays.ay = this->ay.data();
+	arrays.az = this->az.data();
+
+	switch (GetKernelPath())
+	{
+	case KERNEL_AVX2:
+		IntegrateAVX2(arrays, begin, end, this->settings, dt);
+		break;
+	case KERNEL_SSE:
+		IntegrateSSE(arrays, begin, end, this->settings, dt);
+		break;
+	default:
+		IntegrateScalar(arrays, begin, end, this->settings, dt);
+		break;
+	}
+}
+
+
+/// <summary>
+/// Runs the swarm for a step, the hash, the steering and the movement each run over all jobs
+/// </summary>
+/// <param name="dt">Seconds</param>
+/// <param name="jobs"></param>
+void Swarm::Update(float dt, JobSystem & jobs)
+{
+	if (this->count == 0)
+		return;
+
+	const double start = GetWallTime();
+	this->BuildHash(jobs);
+	const double hashed = GetWallTime();
+
+	jobs.ParallelFor(this->count, SWARM_GRAIN, [this](size_t begin, size_t end) {
+		this->Flock(begin, end);
+	});
+	const double flocked = GetWallTime();
+
+	jobs.ParallelFor(this->count, SWARM_GRAIN, [this, dt](size_t begin, size_t end) {
+		this->Integrate(begin, end, dt);
+	});
+	const double integrated = GetWallTime();
+
+	long long found = 0;
+	for (int i = 0; i < this->count; i++)
+		found += this->neighbours[i];
+
+	this->times.hash_ms = hashed - start;
+	this->times.flock_ms = flocked - hashed;
+	this->times.integrate_ms = integrated - flocked;
+	this->times.neighbours = (double)found / this->count;
+	stats.Add("swarm sim ms", integrated - start);
+}
+
+
+/// <summary>
+/// Builds the program and a vertex array over the buffers of the mesh, has to be called after glew is initialized
+/// </summary>
+/// <param name="mesh">Mesh every plane is drawn with, it is not copied</param>
+/// <param name="scale">Scale of the mesh</param>
+void Swarm::Initialize(const ModelRenderer & mesh, float scale)
+{
+	char * vertexshader = glsl::readFile(swarm_vertexshader_name);
+	GLuint vsh_id = glsl::makeVertexShader(vertexshader);
+	delete[] vertexshader;
+
+	char * fragshader = glsl::readFile(swarm_fragshader_name);
+	GLuint fsh_id = glsl::makeFragmentShader(fragshader);
+	delete[] fragshader;
+
+	this->program = glsl::makeShaderProgram(vsh_id, fsh_id);
+	this->view_location = glGetUniformLocation(this->program, "view");
+	this->projection_location = glGetUniformLocation(this->program, "projection");
+	this->light_location = glGetUniformLocation(this->program, "light_pos");
+	this->scale_location = glGetUniformLocation(this->program, "scale");
+	gl_state.UseProgram(this->program);
+	gl_state.Uniform1i(glGetUniformLocation(this->program, "texsampler"), 0);
+
+	// The swarm shader pins its inputs, so the vertex array can be made without asking the program
+	const VertexStream streams[] = {
+		{ 0, 3, mesh.Buffer(0) },
+		{ 1, 3, mesh.Buffer(1) },
+		{ 2, 2, mesh.Buffer(2) }
+	};
+	this->vao = CreateVertexArray(streams, 3, mesh.Buffer(4));
+	this->texture = mesh.Texture();
+	this->index_count = mesh.IndexCount();
+	this->scale = scale;
+
+	this->instances.Initialize(GL_SHADER_STORAGE_BUFFER, SWARM_DEFAULT_AGENTS * 2 * sizeof(glm::vec4));
+}
+
+
+/// <summary>
+/// Writes every plane to the stream buffer and draws all of them with one instanced draw
+/// The vertex shader turns the velocity and the wobble into the orientation, the cpu builds no matrices
+/// </summary>
+/// <param name="view"></param>
+/// <param name="projection"></param>
+/// <param name="light_position">Main light in the world</param>
+/// <param name="jobs">Writes the planes in parallel</param>
+void Swarm::Render(const glm::mat4 & view, const glm::mat4 & projection, const glm::vec3 & light_position, JobSystem & jobs)
+{
+	if (this->program == 0 || this->count == 0)
+		return;
+
+	const GLsizeiptr bytes = (GLsizeiptr)this->count * 2 * sizeof(glm::vec4);
+	this->instances.Reserve(bytes);
+	this->instances.BeginFrame();
+	StreamAllocation block = this->instances.Allocate(bytes);
+	if (block.data == nullptr)
+	{
+		this->instances.EndFrame();
+		return;
+	}
+
+	glm::vec4 * planes = (glm::vec4 *)block.data;
+	jobs.ParallelFor(this->count, SWARM_GRAIN, [this, planes](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			planes[2 * i] = glm::vec4(this->Position((int)i), this->streams[SWARM_PHASE][i]);
+			planes[2 * i + 1] = glm::vec4(this->Velocity((int)i), 0.0f);
+		}
+	});
+	this->instances.Flush();
+	gl_state.BindBufferRange(GL_SHADER_STORAGE_BUFFER, SWARM_BUFFER_BINDING, this->instances.Buffer(), block.offset, bytes);
+
+	const glm::vec3 light_pos = glm::vec3(view * glm::vec4(light_position, 1.0f));
+	gl_state.UseProgram(this->program);
+	gl_state.UniformMatrix4fv(this->view_location, 1, GL_FALSE, glm::value_ptr(view));
+	gl_state.UniformMatrix4fv(this->projection_location, 1, GL_FALSE, glm::value_ptr(projection));
+	gl_state.Uniform3fv(this->light_location, 1, glm::value_ptr(light_pos));
+	gl_state.Uniform1f(this->scale_location, this->scale);
+
+	gl_state.BindTexture(0, GL_TEXTURE_2D, this->texture);
+	gl_state.BindVertexArray(this->vao);
+	glDrawElementsInstanced(GL_TRIANGLES, this->index_count, GL_UNSIGNED_INT, 0, this->count);
+	gl_state.BindVertexArray(0);
+
+	this->instances.EndFrame();
+	stats.Add("swarm planes", this->count);
+}
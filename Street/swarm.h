@@ -0,0 +1,114 @@
+#pragma once
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "jobSystem.h"
+#include "streamBuffer.h"
+
+class ModelRenderer;
+
+// Storage block the swarm vertex shader reads the planes from
+const unsigned int SWARM_BUFFER_BINDING = 5;
+
+// Planes the game flies when the swarm is switched on
+const int SWARM_DEFAULT_AGENTS = 20000;
+
+// Per agent state, one array per property
+enum SwarmStream
+{
+	SWARM_X,
+	SWARM_Y,
+	SWARM_Z,
+	SWARM_VX,
+	SWARM_VY,
+	SWARM_VZ,
+	SWARM_PHASE,	// Wobble angle, the planes roll with its sine
+	SWARM_WOBBLE,	// Wobble speed in radians per second, differs per plane so they don't roll in step
+	SWARM_STREAMS
+};
+
+// How the planes fly
+struct SwarmSettings
+{
+	float neighbour_radius = 2.0f;
+	float separation_radius = 0.7f;
+	float separation = 2.0f;		// Weight of flying away from planes that are too close
+	float alignment = 1.0f;			// Weight of flying the way the neighbours fly
+	float cohesion = 0.5f;			// Weight of flying to the middle of the neighbours
+	float bounds_force = 2.0f;		// Pull back into the box once a plane left it
+	float min_speed = 2.0f;
+	float max_speed = 6.0f;
+	glm::vec3 bounds_min = glm::vec3(-15.0f, 2.0f, 0.0f);		// Over the street in front of the spawn
+	glm::vec3 bounds_max = glm::vec3(15.0f, 14.0f, 90.0f);
+};
+
+// Time the parts of the last update took
+struct SwarmTimes
+{
+	double hash_ms;
+	double flock_ms;
+	double integrate_ms;
+	double neighbours;		// Average planes within the neighbour radius
+};
+
+// Flock of paper planes, every plane steers by its neighbours (separation, alignment, cohesion) and wobbles
+// The state is one array per property so the kernels run over 4 (sse) or 8 (avx2) planes at once, split over the jobs
+// Neighbours are found with a spatial hash, every update the planes are sorted by their bucket so the planes of
+// a cell sit next to each other in memory. All planes are drawn with a single instanced draw of the paper plane
+class Swarm
+{
+private:
+	SwarmSettings settings;
+	int count = 0;
+	bool enabled = false;
+
+	std::vector<float> streams[SWARM_STREAMS];
+	std::vector<float> sorted[SWARM_STREAMS];
+
+	// Steering of the last flock pass and the neighbours it found
+	std::vector<float> ax, ay, az;
+	std::vector<int> neighbours;
+
+	// Spatial hash with cells the size of the neighbour radius, bucket b holds the planes [bucket_start[b], bucket_start[b + 1])
+	std::vector<unsigned int> agent_bucket;
+	std::vector<unsigned int> bucket_start;
+	std::vector<unsigned int> bucket_fill;
+	unsigned int bucket_mask = 0;
+
+	SwarmTimes times = {};
+
+	// Drawing
+	GLuint program = 0;
+	GLuint vao = 0;
+	GLuint texture = 0;
+	GLsizei index_count = 0;
+	float scale = 1.0f;
+	GLint view_location = -1;
+	GLint projection_location = -1;
+	GLint light_location = -1;
+	GLint scale_location = -1;
+	StreamBuffer instances;
+
+	unsigned int Bucket(float x, float y, float z) const;
+	void BuildHash(JobSystem & jobs);
+	void Flock(size_t begin, size_t end);
+	void Integrate(size_t begin, size_t end, float dt);
+public:
+	~Swarm();
+
+	void Spawn(int count, unsigned int seed);
+	int Count() const;
+	SwarmSettings & Settings();
+	const SwarmTimes & Times() const;
+	glm::vec3 Position(int agent) const;
+	glm::vec3 Velocity(int agent) const;
+
+	bool IsEnabled() const;
+	void Toggle();
+
+	void Update(float dt, JobSystem & jobs);
+
+	// Drawing needs a gl context, the mesh has to stay loaded while the swarm is drawn
+	void Initialize(const ModelRenderer & mesh, float scale);
+	void Render(const glm::mat4 & view, const glm::mat4 & projection, const glm::vec3 & light_position, JobSystem & jobs);
+};
@@ -1,8 +1,13 @@
 #ifndef TEXTURE_HPP
 #define TEXTURE_HPP
 
-// Load a .BMP file using our custom loader
-GLuint loadBMP(const char * imagepath);
+#include "imageDecoder.h"
+
+// Load a png, tga or bmp file (see imageDecoder.h) into a texture
+GLuint loadTexture(const char * imagepath);
+
+// Create a texture from a decoded image
+GLuint createTexture(const Image & image);
 
 //// Since GLFW 3, glfwLoadTexture2D() has been removed. You have to use another texture loading library, 
 //// or do it yourself (just like loadBMP_custom and loadDDS)
@@ -0,0 +1,143 @@
+#include "transform.h"
+
+
+/// <summary>
+/// ctor
+/// </summary>
+/// <param name="position"></param>
+/// <param name="rotation"></param>
+/// <param name="scale"></param>
+/// <param name="parent">Index of the parent transform, -1 if this is a root</param>
+Transform::Transform(glm::vec3 position, glm::quat rotation, glm::vec3 scale, int parent)
+{
+	this->position = position;
+	this->rotation = rotation;
+	this->scale = scale;
+	this->parent = parent;
+}
+
+
+/// <summary>
+/// Builds the local matrix (translate * rotate * scale) straight from the components
+/// </summary>
+void Transform::CalculateLocal()
+{
+	glm::mat3 rot = glm::mat3_cast(this->rotation);
+
+	this->local[0] = glm::vec4(rot[0] * this->scale.x, 0.0f);
+	this->local[1] = glm::vec4(rot[1] * this->scale.y, 0.0f);
+	this->local[2] = glm::vec4(rot[2] * this->scale.z, 0.0f);
+	this->local[3] = glm::vec4(this->position, 1.0f);
+}
+
+
+glm::vec3 Transform::GetPosition() const
+{
+	return this->position;
+}
+
+
+glm::quat Transform::GetRotation() const
+{
+	return this->rotation;
+}
+
+
+glm::vec3 Transform::GetScale() const
+{
+	return this->scale;
+}
+
+
+/// <summary>
+/// Returns the world matrix as calculated by the last Update
+/// </summary>
+/// <returns></returns>
+const glm::mat4 & Transform::GetWorldMatrix() const
+{
+	return this->world;
+}
+
+
+/// <summary>
+/// Whether the world matrix was rebuilt during the last Update
+/// </summary>
+/// <returns></returns>
+bool Transform::HasChanged() const
+{
+	return this->changed;
+}
+
+
+void Transform::SetPosition(glm::vec3 position)
+{
+	this->position = position;
+	this->dirty = true;
+}
+
+
+void Transform::SetRotation(glm::quat rotation)
+{
+	this->rotation = rotation;
+	this->dirty = true;
+}
+
+
+void Transform::SetScale(glm::vec3 scale)
+{
+	this->scale = scale;
+	this->dirty = true;
+}
+
+
+/// <summary>
+/// Moves the transform along its own (rotated and scaled) axes, same as glm::translate on the model matrix
+/// </summary>
+/// <param name="offset"></param>
+void Transform::Translate(glm::vec3 offset)
+{
+	this->position += this->rotation * (this->scale * offset);
+	this->dirty = true;
+}
+
+
+/// <summary>
+/// Rotates the transform around one of its own axes, same as glm::rotate on the model matrix
+/// </summary>
+/// <param name="angle">Angle in radians</param>
+/// <param name="axis"></param>
+void Transform::Rotate(float angle, glm::vec3 axis)
+{
+	this->rotation = glm::normalize(this->rotation * glm::angleAxis(angle, axis));
+	this->dirty = true;
+}
+
+
+/// <summary>
+/// Rebuilds the world matrix if this transform or its parent changed
+/// The parent has to be updated before its children, this is the case when walking a sorted array front to back
+/// </summary>
+/// <param name="parent">The parent transform, nullptr for a root</param>
+/// <returns>Whether the world matrix changed</returns>
+bool Transform::Update(const Transform * parent)
+{
+	const bool parent_changed = parent != nullptr && parent->changed;
+
+	if (!this->dirty && !parent_changed)
+	{
+		this->changed = false;
+		return false;
+	}
+
+	if (this->dirty)
+		CalculateLocal();
+
+	if (parent != nullptr)
+		this->world = parent->world * this->local;
+	else
+		this->world = this->local;
+
+	this->dirty = false;
+	this->changed = true;
+	return true;
+}
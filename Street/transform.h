@@ -0,0 +1,40 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Position, rotation and scale of an object
+// The world matrix is cached and only rebuilt when one of the components (or the parent) changed
+class Transform
+{
+private:
+	glm::vec3 position;
+	glm::quat rotation;
+	glm::vec3 scale;
+
+	glm::mat4 local;
+	glm::mat4 world;
+
+	bool dirty = true;
+	bool changed = true;
+
+	void CalculateLocal();
+
+public:
+	Transform(glm::vec3 position = glm::vec3(0.0f), glm::quat rotation = glm::quat(), glm::vec3 scale = glm::vec3(1.0f), int parent = -1);
+
+	// Index of the parent transform (-1 for none), a parent is always stored before its children
+	int parent;
+
+	glm::vec3 GetPosition() const;
+	glm::quat GetRotation() const;
+	glm::vec3 GetScale() const;
+	const glm::mat4 & GetWorldMatrix() const;
+	bool HasChanged() const;
+
+	void SetPosition(glm::vec3 position);
+	void SetRotation(glm::quat rotation);
+	void SetScale(glm::vec3 scale);
+	void Translate(glm::vec3 offset);
+	void Rotate(float angle, glm::vec3 axis);
+	bool Update(const Transform * parent);
+};
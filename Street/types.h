@@ -1,17 +1,22 @@
 #pragma once
+#include <string>
 #include <vector>
 #include <glm/glm.hpp>
 
-struct Mesh
+
+struct Bounds
 {
-	vector<glm::vec3> vertices;
-	vector<glm::vec3> normals;
-	vector<glm::vec2> uvs;
+	glm::vec3 center;
+	float radius;
+	glm::vec3 box_min;
+	glm::vec3 box_max;
 };
 
 struct LightSource
 {
 	glm::vec3 position;
+	glm::vec3 color = glm::vec3(1.0f);
+	float radius = 0.0f; // Range of a point light
 };
 
 struct Material
@@ -22,13 +27,49 @@ struct Material
 	float power;
 };
 
+// Indices [first, first + count) of a mesh drawn with one material
+// material is an index in the materials of the mesh, -1 uses the material of the object
+struct MeshRange
+{
+	unsigned int first;
+	unsigned int count;
+	int material;
+};
+
+// Indexed triangles, the ranges are sorted by material and cover all indices
+struct Mesh
+{
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec2> lightmap_uvs;
+	std::vector<unsigned int> indices;
+	std::vector<MeshRange> ranges;
+	std::vector<Material> materials;	// From the mtl libraries of the obj
+	std::vector<std::string> textures;	// Diffuse map of every material, empty for a material without one
+};
+
 struct ObjectUniforms {
 	GLuint proj;
-	GLuint mv;
 	GLuint light_pos;
 	GLuint material_ambient;
 	GLuint material_diffuse;
 	GLuint material_specular;
 	GLuint material_power;
 	GLuint has_texture;
+	GLuint cluster_count;
+	GLuint cluster_tile_size;
+	GLuint cluster_depth;
+	GLuint view_inverse;
+	GLuint shadow_light_count;
+	GLuint overdraw_enabled;
+};
+
+// Per object data, streamed into a uniform block every frame (std140 layout)
+struct ObjectBlock
+{
+	glm::mat4 mv;
+	glm::mat4 normal_matrix;
+	glm::vec4 lightmap_st;		// Scale and offset of the object in its lightmap page
+	glm::vec4 lightmap_params;	// x is 1 when the object has a baked lightmap
 };